@@ -20,6 +20,8 @@
 #define __ARCH_ARM_MACH_PERF_LOCK_H
 
 #include <linux/list.h>
+#include <linux/plist.h>
+#include <linux/ktime.h>
 #include <linux/cpufreq.h>
 
 /*
@@ -48,11 +50,18 @@ enum {
 };
 
 struct perf_lock {
-	struct list_head link;
+	struct list_head link;		/* all initialized locks */
+	struct plist_node node;		/* active locks, by level */
 	unsigned int flags;
 	unsigned int level;
 	const char *name;
 	unsigned int type;
+
+	/* hold time statistics, shown in debugfs */
+	ktime_t last_lock;
+	ktime_t total_time;
+	ktime_t max_time;
+	unsigned long count;
 };
 
 struct perflock_platform_data {
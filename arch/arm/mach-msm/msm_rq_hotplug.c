@@ -0,0 +1,519 @@
+/* Copyright (c) 2012, Code Aurora Forum. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 and
+ * only version 2 as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ */
+/*
+ * Qualcomm MSM run queue based CPU hotplug
+ *
+ * Brings cores up when the averaged number of runnable tasks exceeds what
+ * the online cores can serve and the online cores are busy, and takes them
+ * down again when both fall.  Each step needs the condition to hold for
+ * up_delay_ms / down_delay_ms, and the thresholds for going up from n cores
+ * are above those for coming back down to n, so a load sitting on the edge
+ * does not toggle a core on every sample.  While msm_thermal holds the
+ * cores at its reduced frequency at most thermal_max_cpus are kept online;
+ * a lower scaling_max_freq or a perflock ceiling does not count.
+ *
+ * Tunables and the current state are in
+ * /sys/devices/system/cpu/cpu0/rq-hotplug/.  cpus_target can be polled and
+ * is notified on every hotplug.
+ */
+#include <linux/kernel.h>
+#include <linux/init.h>
+#include <linux/module.h>
+#include <linux/cpu.h>
+#include <linux/cpufreq.h>
+#include <linux/kobject.h>
+#include <linux/sysfs.h>
+#include <linux/mutex.h>
+#include <linux/workqueue.h>
+#include <linux/sched.h>
+#include <linux/tick.h>
+#include <linux/jiffies.h>
+#include <linux/rq_stats.h>
+#include <linux/msm_thermal.h>
+
+#define DEFAULT_SAMPLE_MS	50
+#define DEFAULT_UP_DELAY_MS	100
+#define DEFAULT_DOWN_DELAY_MS	500
+#define DEFAULT_UP_LOAD		60
+#define DEFAULT_DOWN_LOAD	30
+
+struct rq_hotplug_cpu {
+	u64 prev_idle;
+	u64 prev_wall;
+	int valid;
+};
+
+static DEFINE_PER_CPU(struct rq_hotplug_cpu, rq_hotplug_cpu);
+
+static struct rq_hotplug {
+	struct mutex lock;
+	struct delayed_work work;
+	struct workqueue_struct *wq;
+	struct kobject *kobj;
+
+	/* tunables */
+	unsigned int enabled;
+	unsigned int sample_ms;
+	unsigned int up_delay_ms;
+	unsigned int down_delay_ms;
+	unsigned int up_load;
+	unsigned int down_load;
+	unsigned int min_cpus;
+	unsigned int max_cpus;
+	unsigned int thermal_max_cpus;
+	unsigned int up_nr_run[NR_CPUS + 1];	/* from [n] to n + 1 cores */
+	unsigned int down_nr_run[NR_CPUS + 1];	/* from [n] to n - 1 cores */
+
+	/* state */
+	unsigned int nr_run_avg;		/* tenths, from rq-stats */
+	unsigned int load_avg;			/* percent of max capacity */
+	unsigned int thermal_limited;
+	unsigned int cpus_target;
+	unsigned long up_since;			/* jiffies, 0 = not pending */
+	unsigned long down_since;
+	unsigned long nr_up;
+	unsigned long nr_down;
+} hp;
+
+/*
+ * Frequency scaled busy percentage of the online cores, averaged over them,
+ * since the previous sample.  A core that just came online has no previous
+ * sample and is left out until the next one.
+ */
+static unsigned int rq_hotplug_load(void)
+{
+	unsigned int cpu, total = 0, cnt = 0;
+
+	for_each_online_cpu(cpu) {
+		struct rq_hotplug_cpu *pcpu = &per_cpu(rq_hotplug_cpu, cpu);
+		struct cpufreq_policy *policy;
+		unsigned int wall_time, idle_time, busy;
+		u64 idle, wall;
+
+		idle = get_cpu_idle_time_us(cpu, &wall);
+		if (idle == -1ULL)
+			return 0;
+
+		wall_time = (unsigned int)(wall - pcpu->prev_wall);
+		idle_time = (unsigned int)(idle - pcpu->prev_idle);
+		pcpu->prev_wall = wall;
+		pcpu->prev_idle = idle;
+		if (!pcpu->valid) {
+			pcpu->valid = 1;
+			continue;
+		}
+		if (!wall_time || wall_time < idle_time)
+			continue;
+
+		busy = 100 * (wall_time - idle_time) / wall_time;
+
+		policy = cpufreq_cpu_get(cpu);
+		if (policy) {
+			if (policy->cpuinfo.max_freq)
+				busy = busy * policy->cur /
+					policy->cpuinfo.max_freq;
+			cpufreq_cpu_put(policy);
+		}
+
+		total += busy;
+		cnt++;
+	}
+
+	for_each_cpu_not(cpu, cpu_online_mask)
+		per_cpu(rq_hotplug_cpu, cpu).valid = 0;
+
+	return cnt ? total / cnt : 0;
+}
+
+static void rq_hotplug_sample(void)
+{
+	hp.nr_run_avg = rq_avg_total();
+	hp.load_avg = rq_hotplug_load();
+	hp.thermal_limited = msm_thermal_limited();
+}
+
+/*
+ * Whether cond has held for delay_ms, with *since the jiffy it became true
+ * (0 when it is not true).
+ */
+static int rq_hotplug_held(int cond, unsigned long *since,
+			   unsigned int delay_ms)
+{
+	if (!cond) {
+		*since = 0;
+		return 0;
+	}
+	if (!*since)
+		*since = jiffies ? jiffies : 1;
+
+	return time_after_eq(jiffies, *since + msecs_to_jiffies(delay_ms));
+}
+
+static unsigned int rq_hotplug_max_cpus(void)
+{
+	unsigned int limit = min(hp.max_cpus, num_possible_cpus());
+
+	if (hp.thermal_limited)
+		limit = min(limit, hp.thermal_max_cpus);
+
+	return max(limit, 1U);
+}
+
+static void rq_hotplug_cpu_up(void)
+{
+	unsigned int cpu;
+
+	for_each_cpu_not(cpu, cpu_online_mask) {
+		if (!cpu_possible(cpu))
+			continue;
+		if (!cpu_up(cpu)) {
+			hp.nr_up++;
+			pr_debug("msm_rq_hotplug: cpu%u up, nr_run %u load %u\n",
+				 cpu, hp.nr_run_avg, hp.load_avg);
+		}
+		return;
+	}
+}
+
+static void rq_hotplug_cpu_down(void)
+{
+	unsigned int cpu, last = 0;
+
+	for_each_online_cpu(cpu)
+		last = cpu;
+
+	/* cpu0 cannot be taken down */
+	if (!last)
+		return;
+
+	if (!cpu_down(last)) {
+		hp.nr_down++;
+		pr_debug("msm_rq_hotplug: cpu%u down, nr_run %u load %u\n",
+			 last, hp.nr_run_avg, hp.load_avg);
+	}
+}
+
+static void rq_hotplug_decide(void)
+{
+	unsigned int online = num_online_cpus();
+	unsigned int nr = hp.nr_run_avg;
+	unsigned int limit = rq_hotplug_max_cpus();
+	unsigned int target = online;
+	int up, down;
+
+	up = online < limit && nr > hp.up_nr_run[online] &&
+		hp.load_avg >= hp.up_load;
+	down = online > 1 && nr < hp.down_nr_run[online] &&
+		hp.load_avg < hp.down_load;
+
+	if (online < hp.min_cpus && online < limit)
+		target = online + 1;
+	else if (online > limit || (online > hp.min_cpus && down &&
+		 rq_hotplug_held(1, &hp.down_since, hp.down_delay_ms)))
+		target = online - 1;
+	else if (rq_hotplug_held(up, &hp.up_since, hp.up_delay_ms))
+		target = online + 1;
+
+	if (!down)
+		hp.down_since = 0;
+
+	if (target == online)
+		return;
+
+	hp.up_since = 0;
+	hp.down_since = 0;
+	hp.cpus_target = target;
+
+	if (target > online)
+		rq_hotplug_cpu_up();
+	else
+		rq_hotplug_cpu_down();
+
+	sysfs_notify(hp.kobj, NULL, "cpus_target");
+}
+
+static void rq_hotplug_work_fn(struct work_struct *work)
+{
+	mutex_lock(&hp.lock);
+
+	if (hp.enabled) {
+		rq_hotplug_sample();
+		rq_hotplug_decide();
+		queue_delayed_work(hp.wq, &hp.work,
+				   msecs_to_jiffies(hp.sample_ms));
+	}
+
+	mutex_unlock(&hp.lock);
+}
+
+/************************** sysfs interface ************************/
+
+#define show_one(name)							\
+static ssize_t show_##name(struct kobject *kobj,			\
+		struct kobj_attribute *attr, char *buf)			\
+{									\
+	return snprintf(buf, PAGE_SIZE, "%u\n", hp.name);		\
+}
+
+#define store_one(name, min_val, max_val)				\
+static ssize_t store_##name(struct kobject *kobj,			\
+		struct kobj_attribute *attr, const char *buf,		\
+		size_t count)						\
+{									\
+	unsigned int val;						\
+									\
+	if (sscanf(buf, "%u", &val) != 1 ||				\
+	    val < (min_val) || val > (max_val))				\
+		return -EINVAL;						\
+									\
+	mutex_lock(&hp.lock);						\
+	hp.name = val;							\
+	mutex_unlock(&hp.lock);						\
+									\
+	return count;							\
+}
+
+show_one(sample_ms);
+store_one(sample_ms, 10, 1000);
+show_one(up_delay_ms);
+store_one(up_delay_ms, 0, 60000);
+show_one(down_delay_ms);
+store_one(down_delay_ms, 0, 60000);
+show_one(up_load);
+store_one(up_load, 0, 100);
+show_one(down_load);
+store_one(down_load, 0, 100);
+show_one(min_cpus);
+store_one(min_cpus, 1, NR_CPUS);
+show_one(max_cpus);
+store_one(max_cpus, 1, NR_CPUS);
+show_one(thermal_max_cpus);
+store_one(thermal_max_cpus, 1, NR_CPUS);
+show_one(load_avg);
+show_one(thermal_limited);
+show_one(cpus_target);
+
+static ssize_t show_enabled(struct kobject *kobj,
+		struct kobj_attribute *attr, char *buf)
+{
+	return snprintf(buf, PAGE_SIZE, "%u\n", hp.enabled);
+}
+
+static ssize_t store_enabled(struct kobject *kobj,
+		struct kobj_attribute *attr, const char *buf, size_t count)
+{
+	unsigned int val;
+
+	if (sscanf(buf, "%u", &val) != 1)
+		return -EINVAL;
+	val = !!val;
+
+	mutex_lock(&hp.lock);
+	if (val != hp.enabled) {
+		hp.enabled = val;
+		hp.up_since = 0;
+		hp.down_since = 0;
+		if (val)
+			queue_delayed_work(hp.wq, &hp.work, 0);
+	}
+	mutex_unlock(&hp.lock);
+
+	/* A disabled worker just returns; make sure none is left queued */
+	if (!val)
+		cancel_delayed_work_sync(&hp.work);
+
+	return count;
+}
+
+static ssize_t show_nr_run_avg(struct kobject *kobj,
+		struct kobj_attribute *attr, char *buf)
+{
+	unsigned int val = hp.nr_run_avg;
+
+	return snprintf(buf, PAGE_SIZE, "%u.%u\n", val / 10, val % 10);
+}
+
+static ssize_t show_nr_run(unsigned int *thresh, unsigned int first,
+			   unsigned int last, char *buf)
+{
+	unsigned int n;
+	ssize_t len = 0;
+
+	for (n = first; n <= last; n++)
+		len += snprintf(buf + len, PAGE_SIZE - len, "%u%c", thresh[n],
+				n == last ? '\n' : ' ');
+
+	return len;
+}
+
+static ssize_t store_nr_run(unsigned int *thresh, unsigned int first,
+			    unsigned int last, const char *buf, size_t count)
+{
+	unsigned int val[NR_CPUS + 1];
+	unsigned int n;
+	int consumed;
+
+	for (n = first; n <= last; n++) {
+		if (sscanf(buf, "%u%n", &val[n], &consumed) != 1)
+			return -EINVAL;
+		buf += consumed;
+	}
+
+	mutex_lock(&hp.lock);
+	for (n = first; n <= last; n++)
+		thresh[n] = val[n];
+	mutex_unlock(&hp.lock);
+
+	return count;
+}
+
+/* One value per step, in tenths of a task: 1 -> 2 cores first */
+static ssize_t show_up_nr_run(struct kobject *kobj,
+		struct kobj_attribute *attr, char *buf)
+{
+	return show_nr_run(hp.up_nr_run, 1, num_possible_cpus() - 1, buf);
+}
+
+static ssize_t store_up_nr_run(struct kobject *kobj,
+		struct kobj_attribute *attr, const char *buf, size_t count)
+{
+	return store_nr_run(hp.up_nr_run, 1, num_possible_cpus() - 1,
+			    buf, count);
+}
+
+/* One value per step, in tenths of a task: 2 -> 1 cores first */
+static ssize_t show_down_nr_run(struct kobject *kobj,
+		struct kobj_attribute *attr, char *buf)
+{
+	return show_nr_run(hp.down_nr_run, 2, num_possible_cpus(), buf);
+}
+
+static ssize_t store_down_nr_run(struct kobject *kobj,
+		struct kobj_attribute *attr, const char *buf, size_t count)
+{
+	return store_nr_run(hp.down_nr_run, 2, num_possible_cpus(),
+			    buf, count);
+}
+
+static ssize_t show_hotplug_count(struct kobject *kobj,
+		struct kobj_attribute *attr, char *buf)
+{
+	return snprintf(buf, PAGE_SIZE, "up=%lu down=%lu\n",
+			hp.nr_up, hp.nr_down);
+}
+
+#define RQ_HOTPLUG_RW(name) \
+	static struct kobj_attribute name##_attr = \
+		__ATTR(name, S_IWUSR | S_IRUGO, show_##name, store_##name)
+#define RQ_HOTPLUG_RO(name) \
+	static struct kobj_attribute name##_attr = \
+		__ATTR(name, S_IRUGO, show_##name, NULL)
+
+RQ_HOTPLUG_RW(enabled);
+RQ_HOTPLUG_RW(sample_ms);
+RQ_HOTPLUG_RW(up_delay_ms);
+RQ_HOTPLUG_RW(down_delay_ms);
+RQ_HOTPLUG_RW(up_load);
+RQ_HOTPLUG_RW(down_load);
+RQ_HOTPLUG_RW(min_cpus);
+RQ_HOTPLUG_RW(max_cpus);
+RQ_HOTPLUG_RW(thermal_max_cpus);
+RQ_HOTPLUG_RW(up_nr_run);
+RQ_HOTPLUG_RW(down_nr_run);
+RQ_HOTPLUG_RO(nr_run_avg);
+RQ_HOTPLUG_RO(load_avg);
+RQ_HOTPLUG_RO(thermal_limited);
+RQ_HOTPLUG_RO(cpus_target);
+RQ_HOTPLUG_RO(hotplug_count);
+
+static struct attribute *rq_hotplug_attrs[] = {
+	&enabled_attr.attr,
+	&sample_ms_attr.attr,
+	&up_delay_ms_attr.attr,
+	&down_delay_ms_attr.attr,
+	&up_load_attr.attr,
+	&down_load_attr.attr,
+	&min_cpus_attr.attr,
+	&max_cpus_attr.attr,
+	&thermal_max_cpus_attr.attr,
+	&up_nr_run_attr.attr,
+	&down_nr_run_attr.attr,
+	&nr_run_avg_attr.attr,
+	&load_avg_attr.attr,
+	&thermal_limited_attr.attr,
+	&cpus_target_attr.attr,
+	&hotplug_count_attr.attr,
+	NULL,
+};
+
+static struct attribute_group rq_hotplug_attr_group = {
+	.attrs = rq_hotplug_attrs,
+};
+
+static int __init msm_rq_hotplug_init(void)
+{
+	unsigned int n;
+	int ret;
+
+	mutex_init(&hp.lock);
+	INIT_DELAYED_WORK_DEFERRABLE(&hp.work, rq_hotplug_work_fn);
+
+	hp.sample_ms = DEFAULT_SAMPLE_MS;
+	hp.up_delay_ms = DEFAULT_UP_DELAY_MS;
+	hp.down_delay_ms = DEFAULT_DOWN_DELAY_MS;
+	hp.up_load = DEFAULT_UP_LOAD;
+	hp.down_load = DEFAULT_DOWN_LOAD;
+	hp.min_cpus = 1;
+	hp.max_cpus = num_possible_cpus();
+	hp.thermal_max_cpus = max(num_possible_cpus() - 1, 1U);
+	hp.cpus_target = num_online_cpus();
+
+	/*
+	 * Go from n to n + 1 cores above n + 0.5 runnable tasks and back
+	 * below n - 1 + 0.0, e.g. 1 -> 2 above 1.5 and 2 -> 1 below 1.0.
+	 */
+	for (n = 1; n <= NR_CPUS; n++) {
+		hp.up_nr_run[n] = n * 10 + 5;
+		hp.down_nr_run[n] = (n - 1) * 10;
+	}
+
+	hp.wq = create_freezable_workqueue("rq_hotplug");
+	if (!hp.wq)
+		return -ENOMEM;
+
+	/* Create /sys/devices/system/cpu/cpu0/rq-hotplug/... */
+	hp.kobj = kobject_create_and_add("rq-hotplug",
+			&get_cpu_sysdev(0)->kobj);
+	if (!hp.kobj) {
+		ret = -ENOMEM;
+		goto err_wq;
+	}
+
+	ret = sysfs_create_group(hp.kobj, &rq_hotplug_attr_group);
+	if (ret)
+		goto err_kobj;
+
+	mutex_lock(&hp.lock);
+	hp.enabled = 1;
+	queue_delayed_work(hp.wq, &hp.work, msecs_to_jiffies(hp.sample_ms));
+	mutex_unlock(&hp.lock);
+
+	return 0;
+
+err_kobj:
+	kobject_put(hp.kobj);
+err_wq:
+	destroy_workqueue(hp.wq);
+	return ret;
+}
+late_initcall(msm_rq_hotplug_init);
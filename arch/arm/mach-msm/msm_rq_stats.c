@@ -34,6 +34,7 @@
 static void def_work_fn(struct work_struct *work)
 {
 	int64_t diff;
+	unsigned int val;
 
 	diff = ktime_to_ns(ktime_get()) - rq_info.def_start_time;
 	do_div(diff, 1000 * 1000);
@@ -41,23 +42,39 @@ static void def_work_fn(struct work_struct *work)
 
 	/* Notify polling threads on change of value */
 	sysfs_notify(rq_info.kobj, NULL, "def_timer_ms");
+
+	val = rq_avg_total();
+	if (val != rq_info.rq_avg) {
+		rq_info.rq_avg = val;
+		sysfs_notify(rq_info.kobj, NULL, "run_queue_avg");
+	}
 }
 
 static ssize_t show_run_queue_avg(struct kobject *kobj,
 		struct kobj_attribute *attr, char *buf)
 {
-	unsigned int val = 0;
-	unsigned long flags = 0;
-
-	spin_lock_irqsave(&rq_lock, flags);
-	/* rq avg currently available only on one core */
-	val = rq_info.rq_avg;
-	rq_info.rq_avg = 0;
-	spin_unlock_irqrestore(&rq_lock, flags);
+	unsigned int val = rq_avg_total();
 
 	return snprintf(buf, PAGE_SIZE, "%d.%d\n", val/10, val%10);
 }
 
+static ssize_t show_run_queue_avg_cpu(struct kobject *kobj,
+		struct kobj_attribute *attr, char *buf)
+{
+	unsigned int cpu, val;
+	ssize_t len = 0;
+
+	for_each_possible_cpu(cpu) {
+		val = rq_avg_cpu(cpu);
+		len += snprintf(buf + len, PAGE_SIZE - len, "%d.%d ",
+				val/10, val%10);
+	}
+	if (len)
+		buf[len - 1] = '\n';
+
+	return len;
+}
+
 static ssize_t show_run_queue_poll_ms(struct kobject *kobj,
 				      struct kobj_attribute *attr, char *buf)
 {
@@ -143,7 +160,7 @@ static int init_rq_attribs(void)
 {
 	int i;
 	int err = 0;
-	const int attr_count = 4;
+	const int attr_count = 5;
 
 	struct attribute **attribs =
 		kzalloc(sizeof(struct attribute *) * attr_count, GFP_KERNEL);
@@ -158,7 +175,8 @@ static int init_rq_attribs(void)
 	attribs[0] = MSM_RQ_STATS_RW_ATTRIB(def_timer_ms);
 	attribs[1] = MSM_RQ_STATS_RO_ATTRIB(run_queue_avg);
 	attribs[2] = MSM_RQ_STATS_RW_ATTRIB(run_queue_poll_ms);
-	attribs[3] = NULL;
+	attribs[3] = MSM_RQ_STATS_RO_ATTRIB(run_queue_avg_cpu);
+	attribs[4] = NULL;
 
 	for (i = 0; i < attr_count - 1 ; i++) {
 		if (!attribs[i]) {
@@ -216,7 +234,6 @@ static int __init msm_rq_stats_init(void)
 	spin_lock_init(&rq_lock);
 	rq_info.rq_poll_jiffies = DEFAULT_RQ_POLL_JIFFIES;
 	rq_info.def_timer_jiffies = DEFAULT_DEF_TIMER_JIFFIES;
-	rq_info.rq_poll_last_jiffy = 0;
 	rq_info.def_timer_last_jiffy = 0;
 	return init_rq_attribs();
 }
@@ -19,9 +19,12 @@
 #include <linux/device.h>
 #include <linux/clk.h>
 #include <linux/debugfs.h>
+#include <linux/cpu.h>
 #include <linux/earlysuspend.h>
 #include <linux/cpufreq.h>
 #include <linux/timer.h>
+#include <linux/plist.h>
+#include <linux/seq_file.h>
 #include <mach/perflock.h>
 #include "proc_comm.h"
 #include "acpuclock.h"
@@ -37,10 +40,17 @@ enum {
 	PERF_SCREEN_ON_POLICY_DEBUG = 1U << 4,
 };
 
-static LIST_HEAD(active_perf_locks);
-static LIST_HEAD(inactive_perf_locks);
-static LIST_HEAD(active_cpufreq_ceiling_locks);
-static LIST_HEAD(inactive_cpufreq_ceiling_locks);
+/*
+ * Active locks are kept sorted by level so the highest one is always at the
+ * tail, and the speed it maps to is cached on every lock/unlock.  The
+ * policy notifier applies the cached speeds as a floor (perf locks) or a
+ * ceiling (cpufreq ceiling locks) on policy->min/max.
+ */
+static LIST_HEAD(perf_locks);
+static struct plist_head active_perf_locks =
+	PLIST_HEAD_INIT(active_perf_locks);
+static struct plist_head active_cpufreq_ceiling_locks =
+	PLIST_HEAD_INIT(active_cpufreq_ceiling_locks);
 static DEFINE_SPINLOCK(list_lock);
 static DEFINE_SPINLOCK(policy_update_lock);
 static int initialized;
@@ -48,7 +58,8 @@ static int cpufreq_ceiling_initialized;
 static unsigned int *perf_acpu_table;
 static unsigned int *cpufreq_ceiling_acpu_table;
 static unsigned int table_size;
-static struct workqueue_struct *perflock_setrate_workqueue;
+static unsigned int perflock_floor_speed;	/* Hz, 0 if none active */
+static unsigned int perflock_ceiling_speed;	/* Hz, 0 if none active */
 
 
 #ifdef CONFIG_PERF_LOCK_DEBUG
@@ -278,42 +289,88 @@ void perflock_scaling_min_freq(unsigned int freq, unsigned int cpu)
 
 static unsigned int get_perflock_speed(void)
 {
-	unsigned long irqflags;
-	struct perf_lock *lock;
-	unsigned int perf_level = 0;
+	return perflock_floor_speed;
+}
 
-	/* Get the maxmimum perf level. */
-	if (list_empty(&active_perf_locks))
-		return 0;
+static unsigned int get_cpufreq_ceiling_speed(void)
+{
+	return perflock_ceiling_speed;
+}
 
-	spin_lock_irqsave(&list_lock, irqflags);
-	list_for_each_entry(lock, &active_perf_locks, link) {
-		if (lock->level > perf_level)
-			perf_level = lock->level;
-	}
-	spin_unlock_irqrestore(&list_lock, irqflags);
+/* Called with list_lock held, returns whether either speed changed */
+static int perflock_update_speed(void)
+{
+	unsigned int speed = 0, ceiling = 0;
+	int changed;
+
+	if (!plist_head_empty(&active_perf_locks))
+		speed = perf_acpu_table[plist_last(&active_perf_locks)->prio];
+	if (!plist_head_empty(&active_cpufreq_ceiling_locks))
+		ceiling = cpufreq_ceiling_acpu_table[
+			plist_last(&active_cpufreq_ceiling_locks)->prio];
 
-	return perf_acpu_table[perf_level];
+	changed = speed != perflock_floor_speed ||
+		ceiling != perflock_ceiling_speed;
+	perflock_floor_speed = speed;
+	perflock_ceiling_speed = ceiling;
+
+	return changed;
 }
 
-static unsigned int get_cpufreq_ceiling_speed(void)
+static void perflock_update_policy(void)
+{
+	int cpu;
+
+	get_online_cpus();
+	for_each_online_cpu(cpu)
+		cpufreq_update_policy(cpu);
+	put_online_cpus();
+}
+
+static int perflock_notifier_call(struct notifier_block *nb,
+				  unsigned long event, void *data)
 {
+	struct cpufreq_policy *policy = data;
+	unsigned int lock_speed, ceiling_speed;
 	unsigned long irqflags;
-	struct perf_lock *lock;
-	unsigned int perf_level = 0;
 
-	/* Get the maxmimum perf level. */
-	if (list_empty(&active_cpufreq_ceiling_locks))
+	if (event != CPUFREQ_ADJUST)
 		return 0;
 
 	spin_lock_irqsave(&list_lock, irqflags);
-	list_for_each_entry(lock, &active_cpufreq_ceiling_locks, link) {
-		if (lock->level > perf_level)
-			perf_level = lock->level;
-	}
+	lock_speed = get_perflock_speed() / 1000;
+	ceiling_speed = get_cpufreq_ceiling_speed() / 1000;
 	spin_unlock_irqrestore(&list_lock, irqflags);
 
-	return cpufreq_ceiling_acpu_table[perf_level];
+	if (lock_speed) {
+		/* perflock will respect policy->max prevent thermal issue */
+		policy->min = min(max(policy->min, lock_speed), policy->max);
+	} else if (ceiling_speed) {
+		/* cpufreq_ceiling will respect policy->min */
+		policy->max = max(min(policy->max, ceiling_speed), policy->min);
+	} else
+		return 0;
+
+	if (debug_mask & PERF_CPUFREQ_NOTIFY_DEBUG)
+		pr_info("%s: cpu%u min %u max %u\n", __func__,
+			policy->cpu, policy->min, policy->max);
+
+	return 0;
+}
+
+static struct notifier_block perflock_notifier = {
+	.notifier_call = perflock_notifier_call,
+};
+
+static void perflock_register_notifier(void)
+{
+	static int registered;
+
+	if (registered)
+		return;
+	if (!cpufreq_register_notifier(&perflock_notifier,
+				       CPUFREQ_POLICY_NOTIFIER))
+		registered = 1;
 }
 
 static void print_active_locks(void)
@@ -322,10 +379,10 @@ static void print_active_locks(void)
 	struct perf_lock *lock;
 
 	spin_lock_irqsave(&list_lock, irqflags);
-	list_for_each_entry(lock, &active_perf_locks, link) {
+	plist_for_each_entry(lock, &active_perf_locks, node) {
 		pr_info("active perf lock '%s'\n", lock->name);
 	}
-	list_for_each_entry(lock, &active_cpufreq_ceiling_locks, link) {
+	plist_for_each_entry(lock, &active_cpufreq_ceiling_locks, node) {
 		pr_info("active cpufreq_ceiling_locks '%s'\n", lock->name);
 	}
 	spin_unlock_irqrestore(&list_lock, irqflags);
@@ -337,16 +394,16 @@ void htc_print_active_perf_locks(void)
 	struct perf_lock *lock;
 
 	spin_lock_irqsave(&list_lock, irqflags);
-	if (!list_empty(&active_perf_locks)) {
+	if (!plist_head_empty(&active_perf_locks)) {
 		pr_info("perf_lock:");
-		list_for_each_entry(lock, &active_perf_locks, link) {
+		plist_for_each_entry(lock, &active_perf_locks, node) {
 			pr_info(" '%s' ", lock->name);
 		}
 		pr_info("\n");
 	}
-	if (!list_empty(&active_cpufreq_ceiling_locks)) {
+	if (!plist_head_empty(&active_cpufreq_ceiling_locks)) {
 		printk(KERN_WARNING"perf_lock:");
-		list_for_each_entry(lock, &active_cpufreq_ceiling_locks, link) {
+		plist_for_each_entry(lock, &active_cpufreq_ceiling_locks, node) {
 			printk(KERN_WARNING" '%s' ", lock->name);
 		}
 		pr_info("\n");
@@ -387,39 +444,35 @@ void perf_lock_init(struct perf_lock *lock,
 	lock->flags = PERF_LOCK_INITIALIZED;
 	lock->level = level;
 
-	INIT_LIST_HEAD(&lock->link);
+	lock->count = 0;
+	lock->total_time = ktime_set(0, 0);
+	lock->max_time = ktime_set(0, 0);
+	plist_node_init(&lock->node, level);
+
 	spin_lock_irqsave(&list_lock, irqflags);
-	if (lock->type == TYPE_PERF_LOCK)
-		list_add(&lock->link, &inactive_perf_locks);
-	if (lock->type == TYPE_CPUFREQ_CEILING)
-		list_add(&lock->link, &inactive_cpufreq_ceiling_locks);
+	list_add(&lock->link, &perf_locks);
 	spin_unlock_irqrestore(&list_lock, irqflags);
 }
 EXPORT_SYMBOL(perf_lock_init);
 
+static struct plist_head *perf_lock_head(struct perf_lock *lock)
+{
+	if (lock->type == TYPE_CPUFREQ_CEILING)
+		return &active_cpufreq_ceiling_locks;
+	return &active_perf_locks;
+}
+
 /**
  * perf_lock - activate a perf lock
  * @lock: perf lock to activate
  *
  * Activate @lock.(Need to init_perf_lock before activate)
+ * The new cpufreq limits are applied before returning, so this may sleep.
  */
-static void do_set_rate_fn(struct work_struct *work)
-{
-	struct cpufreq_freqs freqs;
-	int ret = 0;
-	freqs.new = perflock_override(NULL, 0);
-	freqs.cpu = smp_processor_id();
-	cpufreq_notify_transition(&freqs, CPUFREQ_PRECHANGE);
-	ret = acpuclk_set_rate(freqs.cpu, freqs.new, SETRATE_CPUFREQ);
-	if (!ret)
-		cpufreq_notify_transition(&freqs, CPUFREQ_POSTCHANGE);
-}
-
-static DECLARE_WORK(do_setrate_work, do_set_rate_fn);
 void perf_lock(struct perf_lock *lock)
 {
 	unsigned long irqflags;
-	int cpu;
+	int changed;
 
 	WARN_ON((lock->flags & PERF_LOCK_INITIALIZED) == 0);
 	WARN_ON(lock->flags & PERF_LOCK_ACTIVE);
@@ -449,16 +502,14 @@ void perf_lock(struct perf_lock *lock)
 		return;
 	}
 	lock->flags |= PERF_LOCK_ACTIVE;
-	list_del(&lock->link);
-	if (lock->type == TYPE_PERF_LOCK)
-		list_add(&lock->link, &active_perf_locks);
-	else if (lock->type == TYPE_CPUFREQ_CEILING)
-		list_add(&lock->link, &active_cpufreq_ceiling_locks);
+	lock->last_lock = ktime_get();
+	lock->count++;
+	plist_add(&lock->node, perf_lock_head(lock));
+	changed = perflock_update_speed();
 	spin_unlock_irqrestore(&list_lock, irqflags);
 
-	for_each_online_cpu(cpu) {
-		queue_work_on(cpu, perflock_setrate_workqueue, &do_setrate_work);
-	}
+	if (changed)
+		perflock_update_policy();
 }
 EXPORT_SYMBOL(perf_lock);
 
@@ -466,11 +517,13 @@ EXPORT_SYMBOL(perf_lock);
  * perf_unlock - de-activate a perf lock
  * @lock: perf lock to de-activate
  *
- * de-activate @lock.
+ * de-activate @lock.  May sleep like perf_lock().
  */
 void perf_unlock(struct perf_lock *lock)
 {
 	unsigned long irqflags;
+	ktime_t held;
+	int changed;
 
 	WARN_ON(!initialized);
 	WARN_ON((lock->flags & PERF_LOCK_ACTIVE) == 0);
@@ -501,13 +554,16 @@ void perf_unlock(struct perf_lock *lock)
 		return;
 	}
 	lock->flags &= ~PERF_LOCK_ACTIVE;
-	list_del(&lock->link);
-	if (lock->type == TYPE_PERF_LOCK)
-		list_add(&lock->link, &inactive_perf_locks);
-	else if (lock->type == TYPE_CPUFREQ_CEILING)
-		list_add(&lock->link, &inactive_cpufreq_ceiling_locks);
-
+	held = ktime_sub(ktime_get(), lock->last_lock);
+	lock->total_time = ktime_add(lock->total_time, held);
+	if (ktime_to_ns(held) > ktime_to_ns(lock->max_time))
+		lock->max_time = held;
+	plist_del(&lock->node, perf_lock_head(lock));
+	changed = perflock_update_speed();
 	spin_unlock_irqrestore(&list_lock, irqflags);
+
+	if (changed)
+		perflock_update_policy();
 }
 EXPORT_SYMBOL(perf_unlock);
 
@@ -530,7 +586,7 @@ EXPORT_SYMBOL(is_perf_lock_active);
  */
 int is_perf_locked(void)
 {
-	return (!list_empty(&active_perf_locks));
+	return (!plist_head_empty(&active_perf_locks));
 }
 EXPORT_SYMBOL(is_perf_locked);
 
@@ -617,9 +673,9 @@ void __init perflock_init(struct perflock_platform_data *pdata)
 		goto invalid_config;
 
 	perf_acpu_table_fixup();
-	perflock_setrate_workqueue = create_workqueue("perflock_setrate_wq");
 
 	init_local_freq_policy(policy_min, policy_max);
+	perflock_register_notifier();
 	initialized = 1;
 
 #ifdef CONFIG_PERFLOCK_BOOT_LOCK
@@ -660,6 +716,7 @@ void __init cpufreq_ceiling_init(struct perflock_platform_data *pdata)
 	cpufreq_ceiling_acpu_table_fixup();
 
 	init_local_freq_policy(policy_min, policy_max);
+	perflock_register_notifier();
 	cpufreq_ceiling_initialized = 1;
 
 	return;
@@ -668,3 +725,58 @@ invalid_config:
 	pr_err("%s: invalid configuration data, %p %d %d\n", __func__,
 		cpufreq_ceiling_acpu_table, table_size, PERF_LOCK_INVALID);
 }
+
+#ifdef CONFIG_DEBUG_FS
+static int perflock_stats_show(struct seq_file *m, void *unused)
+{
+	unsigned long irqflags;
+	struct perf_lock *lock;
+	ktime_t now = ktime_get();
+	ktime_t total, max, held;
+
+	seq_printf(m, "%-24s %-7s %5s %6s %8s %10s %10s\n", "name", "type",
+		   "level", "active", "count", "total_ms", "max_ms");
+
+	spin_lock_irqsave(&list_lock, irqflags);
+	list_for_each_entry(lock, &perf_locks, link) {
+		total = lock->total_time;
+		max = lock->max_time;
+		if (lock->flags & PERF_LOCK_ACTIVE) {
+			held = ktime_sub(now, lock->last_lock);
+			total = ktime_add(total, held);
+			if (ktime_to_ns(held) > ktime_to_ns(max))
+				max = held;
+		}
+		seq_printf(m, "%-24s %-7s %5u %6d %8lu %10lld %10lld\n",
+			   lock->name,
+			   lock->type == TYPE_CPUFREQ_CEILING ? "ceiling" : "perf",
+			   lock->level, !!(lock->flags & PERF_LOCK_ACTIVE),
+			   lock->count, ktime_to_ms(total), ktime_to_ms(max));
+	}
+	seq_printf(m, "perflock speed %u ceiling speed %u\n",
+		   perflock_floor_speed, perflock_ceiling_speed);
+	spin_unlock_irqrestore(&list_lock, irqflags);
+
+	return 0;
+}
+
+static int perflock_stats_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, perflock_stats_show, NULL);
+}
+
+static const struct file_operations perflock_stats_fops = {
+	.open		= perflock_stats_open,
+	.read		= seq_read,
+	.llseek		= seq_lseek,
+	.release	= single_release,
+};
+
+static int __init perflock_debugfs_init(void)
+{
+	debugfs_create_file("perflock", S_IRUGO, NULL, NULL,
+			    &perflock_stats_fops);
+	return 0;
+}
+late_initcall(perflock_debugfs_init);
+#endif
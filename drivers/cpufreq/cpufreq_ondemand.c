@@ -24,6 +24,7 @@
 #include <linux/sched.h>
 #include <linux/input.h>
 #include <linux/workqueue.h>
+#include <linux/kthread.h>
 #include <linux/slab.h>
 
 /*
@@ -98,6 +99,10 @@ struct cpu_dbs_info_s {
 	unsigned int freq_lo_jiffies;
 	unsigned int freq_hi_jiffies;
 	unsigned int rate_mult;
+	unsigned int prev_load;		/* load seen by the last sample */
+	unsigned long prev_load_jiffies; /* when prev_load was sampled */
+	atomic_t src_sync_cpu;		/* CPU a busy task migrated from */
+	struct task_struct *sync_thread;
 	int cpu;
 	unsigned int sample_type:1;
 	/*
@@ -131,11 +136,17 @@ static struct dbs_tuners {
 	unsigned int sampling_down_factor;
 	int          powersave_bias;
 	unsigned int io_is_busy;
+	unsigned int sync_on_migrate;
+	unsigned int optimal_freq;
+	unsigned int up_threshold_any_cpu_load;
 #ifdef CONFIG_CPU_FREQ_GOV_ONDEMAND_2_PHASE
 	unsigned int two_phase_freq;
 #endif
 } dbs_tuners_ins = {
 	.up_threshold = DEF_FREQUENCY_UP_THRESHOLD,
+	.sync_on_migrate = 1,
+	.optimal_freq = 0,
+	.up_threshold_any_cpu_load = DEF_FREQUENCY_UP_THRESHOLD,
 	.sampling_down_factor = DEF_SAMPLING_DOWN_FACTOR,
 	.down_differential = DEF_FREQUENCY_DOWN_DIFFERENTIAL,
 	.ignore_nice = 0,
@@ -302,6 +313,9 @@ show_one(up_threshold, up_threshold);
 show_one(down_differential, down_differential);
 show_one(sampling_down_factor, sampling_down_factor);
 show_one(ignore_nice_load, ignore_nice);
+show_one(sync_on_migrate, sync_on_migrate);
+show_one(optimal_freq, optimal_freq);
+show_one(up_threshold_any_cpu_load, up_threshold_any_cpu_load);
 #ifdef CONFIG_CPU_FREQ_GOV_ONDEMAND_2_PHASE
 show_one(two_phase_freq, two_phase_freq);
 #endif
@@ -368,6 +382,45 @@ static ssize_t store_up_threshold(struct kobject *a, struct attribute *b,
 	return count;
 }
 
+static ssize_t store_sync_on_migrate(struct kobject *a, struct attribute *b,
+				     const char *buf, size_t count)
+{
+	unsigned int input;
+	int ret;
+	ret = sscanf(buf, "%u", &input);
+	if (ret != 1)
+		return -EINVAL;
+	dbs_tuners_ins.sync_on_migrate = !!input;
+	return count;
+}
+
+static ssize_t store_optimal_freq(struct kobject *a, struct attribute *b,
+				  const char *buf, size_t count)
+{
+	unsigned int input;
+	int ret;
+	ret = sscanf(buf, "%u", &input);
+	if (ret != 1)
+		return -EINVAL;
+	dbs_tuners_ins.optimal_freq = input;
+	return count;
+}
+
+static ssize_t store_up_threshold_any_cpu_load(struct kobject *a,
+			struct attribute *b, const char *buf, size_t count)
+{
+	unsigned int input;
+	int ret;
+	ret = sscanf(buf, "%u", &input);
+
+	if (ret != 1 || input > MAX_FREQUENCY_UP_THRESHOLD ||
+			input < MIN_FREQUENCY_UP_THRESHOLD) {
+		return -EINVAL;
+	}
+	dbs_tuners_ins.up_threshold_any_cpu_load = input;
+	return count;
+}
+
 static ssize_t store_down_differential(struct kobject *a, struct attribute *b,
 		const char *buf, size_t count)
 {
@@ -520,6 +573,9 @@ define_one_global_rw(down_differential);
 define_one_global_rw(sampling_down_factor);
 define_one_global_rw(ignore_nice_load);
 define_one_global_rw(powersave_bias);
+define_one_global_rw(sync_on_migrate);
+define_one_global_rw(optimal_freq);
+define_one_global_rw(up_threshold_any_cpu_load);
 #ifdef CONFIG_CPU_FREQ_GOV_ONDEMAND_2_PHASE
 define_one_global_rw(two_phase_freq);
 #endif
@@ -533,6 +589,9 @@ static struct attribute *dbs_attributes[] = {
 	&ignore_nice_load.attr,
 	&powersave_bias.attr,
 	&io_is_busy.attr,
+	&sync_on_migrate.attr,
+	&optimal_freq.attr,
+	&up_threshold_any_cpu_load.attr,
 #ifdef CONFIG_CPU_FREQ_GOV_ONDEMAND_2_PHASE
 	&two_phase_freq.attr,
 #endif
@@ -568,6 +627,7 @@ int set_two_phase_freq(int cpufreq)
 static void dbs_check_cpu(struct cpu_dbs_info_s *this_dbs_info)
 {
 	unsigned int max_load_freq;
+	unsigned int max_load_other_cpu = 0;
 
 	struct cpufreq_policy *policy;
 	unsigned int j;
@@ -649,6 +709,8 @@ static void dbs_check_cpu(struct cpu_dbs_info_s *this_dbs_info)
 			continue;
 
 		load = 100 * (wall_time - idle_time) / wall_time;
+		j_dbs_info->prev_load = load;
+		j_dbs_info->prev_load_jiffies = jiffies;
 
 		freq_avg = __cpufreq_driver_getavg(policy, j);
 		if (freq_avg <= 0)
@@ -659,6 +721,37 @@ static void dbs_check_cpu(struct cpu_dbs_info_s *this_dbs_info)
 			max_load_freq = load_freq;
 	}
 
+	/*
+	 * With a clock per core, a core that is busy on its own is not seen
+	 * by the other policies.  Look at the load their last samples saw.
+	 */
+	if (dbs_tuners_ins.optimal_freq && num_online_cpus() > 1) {
+		for_each_online_cpu(j) {
+			struct cpu_dbs_info_s *j_dbs_info;
+
+			if (cpumask_test_cpu(j, policy->cpus))
+				continue;
+
+			j_dbs_info = &per_cpu(od_cpu_dbs_info, j);
+			if (!j_dbs_info->cur_policy)
+				continue;
+
+			/*
+			 * An idle core defers its samples; ignore stale ones.
+			 * Only word sized fields are read here, the other
+			 * core updates them without a lock we could take.
+			 */
+			if (time_after(jiffies, j_dbs_info->prev_load_jiffies +
+				       usecs_to_jiffies(2 *
+				       dbs_tuners_ins.sampling_rate *
+				       j_dbs_info->rate_mult)))
+				continue;
+
+			if (j_dbs_info->prev_load > max_load_other_cpu)
+				max_load_other_cpu = j_dbs_info->prev_load;
+		}
+	}
+
 	/* Check for frequency increase */
 	if (max_load_freq > dbs_tuners_ins.up_threshold * policy->cur) {
 		/* If switching to max speed, apply sampling_down_factor */
@@ -698,6 +791,13 @@ static void dbs_check_cpu(struct cpu_dbs_info_s *this_dbs_info)
 	}
 #endif
 
+	/* Keep at least optimal_freq while any other core is busy */
+	if (max_load_other_cpu >= dbs_tuners_ins.up_threshold_any_cpu_load &&
+	    policy->cur < dbs_tuners_ins.optimal_freq) {
+		dbs_freq_increase(policy, dbs_tuners_ins.optimal_freq);
+		return;
+	}
+
 	/* Check for frequency decrease */
 	/* if we cannot reduce the frequency anymore, break out early */
 	if (policy->cur == policy->min)
@@ -722,6 +822,11 @@ static void dbs_check_cpu(struct cpu_dbs_info_s *this_dbs_info)
 		if (freq_next < policy->min)
 			freq_next = policy->min;
 
+		if (max_load_other_cpu >=
+		    dbs_tuners_ins.up_threshold_any_cpu_load &&
+		    freq_next < dbs_tuners_ins.optimal_freq)
+			freq_next = dbs_tuners_ins.optimal_freq;
+
 		if (!dbs_tuners_ins.powersave_bias) {
 			__cpufreq_driver_target(policy, freq_next,
 					CPUFREQ_RELATION_L);
@@ -840,6 +945,122 @@ static void dbs_refresh_callback(struct work_struct *unused)
 	unlock_policy_rwsem_write(cpu);
 }
 
+/*
+ * A busy task has just migrated to this CPU.  Run at least at the speed of
+ * the CPU it came from instead of waiting for the next samples to see it.
+ */
+static void dbs_sync(unsigned int cpu, int src_cpu)
+{
+	struct cpufreq_policy *policy;
+	struct cpu_dbs_info_s *this_dbs_info, *src_dbs_info;
+	unsigned int src_freq = 0;
+
+	this_dbs_info = &per_cpu(od_cpu_dbs_info, cpu);
+	src_dbs_info = &per_cpu(od_cpu_dbs_info, src_cpu);
+
+	if (lock_policy_rwsem_write(cpu) < 0)
+		return;
+
+	policy = this_dbs_info->cur_policy;
+	if (!policy) {
+		/* CPU not using ondemand governor */
+		unlock_policy_rwsem_write(cpu);
+		return;
+	}
+
+	/*
+	 * dbs_mutex keeps the source from starting or stopping the
+	 * governor, its timer_mutex from sampling, while we look at it.
+	 */
+	mutex_lock(&dbs_mutex);
+	if (src_dbs_info->cur_policy) {
+		mutex_lock(&src_dbs_info->timer_mutex);
+		if (src_dbs_info->prev_load >=
+		    dbs_tuners_ins.up_threshold_any_cpu_load)
+			src_freq = src_dbs_info->cur_policy->cur;
+		mutex_unlock(&src_dbs_info->timer_mutex);
+	}
+	mutex_unlock(&dbs_mutex);
+
+	mutex_lock(&this_dbs_info->timer_mutex);
+	if (policy->cur < src_freq) {
+		__cpufreq_driver_target(policy, src_freq, CPUFREQ_RELATION_L);
+		/* Judge the new speed only on load seen after the switch */
+		this_dbs_info->prev_cpu_idle = get_cpu_idle_time(cpu,
+				&this_dbs_info->prev_cpu_wall);
+		this_dbs_info->prev_cpu_iowait = get_cpu_iowait_time(cpu,
+				&this_dbs_info->prev_cpu_wall);
+	}
+	mutex_unlock(&this_dbs_info->timer_mutex);
+	unlock_policy_rwsem_write(cpu);
+}
+
+static int dbs_sync_thread(void *data)
+{
+	unsigned int cpu = (unsigned long)data;
+	struct cpu_dbs_info_s *this_dbs_info = &per_cpu(od_cpu_dbs_info, cpu);
+	int src_cpu;
+
+	while (1) {
+		set_current_state(TASK_INTERRUPTIBLE);
+		src_cpu = atomic_xchg(&this_dbs_info->src_sync_cpu, -1);
+		if (src_cpu < 0) {
+			if (kthread_should_stop())
+				break;
+			schedule();
+			continue;
+		}
+		__set_current_state(TASK_RUNNING);
+
+		get_online_cpus();
+		if (cpu_online(cpu))
+			dbs_sync(cpu, src_cpu);
+		put_online_cpus();
+	}
+	__set_current_state(TASK_RUNNING);
+
+	return 0;
+}
+
+/*
+ * Called after try_to_wake_up or the load balancer moved a task.  No
+ * runqueue lock is held, but it may be called from atomic context, e.g.
+ * a worker wakeup under the workqueue's gcwq->lock, so queueing work
+ * here could deadlock: only wake the destination's sync thread.
+ */
+static int dbs_migration_notify(struct notifier_block *nb,
+				unsigned long dest_cpu, void *data)
+{
+	int src_cpu = (long)data;
+	struct cpu_dbs_info_s *src_dbs_info, *dest_dbs_info;
+
+	if (!dbs_tuners_ins.sync_on_migrate ||
+	    dbs_tuners_ins.powersave_bias == POWERSAVE_BIAS_MAXLEVEL ||
+	    dbs_tuners_ins.powersave_bias == POWERSAVE_BIAS_MINLEVEL)
+		return NOTIFY_OK;
+
+	src_dbs_info = &per_cpu(od_cpu_dbs_info, src_cpu);
+	dest_dbs_info = &per_cpu(od_cpu_dbs_info, dest_cpu);
+
+	/*
+	 * Only a task leaving a busy CPU is worth a speed change.  This is
+	 * a hint; the sync thread checks again under the source's lock.
+	 */
+	if (!dest_dbs_info->sync_thread || !src_dbs_info->cur_policy ||
+	    !dest_dbs_info->cur_policy || src_dbs_info->prev_load <
+	    dbs_tuners_ins.up_threshold_any_cpu_load)
+		return NOTIFY_OK;
+
+	atomic_set(&dest_dbs_info->src_sync_cpu, src_cpu);
+	wake_up_process(dest_dbs_info->sync_thread);
+
+	return NOTIFY_OK;
+}
+
+static struct notifier_block dbs_migration_nb = {
+	.notifier_call = dbs_migration_notify,
+};
+
 static unsigned int enable_dbs_input_event = 1;
 static void dbs_input_event(struct input_handle *handle, unsigned int type,
 		unsigned int code, int value)
@@ -947,6 +1168,9 @@ static int cpufreq_governor_dbs(struct cpufreq_policy *policy,
 		if ((!cpu_online(cpu)) || (!policy->cur))
 			return -EINVAL;
 
+		/* dbs_sync may take it as soon as cur_policy is set below */
+		mutex_init(&this_dbs_info->timer_mutex);
+
 		mutex_lock(&dbs_mutex);
 
 		dbs_enable++;
@@ -991,12 +1215,12 @@ static int cpufreq_governor_dbs(struct cpufreq_policy *policy,
 				    latency * LATENCY_MULTIPLIER);
 			dbs_tuners_ins.io_is_busy = should_io_be_busy();
 		}
-		if (!cpu)
+		if (!cpu) {
 			rc = input_register_handler(&dbs_input_handler);
+			task_migration_register(&dbs_migration_nb);
+		}
 		mutex_unlock(&dbs_mutex);
 
-		mutex_init(&this_dbs_info->timer_mutex);
-
 		if (!ondemand_powersave_bias_setspeed(
 					this_dbs_info->cur_policy,
 					NULL,
@@ -1013,8 +1237,10 @@ static int cpufreq_governor_dbs(struct cpufreq_policy *policy,
 		/* If device is being removed, policy is no longer
 		 * valid. */
 		this_dbs_info->cur_policy = NULL;
-		if (!cpu)
+		if (!cpu) {
+			task_migration_unregister(&dbs_migration_nb);
 			input_unregister_handler(&dbs_input_handler);
+		}
 		mutex_unlock(&dbs_mutex);
 		if (!dbs_enable)
 			sysfs_remove_group(cpufreq_global_kobject,
@@ -1073,7 +1299,19 @@ static int __init cpufreq_gov_dbs_init(void)
 		return -EFAULT;
 	}
 	for_each_possible_cpu(i) {
+		struct cpu_dbs_info_s *this_dbs_info =
+			&per_cpu(od_cpu_dbs_info, i);
+		struct task_struct *t;
+
 		INIT_WORK(&per_cpu(dbs_refresh_work, i), dbs_refresh_callback);
+
+		atomic_set(&this_dbs_info->src_sync_cpu, -1);
+		t = kthread_run(dbs_sync_thread, (void *)(unsigned long)i,
+				"dbs_sync/%d", i);
+		if (IS_ERR(t))
+			pr_err("ondemand: no sync thread for cpu%u\n", i);
+		else
+			this_dbs_info->sync_thread = t;
 	}
 
 	return cpufreq_register_governor(&cpufreq_gov_ondemand);
@@ -1081,7 +1319,16 @@ static int __init cpufreq_gov_dbs_init(void)
 
 static void __exit cpufreq_gov_dbs_exit(void)
 {
+	unsigned int i;
+
 	cpufreq_unregister_governor(&cpufreq_gov_ondemand);
+	for_each_possible_cpu(i) {
+		struct cpu_dbs_info_s *this_dbs_info =
+			&per_cpu(od_cpu_dbs_info, i);
+
+		if (this_dbs_info->sync_thread)
+			kthread_stop(this_dbs_info->sync_thread);
+	}
 	destroy_workqueue(input_wq);
 }
 
@@ -34,6 +34,8 @@
 #include <linux/delay.h>
 #include <linux/capability.h>
 #include <linux/compat.h>
+#include <linux/debugfs.h>
+#include <linux/seq_file.h>
 
 #include <linux/mmc/ioctl.h>
 #include <linux/mmc/card.h>
@@ -59,6 +61,9 @@ MODULE_ALIAS("mmc:block");
 #define INAND_CMD38_ARG_SECTRIM1 0x81
 #define INAND_CMD38_ARG_SECTRIM2 0x88
 
+#define PACKED_CMD_VER	0x01
+#define PACKED_CMD_WR	0x02
+
 static DEFINE_MUTEX(block_mutex);
 
 /*
@@ -89,6 +94,7 @@ struct mmc_blk_data {
 	unsigned int	flags;
 #define MMC_BLK_CMD23	(1 << 0)	/* Can do SET_BLOCK_COUNT for multiblock */
 #define MMC_BLK_REL_WR	(1 << 1)	/* MMC Reliable write support */
+#define MMC_BLK_PACKED_WR	(1 << 2)	/* eMMC 4.5 packed writes */
 
 	unsigned int	usage;
 	unsigned int	read_only;
@@ -102,6 +108,7 @@ struct mmc_blk_data {
 	 */
 	unsigned int	part_curr;
 	struct device_attribute force_ro;
+	struct dentry	*stats_dentry;
 };
 
 static DEFINE_MUTEX(open_lock);
@@ -429,14 +436,6 @@ static const struct block_device_operations mmc_bdops = {
 #endif
 };
 
-struct mmc_blk_request {
-	struct mmc_request	mrq;
-	struct mmc_command	sbc;
-	struct mmc_command	cmd;
-	struct mmc_command	stop;
-	struct mmc_data		data;
-};
-
 static inline int mmc_blk_part_switch(struct mmc_card *card,
 				      struct mmc_blk_data *md)
 {
@@ -698,11 +697,61 @@ static int mmc_blk_cmd_recovery(struct mmc_card *card, struct request *req,
 	return ERR_CONTINUE;
 }
 
+/*
+ * Fold the discards queued right behind @req that continue its range
+ * into one erase.  Every erase costs a handful of commands and the
+ * card's erase timeout however short the range is.  The folded
+ * requests are moved to @merged, the whole range in sectors is
+ * returned.
+ */
+static unsigned int mmc_blk_merge_discard(struct mmc_queue *mq,
+					  struct request *req,
+					  struct list_head *merged)
+{
+	struct request_queue *q = mq->queue;
+	unsigned int max = q->limits.max_discard_sectors;
+	unsigned int nr = blk_rq_sectors(req);
+	struct request *next;
+
+	spin_lock_irq(q->queue_lock);
+	while ((next = blk_peek_request(q)) != NULL) {
+		if (!(next->cmd_flags & REQ_DISCARD) ||
+		    (next->cmd_flags & REQ_SECURE) !=
+		    (req->cmd_flags & REQ_SECURE) ||
+		    blk_rq_pos(next) != blk_rq_pos(req) + nr ||
+		    blk_rq_sectors(next) > max - nr)
+			break;
+
+		blk_start_request(next);
+		list_add_tail(&next->queuelist, merged);
+		nr += blk_rq_sectors(next);
+	}
+	spin_unlock_irq(q->queue_lock);
+
+	return nr;
+}
+
+static void mmc_blk_end_discard(struct mmc_blk_data *md, struct request *req,
+				struct list_head *merged, int err)
+{
+	struct request *next;
+
+	spin_lock_irq(&md->lock);
+	__blk_end_request(req, err, blk_rq_bytes(req));
+	while (!list_empty(merged)) {
+		next = list_entry_rq(merged->next);
+		list_del_init(&next->queuelist);
+		__blk_end_request_all(next, err);
+	}
+	spin_unlock_irq(&md->lock);
+}
+
 static int mmc_blk_issue_discard_rq(struct mmc_queue *mq, struct request *req)
 {
 	struct mmc_blk_data *md = mq->data;
 	struct mmc_card *card = md->queue.card;
 	unsigned int from, nr, arg;
+	LIST_HEAD(merged);
 	int err = 0;
 
 	if (!mmc_can_erase(card)) {
@@ -711,7 +760,7 @@ static int mmc_blk_issue_discard_rq(struct mmc_queue *mq, struct request *req)
 	}
 
 	from = blk_rq_pos(req);
-	nr = blk_rq_sectors(req);
+	nr = mmc_blk_merge_discard(mq, req, &merged);
 
 	if (mmc_can_discard(card))
 		arg = MMC_DISCARD_ARG;
@@ -732,9 +781,7 @@ static int mmc_blk_issue_discard_rq(struct mmc_queue *mq, struct request *req)
 	}
 	err = mmc_erase(card, from, nr, arg);
 out:
-	spin_lock_irq(&md->lock);
-	__blk_end_request(req, err, blk_rq_bytes(req));
-	spin_unlock_irq(&md->lock);
+	mmc_blk_end_discard(md, req, &merged, err);
 
 	return err ? 0 : 1;
 }
@@ -745,6 +792,7 @@ static int mmc_blk_issue_secdiscard_rq(struct mmc_queue *mq,
 	struct mmc_blk_data *md = mq->data;
 	struct mmc_card *card = md->queue.card;
 	unsigned int from, nr, arg;
+	LIST_HEAD(merged);
 	int err = 0;
 
 	if (!mmc_can_secure_erase_trim(card)) {
@@ -753,7 +801,7 @@ static int mmc_blk_issue_secdiscard_rq(struct mmc_queue *mq,
 	}
 
 	from = blk_rq_pos(req);
-	nr = blk_rq_sectors(req);
+	nr = mmc_blk_merge_discard(mq, req, &merged);
 
 	/* eMMC will be corrupted if secure-trim and secure-erase are
 	   adopted for Samsung 27 nm eMMC. Therefore, replace secure-trim
@@ -788,9 +836,7 @@ static int mmc_blk_issue_secdiscard_rq(struct mmc_queue *mq,
 		err = mmc_erase(card, from, nr, MMC_SECURE_TRIM2_ARG);
 	} */
 out:
-	spin_lock_irq(&md->lock);
-	__blk_end_request(req, err, blk_rq_bytes(req));
-	spin_unlock_irq(&md->lock);
+	mmc_blk_end_discard(md, req, &merged, err);
 
 	return err ? 0 : 1;
 }
@@ -798,16 +844,23 @@ out:
 static int mmc_blk_issue_flush(struct mmc_queue *mq, struct request *req)
 {
 	struct mmc_blk_data *md = mq->data;
+	struct mmc_card *card = md->queue.card;
+	int ret;
 
 	/*
-	 * No-op, only service this because we need REQ_FUA for reliable
+	 * Without the cache turned on there is nothing to write back, the
+	 * request is only serviced because we need REQ_FUA for reliable
 	 * writes.
 	 */
+	ret = mmc_flush_cache(card);
+	if (ret)
+		ret = -EIO;
+
 	spin_lock_irq(&md->lock);
-	__blk_end_request_all(req, 0);
+	__blk_end_request_all(req, ret);
 	spin_unlock_irq(&md->lock);
 
-	return 1;
+	return ret ? 0 : 1;
 }
 
 /*
@@ -973,8 +1026,8 @@ static int sd_blk_issue_rw_rq(struct mmc_queue *mq, struct request *req)
 
 		mmc_set_data_timeout(&brq.data, card);
 
-		brq.data.sg = mq->sg;
-		brq.data.sg_len = mmc_queue_map_sg(mq);
+		brq.data.sg = mq->mqrq_cur->sg;
+		brq.data.sg_len = mmc_queue_map_sg(mq, mq->mqrq_cur);
 
 		/*
 		 * Adjust the sg list so it is the same size as the
@@ -997,11 +1050,11 @@ static int sd_blk_issue_rw_rq(struct mmc_queue *mq, struct request *req)
 #ifdef CONFIG_MMC_PERF_PROFILING
 		start = ktime_get();
 #endif
-		mmc_queue_bounce_pre(mq);
+		mmc_queue_bounce_pre(mq->mqrq_cur);
 
 		mmc_wait_for_req(card->host, &brq.mrq);
 
-		mmc_queue_bounce_post(mq);
+		mmc_queue_bounce_post(mq->mqrq_cur);
 #ifdef CONFIG_MMC_PERF_PROFILING
 		diff = ktime_sub(ktime_get(), start);
 		if (ktime_to_us(diff) > 400000)
@@ -1246,17 +1299,240 @@ recovery:
 	return 0;
 }
 
-static int mmc_blk_issue_rw_rq(struct mmc_queue *mq, struct request *req)
+enum mmc_blk_status {
+	MMC_BLK_SUCCESS = 0,
+	MMC_BLK_PARTIAL,
+	MMC_BLK_RETRY,
+	MMC_BLK_ABORT,
+	MMC_BLK_DATA_ERR,
+	MMC_BLK_CMD_ERR,
+	MMC_BLK_REINIT,
+};
+
+static int mmc_blk_err_check(struct mmc_card *card,
+			     struct mmc_async_req *areq)
+{
+	struct mmc_queue_req *mq_mrq = container_of(areq, struct mmc_queue_req,
+						    mmc_active);
+	struct mmc_blk_request *brq = &mq_mrq->brq;
+	struct request *req = mq_mrq->req;
+	int no_ready = 0, err;
+	u32 status = 0;
+	ktime_t diff;
+
+	diff = ktime_sub(ktime_get(), mq_mrq->start);
+	if (ktime_to_ms(diff) > 3000)
+		printk(KERN_INFO "%s:finish cmd%d. start sector %u, numSector %u, time=%lldms\n",
+			mmc_hostname(card->host), brq->cmd.opcode,
+			brq->cmd.arg , blk_rq_sectors(req) , ktime_to_ms(diff));
+
+	/*
+	 * sbc.error indicates a problem with the set block count
+	 * command.  No data will have been transferred.
+	 *
+	 * cmd.error indicates a problem with the r/w command.  No
+	 * data will have been transferred.
+	 *
+	 * stop.error indicates a problem with the stop command.  Data
+	 * may have been transferred, or may still be transferring.
+	 */
+	if (brq->sbc.error || brq->cmd.error || brq->stop.error) {
+		if (mq_mrq->reinit_retry)
+			return MMC_BLK_REINIT;
+		switch (mmc_blk_cmd_recovery(card, req, brq)) {
+		case ERR_RETRY:
+			return MMC_BLK_RETRY;
+		case ERR_ABORT:
+		case ERR_NOMEDIUM:
+			return MMC_BLK_ABORT;
+		case ERR_CONTINUE:
+			break;
+		}
+	}
+
+	/*
+	 * Check for errors relating to the execution of the
+	 * initial command - such as address errors.  No data
+	 * has been transferred.
+	 */
+	if (brq->cmd.resp[0] & CMD_ERRORS) {
+		pr_err("%s: r/w command failed, status = %#x\n",
+			req->rq_disk->disk_name, brq->cmd.resp[0]);
+		return MMC_BLK_ABORT;
+	}
+
+	/*
+	 * Everything else is either success, or a data error of some
+	 * kind.  If it was a write, we may have transitioned to
+	 * program mode, which we have to wait for it to complete.
+	 */
+	if (!mmc_host_is_spi(card->host) && rq_data_dir(req) != READ) {
+		int i = 0;
+		unsigned long timeout = jiffies + HZ * 2;
+
+		do {
+			err = get_card_status(card, &status, 5);
+			if (err) {
+				printk(KERN_ERR "%s: error %d requesting status\n",
+				       req->rq_disk->disk_name, err);
+				return MMC_BLK_CMD_ERR;
+			}
+			if (time_after(jiffies, timeout) && (i > 1000)) {
+				if ((status & R1_READY_FOR_DATA) &&
+					(R1_CURRENT_STATE(status) == 4)) {
+					printk(KERN_ERR "%s: timeout but get card ready i = %d\n",
+					mmc_hostname(card->host), i);
+					break;
+				}
+				no_ready = 1;
+				printk(KERN_ERR "%s: card is not ready (%d)\n",
+					mmc_hostname(card->host), i);
+				break;
+			}
+			i++;
+			/*
+			 * Some cards mishandle the status bits,
+			 * so make sure to check both the busy
+			 * indication and the card state.
+			 */
+		} while (!(status & R1_READY_FOR_DATA) ||
+			 (R1_CURRENT_STATE(status) == R1_STATE_PRG));
+
+		diff = ktime_sub(ktime_get(), mq_mrq->start);
+		if (ktime_to_ms(diff) > 3000)
+			printk(KERN_INFO "%s:end request. cmd%d, start sector %u, numSector %u, time=%lldms\n",
+					mmc_hostname(card->host), brq->cmd.opcode,
+					brq->cmd.arg , blk_rq_sectors(req) , ktime_to_ms(diff));
+	}
+
+	if (no_ready && mq_mrq->reinit_retry)
+		return MMC_BLK_REINIT;
+
+	if (brq->data.error) {
+		pr_err("%s: error %d transferring data, sector %u, nr %u, cmd response %#x, card status %#x\n",
+			req->rq_disk->disk_name, brq->data.error,
+			(unsigned)blk_rq_pos(req),
+			(unsigned)blk_rq_sectors(req),
+			brq->cmd.resp[0], brq->stop.resp[0]);
+
+		if (mq_mrq->reinit_retry)
+			return MMC_BLK_REINIT;
+		if (rq_data_dir(req) == READ)
+			return MMC_BLK_DATA_ERR;
+		return MMC_BLK_CMD_ERR;
+	}
+
+	if (mq_mrq->packed_cmd == MMC_PACKED_NONE &&
+	    blk_rq_bytes(req) != brq->data.bytes_xfered)
+		return MMC_BLK_PARTIAL;
+
+	return MMC_BLK_SUCCESS;
+}
+
+/*
+ * A packed write that failed on one of its requests reports that
+ * through an exception event, the index of the failed request is in
+ * EXT_CSD.  Everything before it was written.
+ */
+static int mmc_blk_packed_err_check(struct mmc_card *card,
+				    struct mmc_async_req *areq)
+{
+	struct mmc_queue_req *mq_rq = container_of(areq, struct mmc_queue_req,
+						   mmc_active);
+	struct request *req = mq_rq->req;
+	int err, check;
+	u32 status;
+	u8 *ext_csd;
+
+	BUG_ON(!mq_rq->packed_num);
+
+	mq_rq->packed_retries--;
+	check = mmc_blk_err_check(card, areq);
+	if (check == MMC_BLK_SUCCESS || check == MMC_BLK_REINIT)
+		return check;
+
+	err = get_card_status(card, &status, 0);
+	if (err) {
+		pr_err("%s: error %d sending status command\n",
+			req->rq_disk->disk_name, err);
+		return MMC_BLK_ABORT;
+	}
+
+	if (!(status & R1_EXCEPTION_EVENT))
+		return check;
+
+	ext_csd = kzalloc(512, GFP_KERNEL);
+	if (!ext_csd) {
+		pr_err("%s: unable to allocate buffer for ext_csd\n",
+			req->rq_disk->disk_name);
+		return MMC_BLK_ABORT;
+	}
+
+	err = mmc_send_ext_csd(card, ext_csd);
+	if (err) {
+		pr_err("%s: error %d sending ext_csd\n",
+			req->rq_disk->disk_name, err);
+		check = MMC_BLK_ABORT;
+		goto free;
+	}
+
+	if ((ext_csd[EXT_CSD_EXP_EVENTS_STATUS] & EXT_CSD_PACKED_FAILURE) &&
+	    (ext_csd[EXT_CSD_PACKED_CMD_STATUS] &
+	     EXT_CSD_PACKED_GENERIC_ERROR) &&
+	    (ext_csd[EXT_CSD_PACKED_CMD_STATUS] &
+	     EXT_CSD_PACKED_INDEXED_ERROR)) {
+		/* the card counts the requests of the pack from 1 */
+		int idx = ext_csd[EXT_CSD_PACKED_FAILURE_INDEX] - 1;
+
+		if (idx >= 0 && idx < mq_rq->packed_num) {
+			mq_rq->packed_fail_idx = idx;
+			check = MMC_BLK_PARTIAL;
+		}
+	}
+
+free:
+	kfree(ext_csd);
+	return check;
+}
+
+/*
+ * Reinitialize the card once per request before falling back to the
+ * usual error recovery.  Some cards only come out of a stuck state
+ * this way.
+ */
+static int mmc_blk_reinit(struct mmc_blk_data *md,
+			  struct mmc_queue_req *mq_rq)
 {
-	struct mmc_blk_data *md = mq->data;
 	struct mmc_card *card = md->queue.card;
-	struct mmc_blk_request brq;
-	int ret = 1, disable_multi = 0, retry = 0;
-	int reinit_retry = 1;
-	int err;
+	struct request *req = mq_rq->req;
 	u32 status;
-	int  no_ready = 0;
-	ktime_t start, diff;
+	int err;
+
+	mq_rq->reinit_retry = 0;
+	err = get_card_status(card, &status, 0);
+	if (err)
+		pr_info("%s: error %d sending status command\n",
+			req->rq_disk->disk_name, err);
+	else
+		pr_info("%s: card status %#x \n", req->rq_disk->disk_name, status);
+	pr_info("%s: reinit card\n", mmc_hostname(card->host));
+
+	err = mmc_reinit_card(card->host);
+	if (!err)
+		mmc_blk_set_blksize(md, card);
+
+	return err;
+}
+
+static void mmc_blk_rw_rq_prep(struct mmc_queue_req *mqrq,
+			       struct mmc_card *card,
+			       int disable_multi,
+			       struct mmc_queue *mq)
+{
+	u32 readcmd, writecmd;
+	struct mmc_blk_request *brq = &mqrq->brq;
+	struct request *req = mqrq->req;
+	struct mmc_blk_data *md = mq->data;
 
 	/*
 	 * Reliable writes are used to implement Forced Unit Access and
@@ -1267,282 +1543,493 @@ static int mmc_blk_issue_rw_rq(struct mmc_queue *mq, struct request *req)
 		(rq_data_dir(req) == WRITE) &&
 		(md->flags & MMC_BLK_REL_WR);
 
-	do {
-		u32 readcmd, writecmd;
+	memset(brq, 0, sizeof(struct mmc_blk_request));
+	brq->mrq.cmd = &brq->cmd;
+	brq->mrq.data = &brq->data;
 
-		memset(&brq, 0, sizeof(struct mmc_blk_request));
-		brq.mrq.cmd = &brq.cmd;
-		brq.mrq.data = &brq.data;
+	brq->cmd.arg = blk_rq_pos(req);
+	if (!mmc_card_blockaddr(card))
+		brq->cmd.arg <<= 9;
+	brq->cmd.flags = MMC_RSP_SPI_R1 | MMC_RSP_R1 | MMC_CMD_ADTC;
+	brq->data.blksz = 512;
+	brq->stop.opcode = MMC_STOP_TRANSMISSION;
+	brq->stop.arg = 0;
+	brq->stop.flags = MMC_RSP_SPI_R1B | MMC_RSP_R1B | MMC_CMD_AC;
+	brq->data.blocks = blk_rq_sectors(req);
 
-		brq.cmd.arg = blk_rq_pos(req);
-		if (!mmc_card_blockaddr(card))
-			brq.cmd.arg <<= 9;
-		brq.cmd.flags = MMC_RSP_SPI_R1 | MMC_RSP_R1 | MMC_CMD_ADTC;
-		brq.data.blksz = 512;
-		brq.stop.opcode = MMC_STOP_TRANSMISSION;
-		brq.stop.arg = 0;
-		brq.stop.flags = MMC_RSP_SPI_R1B | MMC_RSP_R1B | MMC_CMD_AC;
-		brq.data.blocks = blk_rq_sectors(req);
+	/*
+	 * The block layer doesn't support all sector count
+	 * restrictions, so we need to be prepared for too big
+	 * requests.
+	 */
+	if (brq->data.blocks > card->host->max_blk_count)
+		brq->data.blocks = card->host->max_blk_count;
 
-		/*
-		 * The block layer doesn't support all sector count
-		 * restrictions, so we need to be prepared for too big
-		 * requests.
-		 */
-		if (brq.data.blocks > card->host->max_blk_count)
-			brq.data.blocks = card->host->max_blk_count;
+	/*
+	 * After a read error, we redo the request one sector at a time
+	 * in order to accurately determine which sectors can be read
+	 * successfully.
+	 */
+	if (disable_multi && brq->data.blocks > 1)
+		brq->data.blocks = 1;
 
-		/*
-		 * After a read error, we redo the request one sector at a time
-		 * in order to accurately determine which sectors can be read
-		 * successfully.
+	if (brq->data.blocks > 1 || do_rel_wr) {
+		/* SPI multiblock writes terminate using a special
+		 * token, not a STOP_TRANSMISSION request.
 		 */
-		if (disable_multi && brq.data.blocks > 1)
-			brq.data.blocks = 1;
+		if (!mmc_host_is_spi(card->host) ||
+		    rq_data_dir(req) == READ)
+			brq->mrq.stop = &brq->stop;
+		readcmd = MMC_READ_MULTIPLE_BLOCK;
+		writecmd = MMC_WRITE_MULTIPLE_BLOCK;
+	} else {
+		brq->mrq.stop = NULL;
+		readcmd = MMC_READ_SINGLE_BLOCK;
+		writecmd = MMC_WRITE_BLOCK;
+	}
+	if (rq_data_dir(req) == READ) {
+		brq->cmd.opcode = readcmd;
+		brq->data.flags |= MMC_DATA_READ;
+	} else {
+		brq->cmd.opcode = writecmd;
+		brq->data.flags |= MMC_DATA_WRITE;
+	}
 
-		if (brq.data.blocks > 1 || do_rel_wr) {
-			/* SPI multiblock writes terminate using a special
-			 * token, not a STOP_TRANSMISSION request.
-			 */
-			if (!mmc_host_is_spi(card->host) ||
-			    rq_data_dir(req) == READ)
-				brq.mrq.stop = &brq.stop;
-			readcmd = MMC_READ_MULTIPLE_BLOCK;
-			writecmd = MMC_WRITE_MULTIPLE_BLOCK;
-		} else {
-			brq.mrq.stop = NULL;
-			readcmd = MMC_READ_SINGLE_BLOCK;
-			writecmd = MMC_WRITE_BLOCK;
-		}
-		if (rq_data_dir(req) == READ) {
-			brq.cmd.opcode = readcmd;
-			brq.data.flags |= MMC_DATA_READ;
-		} else {
-			brq.cmd.opcode = writecmd;
-			brq.data.flags |= MMC_DATA_WRITE;
-		}
+	if (do_rel_wr)
+		mmc_apply_rel_rw(brq, card, req);
 
-		if (do_rel_wr)
-			mmc_apply_rel_rw(&brq, card, req);
+	/*
+	 * Pre-defined multi-block transfers are preferable to
+	 * open ended-ones (and necessary for reliable writes).
+	 * However, it is not sufficient to just send CMD23,
+	 * and avoid the final CMD12, as on an error condition
+	 * CMD12 (stop) needs to be sent anyway. This, coupled
+	 * with Auto-CMD23 enhancements provided by some
+	 * hosts, means that the complexity of dealing
+	 * with this is best left to the host. If CMD23 is
+	 * supported by card and host, we'll fill sbc in and let
+	 * the host deal with handling it correctly. This means
+	 * that for hosts that don't expose MMC_CAP_CMD23, no
+	 * change of behavior will be observed.
+	 *
+	 * N.B: Some MMC cards experience perf degradation.
+	 * We'll avoid using CMD23-bounded multiblock writes for
+	 * these, while retaining features like reliable writes.
+	 */
 
-		/*
-		 * Pre-defined multi-block transfers are preferable to
-		 * open ended-ones (and necessary for reliable writes).
-		 * However, it is not sufficient to just send CMD23,
-		 * and avoid the final CMD12, as on an error condition
-		 * CMD12 (stop) needs to be sent anyway. This, coupled
-		 * with Auto-CMD23 enhancements provided by some
-		 * hosts, means that the complexity of dealing
-		 * with this is best left to the host. If CMD23 is
-		 * supported by card and host, we'll fill sbc in and let
-		 * the host deal with handling it correctly. This means
-		 * that for hosts that don't expose MMC_CAP_CMD23, no
-		 * change of behavior will be observed.
-		 *
-		 * N.B: Some MMC cards experience perf degradation.
-		 * We'll avoid using CMD23-bounded multiblock writes for
-		 * these, while retaining features like reliable writes.
-		 */
+	if ((md->flags & MMC_BLK_CMD23) &&
+	    mmc_op_multi(brq->cmd.opcode) &&
+	    (do_rel_wr || !(card->quirks & MMC_QUIRK_BLK_NO_CMD23))) {
+		brq->sbc.opcode = MMC_SET_BLOCK_COUNT;
+		brq->sbc.arg = brq->data.blocks |
+			(do_rel_wr ? MMC_CMD23_ARG_REL_WR : 0);
+		brq->sbc.flags = MMC_RSP_R1 | MMC_CMD_AC;
+		brq->mrq.sbc = &brq->sbc;
+	}
 
-		if ((md->flags & MMC_BLK_CMD23) &&
-		    mmc_op_multi(brq.cmd.opcode) &&
-		    (do_rel_wr || !(card->quirks & MMC_QUIRK_BLK_NO_CMD23))) {
-			brq.sbc.opcode = MMC_SET_BLOCK_COUNT;
-			brq.sbc.arg = brq.data.blocks |
-				(do_rel_wr ? (1 << 31) : 0);
-			brq.sbc.flags = MMC_RSP_R1 | MMC_CMD_AC;
-			brq.mrq.sbc = &brq.sbc;
+	mmc_set_data_timeout(&brq->data, card);
+
+	brq->data.sg = mqrq->sg;
+	brq->data.sg_len = mmc_queue_map_sg(mq, mqrq);
+
+	/*
+	 * Adjust the sg list so it is the same size as the
+	 * request.
+	 */
+	if (brq->data.blocks != blk_rq_sectors(req)) {
+		int i, data_size = brq->data.blocks << 9;
+		struct scatterlist *sg;
+
+		for_each_sg(brq->data.sg, sg, brq->data.sg_len, i) {
+			data_size -= sg->length;
+			if (data_size <= 0) {
+				sg->length += data_size;
+				i++;
+				break;
+			}
 		}
+		brq->data.sg_len = i;
+	}
 
-		mmc_set_data_timeout(&brq.data, card);
+	mqrq->mmc_active.mrq = &brq->mrq;
+	mqrq->mmc_active.err_check = mmc_blk_err_check;
+	mqrq->start = ktime_get();
 
-		brq.data.sg = mq->sg;
-		brq.data.sg_len = mmc_queue_map_sg(mq);
+	mmc_queue_bounce_pre(mqrq);
+}
 
-		/*
-		 * Adjust the sg list so it is the same size as the
-		 * request.
-		 */
-		if (brq.data.blocks != blk_rq_sectors(req)) {
-			int i, data_size = brq.data.blocks << 9;
-			struct scatterlist *sg;
+static void mmc_blk_clear_packed(struct mmc_queue_req *mqrq)
+{
+	mqrq->packed_cmd = MMC_PACKED_NONE;
+	mqrq->packed_blocks = 0;
+	mqrq->packed_num = 0;
+	mqrq->packed_fail_idx = MMC_PACKED_N_IDX;
+	mqrq->packed_retries = 0;
+}
 
-			for_each_sg(brq.data.sg, sg, brq.data.sg_len, i) {
-				data_size -= sg->length;
-				if (data_size <= 0) {
-					sg->length += data_size;
-					i++;
-					break;
-				}
-			}
-			brq.data.sg_len = i;
-		}
+/*
+ * Requests that carry their own ordering or reliability semantics
+ * are never put into a pack.
+ */
+static inline bool mmc_blk_req_unpackable(struct request *req)
+{
+	return req->cmd_flags & (REQ_DISCARD | REQ_FLUSH | REQ_FUA | REQ_META);
+}
 
-		start = ktime_get();
-		mmc_queue_bounce_pre(mq);
+/*
+ * Pull further writes off the queue behind @req for as long as they fit
+ * into one packed write.  Returns the number of requests in the pack,
+ * or 0 if @req goes out on its own.
+ */
+static u8 mmc_blk_prep_packed_list(struct mmc_queue *mq, struct request *req)
+{
+	struct request_queue *q = mq->queue;
+	struct mmc_card *card = mq->card;
+	struct mmc_blk_data *md = mq->data;
+	struct mmc_queue_req *mqrq = mq->mqrq_cur;
+	struct request *next = NULL;
+	unsigned int req_sectors, phys_segments;
+	unsigned int max_blk_count, max_phys_segs, max_num;
+	enum mmc_pack_stop stop;
+	bool put_back = false;
+	u8 num = 0;
+
+	if (!(md->flags & MMC_BLK_PACKED_WR) || mqrq->bounce_buf)
+		return 0;
 
-		mmc_wait_for_req(card->host, &brq.mrq);
+	if (rq_data_dir(req) != WRITE || mmc_blk_req_unpackable(req))
+		return 0;
 
-		mmc_queue_bounce_post(mq);
-		diff = ktime_sub(ktime_get(), start);
-		if (ktime_to_ms(diff) > 3000)
-			printk(KERN_INFO "%s:finish cmd%d. start sector %u, numSector %u, time=%lldms\n",
-				mmc_hostname(card->host), brq.cmd.opcode,
-				brq.cmd.arg , blk_rq_sectors(req) , ktime_to_ms(diff));
+	max_blk_count = min(card->host->max_blk_count,
+			    card->host->max_req_size >> 9);
+	max_phys_segs = queue_max_segments(q);
+	max_num = min_t(unsigned int, card->ext_csd.max_packed_writes,
+			MMC_PACKED_HDR_SIZE / 8 - 1);
 
+	/* the header takes one block and one segment of its own */
+	req_sectors = blk_rq_sectors(req) + 1;
+	phys_segments = req->nr_phys_segments + 1;
+	if (req_sectors > max_blk_count || phys_segments > max_phys_segs)
+		return 0;
 
-		/*
-		 * sbc.error indicates a problem with the set block count
-		 * command.  No data will have been transferred.
-		 *
-		 * cmd.error indicates a problem with the r/w command.  No
-		 * data will have been transferred.
-		 *
-		 * stop.error indicates a problem with the stop command.  Data
-		 * may have been transferred, or may still be transferring.
-		 */
-		if (brq.sbc.error || brq.cmd.error || brq.stop.error) {
-			if (reinit_retry) {
-				reinit_retry = 0;
-				err = get_card_status(card, &status, 0);
-				if (err)
-					pr_info("%s: error %d sending status command\n",
-						req->rq_disk->disk_name, err);
-				else
-					pr_info("%s: card status %#x \n", req->rq_disk->disk_name, status);
-				pr_info("%s: reinit card\n", mmc_hostname(card->host));
-				if (mmc_reinit_card(card->host) == 0) {
-					mmc_blk_set_blksize(md, card);
-					continue;
-				}
-			}
-			switch (mmc_blk_cmd_recovery(card, req, &brq)) {
-			case ERR_RETRY:
-				if (retry++ < 5)
-					continue;
-			case ERR_ABORT:
-			case ERR_NOMEDIUM:
-				goto cmd_abort;
-			case ERR_CONTINUE:
-				break;
-			}
-		}
+	list_add_tail(&req->queuelist, &mqrq->packed_list);
+	num++;
 
-		/*
-		 * Check for errors relating to the execution of the
-		 * initial command - such as address errors.  No data
-		 * has been transferred.
-		 */
-		if (brq.cmd.resp[0] & CMD_ERRORS) {
-			pr_err("%s: r/w command failed, status = %#x\n",
-				req->rq_disk->disk_name, brq.cmd.resp[0]);
-			goto cmd_abort;
+	do {
+		if (num >= max_num) {
+			stop = MMC_PACK_STOP_NUM;
+			break;
 		}
 
-		/*
-		 * Everything else is either success, or a data error of some
-		 * kind.  If it was a write, we may have transitioned to
-		 * program mode, which we have to wait for it to complete.
-		 */
-		if (!mmc_host_is_spi(card->host) && rq_data_dir(req) != READ) {
-			int i = 0;
-			unsigned long timeout = jiffies + HZ * 2;
-			u32 status;
-			do {
-				err = get_card_status(card, &status, 5);
-				if (err) {
-					printk(KERN_ERR "%s: error %d requesting status\n",
-					       req->rq_disk->disk_name, err);
-					goto cmd_err;
-				}
-				if (time_after(jiffies, timeout) && (i > 1000)) {
-					if ((status & R1_READY_FOR_DATA) &&
-						(R1_CURRENT_STATE(status) == 4)) {
-						printk(KERN_ERR "%s: timeout but get card ready i = %d\n",
-						mmc_hostname(card->host), i);
-						break;
-					}
-					no_ready = 1;
-					printk(KERN_ERR "%s: card is not ready (%d)\n",
-						mmc_hostname(card->host), i);
-					break;
-				}
-				i++;
-				/*
-				 * Some cards mishandle the status bits,
-				 * so make sure to check both the busy
-				 * indication and the card state.
-				 */
-			} while (!(status & R1_READY_FOR_DATA) ||
-				 (R1_CURRENT_STATE(status) == R1_STATE_PRG));
+		spin_lock_irq(q->queue_lock);
+		next = blk_fetch_request(q);
+		spin_unlock_irq(q->queue_lock);
+		if (!next) {
+			stop = MMC_PACK_STOP_EMPTY;
+			break;
+		}
 
-			diff = ktime_sub(ktime_get(), start);
-			if (ktime_to_ms(diff) > 3000)
-				printk(KERN_INFO "%s:end request. cmd%d, start sector %u, numSector %u, time=%lldms\n",
-						mmc_hostname(card->host), brq.cmd.opcode,
-						brq.cmd.arg , blk_rq_sectors(req) , ktime_to_ms(diff));
+		put_back = true;
+		if (rq_data_dir(next) != WRITE) {
+			stop = MMC_PACK_STOP_DIR;
+			break;
+		}
+		if (mmc_blk_req_unpackable(next)) {
+			stop = MMC_PACK_STOP_FLAGS;
+			break;
+		}
+		if (req_sectors + blk_rq_sectors(next) > max_blk_count) {
+			stop = MMC_PACK_STOP_SIZE;
+			break;
 		}
+		if (phys_segments + next->nr_phys_segments > max_phys_segs) {
+			stop = MMC_PACK_STOP_SEGS;
+			break;
+		}
+		put_back = false;
+
+		list_add_tail(&next->queuelist, &mqrq->packed_list);
+		req_sectors += blk_rq_sectors(next);
+		phys_segments += next->nr_phys_segments;
+		num++;
+	} while (1);
+
+	if (put_back) {
+		spin_lock_irq(q->queue_lock);
+		blk_requeue_request(q, next);
+		spin_unlock_irq(q->queue_lock);
+	}
 
-		if (no_ready && reinit_retry) {
-			reinit_retry = 0;
-			pr_info("%s: card status %#x \n", req->rq_disk->disk_name, status);
-			pr_info("%s: reinit card\n", mmc_hostname(card->host));
-			if (mmc_reinit_card(card->host) == 0) {
-				mmc_blk_set_blksize(md, card);
-				continue;
+	mq->stats.pack_stop[stop]++;
+
+	if (num > 1) {
+		mqrq->packed_num = num;
+		mqrq->packed_retries = num;
+		mqrq->packed_cmd = MMC_PACKED_WRITE;
+		return num;
+	}
+
+	list_del_init(&req->queuelist);
+	return 0;
+}
+
+static void mmc_blk_packed_hdr_wrq_prep(struct mmc_queue_req *mqrq,
+					struct mmc_card *card,
+					struct mmc_queue *mq)
+{
+	struct mmc_blk_request *brq = &mqrq->brq;
+	struct request *req = mqrq->req;
+	struct request *prq;
+	__le32 *packed_cmd_hdr = mqrq->packed_cmd_hdr;
+	int i = 1;
+
+	mqrq->packed_blocks = 0;
+	mqrq->packed_fail_idx = MMC_PACKED_N_IDX;
+
+	memset(packed_cmd_hdr, 0, MMC_PACKED_HDR_SIZE);
+	packed_cmd_hdr[0] = cpu_to_le32((mqrq->packed_num << 16) |
+					(PACKED_CMD_WR << 8) | PACKED_CMD_VER);
+
+	/* one CMD23/CMD25 argument pair per request, after the first word pair */
+	list_for_each_entry(prq, &mqrq->packed_list, queuelist) {
+		packed_cmd_hdr[i * 2] = cpu_to_le32(blk_rq_sectors(prq));
+		packed_cmd_hdr[i * 2 + 1] = cpu_to_le32(mmc_card_blockaddr(card) ?
+				blk_rq_pos(prq) : blk_rq_pos(prq) << 9);
+		mqrq->packed_blocks += blk_rq_sectors(prq);
+		i++;
+	}
+
+	memset(brq, 0, sizeof(struct mmc_blk_request));
+	brq->mrq.cmd = &brq->cmd;
+	brq->mrq.data = &brq->data;
+	brq->mrq.sbc = &brq->sbc;
+	brq->mrq.stop = &brq->stop;
+
+	brq->sbc.opcode = MMC_SET_BLOCK_COUNT;
+	brq->sbc.arg = MMC_CMD23_ARG_PACKED | (mqrq->packed_blocks + 1);
+	brq->sbc.flags = MMC_RSP_R1 | MMC_CMD_AC;
+
+	brq->cmd.opcode = MMC_WRITE_MULTIPLE_BLOCK;
+	brq->cmd.arg = blk_rq_pos(req);
+	if (!mmc_card_blockaddr(card))
+		brq->cmd.arg <<= 9;
+	brq->cmd.flags = MMC_RSP_SPI_R1 | MMC_RSP_R1 | MMC_CMD_ADTC;
+
+	brq->data.blksz = 512;
+	brq->data.blocks = mqrq->packed_blocks + 1;
+	brq->data.flags |= MMC_DATA_WRITE;
+
+	brq->stop.opcode = MMC_STOP_TRANSMISSION;
+	brq->stop.arg = 0;
+	brq->stop.flags = MMC_RSP_SPI_R1B | MMC_RSP_R1B | MMC_CMD_AC;
+
+	mmc_set_data_timeout(&brq->data, card);
+
+	brq->data.sg = mqrq->sg;
+	brq->data.sg_len = mmc_queue_map_sg(mq, mqrq);
+
+	mqrq->mmc_active.mrq = &brq->mrq;
+	mqrq->mmc_active.err_check = mmc_blk_packed_err_check;
+	mqrq->start = ktime_get();
+
+	mmc_queue_bounce_pre(mqrq);
+}
+
+static void mmc_blk_prep_rq(struct mmc_queue_req *mqrq,
+			    struct mmc_card *card,
+			    int disable_multi,
+			    struct mmc_queue *mq)
+{
+	if (mqrq->packed_cmd != MMC_PACKED_NONE)
+		mmc_blk_packed_hdr_wrq_prep(mqrq, card, mq);
+	else
+		mmc_blk_rw_rq_prep(mqrq, card, disable_multi, mq);
+}
+
+/*
+ * Complete the requests of a pack ahead of the one the card reported
+ * as failed.  Returns 1 if there is something left to resend; a single
+ * leftover request is resent unpacked.
+ */
+static int mmc_blk_end_packed_req(struct mmc_blk_data *md,
+				  struct mmc_queue_req *mq_rq)
+{
+	struct request *prq;
+	int idx = mq_rq->packed_fail_idx, i = 0;
+
+	while (!list_empty(&mq_rq->packed_list)) {
+		prq = list_entry_rq(mq_rq->packed_list.next);
+		if (i == idx) {
+			mq_rq->req = prq;
+			mq_rq->packed_num -= idx;
+			if (mq_rq->packed_num == 1) {
+				list_del_init(&prq->queuelist);
+				mmc_blk_clear_packed(mq_rq);
 			}
+			return 1;
 		}
 
-		if (brq.data.error) {
-			pr_err("%s: error %d transferring data, sector %u, nr %u, cmd response %#x, card status %#x\n",
-				req->rq_disk->disk_name, brq.data.error,
-				(unsigned)blk_rq_pos(req),
-				(unsigned)blk_rq_sectors(req),
-				brq.cmd.resp[0], brq.stop.resp[0]);
-			if (reinit_retry) {
-				reinit_retry = 0;
-				err = get_card_status(card, &status, 0);
-				if (err)
-					pr_info("%s: error %d sending status command\n",
-						req->rq_disk->disk_name, err);
-				else
-					pr_info("%s: card status %#x \n", req->rq_disk->disk_name, status);
-				pr_info("%s: reinit card\n", mmc_hostname(card->host));
-				if (mmc_reinit_card(card->host) == 0) {
-					mmc_blk_set_blksize(md, card);
-					continue;
-				}
-			}
+		list_del_init(&prq->queuelist);
+		spin_lock_irq(&md->lock);
+		__blk_end_request(prq, 0, blk_rq_bytes(prq));
+		spin_unlock_irq(&md->lock);
+		i++;
+	}
 
-			if (rq_data_dir(req) == READ) {
-				if (brq.data.blocks > 1) {
-					/* Redo read one sector at a time */
-					pr_warning("%s: retrying using single block read\n",
-						req->rq_disk->disk_name);
-					disable_multi = 1;
-					continue;
-				}
+	mmc_blk_clear_packed(mq_rq);
+	return 0;
+}
+
+static void mmc_blk_abort_packed_req(struct mmc_blk_data *md,
+				     struct mmc_queue_req *mq_rq)
+{
+	struct request *prq;
 
+	spin_lock_irq(&md->lock);
+	while (!list_empty(&mq_rq->packed_list)) {
+		prq = list_entry_rq(mq_rq->packed_list.next);
+		list_del_init(&prq->queuelist);
+		if (mmc_card_removed(md->queue.card))
+			prq->cmd_flags |= REQ_QUIET;
+		__blk_end_request(prq, -EIO, blk_rq_bytes(prq));
+	}
+	spin_unlock_irq(&md->lock);
+
+	mmc_blk_clear_packed(mq_rq);
+}
+
+/*
+ * Start @rqc (which may be NULL) and then finish whatever the host was
+ * busy with before.  The previous request is retried or ended here.
+ */
+static int mmc_blk_issue_rw_rq(struct mmc_queue *mq, struct request *rqc)
+{
+	struct mmc_blk_data *md = mq->data;
+	struct mmc_card *card = md->queue.card;
+	struct mmc_blk_request *brq = &mq->mqrq_cur->brq;
+	int ret = 1, disable_multi = 0, retry = 0;
+	enum mmc_blk_status status;
+	struct mmc_queue_req *mq_rq;
+	struct request *req = rqc;
+	struct mmc_async_req *areq;
+	u8 reqs = 0;
+
+	if (!rqc && !mq->mqrq_prev->req)
+		return 0;
+
+	if (rqc) {
+		mq->mqrq_cur->reinit_retry = 1;
+		reqs = mmc_blk_prep_packed_list(mq, rqc);
+
+		mq->stats.rw_reqs++;
+		if (card->host->areq)
+			mq->stats.async_reqs++;
+		if (reqs) {
+			mq->stats.packed_cmds++;
+			mq->stats.packed_reqs += reqs;
+		}
+	}
+
+	do {
+		if (rqc) {
+			mmc_blk_prep_rq(mq->mqrq_cur, card, 0, mq);
+			areq = &mq->mqrq_cur->mmc_active;
+		} else
+			areq = NULL;
+		areq = mmc_start_req(card->host, areq, (int *) &status);
+		if (!areq)
+			return 0;
+
+		mq_rq = container_of(areq, struct mmc_queue_req, mmc_active);
+		brq = &mq_rq->brq;
+		req = mq_rq->req;
+		mmc_queue_bounce_post(mq_rq);
+
+		if (mq_rq->packed_cmd != MMC_PACKED_NONE &&
+		    status != MMC_BLK_SUCCESS)
+			mq->stats.packed_fails++;
+
+		/* a card that does not come back is handled as usual */
+		if (status == MMC_BLK_REINIT && mmc_blk_reinit(md, mq_rq))
+			status = areq->err_check(card, areq);
+
+		switch (status) {
+		case MMC_BLK_SUCCESS:
+		case MMC_BLK_PARTIAL:
+			if (mq_rq->packed_cmd != MMC_PACKED_NONE) {
+				ret = mmc_blk_end_packed_req(md, mq_rq);
+				req = mq_rq->req;
+				break;
+			}
+
+			/*
+			 * A block was successfully transferred.
+			 */
+			spin_lock_irq(&md->lock);
+			ret = __blk_end_request(req, 0,
+						brq->data.bytes_xfered);
+			spin_unlock_irq(&md->lock);
+			if (status == MMC_BLK_SUCCESS && ret) {
 				/*
-				 * After an error, we redo I/O one sector at a
-				 * time, so we only reach here after trying to
-				 * read a single sector.
+				 * The blk_end_request has returned non zero
+				 * even though all data is transfered and no
+				 * erros returned by host.
+				 * If this happen it's a bug.
 				 */
-				spin_lock_irq(&md->lock);
-				ret = __blk_end_request(req, -EIO, brq.data.blksz);
-				spin_unlock_irq(&md->lock);
-				continue;
-			} else {
-				goto cmd_err;
+				printk(KERN_ERR "%s BUG rq_tot %d d_xfer %d\n",
+				       __func__, blk_rq_bytes(req),
+				       brq->data.bytes_xfered);
+				rqc = NULL;
+				goto cmd_abort;
+			}
+			break;
+		case MMC_BLK_REINIT:
+			break;
+		case MMC_BLK_CMD_ERR:
+			if (mq_rq->packed_cmd != MMC_PACKED_NONE)
+				goto cmd_abort;
+			goto cmd_err;
+		case MMC_BLK_RETRY:
+			if (retry++ < 5)
+				break;
+		case MMC_BLK_ABORT:
+			goto cmd_abort;
+		case MMC_BLK_DATA_ERR:
+			if (brq->data.blocks > 1) {
+				/* Redo read one sector at a time */
+				pr_warning("%s: retrying using single block read\n",
+					   req->rq_disk->disk_name);
+				disable_multi = 1;
+				break;
 			}
+			/*
+			 * After an error, we redo I/O one sector at a
+			 * time, so we only reach here after trying to
+			 * read a single sector.
+			 */
+			spin_lock_irq(&md->lock);
+			ret = __blk_end_request(req, -EIO,
+						brq->data.blksz);
+			spin_unlock_irq(&md->lock);
+			break;
 		}
 
-		/*
-		 * A block was successfully transferred.
-		 */
-		spin_lock_irq(&md->lock);
-		ret = __blk_end_request(req, 0, brq.data.bytes_xfered);
-		spin_unlock_irq(&md->lock);
+		/* the new request was held back while this one failed */
+		if (!ret && status != MMC_BLK_SUCCESS)
+			goto start_new_req;
+
+		if (ret && mq_rq->packed_cmd != MMC_PACKED_NONE &&
+		    !mq_rq->packed_retries)
+			goto cmd_abort;
+
+		if (ret) {
+			/*
+			 * In case of a none complete request
+			 * prepare it again and resend.
+			 */
+			mmc_blk_prep_rq(mq_rq, card, disable_multi, mq);
+			mmc_start_req(card->host, &mq_rq->mmc_active, NULL);
+		}
 	} while (ret);
 
 	return 1;
@@ -1567,17 +2054,27 @@ static int mmc_blk_issue_rw_rq(struct mmc_queue *mq, struct request *req)
 		}
 	} else {
 		spin_lock_irq(&md->lock);
-		ret = __blk_end_request(req, 0, brq.data.bytes_xfered);
+		ret = __blk_end_request(req, 0, brq->data.bytes_xfered);
 		spin_unlock_irq(&md->lock);
 	}
 
  cmd_abort:
-	spin_lock_irq(&md->lock);
-	if (mmc_card_removed(card))
-		req->cmd_flags |= REQ_QUIET;
-	while (ret)
-		ret = __blk_end_request(req, -EIO, blk_rq_cur_bytes(req));
-	spin_unlock_irq(&md->lock);
+	if (mq_rq->packed_cmd != MMC_PACKED_NONE) {
+		mmc_blk_abort_packed_req(md, mq_rq);
+	} else {
+		spin_lock_irq(&md->lock);
+		if (mmc_card_removed(card))
+			req->cmd_flags |= REQ_QUIET;
+		while (ret)
+			ret = __blk_end_request(req, -EIO, blk_rq_cur_bytes(req));
+		spin_unlock_irq(&md->lock);
+	}
+
+ start_new_req:
+	if (rqc) {
+		mmc_blk_prep_rq(mq->mqrq_cur, card, 0, mq);
+		mmc_start_req(card->host, &mq->mqrq_cur->mmc_active, NULL);
+	}
 
 	return 0;
 }
@@ -1700,10 +2197,21 @@ static int mmc_blk_issue_rq(struct mmc_queue *mq, struct request *req)
 	int ret;
 	struct mmc_blk_data *md = mq->data;
 	struct mmc_card *card = md->queue.card;
-
 #ifdef CONFIG_MMC_BLOCK_DEFERRED_RESUME
 	int err = 0, card_no_ready = 0;
 	int retries = 3;
+#endif
+
+	if (req && !mq->mqrq_prev->req) {
+		/* claim host only for the first request */
+		mmc_claim_host(card->host);
+		if (mmc_card_doing_bkops(card))
+			mmc_stop_bkops(card);
+	}
+
+#ifdef CONFIG_MMC_BLOCK_DEFERRED_RESUME
+	if (!req)
+		goto resumed;
 	mmc_claim_host(card->host);
 	if (mmc_bus_needs_resume(card->host)) {
 #if 0
@@ -1730,7 +2238,8 @@ static int mmc_blk_issue_rq(struct mmc_queue *mq, struct request *req)
 			__blk_end_request_all(req, -EIO);
 			spin_unlock_irq(&md->lock);
 			mmc_release_host(card->host);
-			return 0;
+			ret = 0;
+			goto out;
 		}
 		retries = 3;
 		mmc_blk_set_blksize(md, card);
@@ -1781,30 +2290,47 @@ static int mmc_blk_issue_rq(struct mmc_queue *mq, struct request *req)
 		__blk_end_request_all(req, -EIO);
 		spin_unlock_irq(&md->lock);
 		mmc_release_host(card->host);
-		return 0;
+		ret = 0;
+		goto out;
 	} else
 		mmc_release_host(card->host);
+resumed:
 #endif
 
-	mmc_claim_host(card->host);
 	ret = mmc_blk_part_switch(card, md);
 	if (ret) {
+		if (req) {
+			/* complete ongoing async transfer first */
+			if (card->host->areq)
+				mmc_blk_issue_rw_rq(mq, NULL);
+			spin_lock_irq(&md->lock);
+			__blk_end_request_all(req, -EIO);
+			spin_unlock_irq(&md->lock);
+		}
 		ret = 0;
 		goto out;
 	}
 
-	if (req->cmd_flags & REQ_DISCARD) {
+	if (req && req->cmd_flags & REQ_DISCARD) {
+		/* complete ongoing async transfer before issuing discard */
+		if (card->host->areq)
+			mmc_blk_issue_rw_rq(mq, NULL);
 		if (req->cmd_flags & REQ_SECURE)
 			ret = mmc_blk_issue_secdiscard_rq(mq, req);
 		else
 			ret = mmc_blk_issue_discard_rq(mq, req);
-	} else if (req->cmd_flags & REQ_FLUSH)
+	} else if (req && req->cmd_flags & REQ_FLUSH) {
+		/* complete ongoing async transfer before issuing flush */
+		if (card->host->areq)
+			mmc_blk_issue_rw_rq(mq, NULL);
 		ret = mmc_blk_issue_flush(mq, req);
-	else
+	} else
 		ret = mmc_blk_issue_rw_rq(mq, req);
 
 out:
-	mmc_release_host(card->host);
+	if (!req)
+		/* release host only when there are no more requests */
+		mmc_release_host(card->host);
 	return ret;
 }
 
@@ -1914,8 +2440,18 @@ static struct mmc_blk_data *mmc_blk_alloc_req(struct mmc_card *card,
 	     card->ext_csd.rel_sectors)) {
 		md->flags |= MMC_BLK_REL_WR;
 		blk_queue_flush(md->queue.queue, REQ_FLUSH | REQ_FUA);
+	} else if (card->ext_csd.cache_ctrl) {
+		blk_queue_flush(md->queue.queue, REQ_FLUSH);
 	}
 
+	/* packed writes are bounded with CMD23, the host has to opt in */
+	if (mmc_card_mmc(card) &&
+	    md->flags & MMC_BLK_CMD23 &&
+	    !(card->quirks & MMC_QUIRK_BLK_NO_CMD23) &&
+	    card->ext_csd.packed_event_en &&
+	    card->host->caps2 & MMC_CAP2_PACKED_WR)
+		md->flags |= MMC_BLK_PACKED_WR;
+
 	return md;
 
  err_putdisk:
@@ -2017,9 +2553,76 @@ mmc_blk_set_blksize(struct mmc_blk_data *md, struct mmc_card *card)
 	return 0;
 }
 
+#ifdef CONFIG_DEBUG_FS
+static int mmc_blk_stats_show(struct seq_file *s, void *data)
+{
+	struct mmc_blk_data *md = s->private;
+	struct mmc_queue_stats *stats = &md->queue.stats;
+
+	seq_printf(s, "rw_reqs:\t\t%lu\n", stats->rw_reqs);
+	seq_printf(s, "async_reqs:\t\t%lu\n", stats->async_reqs);
+	seq_printf(s, "packed_cmds:\t\t%lu\n", stats->packed_cmds);
+	seq_printf(s, "packed_reqs:\t\t%lu\n", stats->packed_reqs);
+	seq_printf(s, "packed_fails:\t\t%lu\n", stats->packed_fails);
+	seq_printf(s, "pack_stop_empty:\t%lu\n",
+		   stats->pack_stop[MMC_PACK_STOP_EMPTY]);
+	seq_printf(s, "pack_stop_dir:\t\t%lu\n",
+		   stats->pack_stop[MMC_PACK_STOP_DIR]);
+	seq_printf(s, "pack_stop_flags:\t%lu\n",
+		   stats->pack_stop[MMC_PACK_STOP_FLAGS]);
+	seq_printf(s, "pack_stop_size:\t\t%lu\n",
+		   stats->pack_stop[MMC_PACK_STOP_SIZE]);
+	seq_printf(s, "pack_stop_segs:\t\t%lu\n",
+		   stats->pack_stop[MMC_PACK_STOP_SEGS]);
+	seq_printf(s, "pack_stop_num:\t\t%lu\n",
+		   stats->pack_stop[MMC_PACK_STOP_NUM]);
+
+	return 0;
+}
+
+static int mmc_blk_stats_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, mmc_blk_stats_show, inode->i_private);
+}
+
+static const struct file_operations mmc_blk_stats_fops = {
+	.open		= mmc_blk_stats_open,
+	.read		= seq_read,
+	.llseek		= seq_lseek,
+	.release	= single_release,
+};
+
+static void mmc_blk_add_debugfs(struct mmc_blk_data *md)
+{
+	struct mmc_card *card = md->queue.card;
+
+	if (!card->debugfs_root)
+		return;
+
+	md->stats_dentry = debugfs_create_file(md->disk->disk_name, S_IRUSR,
+					       card->debugfs_root, md,
+					       &mmc_blk_stats_fops);
+}
+
+static void mmc_blk_remove_debugfs(struct mmc_blk_data *md)
+{
+	debugfs_remove(md->stats_dentry);
+	md->stats_dentry = NULL;
+}
+#else
+static inline void mmc_blk_add_debugfs(struct mmc_blk_data *md)
+{
+}
+
+static inline void mmc_blk_remove_debugfs(struct mmc_blk_data *md)
+{
+}
+#endif
+
 static void mmc_blk_remove_req(struct mmc_blk_data *md)
 {
 	if (md) {
+		mmc_blk_remove_debugfs(md);
 		if (md->disk->flags & GENHD_FL_UP) {
 			device_remove_file(disk_to_dev(md->disk), &md->force_ro);
 
@@ -2058,10 +2661,13 @@ static int mmc_add_disk(struct mmc_blk_data *md)
 	md->force_ro.attr.name = "force_ro";
 	md->force_ro.attr.mode = S_IRUGO | S_IWUSR;
 	ret = device_create_file(disk_to_dev(md->disk), &md->force_ro);
-	if (ret)
+	if (ret) {
 		del_gendisk(md->disk);
+		return ret;
+	}
 
-	return ret;
+	mmc_blk_add_debugfs(md);
+	return 0;
 }
 
 static const struct mmc_fixup blk_fixups[] =
@@ -18,6 +18,8 @@
 #include <linux/scatterlist.h>
 #include <linux/swap.h>		/* For nr_free_buffer_pages() */
 #include <linux/list.h>
+#include <linux/ktime.h>
+#include <linux/math64.h>
 
 #include <linux/debugfs.h>
 #include <linux/uaccess.h>
@@ -37,6 +39,23 @@
  */
 #define TEST_AREA_MAX_SIZE (128 * 1024 * 1024)
 
+/*
+ * Benchmark latencies are kept in a log-linear histogram: values below
+ * 2^BENCH_LAT_EXACT_SHIFT us get a bucket each, above that every power of two
+ * is split into 2^BENCH_LAT_SUB_SHIFT buckets, i.e. about 6% resolution.
+ */
+#define BENCH_LAT_EXACT_SHIFT	5
+#define BENCH_LAT_SUB_SHIFT	4
+#define BENCH_LAT_EXACT		(1 << BENCH_LAT_EXACT_SHIFT)
+#define BENCH_LAT_SUB		(1 << BENCH_LAT_SUB_SHIFT)
+#define BENCH_LAT_BUCKETS	(BENCH_LAT_EXACT + \
+				 (32 - BENCH_LAT_EXACT_SHIFT) * BENCH_LAT_SUB)
+
+#define BENCH_MAX_TIME		3600	/* seconds */
+#define BENCH_READ		0
+#define BENCH_WRITE		1
+#define BENCH_TOTAL		2
+
 /**
  * struct mmc_test_pages - pages allocated by 'alloc_pages()'.
  * @page: first page in the allocation
@@ -127,6 +146,62 @@ struct mmc_test_dbgfs_file {
 	struct dentry *file;
 };
 
+/**
+ * struct mmc_test_bench_params - parameters of a benchmark run.
+ * @bs: transfer size (in bytes)
+ * @depth: number of requests kept in flight (1 or 2)
+ * @read_pct: percentage of transfers that are reads
+ * @random: random instead of sequential addresses
+ * @time: run time (in seconds)
+ * @span: size of the region transfers are spread over (in MiB, 0 = default)
+ * @count: stop after this many transfers (0 = only stop on @time)
+ */
+struct mmc_test_bench_params {
+	unsigned int bs;
+	unsigned int depth;
+	unsigned int read_pct;
+	unsigned int random;
+	unsigned int time;
+	unsigned int span;
+	unsigned int count;
+};
+
+/**
+ * struct mmc_test_bench_lat - completed transfers of one direction.
+ * @cnt: number of transfers
+ * @bytes: bytes transferred
+ * @sum_us: sum of all latencies (in us)
+ * @min_us: lowest latency (in us)
+ * @max_us: highest latency (in us)
+ * @hist: latency histogram, see mmc_test_bench_bucket()
+ */
+struct mmc_test_bench_lat {
+	unsigned int cnt;
+	uint64_t bytes;
+	uint64_t sum_us;
+	unsigned int min_us;
+	unsigned int max_us;
+	unsigned int hist[BENCH_LAT_BUCKETS];
+};
+
+/**
+ * struct mmc_test_bench_result - results of a benchmark run.
+ * @link: double-linked list
+ * @card: card under test
+ * @p: parameters of the run
+ * @result: 0 or the error that ended the run
+ * @elapsed_us: time from first submission to last completion (in us)
+ * @lat: reads, writes and both together
+ */
+struct mmc_test_bench_result {
+	struct list_head link;
+	struct mmc_card *card;
+	struct mmc_test_bench_params p;
+	int result;
+	uint64_t elapsed_us;
+	struct mmc_test_bench_lat lat[3];
+};
+
 /**
  * struct mmc_test_card - test information.
  * @card: card under test
@@ -2445,7 +2520,519 @@ static const struct file_operations mmc_test_fops_test = {
 	.release	= single_release,
 };
 
-static void mmc_test_free_file_test(struct mmc_card *card)
+/*******************************************************************/
+/*  Benchmark                                                      */
+/*******************************************************************/
+
+/*
+ * Writing "key=value" pairs to the "bench" file runs one benchmark on the
+ * card, e.g.
+ *
+ *	echo "bs=4096 depth=2 read=70 pattern=random time=30" > bench
+ *
+ * Keys not given keep their default (bs=4096 depth=2 read=100 pattern=seq
+ * time=10 span=0 count=0).  Transfers are spread over span MiB starting at a
+ * quarter of the card, the default span being a quarter of the card.  The
+ * address and read/write sequence is the same on every run.  Anything but a
+ * pure read run overwrites what is on the card.
+ *
+ * Reading the file gives the last run, in a format that only ever gets new
+ * keys appended:
+ *
+ *	bench result=<err> elapsed_us=<us>
+ *	params bs=.. depth=.. read=.. pattern=seq|random time=.. span=.. count=..
+ *	read ops=.. bytes=.. rate=<B/s> mb_s=<MB/s> iops=.. min_us=.. avg_us=..
+ *	     p50_us=.. p90_us=.. p99_us=.. p999_us=.. max_us=..
+ *	write <as read>
+ *	total <as read>
+ *
+ * where each of the last three is a single line.  Latency is measured from
+ * submission to completion, including the wait for the card to leave the
+ * busy state, so with depth=2 it also counts the time a request is queued
+ * behind the one in flight.  Percentiles are the upper bound of their
+ * histogram bucket.
+ */
+
+static LIST_HEAD(mmc_test_bench_result);
+
+/**
+ * struct mmc_test_bench_req - one benchmark request slot.
+ * @mrq: request
+ * @cmd: command
+ * @stop: stop command
+ * @data: data
+ * @areq: async request handed to mmc_start_req()
+ * @test: test information
+ * @mem: memory the transfer is done from or to
+ * @sg: scatterlist mapping @mem
+ * @sg_len: length of @sg
+ * @write: direction of the request
+ * @start: time the request was submitted
+ */
+struct mmc_test_bench_req {
+	struct mmc_request mrq;
+	struct mmc_command cmd;
+	struct mmc_command stop;
+	struct mmc_data data;
+	struct mmc_async_req areq;
+	struct mmc_test_card *test;
+	struct mmc_test_mem *mem;
+	struct scatterlist *sg;
+	unsigned int sg_len;
+	int write;
+	ktime_t start;
+};
+
+static unsigned int mmc_test_bench_bucket(unsigned int us)
+{
+	unsigned int msb;
+
+	if (us < BENCH_LAT_EXACT)
+		return us;
+
+	msb = fls(us) - 1;
+	return BENCH_LAT_EXACT + (msb - BENCH_LAT_EXACT_SHIFT) * BENCH_LAT_SUB +
+	       ((us >> (msb - BENCH_LAT_SUB_SHIFT)) & (BENCH_LAT_SUB - 1));
+}
+
+/*
+ * Highest latency that falls into bucket idx.
+ */
+static unsigned int mmc_test_bench_bucket_max(unsigned int idx)
+{
+	unsigned int shift, sub;
+
+	if (idx < BENCH_LAT_EXACT)
+		return idx;
+
+	idx -= BENCH_LAT_EXACT;
+	shift = idx / BENCH_LAT_SUB + BENCH_LAT_EXACT_SHIFT -
+		BENCH_LAT_SUB_SHIFT;
+	sub = idx % BENCH_LAT_SUB;
+	return ((BENCH_LAT_SUB + sub) << shift) + (1U << shift) - 1;
+}
+
+static void mmc_test_bench_lat_add(struct mmc_test_bench_lat *lat,
+				   unsigned int us, unsigned int bytes)
+{
+	if (!lat->cnt || us < lat->min_us)
+		lat->min_us = us;
+	if (us > lat->max_us)
+		lat->max_us = us;
+	lat->cnt += 1;
+	lat->bytes += bytes;
+	lat->sum_us += us;
+	lat->hist[mmc_test_bench_bucket(us)] += 1;
+}
+
+/*
+ * Latency below which permille thousandths of the transfers completed.
+ */
+static unsigned int mmc_test_bench_pct(struct mmc_test_bench_lat *lat,
+				       unsigned int permille)
+{
+	uint64_t target = (uint64_t)lat->cnt * permille + 999;
+	unsigned int i, seen = 0;
+
+	if (!lat->cnt)
+		return 0;
+
+	do_div(target, 1000);
+	for (i = 0; i < BENCH_LAT_BUCKETS - 1; i++) {
+		seen += lat->hist[i];
+		if (seen >= target)
+			break;
+	}
+
+	return min(mmc_test_bench_bucket_max(i), lat->max_us);
+}
+
+/*
+ * mmc_test_rnd_num() only has 15 bits of randomness, which is too coarse for
+ * a region of a few GiB, so combine two of them.
+ */
+static unsigned int mmc_test_bench_rnd(unsigned int rnd_cnt)
+{
+	uint64_t r;
+
+	r = mmc_test_rnd_num(1 << 15);
+	r = (r << 15) | mmc_test_rnd_num(1 << 15);
+	return (r * rnd_cnt) >> 30;
+}
+
+static int mmc_test_bench_err_check(struct mmc_card *card,
+				    struct mmc_async_req *areq)
+{
+	struct mmc_test_bench_req *br =
+		container_of(areq, struct mmc_test_bench_req, areq);
+
+	mmc_test_wait_busy(br->test);
+
+	return mmc_test_check_result(br->test, &br->mrq);
+}
+
+static void mmc_test_bench_prep(struct mmc_test_bench_req *br,
+				unsigned int dev_addr, unsigned int blocks,
+				int write)
+{
+	memset(&br->mrq, 0, sizeof(struct mmc_request));
+	memset(&br->cmd, 0, sizeof(struct mmc_command));
+	memset(&br->stop, 0, sizeof(struct mmc_command));
+	memset(&br->data, 0, sizeof(struct mmc_data));
+
+	br->mrq.cmd = &br->cmd;
+	br->mrq.data = &br->data;
+	br->mrq.stop = &br->stop;
+	br->write = write;
+
+	mmc_test_prepare_mrq(br->test, &br->mrq, br->sg, br->sg_len, dev_addr,
+			     blocks, 512, write);
+}
+
+static void mmc_test_bench_done(struct mmc_test_bench_result *res,
+				struct mmc_async_req *areq, ktime_t now)
+{
+	struct mmc_test_bench_req *br =
+		container_of(areq, struct mmc_test_bench_req, areq);
+	unsigned int us = ktime_us_delta(now, br->start);
+
+	mmc_test_bench_lat_add(&res->lat[br->write ? BENCH_WRITE : BENCH_READ],
+			       us, res->p.bs);
+	mmc_test_bench_lat_add(&res->lat[BENCH_TOTAL], us, res->p.bs);
+}
+
+static void mmc_test_bench_free_reqs(struct mmc_test_bench_req *brq)
+{
+	int i;
+
+	for (i = 0; i < 2; i++) {
+		kfree(brq[i].sg);
+		mmc_test_free_mem(brq[i].mem);
+	}
+	kfree(brq);
+}
+
+/*
+ * Run the benchmark described by res->p and fill in the rest of res.  With
+ * depth=2 the next request is prepared (and pre_req'd by the host) while the
+ * previous one is on the bus, the same way the block driver drives the card.
+ */
+static int mmc_test_bench_run(struct mmc_test_card *test,
+			      struct mmc_test_bench_result *res)
+{
+	struct mmc_test_bench_params *p = &res->p;
+	struct mmc_host *host = test->card->host;
+	struct mmc_test_bench_req *brq, *cur;
+	struct mmc_async_req *areq;
+	unsigned int ssz = p->bs >> 9, base, nblk, max_nblk, idx;
+	unsigned int ops = 0, seq = 0, slot = 0;
+	ktime_t start, end, now, last;
+	int i, ret, err = 0, stop = 0;
+
+	brq = kzalloc(sizeof(struct mmc_test_bench_req) * 2, GFP_KERNEL);
+	if (!brq)
+		return -ENOMEM;
+
+	for (i = 0; i < p->depth; i++) {
+		brq[i].test = test;
+		brq[i].areq.mrq = &brq[i].mrq;
+		brq[i].areq.err_check = mmc_test_bench_err_check;
+		brq[i].mem = mmc_test_alloc_mem(p->bs, p->bs, host->max_segs,
+						host->max_seg_size);
+		brq[i].sg = kmalloc(sizeof(struct scatterlist) *
+				    host->max_segs, GFP_KERNEL);
+		if (!brq[i].mem || !brq[i].sg) {
+			ret = -ENOMEM;
+			goto out_free;
+		}
+		ret = mmc_test_map_sg(brq[i].mem, p->bs, brq[i].sg, 1,
+				      host->max_segs, host->max_seg_size,
+				      &brq[i].sg_len);
+		if (ret)
+			goto out_free;
+	}
+
+	base = mmc_test_capacity(test->card) / 4;
+	base -= base % ssz;
+	max_nblk = (mmc_test_capacity(test->card) - base) / ssz;
+	if (p->span)
+		nblk = min_t(uint64_t, div_u64((uint64_t)p->span << 11, ssz),
+			     max_nblk);
+	else
+		nblk = base / ssz;
+	if (!nblk) {
+		ret = RESULT_UNSUP_CARD;
+		goto out_free;
+	}
+
+	/* Same addresses and read/write mix on every run */
+	rnd_next = 1;
+
+	mmc_claim_host(host);
+
+	ret = mmc_test_set_blksize(test, 512);
+	if (ret)
+		goto out_release;
+
+	start = last = ktime_get();
+	end = ktime_add_ns(start, (u64)p->time * NSEC_PER_SEC);
+	do {
+		cur = NULL;
+		if (!stop) {
+			cur = &brq[slot];
+			slot = (slot + 1) % p->depth;
+
+			if (p->random) {
+				idx = mmc_test_bench_rnd(nblk);
+			} else {
+				idx = seq++;
+				if (seq == nblk)
+					seq = 0;
+			}
+			mmc_test_bench_prep(cur, base + idx * ssz, ssz,
+					    mmc_test_rnd_num(100) >= p->read_pct);
+			cur->start = ktime_get();
+		}
+
+		areq = mmc_start_req(host, cur ? &cur->areq : NULL, &err);
+		if (err)
+			break;
+		if (areq) {
+			last = ktime_get();
+			mmc_test_bench_done(res, areq, last);
+		}
+
+		if (cur && p->depth == 1) {
+			areq = mmc_start_req(host, NULL, &err);
+			if (err)
+				break;
+			last = ktime_get();
+			mmc_test_bench_done(res, areq, last);
+		}
+
+		if (cur) {
+			ops += 1;
+			now = ktime_get();
+			stop = (p->count && ops >= p->count) ||
+			       ktime_to_ns(now) >= ktime_to_ns(end);
+		}
+	} while (cur);
+
+	res->elapsed_us = ktime_us_delta(last, start);
+	ret = err;
+
+out_release:
+	mmc_release_host(host);
+out_free:
+	mmc_test_bench_free_reqs(brq);
+	return ret;
+}
+
+static void mmc_test_bench_show_lat(struct seq_file *sf, const char *name,
+				    struct mmc_test_bench_lat *lat,
+				    uint64_t elapsed_us)
+{
+	unsigned int rate = 0, iops = 0;
+	uint64_t avg = 0;
+
+	if (elapsed_us) {
+		rate = div64_u64(lat->bytes * USEC_PER_SEC, elapsed_us);
+		iops = div64_u64((uint64_t)lat->cnt * 100 * USEC_PER_SEC,
+				 elapsed_us); /* I/O ops per sec x 100 */
+	}
+	if (lat->cnt)
+		avg = div_u64(lat->sum_us, lat->cnt);
+
+	seq_printf(sf, "%s ops=%u bytes=%llu rate=%u mb_s=%u.%02u "
+		   "iops=%u.%02u min_us=%u avg_us=%llu p50_us=%u "
+		   "p90_us=%u p99_us=%u p999_us=%u max_us=%u\n",
+		   name, lat->cnt, (unsigned long long)lat->bytes, rate,
+		   rate / 1000000, (rate / 10000) % 100, iops / 100, iops % 100,
+		   lat->min_us, (unsigned long long)avg,
+		   mmc_test_bench_pct(lat, 500), mmc_test_bench_pct(lat, 900),
+		   mmc_test_bench_pct(lat, 990), mmc_test_bench_pct(lat, 999),
+		   lat->max_us);
+}
+
+static void mmc_test_free_bench_result(struct mmc_card *card)
+{
+	struct mmc_test_bench_result *res, *ress;
+
+	mutex_lock(&mmc_test_lock);
+
+	list_for_each_entry_safe(res, ress, &mmc_test_bench_result, link) {
+		if (card && res->card != card)
+			continue;
+		list_del(&res->link);
+		kfree(res);
+	}
+
+	mutex_unlock(&mmc_test_lock);
+}
+
+static int mtf_bench_show(struct seq_file *sf, void *data)
+{
+	struct mmc_card *card = (struct mmc_card *)sf->private;
+	struct mmc_test_bench_result *res;
+
+	mutex_lock(&mmc_test_lock);
+
+	list_for_each_entry(res, &mmc_test_bench_result, link) {
+		if (res->card != card)
+			continue;
+
+		seq_printf(sf, "bench result=%d elapsed_us=%llu\n",
+			   res->result, (unsigned long long)res->elapsed_us);
+		seq_printf(sf, "params bs=%u depth=%u read=%u pattern=%s "
+			   "time=%u span=%u count=%u\n",
+			   res->p.bs, res->p.depth, res->p.read_pct,
+			   res->p.random ? "random" : "seq", res->p.time,
+			   res->p.span, res->p.count);
+		mmc_test_bench_show_lat(sf, "read", &res->lat[BENCH_READ],
+					res->elapsed_us);
+		mmc_test_bench_show_lat(sf, "write", &res->lat[BENCH_WRITE],
+					res->elapsed_us);
+		mmc_test_bench_show_lat(sf, "total", &res->lat[BENCH_TOTAL],
+					res->elapsed_us);
+	}
+
+	mutex_unlock(&mmc_test_lock);
+
+	return 0;
+}
+
+static int mtf_bench_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, mtf_bench_show, inode->i_private);
+}
+
+static int mmc_test_bench_parse(struct mmc_card *card, char *buf,
+				struct mmc_test_bench_params *p)
+{
+	struct mmc_host *host = card->host;
+	unsigned long val;
+	char *opt, *arg;
+
+	while ((opt = strsep(&buf, " \t\n")) != NULL) {
+		if (!*opt)
+			continue;
+
+		arg = strchr(opt, '=');
+		if (!arg)
+			return -EINVAL;
+		*arg++ = '\0';
+
+		if (!strcmp(opt, "pattern")) {
+			if (!strcmp(arg, "seq"))
+				p->random = 0;
+			else if (!strcmp(arg, "random"))
+				p->random = 1;
+			else
+				return -EINVAL;
+			continue;
+		}
+
+		if (strict_strtoul(arg, 0, &val) || val > UINT_MAX)
+			return -EINVAL;
+
+		if (!strcmp(opt, "bs"))
+			p->bs = val;
+		else if (!strcmp(opt, "depth"))
+			p->depth = val;
+		else if (!strcmp(opt, "read"))
+			p->read_pct = val;
+		else if (!strcmp(opt, "time"))
+			p->time = val;
+		else if (!strcmp(opt, "span"))
+			p->span = val;
+		else if (!strcmp(opt, "count"))
+			p->count = val;
+		else
+			return -EINVAL;
+	}
+
+	if (!p->bs || (p->bs & 511) || p->bs > host->max_req_size ||
+	    (p->bs >> 9) > host->max_blk_count ||
+	    p->bs > host->max_segs * host->max_seg_size)
+		return -EINVAL;
+	if (p->depth < 1 || p->depth > 2)
+		return -EINVAL;
+	if (p->read_pct > 100 || !p->time || p->time > BENCH_MAX_TIME)
+		return -EINVAL;
+
+	return 0;
+}
+
+static ssize_t mtf_bench_write(struct file *file, const char __user *buf,
+	size_t count, loff_t *pos)
+{
+	struct seq_file *sf = (struct seq_file *)file->private_data;
+	struct mmc_card *card = (struct mmc_card *)sf->private;
+	struct mmc_test_bench_result *res;
+	struct mmc_test_card *test;
+	char lbuf[128];
+	int ret;
+
+	if (count >= sizeof(lbuf))
+		return -EINVAL;
+
+	if (copy_from_user(lbuf, buf, count))
+		return -EFAULT;
+	lbuf[count] = '\0';
+
+	res = kzalloc(sizeof(struct mmc_test_bench_result), GFP_KERNEL);
+	if (!res)
+		return -ENOMEM;
+
+	res->card = card;
+	res->p.bs = 4096;
+	res->p.depth = 2;
+	res->p.read_pct = 100;
+	res->p.time = 10;
+
+	ret = mmc_test_bench_parse(card, lbuf, &res->p);
+	if (ret) {
+		kfree(res);
+		return ret;
+	}
+
+	test = kzalloc(sizeof(struct mmc_test_card), GFP_KERNEL);
+	if (!test) {
+		kfree(res);
+		return -ENOMEM;
+	}
+	test->card = card;
+
+	/* Only the last run is kept */
+	mmc_test_free_bench_result(card);
+
+	mutex_lock(&mmc_test_lock);
+
+	printk(KERN_INFO "%s: Starting benchmark of card %s...\n",
+		mmc_hostname(card->host), mmc_card_id(card));
+
+	res->result = mmc_test_bench_run(test, res);
+	list_add_tail(&res->link, &mmc_test_bench_result);
+
+	printk(KERN_INFO "%s: Benchmark completed (%d).\n",
+		mmc_hostname(card->host), res->result);
+
+	mutex_unlock(&mmc_test_lock);
+
+	kfree(test);
+
+	return count;
+}
+
+static const struct file_operations mmc_test_fops_bench = {
+	.open		= mtf_bench_open,
+	.read		= seq_read,
+	.write		= mtf_bench_write,
+	.llseek		= seq_lseek,
+	.release	= single_release,
+};
+
+static void mmc_test_free_dbgfs_file(struct mmc_card *card)
 {
 	struct mmc_test_dbgfs_file *df, *dfs;
 
@@ -2462,7 +3049,8 @@ static void mmc_test_free_file_test(struct mmc_card *card)
 	mutex_unlock(&mmc_test_lock);
 }
 
-static int mmc_test_register_file_test(struct mmc_card *card)
+static int __mmc_test_register_dbgfs_file(struct mmc_card *card,
+	const char *name, mode_t mode, const struct file_operations *fops)
 {
 	struct dentry *file = NULL;
 	struct mmc_test_dbgfs_file *df;
@@ -2471,8 +3059,8 @@ static int mmc_test_register_file_test(struct mmc_card *card)
 	mutex_lock(&mmc_test_lock);
 
 	if (card->debugfs_root)
-		file = debugfs_create_file("test", S_IWUSR | S_IRUGO,
-			card->debugfs_root, card, &mmc_test_fops_test);
+		file = debugfs_create_file(name, mode, card->debugfs_root,
+			card, fops);
 
 	if (IS_ERR_OR_NULL(file)) {
 		dev_err(&card->dev,
@@ -2501,6 +3089,23 @@ err:
 	return ret;
 }
 
+static int mmc_test_register_dbgfs_file(struct mmc_card *card)
+{
+	int ret;
+
+	ret = __mmc_test_register_dbgfs_file(card, "test", S_IWUSR | S_IRUGO,
+		&mmc_test_fops_test);
+	if (ret)
+		return ret;
+
+	ret = __mmc_test_register_dbgfs_file(card, "bench", S_IWUSR | S_IRUGO,
+		&mmc_test_fops_bench);
+	if (ret)
+		mmc_test_free_dbgfs_file(card);
+
+	return ret;
+}
+
 static int mmc_test_probe(struct mmc_card *card)
 {
 	int ret;
@@ -2508,7 +3113,7 @@ static int mmc_test_probe(struct mmc_card *card)
 	if (!mmc_card_mmc(card) && !mmc_card_sd(card))
 		return -ENODEV;
 
-	ret = mmc_test_register_file_test(card);
+	ret = mmc_test_register_dbgfs_file(card);
 	if (ret)
 		return ret;
 
@@ -2520,7 +3125,8 @@ static int mmc_test_probe(struct mmc_card *card)
 static void mmc_test_remove(struct mmc_card *card)
 {
 	mmc_test_free_result(card);
-	mmc_test_free_file_test(card);
+	mmc_test_free_bench_result(card);
+	mmc_test_free_dbgfs_file(card);
 }
 
 static struct mmc_driver mmc_driver = {
@@ -2540,7 +3146,8 @@ static void __exit mmc_test_exit(void)
 {
 	/* Clear stalled data if card is still plugged */
 	mmc_test_free_result(NULL);
-	mmc_test_free_file_test(NULL);
+	mmc_test_free_bench_result(NULL);
+	mmc_test_free_dbgfs_file(NULL);
 
 	mmc_unregister_driver(&mmc_driver);
 }
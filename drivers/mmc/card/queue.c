@@ -69,7 +69,7 @@ static int sd_queue_thread(void *d)
 		spin_lock_irq(q->queue_lock);
 		set_current_state(TASK_INTERRUPTIBLE);
 		req = blk_fetch_request(q);
-		mq->req = req;
+		mq->mqrq_cur->req = req;
 		spin_unlock_irq(q->queue_lock);
 
 		if (!req) {
@@ -127,19 +127,32 @@ static int mmc_queue_thread(void *d)
 
 	down(&mq->thread_sem);
 	do {
+		struct mmc_queue_req *tmp;
+
 		req = NULL;	/* Must be set to NULL at each iteration */
 
 		spin_lock_irq(q->queue_lock);
 		set_current_state(TASK_INTERRUPTIBLE);
 		req = blk_fetch_request(q);
-		mq->req = req;
+		mq->mqrq_cur->req = req;
 		spin_unlock_irq(q->queue_lock);
 
-		if (!req) {
+		if (!req && !mq->mqrq_prev->req) {
 			if (kthread_should_stop()) {
 				set_current_state(TASK_RUNNING);
 				break;
 			}
+			/*
+			 * The queue ran dry after writes, give the card the
+			 * chance to collect garbage now rather than in the
+			 * middle of the next write burst.
+			 */
+			if (mq->bkops_check) {
+				set_current_state(TASK_RUNNING);
+				mq->bkops_check = false;
+				mmc_start_bkops(mq->card);
+				continue;
+			}
 			up(&mq->thread_sem);
 			schedule();
 			down(&mq->thread_sem);
@@ -147,9 +160,19 @@ static int mmc_queue_thread(void *d)
 		}
 		set_current_state(TASK_RUNNING);
 
+		if (req && rq_data_dir(req) == WRITE)
+			mq->bkops_check = true;
+
+		/*
+		 * With a request still active on the host, issue_fn prepares
+		 * the new one before waiting for the old to complete.  A NULL
+		 * req just completes the active one.
+		 */
 #ifdef CONFIG_MMC_PERF_PROFILING
-		bytes_xfer = blk_rq_bytes(req);
-		if (rq_data_dir(req) == READ) {
+		if (!req) {
+			mq->issue_fn(mq, req);
+		} else if (rq_data_dir(req) == READ) {
+			bytes_xfer = blk_rq_bytes(req);
 			start = ktime_get();
 			mq->issue_fn(mq, req);
 			diff = ktime_sub(ktime_get(), start);
@@ -157,6 +180,7 @@ static int mmc_queue_thread(void *d)
 			host->perf.rtime_mmcq =
 				ktime_add(host->perf.rtime_mmcq, diff);
 		} else {
+			bytes_xfer = blk_rq_bytes(req);
 			start = ktime_get();
 			mq->issue_fn(mq, req);
 			diff = ktime_sub(ktime_get(), start);
@@ -165,8 +189,15 @@ static int mmc_queue_thread(void *d)
 				ktime_add(host->perf.wtime_mmcq, diff);
 		}
 #else
-			mq->issue_fn(mq, req);
+		mq->issue_fn(mq, req);
 #endif
+
+		/* Current request becomes previous request and vice versa. */
+		mq->mqrq_prev->brq.mrq.data = NULL;
+		mq->mqrq_prev->req = NULL;
+		tmp = mq->mqrq_prev;
+		mq->mqrq_prev = mq->mqrq_cur;
+		mq->mqrq_cur = tmp;
 	} while (1);
 	up(&mq->thread_sem);
 
@@ -192,10 +223,37 @@ static void mmc_request(struct request_queue *q)
 		return;
 	}
 
-	if (!mq->req)
+	if (!mq->mqrq_cur->req && !mq->mqrq_prev->req)
 		wake_up_process(mq->thread);
 }
 
+/*
+ * Free what mmc_init_queue() allocated for each request slot.  The sg
+ * table of an SD card is the shared sd_sg and stays.
+ */
+static void mmc_queue_free_reqs(struct mmc_queue *mq)
+{
+	struct mmc_queue_req *mqrq;
+	int i;
+
+	for (i = 0; i < ARRAY_SIZE(mq->mqrq); i++) {
+		mqrq = &mq->mqrq[i];
+
+		kfree(mqrq->bounce_sg);
+		mqrq->bounce_sg = NULL;
+
+		if (mq->card->type != MMC_TYPE_SD)
+			kfree(mqrq->sg);
+		mqrq->sg = NULL;
+
+		kfree(mqrq->bounce_buf);
+		mqrq->bounce_buf = NULL;
+
+		kfree(mqrq->packed_cmd_hdr);
+		mqrq->packed_cmd_hdr = NULL;
+	}
+}
+
 /**
  * mmc_init_queue - initialise a queue structure.
  * @mq: mmc queue
@@ -210,7 +268,10 @@ int mmc_init_queue(struct mmc_queue *mq, struct mmc_card *card,
 {
 	struct mmc_host *host = card->host;
 	u64 limit = BLK_BOUNCE_HIGH;
-	int ret;
+	struct mmc_queue_req *mqrq;
+	/* SD cards are issued one request at a time, see sd_queue_thread() */
+	int nr_mqrq = mmc_card_sd(card) ? 1 : 2;
+	int ret, i;
 
 	if (mmc_dev(host)->dma_mask && *mmc_dev(host)->dma_mask)
 		limit = *mmc_dev(host)->dma_mask;
@@ -219,8 +280,13 @@ int mmc_init_queue(struct mmc_queue *mq, struct mmc_card *card,
 	mq->queue = blk_init_queue(mmc_request, lock);
 	if (!mq->queue)
 		return -ENOMEM;
+
+	memset(&mq->mqrq, 0, sizeof(mq->mqrq));
+	for (i = 0; i < ARRAY_SIZE(mq->mqrq); i++)
+		INIT_LIST_HEAD(&mq->mqrq[i].packed_list);
+	mq->mqrq_cur = &mq->mqrq[0];
+	mq->mqrq_prev = &mq->mqrq[1];
 	mq->queue->queuedata = mq;
-	mq->req = NULL;
 
 	blk_queue_prep_rq(mq->queue, mmc_prep_request);
 	queue_flag_set_unlocked(QUEUE_FLAG_NONROT, mq->queue);
@@ -254,70 +320,95 @@ int mmc_init_queue(struct mmc_queue *mq, struct mmc_card *card,
 			bouncesz = host->max_blk_count * 512;
 
 		if (bouncesz > 512) {
-			mq->bounce_buf = kmalloc(bouncesz, GFP_KERNEL);
-			if (!mq->bounce_buf) {
-				printk(KERN_WARNING "%s: unable to "
-					"allocate bounce buffer\n",
-					mmc_card_name(card));
+			for (i = 0; i < nr_mqrq; i++) {
+				mqrq = &mq->mqrq[i];
+				mqrq->bounce_buf = kmalloc(bouncesz, GFP_KERNEL);
+				if (!mqrq->bounce_buf) {
+					printk(KERN_WARNING "%s: unable to "
+						"allocate bounce buffer\n",
+						mmc_card_name(card));
+					mmc_queue_free_reqs(mq);
+					break;
+				}
 			}
 		}
 
-		if (mq->bounce_buf) {
+		if (mq->mqrq_cur->bounce_buf) {
 			blk_queue_bounce_limit(mq->queue, BLK_BOUNCE_ANY);
 			blk_queue_max_hw_sectors(mq->queue, bouncesz / 512);
 			blk_queue_max_segments(mq->queue, bouncesz / 512);
 			blk_queue_max_segment_size(mq->queue, bouncesz);
 
-			if (mmc_card_sd(card)) {
-				if (!sd_sg) {
-					printk(KERN_INFO "[mmc] SD allocate SG memory\n");
-					sd_sg = kmalloc(sizeof(struct scatterlist), GFP_KERNEL);
+			for (i = 0; i < nr_mqrq; i++) {
+				mqrq = &mq->mqrq[i];
+				if (mmc_card_sd(card)) {
+					if (!sd_sg) {
+						printk(KERN_INFO "[mmc] SD allocate SG memory\n");
+						sd_sg = kmalloc(sizeof(struct scatterlist), GFP_KERNEL);
+					} else
+						memset(sd_sg, 0, sizeof(struct scatterlist));
+					mqrq->sg = sd_sg;
 				} else
-					memset(sd_sg, 0, sizeof(struct scatterlist));
-				mq->sg = sd_sg;
-			} else
-				mq->sg = kmalloc(sizeof(struct scatterlist),
-				GFP_KERNEL);
-			if (!mq->sg) {
-				ret = -ENOMEM;
-				goto cleanup_queue;
+					mqrq->sg = kmalloc(sizeof(struct scatterlist),
+					GFP_KERNEL);
+				if (!mqrq->sg) {
+					ret = -ENOMEM;
+					goto cleanup_queue;
+				}
+				sg_init_table(mqrq->sg, 1);
+
+				mqrq->bounce_sg = kmalloc(sizeof(struct scatterlist) *
+					bouncesz / 512, GFP_KERNEL);
+				if (!mqrq->bounce_sg) {
+					ret = -ENOMEM;
+					goto cleanup_queue;
+				}
+				sg_init_table(mqrq->bounce_sg, bouncesz / 512);
 			}
-			sg_init_table(mq->sg, 1);
-
-			mq->bounce_sg = kmalloc(sizeof(struct scatterlist) *
-				bouncesz / 512, GFP_KERNEL);
-			if (!mq->bounce_sg) {
-				ret = -ENOMEM;
-				goto cleanup_queue;
-			}
-			sg_init_table(mq->bounce_sg, bouncesz / 512);
 		}
 	}
 #endif
 
-	if (!mq->bounce_buf) {
+	if (!mq->mqrq_cur->bounce_buf) {
 		blk_queue_bounce_limit(mq->queue, limit);
 		blk_queue_max_hw_sectors(mq->queue,
 			min(host->max_blk_count, host->max_req_size / 512));
 		blk_queue_max_segments(mq->queue, host->max_segs);
 		blk_queue_max_segment_size(mq->queue, host->max_seg_size);
-		if (mmc_card_sd(card)) {
-			if (!sd_sg) {
-				printk(KERN_INFO "[mmc] SD allocate SG memory\n");
-				sd_sg = kmalloc(sizeof(struct scatterlist) *
-				host->max_segs, GFP_KERNEL);
+
+		for (i = 0; i < nr_mqrq; i++) {
+			mqrq = &mq->mqrq[i];
+			if (mmc_card_sd(card)) {
+				if (!sd_sg) {
+					printk(KERN_INFO "[mmc] SD allocate SG memory\n");
+					sd_sg = kmalloc(sizeof(struct scatterlist) *
+					host->max_segs, GFP_KERNEL);
+				} else
+					memset(sd_sg, 0, sizeof(struct scatterlist) * host->max_segs);
+				mqrq->sg = sd_sg;
 			} else
-				memset(sd_sg, 0, sizeof(struct scatterlist) * host->max_segs);
-			mq->sg = sd_sg;
-		} else
-			mq->sg = kmalloc(sizeof(struct scatterlist) *
-				host->max_segs, GFP_KERNEL);
-
-		if (!mq->sg) {
-			ret = -ENOMEM;
-			goto cleanup_queue;
+				mqrq->sg = kmalloc(sizeof(struct scatterlist) *
+					host->max_segs, GFP_KERNEL);
+
+			if (!mqrq->sg) {
+				ret = -ENOMEM;
+				goto cleanup_queue;
+			}
+			sg_init_table(mqrq->sg, host->max_segs);
+		}
+	}
+
+	/* the packed write header goes out as the first data block */
+	if (!mmc_card_sd(card) && card->ext_csd.packed_event_en) {
+		for (i = 0; i < nr_mqrq; i++) {
+			mqrq = &mq->mqrq[i];
+			mqrq->packed_cmd_hdr = kzalloc(MMC_PACKED_HDR_SIZE,
+						       GFP_KERNEL);
+			if (!mqrq->packed_cmd_hdr) {
+				ret = -ENOMEM;
+				goto cleanup_queue;
+			}
 		}
-		sg_init_table(mq->sg, host->max_segs);
 	}
 
 	sema_init(&mq->thread_sem, 1);
@@ -330,22 +421,12 @@ int mmc_init_queue(struct mmc_queue *mq, struct mmc_card *card,
 
 	if (IS_ERR(mq->thread)) {
 		ret = PTR_ERR(mq->thread);
-		goto free_bounce_sg;
+		goto cleanup_queue;
 	}
 
 	return 0;
- free_bounce_sg:
- 	if (mq->bounce_sg)
- 		kfree(mq->bounce_sg);
- 	mq->bounce_sg = NULL;
  cleanup_queue:
-	if (mq->sg && mq->card->type != MMC_TYPE_SD)
-		kfree(mq->sg);
-
-	mq->sg = NULL;
-	if (mq->bounce_buf)
-		kfree(mq->bounce_buf);
-	mq->bounce_buf = NULL;
+	mmc_queue_free_reqs(mq);
 	blk_cleanup_queue(mq->queue);
 	return ret;
 }
@@ -367,17 +448,7 @@ void mmc_cleanup_queue(struct mmc_queue *mq)
 	blk_start_queue(q);
 	spin_unlock_irqrestore(q->queue_lock, flags);
 
- 	if (mq->bounce_sg)
- 		kfree(mq->bounce_sg);
- 	mq->bounce_sg = NULL;
-	if (mq->card->type != MMC_TYPE_SD)
-		kfree(mq->sg);
-
-	mq->sg = NULL;
-
-	if (mq->bounce_buf)
-		kfree(mq->bounce_buf);
-	mq->bounce_buf = NULL;
+	mmc_queue_free_reqs(mq);
 
 	mq->card = NULL;
 }
@@ -427,30 +498,61 @@ void mmc_queue_resume(struct mmc_queue *mq)
 	}
 }
 
+/*
+ * Map the packed header and then every request of the pack into one sg
+ * list.  Packing is never used together with a bounce buffer.
+ */
+static unsigned int mmc_queue_packed_map_sg(struct mmc_queue *mq,
+					    struct mmc_queue_req *mqrq)
+{
+	struct scatterlist *sg = mqrq->sg;
+	struct scatterlist *__sg;
+	struct request *req;
+	unsigned int sg_len = 0;
+
+	sg_set_buf(sg, mqrq->packed_cmd_hdr, MMC_PACKED_HDR_SIZE);
+	sg->page_link &= ~0x02;
+	sg_len++;
+
+	__sg = sg + sg_len;
+	list_for_each_entry(req, &mqrq->packed_list, queuelist) {
+		sg_len += blk_rq_map_sg(mq->queue, req, __sg);
+		/* blk_rq_map_sg() ended the list, the next request goes on */
+		__sg = sg + (sg_len - 1);
+		(__sg++)->page_link &= ~0x02;
+	}
+	sg_mark_end(sg + (sg_len - 1));
+
+	return sg_len;
+}
+
 /*
  * Prepare the sg list(s) to be handed of to the host driver
  */
-unsigned int mmc_queue_map_sg(struct mmc_queue *mq)
+unsigned int mmc_queue_map_sg(struct mmc_queue *mq, struct mmc_queue_req *mqrq)
 {
 	unsigned int sg_len;
 	size_t buflen;
 	struct scatterlist *sg;
 	int i;
 
-	if (!mq->bounce_buf)
-		return blk_rq_map_sg(mq->queue, mq->req, mq->sg);
+	if (!mqrq->bounce_buf) {
+		if (mqrq->packed_cmd != MMC_PACKED_NONE)
+			return mmc_queue_packed_map_sg(mq, mqrq);
+		return blk_rq_map_sg(mq->queue, mqrq->req, mqrq->sg);
+	}
 
-	BUG_ON(!mq->bounce_sg);
+	BUG_ON(!mqrq->bounce_sg);
 
-	sg_len = blk_rq_map_sg(mq->queue, mq->req, mq->bounce_sg);
+	sg_len = blk_rq_map_sg(mq->queue, mqrq->req, mqrq->bounce_sg);
 
-	mq->bounce_sg_len = sg_len;
+	mqrq->bounce_sg_len = sg_len;
 
 	buflen = 0;
-	for_each_sg(mq->bounce_sg, sg, sg_len, i)
+	for_each_sg(mqrq->bounce_sg, sg, sg_len, i)
 		buflen += sg->length;
 
-	sg_init_one(mq->sg, mq->bounce_buf, buflen);
+	sg_init_one(mqrq->sg, mqrq->bounce_buf, buflen);
 
 	return 1;
 }
@@ -459,31 +561,30 @@ unsigned int mmc_queue_map_sg(struct mmc_queue *mq)
  * If writing, bounce the data to the buffer before the request
  * is sent to the host driver
  */
-void mmc_queue_bounce_pre(struct mmc_queue *mq)
+void mmc_queue_bounce_pre(struct mmc_queue_req *mqrq)
 {
-	if (!mq->bounce_buf)
+	if (!mqrq->bounce_buf)
 		return;
 
-	if (rq_data_dir(mq->req) != WRITE)
+	if (rq_data_dir(mqrq->req) != WRITE)
 		return;
 
-	sg_copy_to_buffer(mq->bounce_sg, mq->bounce_sg_len,
-		mq->bounce_buf, mq->sg[0].length);
+	sg_copy_to_buffer(mqrq->bounce_sg, mqrq->bounce_sg_len,
+		mqrq->bounce_buf, mqrq->sg[0].length);
 }
 
 /*
  * If reading, bounce the data from the buffer after the request
  * has been handled by the host driver
  */
-void mmc_queue_bounce_post(struct mmc_queue *mq)
+void mmc_queue_bounce_post(struct mmc_queue_req *mqrq)
 {
-	if (!mq->bounce_buf)
+	if (!mqrq->bounce_buf)
 		return;
 
-	if (rq_data_dir(mq->req) != READ)
+	if (rq_data_dir(mqrq->req) != READ)
 		return;
 
-	sg_copy_from_buffer(mq->bounce_sg, mq->bounce_sg_len,
-		mq->bounce_buf, mq->sg[0].length);
+	sg_copy_from_buffer(mqrq->bounce_sg, mqrq->bounce_sg_len,
+		mqrq->bounce_buf, mqrq->sg[0].length);
 }
-
@@ -4,19 +4,78 @@
 struct request;
 struct task_struct;
 
+struct mmc_blk_request {
+	struct mmc_request	mrq;
+	struct mmc_command	sbc;
+	struct mmc_command	cmd;
+	struct mmc_command	stop;
+	struct mmc_data		data;
+};
+
+enum mmc_packed_cmd {
+	MMC_PACKED_NONE = 0,
+	MMC_PACKED_WRITE,
+};
+
+/* the packed header takes one 512 byte block ahead of the data */
+#define MMC_PACKED_HDR_SIZE	512
+#define MMC_PACKED_N_IDX	-1
+
+struct mmc_queue_req {
+	struct request		*req;
+	struct mmc_blk_request	brq;
+	struct scatterlist	*sg;
+	char			*bounce_buf;
+	struct scatterlist	*bounce_sg;
+	unsigned int		bounce_sg_len;
+	struct mmc_async_req	mmc_active;
+	ktime_t			start;		/* when it was prepared */
+	int			reinit_retry;	/* may reinit the card once */
+
+	/* packed write, only used when packed_cmd != MMC_PACKED_NONE */
+	struct list_head	packed_list;	/* requests in the pack */
+	__le32			*packed_cmd_hdr;
+	unsigned int		packed_blocks;
+	unsigned int		packed_num;
+	int			packed_fail_idx;
+	u8			packed_retries;
+	enum mmc_packed_cmd	packed_cmd;
+};
+
+/* why mmc_blk_prep_packed_list() stopped adding requests */
+enum mmc_pack_stop {
+	MMC_PACK_STOP_EMPTY,		/* nothing more queued */
+	MMC_PACK_STOP_DIR,		/* next request is a read */
+	MMC_PACK_STOP_FLAGS,		/* discard, flush or reliable write */
+	MMC_PACK_STOP_SIZE,		/* would exceed max_blk_count */
+	MMC_PACK_STOP_SEGS,		/* would exceed max_segs */
+	MMC_PACK_STOP_NUM,		/* card's max_packed_writes reached */
+	MMC_PACK_STOP_NR,
+};
+
+/* Counters for the debugfs stats, only updated by the queue thread */
+struct mmc_queue_stats {
+	unsigned long		rw_reqs;	/* read/write requests issued */
+	unsigned long		async_reqs;	/* issued while one was active */
+	unsigned long		packed_cmds;	/* packed writes issued */
+	unsigned long		packed_reqs;	/* requests they carried */
+	unsigned long		packed_fails;	/* packed writes that failed */
+	unsigned long		pack_stop[MMC_PACK_STOP_NR];
+};
+
 struct mmc_queue {
 	struct mmc_card		*card;
 	struct task_struct	*thread;
 	struct semaphore	thread_sem;
 	unsigned int		flags;
-	struct request		*req;
 	int			(*issue_fn)(struct mmc_queue *, struct request *);
 	void			*data;
 	struct request_queue	*queue;
-	struct scatterlist	*sg;
-	char			*bounce_buf;
-	struct scatterlist	*bounce_sg;
-	unsigned int		bounce_sg_len;
+	struct mmc_queue_req	mqrq[2];
+	struct mmc_queue_req	*mqrq_cur;
+	struct mmc_queue_req	*mqrq_prev;
+	struct mmc_queue_stats	stats;
+	bool			bkops_check;	/* written since last idle */
 };
 
 extern int mmc_init_queue(struct mmc_queue *, struct mmc_card *, spinlock_t *,
@@ -25,9 +84,10 @@ extern void mmc_cleanup_queue(struct mmc_queue *);
 extern void mmc_queue_suspend(struct mmc_queue *);
 extern void mmc_queue_resume(struct mmc_queue *);
 
-extern unsigned int mmc_queue_map_sg(struct mmc_queue *);
-extern void mmc_queue_bounce_pre(struct mmc_queue *);
-extern void mmc_queue_bounce_post(struct mmc_queue *);
+extern unsigned int mmc_queue_map_sg(struct mmc_queue *,
+				     struct mmc_queue_req *);
+extern void mmc_queue_bounce_pre(struct mmc_queue_req *);
+extern void mmc_queue_bounce_post(struct mmc_queue_req *);
 extern int mmc_reinit_card(struct mmc_host *host);
 extern int mmc_schedule_card_removal_work(struct delayed_work *work,
 				     unsigned long delay);
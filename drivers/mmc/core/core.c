@@ -25,6 +25,7 @@
 #include <linux/pm_runtime.h>
 #include <linux/wakelock.h>
 #include <linux/pm.h>
+#include <linux/slab.h>
 
 #include <linux/mmc/card.h>
 #include <linux/mmc/host.h>
@@ -240,6 +241,112 @@ static void mmc_wait_done(struct mmc_request *mrq)
 	complete(mrq->done_data);
 }
 
+static void __mmc_start_req(struct mmc_host *host, struct mmc_request *mrq)
+{
+	init_completion(&mrq->completion);
+	mrq->done_data = &mrq->completion;
+	mrq->done = mmc_wait_done;
+	if (mmc_card_removed(host->card)) {
+		mrq->cmd->error = -ENOMEDIUM;
+		complete(&mrq->completion);
+		return;
+	}
+
+	mmc_start_request(host, mrq);
+}
+
+/**
+ *	mmc_pre_req - Prepare for a new request
+ *	@host: MMC host to prepare command
+ *	@mrq: MMC request to prepare for
+ *	@is_first_req: true if there is no previous started request
+ *                     that may run in parallel to this call, otherwise false
+ *
+ *	mmc_pre_req() is called prior to mmc_start_req() to let
+ *	host prepare for the new request. Preparation of a request may be
+ *	performed while another request is running on the host.
+ */
+static void mmc_pre_req(struct mmc_host *host, struct mmc_request *mrq,
+		 bool is_first_req)
+{
+	if (host->ops->pre_req)
+		host->ops->pre_req(host, mrq, is_first_req);
+}
+
+/**
+ *	mmc_post_req - Post process a completed request
+ *	@host: MMC host to post process command
+ *	@mrq: MMC request to post process for
+ *	@err: Error, if non zero, clean up any resources made in pre_req
+ *
+ *	Let the host post process a completed request. Post processing of
+ *	a request may be performed while another request is running.
+ */
+static void mmc_post_req(struct mmc_host *host, struct mmc_request *mrq,
+			 int err)
+{
+	if (host->ops->post_req)
+		host->ops->post_req(host, mrq, err);
+}
+
+/**
+ *	mmc_start_req - start a non-blocking request
+ *	@host: MMC host to start command
+ *	@areq: async request to start
+ *	@error: out parameter returns 0 for success, otherwise non zero
+ *
+ *	Start a new MMC custom command request for a host.
+ *	If there is an ongoing async request, wait for it to complete
+ *	and check it with its err_check() before starting the new one.
+ *	Does not wait for the new request to complete.
+ *
+ *	Returns the completed request, or NULL if none was in flight.
+ *	NULL is not an error condition.  If the completed request failed
+ *	its check, @areq is not started and the caller must handle the
+ *	error and issue @areq again.
+ */
+struct mmc_async_req *mmc_start_req(struct mmc_host *host,
+				    struct mmc_async_req *areq, int *error)
+{
+	int err = 0;
+	struct mmc_async_req *data = host->areq;
+
+	/* Prepare a new request */
+	if (areq)
+		mmc_pre_req(host, areq->mrq, !host->areq);
+
+	if (host->areq) {
+		wait_for_completion_io(&host->areq->mrq->completion);
+		err = host->areq->err_check(host->card, host->areq);
+		if (err) {
+			/* post process the completed failed request */
+			mmc_post_req(host, host->areq->mrq, 0);
+			if (areq)
+				/*
+				 * Cancel the prepared request. The caller
+				 * will retry it once the error is handled.
+				 */
+				mmc_post_req(host, areq->mrq, -EINVAL);
+
+			host->areq = NULL;
+			goto out;
+		}
+	}
+
+	if (areq)
+		__mmc_start_req(host, areq->mrq);
+
+	if (host->areq)
+		mmc_post_req(host, host->areq->mrq, 0);
+
+	host->areq = areq;
+ out:
+	if (error)
+		*error = err;
+	return data;
+}
+EXPORT_SYMBOL(mmc_start_req);
+
 /**
  *	mmc_wait_for_req - start a request and wait for completion
  *	@host: MMC host to start command
@@ -1725,6 +1832,175 @@ int mmc_set_blocklen(struct mmc_card *card, unsigned int blocklen)
 }
 EXPORT_SYMBOL(mmc_set_blocklen);
 
+/**
+ *	mmc_flush_cache - write the volatile cache back to flash
+ *	@card: MMC card
+ *
+ *	Does nothing unless the cache was turned on at init.
+ */
+int mmc_flush_cache(struct mmc_card *card)
+{
+	int err = 0;
+
+	if (mmc_card_mmc(card) && card->ext_csd.cache_ctrl) {
+		err = mmc_switch(card, EXT_CSD_CMD_SET_NORMAL,
+				 EXT_CSD_FLUSH_CACHE, 1, 0);
+		if (err)
+			pr_err("%s: cache flush error %d\n",
+			       mmc_hostname(card->host), err);
+	}
+
+	return err;
+}
+EXPORT_SYMBOL(mmc_flush_cache);
+
+/*
+ * How long a card may take to leave prg-state after HPI when its
+ * EXT_CSD does not say (OUT_OF_INTERRUPT_TIME is eMMC 4.5 and later).
+ */
+#define MMC_HPI_DEFAULT_TIMEOUT_MS	100
+
+/**
+ *	mmc_interrupt_hpi - interrupt the operation the card is busy with
+ *	@card: MMC card
+ *
+ *	Sends HPI to a card in the programming state and waits for it to
+ *	return to the transfer state, for at most the card's out-of-
+ *	interrupt time.  A card that is not programming is left alone.
+ *	Returns -ETIMEDOUT if the card is still busy after that.
+ */
+int mmc_interrupt_hpi(struct mmc_card *card)
+{
+	int err;
+	u32 status;
+	unsigned int timeout_ms;
+	unsigned long deadline;
+
+	BUG_ON(!card);
+
+	if (!card->ext_csd.hpi_en)
+		return -EINVAL;
+
+	mmc_claim_host(card->host);
+	err = mmc_send_status(card, &status);
+	if (err) {
+		pr_err("%s: error %d getting card status\n",
+		       mmc_hostname(card->host), err);
+		goto out;
+	}
+
+	if (R1_CURRENT_STATE(status) != R1_STATE_PRG)
+		goto out;
+
+	timeout_ms = card->ext_csd.out_of_int_time;
+	if (!timeout_ms)
+		timeout_ms = MMC_HPI_DEFAULT_TIMEOUT_MS;
+	deadline = jiffies + msecs_to_jiffies(timeout_ms) + 1;
+
+	/* A failed HPI usually means the card already left prg-state */
+	mmc_send_hpi_cmd(card, NULL);
+
+	for (;;) {
+		err = mmc_send_status(card, &status);
+		if (err || R1_CURRENT_STATE(status) == R1_STATE_TRAN)
+			break;
+		if (time_after(jiffies, deadline)) {
+			pr_err("%s: card still busy %u ms after HPI\n",
+			       mmc_hostname(card->host), timeout_ms);
+			err = -ETIMEDOUT;
+			break;
+		}
+		usleep_range(1000, 2000);
+	}
+
+out:
+	mmc_release_host(card->host);
+	return err;
+}
+EXPORT_SYMBOL(mmc_interrupt_hpi);
+
+/**
+ *	mmc_start_bkops - let the card run background operations
+ *	@card: MMC card
+ *
+ *	Called when the card has gone idle.  If the card reports that
+ *	its housekeeping affects performance, BKOPS is started and the
+ *	card is left busy with it.  mmc_stop_bkops() has to be called
+ *	before the card is used again.  BKOPS is only started on cards
+ *	that can be interrupted with HPI.
+ */
+void mmc_start_bkops(struct mmc_card *card)
+{
+	u8 *ext_csd;
+	int err;
+
+	BUG_ON(!card);
+
+	if (!mmc_card_mmc(card) || !card->ext_csd.bkops_en ||
+	    !card->ext_csd.hpi_en || !(card->host->caps2 & MMC_CAP2_BKOPS))
+		return;
+
+	ext_csd = kmalloc(512, GFP_KERNEL);
+	if (!ext_csd)
+		return;
+
+	mmc_claim_host(card->host);
+	if (mmc_card_doing_bkops(card))
+		goto out;
+
+	err = mmc_send_ext_csd(card, ext_csd);
+	if (err) {
+		pr_err("%s: error %d reading BKOPS status\n",
+		       mmc_hostname(card->host), err);
+		goto out;
+	}
+
+	card->ext_csd.raw_bkops_status = ext_csd[EXT_CSD_BKOPS_STATUS];
+	if (card->ext_csd.raw_bkops_status < EXT_CSD_BKOPS_LEVEL_2 &&
+	    !(ext_csd[EXT_CSD_EXP_EVENTS_STATUS] & EXT_CSD_URGENT_BKOPS))
+		goto out;
+
+	err = __mmc_switch(card, EXT_CSD_CMD_SET_NORMAL,
+			   EXT_CSD_BKOPS_START, 1, 0, false);
+	if (err) {
+		pr_warning("%s: error %d starting BKOPS\n",
+			   mmc_hostname(card->host), err);
+		goto out;
+	}
+	mmc_card_set_doing_bkops(card);
+
+out:
+	mmc_release_host(card->host);
+	kfree(ext_csd);
+}
+EXPORT_SYMBOL(mmc_start_bkops);
+
+/**
+ *	mmc_stop_bkops - stop background operations
+ *	@card: MMC card
+ *
+ *	Interrupts BKOPS started by mmc_start_bkops(), the card keeps
+ *	what it has done so far.  If the card does not stop in time it is
+ *	left to finish on its own: BKOPS is no longer tracked as running,
+ *	so later requests do not retry HPI against the busy card and BKOPS
+ *	can be started again at the next idle period.
+ */
+int mmc_stop_bkops(struct mmc_card *card)
+{
+	int err;
+
+	BUG_ON(!card);
+
+	err = mmc_interrupt_hpi(card);
+	mmc_card_clr_doing_bkops(card);
+	if (err)
+		pr_warning("%s: error %d stopping BKOPS\n",
+			   mmc_hostname(card->host), err);
+
+	return err;
+}
+EXPORT_SYMBOL(mmc_stop_bkops);
+
 static int mmc_rescan_try_freq(struct mmc_host *host, unsigned freq)
 {
 	host->f_init = freq;
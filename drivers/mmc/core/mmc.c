@@ -259,7 +259,7 @@ static int mmc_read_ext_csd(struct mmc_card *card, u8 *ext_csd)
 	}
 
 	card->ext_csd.rev = ext_csd[EXT_CSD_REV];
-	if (card->ext_csd.rev > 5) {
+	if (card->ext_csd.rev > 6) {
 		printk(KERN_ERR "%s: unrecognised EXT_CSD revision %d\n",
 			mmc_hostname(card->host), card->ext_csd.rev);
 		err = -EINVAL;
@@ -402,9 +402,44 @@ static int mmc_read_ext_csd(struct mmc_card *card, u8 *ext_csd)
 			ext_csd[EXT_CSD_TRIM_MULT];
 	}
 
-	if (card->ext_csd.rev >= 5)
+	if (card->ext_csd.rev >= 5) {
 		card->ext_csd.rel_param = ext_csd[EXT_CSD_WR_REL_PARAM];
 
+		/* HPI, either through CMD12 or CMD13 */
+		if (ext_csd[EXT_CSD_HPI_FEATURES] & 0x1) {
+			card->ext_csd.hpi = 1;
+			if (ext_csd[EXT_CSD_HPI_FEATURES] & 0x2)
+				card->ext_csd.hpi_cmd = MMC_STOP_TRANSMISSION;
+			else
+				card->ext_csd.hpi_cmd = MMC_SEND_STATUS;
+		}
+
+		/*
+		 * BKOPS_EN is one time programmable, it is only used when
+		 * the card comes with it set.
+		 */
+		if (ext_csd[EXT_CSD_BKOPS_SUPPORT] & 0x1) {
+			card->ext_csd.bkops = 1;
+			card->ext_csd.bkops_en = ext_csd[EXT_CSD_BKOPS_EN] & 0x1;
+			card->ext_csd.raw_bkops_status =
+				ext_csd[EXT_CSD_BKOPS_STATUS];
+		}
+	}
+
+	if (card->ext_csd.rev >= 6) {
+		card->ext_csd.max_packed_writes =
+			ext_csd[EXT_CSD_MAX_PACKED_WRITES];
+		card->ext_csd.max_packed_reads =
+			ext_csd[EXT_CSD_MAX_PACKED_READS];
+		card->ext_csd.out_of_int_time = 10 *
+			ext_csd[EXT_CSD_OUT_OF_INTERRUPT_TIME];
+		card->ext_csd.cache_size =
+			ext_csd[EXT_CSD_CACHE_SIZE + 0] << 0 |
+			ext_csd[EXT_CSD_CACHE_SIZE + 1] << 8 |
+			ext_csd[EXT_CSD_CACHE_SIZE + 2] << 16 |
+			ext_csd[EXT_CSD_CACHE_SIZE + 3] << 24;
+	}
+
 	if (ext_csd[EXT_CSD_ERASED_MEM_CONT])
 		card->erased_byte = 0xFF;
 	else
@@ -710,6 +745,68 @@ static int mmc_init_card(struct mmc_host *host, u32 ocr,
 			goto free_card;
 	}
 
+	/*
+	 * Packed writes need the card to report which packed entry failed,
+	 * so turn on the packed exception event.  The spec mandates at
+	 * least 3 packed writes and 5 packed reads when packing is offered.
+	 */
+	card->ext_csd.packed_event_en = 0;
+	if ((host->caps2 & MMC_CAP2_PACKED_WR) &&
+	    card->ext_csd.max_packed_writes >= 3 &&
+	    card->ext_csd.max_packed_reads >= 5) {
+		err = mmc_switch(card, EXT_CSD_CMD_SET_NORMAL,
+				 EXT_CSD_EXP_EVENTS_CTRL,
+				 EXT_CSD_PACKED_EVENT_EN, 0);
+		if (err && err != -EBADMSG)
+			goto free_card;
+
+		if (err) {
+			printk(KERN_WARNING "%s: enabling packed event failed\n",
+			       mmc_hostname(card->host));
+			err = 0;
+		} else
+			card->ext_csd.packed_event_en = 1;
+	}
+
+	/*
+	 * HPI lets BKOPS be cut short when a request comes in.
+	 */
+	card->ext_csd.hpi_en = 0;
+	if (card->ext_csd.hpi) {
+		err = mmc_switch(card, EXT_CSD_CMD_SET_NORMAL,
+				 EXT_CSD_HPI_MGMT, 1, 0);
+		if (err && err != -EBADMSG)
+			goto free_card;
+
+		if (err) {
+			printk(KERN_WARNING "%s: enabling HPI failed\n",
+			       mmc_hostname(card->host));
+			err = 0;
+		} else
+			card->ext_csd.hpi_en = 1;
+	}
+
+	/*
+	 * The volatile cache is only turned on for hosts that ask for it,
+	 * the block driver then flushes it on REQ_FLUSH and it is flushed
+	 * before the card sleeps.
+	 */
+	card->ext_csd.cache_ctrl = 0;
+	if ((host->caps2 & MMC_CAP2_CACHE_CTRL) &&
+	    card->ext_csd.cache_size > 0) {
+		err = mmc_switch(card, EXT_CSD_CMD_SET_NORMAL,
+				 EXT_CSD_CACHE_CTRL, 1, 0);
+		if (err && err != -EBADMSG)
+			goto free_card;
+
+		if (err) {
+			printk(KERN_WARNING "%s: enabling cache failed\n",
+			       mmc_hostname(card->host));
+			err = 0;
+		} else
+			card->ext_csd.cache_ctrl = 1;
+	}
+
 	/*
 	 * Activate high speed (if supported)
 	 */
@@ -923,6 +1020,23 @@ static void mmc_detect(struct mmc_host *host)
 	}
 }
 
+/*
+ * Stop BKOPS and write the cache back before the card is put to
+ * sleep or deselected.
+ */
+static int mmc_quiesce(struct mmc_card *card)
+{
+	int err;
+
+	if (mmc_card_doing_bkops(card)) {
+		err = mmc_stop_bkops(card);
+		if (err)
+			return err;
+	}
+
+	return mmc_flush_cache(card);
+}
+
 /*
  * Suspend callback from host.
  */
@@ -936,8 +1050,14 @@ static int mmc_suspend(struct mmc_host *host)
 	mmc_claim_host(host);
 	if (mmc_card_can_sleep(host))
 		err = mmc_card_sleep(host);
-	else if (!mmc_host_is_spi(host))
+	else if (!mmc_host_is_spi(host)) {
+		err = mmc_quiesce(host->card);
+		if (err) {
+			mmc_release_host(host);
+			return err;
+		}
 		mmc_deselect_cards(host);
+	}
 	host->card->state &= ~MMC_STATE_HIGHSPEED;
 	mmc_release_host(host);
 
@@ -982,6 +1102,9 @@ static int mmc_sleep(struct mmc_host *host)
 	int err = -ENOSYS;
 
 	if (card && card->ext_csd.rev >= 3) {
+		err = mmc_quiesce(card);
+		if (err)
+			return err;
 		err = mmc_card_sleepawake(host, 1);
 		if (err < 0)
 			pr_debug("%s: Error %d while putting card into sleep",
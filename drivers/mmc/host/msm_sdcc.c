@@ -854,9 +854,10 @@ static void msmsdcc_sps_complete_tlet(unsigned long data)
 			mrq->data->error = -EIO;
 	}
 
-	/* Unmap sg buffers */
-	dma_unmap_sg(mmc_dev(host->mmc), host->sps.sg, host->sps.num_ents,
-			 host->sps.dir);
+	/* Unmap sg buffers, unless post_req will */
+	if (!mrq->data->host_cookie)
+		dma_unmap_sg(mmc_dev(host->mmc), host->sps.sg,
+			     host->sps.num_ents, host->sps.dir);
 
 	host->sps.sg = NULL;
 	host->sps.busy = 0;
@@ -925,9 +926,10 @@ static void msmsdcc_sps_exit_curr_xfer(struct msmsdcc_host *host)
 	if (!mrq->data->error)
 		mrq->data->error = -EIO;
 
-	/* Unmap sg buffers */
-	dma_unmap_sg(mmc_dev(host->mmc), host->sps.sg, host->sps.num_ents,
-			 host->sps.dir);
+	/* Unmap sg buffers, unless post_req will */
+	if (!mrq->data->host_cookie)
+		dma_unmap_sg(mmc_dev(host->mmc), host->sps.sg,
+			     host->sps.num_ents, host->sps.dir);
 
 	host->sps.sg = NULL;
 	host->sps.busy = 0;
@@ -975,6 +977,11 @@ static int msmsdcc_check_dma_op_req(struct mmc_data *data)
 		return 0;
 }
 
+static inline enum dma_data_direction msmsdcc_dma_dir(struct mmc_data *data)
+{
+	return data->flags & MMC_DATA_READ ? DMA_FROM_DEVICE : DMA_TO_DEVICE;
+}
+
 static int msmsdcc_config_dma(struct msmsdcc_host *host, struct mmc_data *data)
 {
 	struct msmsdcc_nc_dmadata *nc;
@@ -1126,17 +1133,19 @@ static int msmsdcc_sps_start_xfer(struct msmsdcc_host *host,
 		sps_pipe_handle = host->sps.cons.pipe_handle;
 	}
 
-	/* Make sg buffers DMA ready */
-	rc = dma_map_sg(mmc_dev(host->mmc), data->sg, data->sg_len,
-			host->sps.dir);
+	/* Make sg buffers DMA ready, pre_req may have done that already */
+	if (!data->host_cookie) {
+		rc = dma_map_sg(mmc_dev(host->mmc), data->sg, data->sg_len,
+				host->sps.dir);
 
-	if (rc != data->sg_len) {
-		pr_err("[SD] %s: Unable to map in all sg elements, rc=%d\n",
-		       mmc_hostname(host->mmc), rc);
-		host->sps.sg = NULL;
-		host->sps.num_ents = 0;
-		rc = -ENOMEM;
-		goto dma_map_err;
+		if (rc != data->sg_len) {
+			pr_err("[SD] %s: Unable to map in all sg elements, rc=%d\n",
+			       mmc_hostname(host->mmc), rc);
+			host->sps.sg = NULL;
+			host->sps.num_ents = 0;
+			rc = -ENOMEM;
+			goto dma_map_err;
+		}
 	}
 
 	pr_debug("%s: %s: %s: pipe=0x%x, total_xfer=0x%x, sg_len=%d\n",
@@ -1180,8 +1189,9 @@ static int msmsdcc_sps_start_xfer(struct msmsdcc_host *host,
 
 dma_map_err:
 	/* unmap sg buffers */
-	dma_unmap_sg(mmc_dev(host->mmc), host->sps.sg, host->sps.num_ents,
-			host->sps.dir);
+	if (!data->host_cookie)
+		dma_unmap_sg(mmc_dev(host->mmc), host->sps.sg,
+			     host->sps.num_ents, host->sps.dir);
 out:
 	return rc;
 }
@@ -1315,6 +1325,13 @@ msmsdcc_start_data(struct msmsdcc_host *host, struct mmc_data *data,
 	if (!(datactrl & MCI_DPSM_DMAENABLE)) {
 		host->use_pio = 1;
 
+		/* hand buffers mapped by pre_req back to the CPU */
+		if (data->host_cookie) {
+			dma_unmap_sg(mmc_dev(host->mmc), data->sg,
+				     data->sg_len, msmsdcc_dma_dir(data));
+			data->host_cookie = 0;
+		}
+
 		if (data->flags & MMC_DATA_READ) {
 			pio_irqmask = MCI_RXFIFOHALFFULLMASK;
 			if (host->curr.xfer_remain < MCI_FIFOSIZE)
@@ -3577,9 +3594,51 @@ exit:
 	return rc;
 }
 
+/*
+ * Map the sg list of the next request while the previous one is still
+ * on the bus.  Only SPS transfers hand the caller's sg list to the
+ * hardware, ADM DMA copies through its own buffers.
+ */
+static void msmsdcc_pre_req(struct mmc_host *mmc, struct mmc_request *mrq,
+			    bool is_first_req)
+{
+	struct msmsdcc_host *host = mmc_priv(mmc);
+	struct mmc_data *data = mrq->data;
+
+	if (!data)
+		return;
+
+	data->host_cookie = 0;
+	if (!host->is_sps_mode || msmsdcc_check_dma_op_req(data))
+		return;
+
+	if (dma_map_sg(mmc_dev(mmc), data->sg, data->sg_len,
+		       msmsdcc_dma_dir(data)) != data->sg_len) {
+		pr_debug("%s: %s: mapping deferred to the transfer\n",
+			 mmc_hostname(mmc), __func__);
+		return;
+	}
+	data->host_cookie = 1;
+}
+
+static void msmsdcc_post_req(struct mmc_host *mmc, struct mmc_request *mrq,
+			     int err)
+{
+	struct mmc_data *data = mrq->data;
+
+	if (!data || !data->host_cookie)
+		return;
+
+	dma_unmap_sg(mmc_dev(mmc), data->sg, data->sg_len,
+		     msmsdcc_dma_dir(data));
+	data->host_cookie = 0;
+}
+
 static const struct mmc_host_ops msmsdcc_ops = {
 	.enable		= msmsdcc_enable,
 	.disable	= msmsdcc_disable,
+	.pre_req	= msmsdcc_pre_req,
+	.post_req	= msmsdcc_post_req,
 	.request	= msmsdcc_request,
 	.set_ios	= msmsdcc_set_ios,
 	.get_ro		= msmsdcc_get_ro,
@@ -3628,6 +3687,8 @@ static int msmsdcc_sdc_get_status(struct mmc_host *mmc)
 static const struct mmc_host_ops msmsdcc_ops_sd = {
 	.enable		= msmsdcc_enable,
 	.disable	= msmsdcc_disable,
+	.pre_req	= msmsdcc_pre_req,
+	.post_req	= msmsdcc_post_req,
 	.request	= msmsdcc_request,
 	.set_ios	= msmsdcc_set_ios,
 	.get_ro		= msmsdcc_get_ro,
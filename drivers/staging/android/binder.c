@@ -16,9 +16,11 @@
  */
 
 #include <asm/cacheflush.h>
+#include <linux/capability.h>
 #include <linux/fdtable.h>
 #include <linux/file.h>
 #include <linux/fs.h>
+#include <linux/ktime.h>
 #include <linux/list.h>
 #include <linux/miscdevice.h>
 #include <linux/mm.h>
@@ -28,26 +30,62 @@
 #include <linux/poll.h>
 #include <linux/debugfs.h>
 #include <linux/rbtree.h>
+#include <linux/rwsem.h>
 #include <linux/sched.h>
 #include <linux/seq_file.h>
 #include <linux/slab.h>
+#include <linux/spinlock.h>
 #include <linux/uaccess.h>
 #include <linux/vmalloc.h>
 
 #include "binder.h"
 
-static DEFINE_MUTEX(binder_lock);
+/*
+ * Locking overview:
+ *
+ * binder_main_lock is held for reading by every ioctl, poll and debugfs
+ * reader.  It keeps the procs, threads and dead nodes of other processes
+ * alive while they are reached through transaction and ref pointers, and
+ * is only taken for writing to tear threads and processes down or to
+ * install the context manager.
+ *
+ * proc->lock serializes everything a process owns: its threads, nodes,
+ * ref trees, buffers and the transaction stacks of its threads.  A
+ * transaction takes the target process lock as well, in address order
+ * (see binder_proc_lock_target).
+ *
+ * proc->inner_lock protects the todo lists of the process and its
+ * threads, and the reference counts of the nodes it owns, which other
+ * processes update while holding only their own proc->lock.  Dead nodes
+ * are covered by binder_dead_nodes_lock instead.  Inner locks are never
+ * nested and never held across user copies.
+ *
+ * binder_lru_lock protects the global list of idle buffer pages.  It
+ * nests inside proc->lock.  binder_shrink walks the list without
+ * blocking: it holds binder_main_lock for reading via trylock, so no
+ * proc can be released under it, and trylocks each page's proc->lock.
+ */
+static DECLARE_RWSEM(binder_main_lock);
+static DEFINE_MUTEX(binder_procs_lock);
+static DEFINE_SPINLOCK(binder_dead_nodes_lock);
 static DEFINE_MUTEX(binder_deferred_lock);
+static DEFINE_SPINLOCK(binder_transaction_log_lock);
+static DEFINE_SPINLOCK(binder_lru_lock);
 
 static HLIST_HEAD(binder_procs);
 static HLIST_HEAD(binder_deferred_list);
 static HLIST_HEAD(binder_dead_nodes);
+static LIST_HEAD(binder_lru);
 
 static struct dentry *binder_debugfs_dir_entry_root;
 static struct dentry *binder_debugfs_dir_entry_proc;
 static struct binder_node *binder_context_mgr_node;
 static uid_t binder_context_mgr_uid = -1;
-static int binder_last_id;
+static atomic_t binder_last_id = ATOMIC_INIT(0);
+static atomic_t binder_proc_lock_contended = ATOMIC_INIT(0);
+static atomic_t binder_inner_lock_contended = ATOMIC_INIT(0);
+static int binder_lru_count;
+static atomic_t binder_lru_reclaimed = ATOMIC_INIT(0);
 static struct workqueue_struct *binder_deferred_workqueue;
 
 #define BINDER_DEBUG_ENTRY(name) \
@@ -145,23 +183,34 @@ enum binder_stat_types {
 	BINDER_STAT_COUNT
 };
 
+/*
+ * Latency histograms use log2 buckets in microseconds: bucket 0 counts
+ * latencies below 1us, bucket n counts [2^(n-1), 2^n) us and the last
+ * bucket collects everything slower.
+ */
+#define BINDER_LATENCY_BUCKETS 24
+
+struct binder_latency_hist {
+	u32 count[BINDER_LATENCY_BUCKETS];
+};
+
 struct binder_stats {
-	int br[_IOC_NR(BR_FAILED_REPLY) + 1];
-	int bc[_IOC_NR(BC_DEAD_BINDER_DONE) + 1];
-	int obj_created[BINDER_STAT_COUNT];
-	int obj_deleted[BINDER_STAT_COUNT];
+	atomic_t br[_IOC_NR(BR_FAILED_REPLY) + 1];
+	atomic_t bc[_IOC_NR(BC_DEAD_BINDER_DONE) + 1];
+	atomic_t obj_created[BINDER_STAT_COUNT];
+	atomic_t obj_deleted[BINDER_STAT_COUNT];
 };
 
 static struct binder_stats binder_stats;
 
 static inline void binder_stats_deleted(enum binder_stat_types type)
 {
-	binder_stats.obj_deleted[type]++;
+	atomic_inc(&binder_stats.obj_deleted[type]);
 }
 
 static inline void binder_stats_created(enum binder_stat_types type)
 {
-	binder_stats.obj_created[type]++;
+	atomic_inc(&binder_stats.obj_created[type]);
 }
 
 struct binder_transaction_log_entry {
@@ -188,6 +237,8 @@ static struct binder_transaction_log_entry *binder_transaction_log_add(
 	struct binder_transaction_log *log)
 {
 	struct binder_transaction_log_entry *e;
+
+	spin_lock(&binder_transaction_log_lock);
 	e = &log->entry[log->next];
 	memset(e, 0, sizeof(*e));
 	log->next++;
@@ -195,9 +246,20 @@ static struct binder_transaction_log_entry *binder_transaction_log_add(
 		log->next = 0;
 		log->full = 1;
 	}
+	spin_unlock(&binder_transaction_log_lock);
 	return e;
 }
 
+/*
+ * Priorities are kept in the kernel's prio scale: 0 to MAX_RT_PRIO - 1
+ * for SCHED_FIFO and SCHED_RR, MAX_RT_PRIO and up for nice levels.
+ * A lower prio value always means a more important task.
+ */
+struct binder_priority {
+	unsigned int sched_policy;
+	int prio;
+};
+
 struct binder_work {
 	struct list_head entry;
 	enum {
@@ -230,6 +292,7 @@ struct binder_node {
 	unsigned pending_weak_ref:1;
 	unsigned has_async_transaction:1;
 	unsigned accept_fds:1;
+	unsigned sched_policy:3;	/* up to SCHED_IDLE */
 	unsigned min_priority:8;
 	struct list_head async_todo;
 };
@@ -273,13 +336,28 @@ struct binder_buffer {
 	uint8_t data[0];
 };
 
+/*
+ * A mapped page that no buffer currently uses sits on binder_lru until
+ * it is reused or reclaimed by binder_shrink.  The list and
+ * binder_lru_count are protected by binder_lru_lock.
+ */
+struct binder_lru_page {
+	struct list_head lru;
+	struct binder_proc *proc;
+};
+
 enum binder_deferred_state {
 	BINDER_DEFERRED_PUT_FILES    = 0x01,
 	BINDER_DEFERRED_FLUSH        = 0x02,
 	BINDER_DEFERRED_RELEASE      = 0x04,
+	BINDER_DEFERRED_REAP_NODES   = 0x08,
 };
 
 struct binder_proc {
+	struct mutex lock;
+	spinlock_t inner_lock;
+	atomic_t lock_contended;
+	atomic_t inner_lock_contended;
 	struct hlist_node proc_node;
 	struct rb_root threads;
 	struct rb_root nodes;
@@ -300,17 +378,23 @@ struct binder_proc {
 	size_t free_async_space;
 
 	struct page **pages;
+	struct binder_lru_page *lru_pages;
+	unsigned long pages_mapped;	/* pages currently mapped */
+	unsigned long pages_warm_hits;
 	size_t buffer_size;
 	uint32_t buffer_free;
 	struct list_head todo;
 	wait_queue_head_t wait;
 	struct binder_stats stats;
+	struct binder_latency_hist recv_latency;
+	struct binder_latency_hist reply_latency;
 	struct list_head delivered_death;
 	int max_threads;
 	int requested_threads;
 	int requested_threads_started;
 	int ready_threads;
-	long default_priority;
+	int reap_nodes;		/* refless nodes queued, under inner_lock */
+	struct binder_priority default_priority;
 	struct dentry *debugfs_entry;
 };
 
@@ -352,14 +436,128 @@ struct binder_transaction {
 	struct binder_buffer *buffer;
 	unsigned int	code;
 	unsigned int	flags;
-	long	priority;
-	long	saved_priority;
+	struct binder_priority	priority;
+	struct binder_priority	saved_priority;
 	uid_t	sender_euid;
+	ktime_t	start_time;
 };
 
+#define CREATE_TRACE_POINTS
+#include "binder_trace.h"
+
+static s64 binder_latency_add(struct binder_latency_hist *hist,
+			      ktime_t start)
+{
+	s64 us = ktime_us_delta(ktime_get(), start);
+	int bucket = us > 0 ? fls64(us) : 0;
+
+	if (bucket >= BINDER_LATENCY_BUCKETS)
+		bucket = BINDER_LATENCY_BUCKETS - 1;
+	hist->count[bucket]++;
+	return us;
+}
+
 static void
 binder_defer_work(struct binder_proc *proc, enum binder_deferred_state defer);
 
+static inline void binder_proc_lock(struct binder_proc *proc)
+{
+	if (!mutex_trylock(&proc->lock)) {
+		atomic_inc(&proc->lock_contended);
+		atomic_inc(&binder_proc_lock_contended);
+		mutex_lock(&proc->lock);
+	}
+}
+
+static inline void binder_proc_unlock(struct binder_proc *proc)
+{
+	mutex_unlock(&proc->lock);
+}
+
+/*
+ * Make @target the second process locked by a transaction running with
+ * @proc->lock held, dropping the one previously recorded in *@locked.
+ * Locks are ordered by address: if @target sorts before @proc and is busy,
+ * proc->lock is dropped and both are retaken, and 1 is returned so the
+ * caller can redo everything it looked up under proc->lock.
+ */
+static int binder_proc_lock_target(struct binder_proc *proc,
+				   struct binder_proc **locked,
+				   struct binder_proc *target)
+{
+	if (*locked == target)
+		return 0;
+	if (*locked)
+		mutex_unlock(&(*locked)->lock);
+	*locked = NULL;
+	if (target == proc)
+		return 0;
+	*locked = target;
+	if (mutex_trylock(&target->lock))
+		return 0;
+	atomic_inc(&target->lock_contended);
+	atomic_inc(&binder_proc_lock_contended);
+	if (target > proc) {
+		mutex_lock_nested(&target->lock, SINGLE_DEPTH_NESTING);
+		return 0;
+	}
+	mutex_unlock(&proc->lock);
+	mutex_lock(&target->lock);
+	mutex_lock_nested(&proc->lock, SINGLE_DEPTH_NESTING);
+	return 1;
+}
+
+static inline void binder_inner_lock(struct binder_proc *proc)
+{
+	if (!spin_trylock(&proc->inner_lock)) {
+		atomic_inc(&proc->inner_lock_contended);
+		atomic_inc(&binder_inner_lock_contended);
+		spin_lock(&proc->inner_lock);
+	}
+}
+
+static inline void binder_inner_unlock(struct binder_proc *proc)
+{
+	spin_unlock(&proc->inner_lock);
+}
+
+/*
+ * Node reference counts live under the owning process's inner lock, or
+ * under binder_dead_nodes_lock once the owner is gone.  node->proc only
+ * changes with binder_main_lock held for writing, so the owner returned
+ * here is what binder_node_unlock() must be passed.
+ */
+static struct binder_proc *binder_node_lock(struct binder_node *node)
+{
+	struct binder_proc *proc = node->proc;
+
+	if (proc)
+		binder_inner_lock(proc);
+	else
+		spin_lock(&binder_dead_nodes_lock);
+	return proc;
+}
+
+/*
+ * A refless node can only be freed by its owner, see
+ * binder_dec_node_ilocked(); kick the owner's deferred work for it here,
+ * where we may sleep again.
+ */
+static void binder_node_unlock(struct binder_proc *proc)
+{
+	int reap;
+
+	if (!proc) {
+		spin_unlock(&binder_dead_nodes_lock);
+		return;
+	}
+	reap = proc->reap_nodes;
+	proc->reap_nodes = 0;
+	binder_inner_unlock(proc);
+	if (reap)
+		binder_defer_work(proc, BINDER_DEFERRED_REAP_NODES);
+}
+
 /*
  * copied from get_unused_fd_flags
  */
@@ -501,21 +699,117 @@ out_unlock:
 	return -EBADF;
 }
 
-static void binder_set_nice(long nice)
+static inline int is_rt_policy(int policy)
+{
+	return policy == SCHED_FIFO || policy == SCHED_RR;
+}
+
+static inline int is_fair_policy(int policy)
+{
+	return policy == SCHED_NORMAL || policy == SCHED_BATCH ||
+	       policy == SCHED_IDLE;
+}
+
+static int to_userspace_prio(int policy, int kernel_priority)
+{
+	if (is_fair_policy(policy))
+		return kernel_priority - MAX_RT_PRIO - 20;
+	else
+		return MAX_USER_RT_PRIO - 1 - kernel_priority;
+}
+
+static int to_kernel_prio(int policy, int user_priority)
+{
+	if (is_fair_policy(policy))
+		return MAX_RT_PRIO + 20 + clamp(user_priority, -20, 19);
+	else
+		return MAX_USER_RT_PRIO - 1 -
+			clamp(user_priority, 1, MAX_USER_RT_PRIO - 1);
+}
+
+static void binder_get_priority(struct task_struct *task,
+				struct binder_priority *p)
 {
-	long min_nice;
-	if (can_nice(current, nice)) {
-		set_user_nice(current, nice);
+	p->sched_policy = task->policy;
+	p->prio = task->normal_prio;
+}
+
+/*
+ * Move current to the given policy and priority.  Without CAP_SYS_NICE
+ * the request is capped by RLIMIT_RTPRIO and RLIMIT_NICE, and an rt
+ * request that RLIMIT_RTPRIO does not allow at all falls back to the
+ * best nice level instead.
+ */
+static void binder_set_priority(struct binder_priority desired)
+{
+	struct task_struct *task = current;
+	unsigned int policy = desired.sched_policy;
+	int priority;
+	int has_cap_nice;
+	struct sched_param params;
+
+	if (task->policy == policy && task->normal_prio == desired.prio &&
+	    task->sched_reset_on_fork)
 		return;
+
+	has_cap_nice = has_capability_noaudit(task, CAP_SYS_NICE);
+	priority = to_userspace_prio(policy, desired.prio);
+
+	if (is_rt_policy(policy) && !has_cap_nice) {
+		unsigned long max_rtprio = task_rlimit(task, RLIMIT_RTPRIO);
+
+		if (max_rtprio == 0) {
+			policy = SCHED_NORMAL;
+			priority = -20;
+		} else if (priority > max_rtprio) {
+			priority = max_rtprio;
+		}
 	}
-	min_nice = 20 - current->signal->rlim[RLIMIT_NICE].rlim_cur;
-	binder_debug(BINDER_DEBUG_PRIORITY_CAP,
-		     "binder: %d: nice value %ld not allowed use "
-		     "%ld instead\n", current->pid, nice, min_nice);
-	set_user_nice(current, min_nice);
-	if (min_nice < 20)
-		return;
-	binder_user_error("binder: %d RLIMIT_NICE not set\n", current->pid);
+
+	if (is_fair_policy(policy) && !has_cap_nice) {
+		long min_nice = 20 - task_rlimit(task, RLIMIT_NICE);
+
+		if (priority < min_nice) {
+			binder_debug(BINDER_DEBUG_PRIORITY_CAP,
+				     "binder: %d: nice value %d not allowed use "
+				     "%ld instead\n", task->pid, priority,
+				     min_nice);
+			priority = min(min_nice, 19L);
+			if (min_nice > 19)
+				binder_user_error("binder: %d RLIMIT_NICE not "
+						  "set\n", task->pid);
+		}
+	}
+
+	/* The reset flag is set even when policy and priority already match */
+	params.sched_priority = is_rt_policy(policy) ? priority : 0;
+	if (policy != task->policy || !task->sched_reset_on_fork ||
+	    (is_rt_policy(policy) && params.sched_priority != task->rt_priority))
+		sched_setscheduler_nocheck(task, policy | SCHED_RESET_ON_FORK,
+					   &params);
+	if (is_fair_policy(policy))
+		set_user_nice(task, priority);
+}
+
+/*
+ * Pick the priority a thread runs a transaction at: the caller's policy
+ * and priority, or the node's minimum if that is more important.
+ */
+static void binder_transaction_priority(struct binder_transaction *t,
+					struct binder_node *node)
+{
+	struct binder_priority desired = t->priority;
+	struct binder_priority node_prio;
+
+	node_prio.sched_policy = node->sched_policy;
+	node_prio.prio = node->min_priority;
+
+	if (node_prio.prio < desired.prio ||
+	    (node_prio.prio == desired.prio &&
+	     node_prio.sched_policy == SCHED_FIFO))
+		desired = node_prio;
+
+	binder_set_priority(desired);
 }
 
 static size_t binder_buffer_size(struct binder_proc *proc,
@@ -610,15 +904,106 @@ static struct binder_buffer *binder_buffer_lookup(struct binder_proc *proc,
 	return NULL;
 }
 
+static void binder_lru_add(struct binder_proc *proc, size_t index)
+{
+	struct binder_lru_page *lru_page = &proc->lru_pages[index];
+
+	spin_lock(&binder_lru_lock);
+	BUG_ON(!list_empty(&lru_page->lru));
+	list_add_tail(&lru_page->lru, &binder_lru);
+	binder_lru_count++;
+	spin_unlock(&binder_lru_lock);
+}
+
+static int binder_lru_del(struct binder_proc *proc, size_t index)
+{
+	struct binder_lru_page *lru_page = &proc->lru_pages[index];
+	int on_lru;
+
+	spin_lock(&binder_lru_lock);
+	on_lru = !list_empty(&lru_page->lru);
+	if (on_lru) {
+		list_del_init(&lru_page->lru);
+		binder_lru_count--;
+	}
+	spin_unlock(&binder_lru_lock);
+	return on_lru;
+}
+
+static int binder_map_page_run(struct binder_proc *proc,
+			       struct vm_area_struct *vma,
+			       void *start, void *end)
+{
+	struct page **pages = &proc->pages[(start - proc->buffer) / PAGE_SIZE];
+	struct page **page_array_ptr = pages;
+	struct vm_struct tmp_area;
+	unsigned long user_start;
+	int nr = (end - start) / PAGE_SIZE;
+	int i;
+	int ret;
+
+	for (i = 0; i < nr; i++) {
+		pages[i] = alloc_page(GFP_KERNEL | __GFP_ZERO);
+		if (pages[i] == NULL) {
+			printk(KERN_ERR "[K] binder: %d: binder_alloc_buf failed "
+			       "for page at %p\n", proc->pid,
+			       start + i * PAGE_SIZE);
+			goto err_alloc_page_failed;
+		}
+	}
+	tmp_area.addr = start;
+	tmp_area.size = end - start + PAGE_SIZE /* guard page? */;
+	ret = map_vm_area(&tmp_area, PAGE_KERNEL, &page_array_ptr);
+	if (ret) {
+		printk(KERN_ERR "[K] binder: %d: binder_alloc_buf failed "
+		       "to map pages %p-%p in kernel\n",
+		       proc->pid, start, end);
+		goto err_map_kernel_failed;
+	}
+	user_start = (uintptr_t)start + proc->user_buffer_offset;
+	for (i = 0; i < nr; i++) {
+		ret = vm_insert_page(vma, user_start + i * PAGE_SIZE, pages[i]);
+		if (ret) {
+			printk(KERN_ERR "[K] binder: %d: binder_alloc_buf failed "
+			       "to map page at %lx in userspace\n",
+			       proc->pid, user_start + i * PAGE_SIZE);
+			goto err_vm_insert_page_failed;
+		}
+		/* vm_insert_page does not seem to increment the refcount */
+	}
+	return 0;
+
+err_vm_insert_page_failed:
+	if (i)
+		zap_page_range(vma, user_start, i * PAGE_SIZE, NULL);
+	unmap_kernel_range((unsigned long)start, end - start);
+err_map_kernel_failed:
+	i = nr;
+err_alloc_page_failed:
+	while (i--) {
+		__free_page(pages[i]);
+		pages[i] = NULL;
+	}
+	return -ENOMEM;
+}
+
+/*
+ * Freed pages are not unmapped right away.  They stay mapped in both the
+ * kernel and the user address space and are parked on binder_lru, so the
+ * next buffer that covers them only has to take them off the list.  Only
+ * pages that were never mapped, or that binder_shrink reclaimed, are
+ * allocated here, and each contiguous run of them is mapped into the
+ * kernel with a single map_vm_area call.
+ */
 static int binder_update_page_range(struct binder_proc *proc, int allocate,
 				    void *start, void *end,
 				    struct vm_area_struct *vma)
 {
 	void *page_addr;
-	unsigned long user_page_addr;
-	struct vm_struct tmp_area;
-	struct page **page;
+	void *run_start;
+	void *first_missing = NULL;
 	struct mm_struct *mm;
+	size_t index;
 
 	binder_debug(BINDER_DEBUG_BUFFER_ALLOC,
 		     "binder: %d: %s pages %p-%p\n", proc->pid,
@@ -627,6 +1012,26 @@ static int binder_update_page_range(struct binder_proc *proc, int allocate,
 	if (end <= start)
 		return 0;
 
+	if (allocate == 0) {
+		for (page_addr = start; page_addr < end; page_addr += PAGE_SIZE)
+			binder_lru_add(proc,
+				       (page_addr - proc->buffer) / PAGE_SIZE);
+		return 0;
+	}
+
+	for (page_addr = start; page_addr < end; page_addr += PAGE_SIZE) {
+		index = (page_addr - proc->buffer) / PAGE_SIZE;
+		if (proc->pages[index]) {
+			if (!binder_lru_del(proc, index))
+				BUG();
+			proc->pages_warm_hits++;
+		} else if (!first_missing) {
+			first_missing = page_addr;
+		}
+	}
+	if (!first_missing)
+		return 0;
+
 	if (vma)
 		mm = NULL;
 	else
@@ -637,47 +1042,25 @@ static int binder_update_page_range(struct binder_proc *proc, int allocate,
 		vma = proc->vma;
 	}
 
-	if (allocate == 0)
-		goto free_range;
-
 	if (vma == NULL) {
 		printk(KERN_ERR "[K] binder: %d: binder_alloc_buf failed to "
 		       "map pages in userspace, no vma\n", proc->pid);
-		goto err_no_vma;
+		goto err_map_failed;
 	}
 
-	for (page_addr = start; page_addr < end; page_addr += PAGE_SIZE) {
-		int ret;
-		struct page **page_array_ptr;
-		page = &proc->pages[(page_addr - proc->buffer) / PAGE_SIZE];
-
-		BUG_ON(*page);
-		*page = alloc_page(GFP_KERNEL | __GFP_ZERO);
-		if (*page == NULL) {
-			printk(KERN_ERR "[K] binder: %d: binder_alloc_buf failed "
-			       "for page at %p\n", proc->pid, page_addr);
-			goto err_alloc_page_failed;
-		}
-		tmp_area.addr = page_addr;
-		tmp_area.size = PAGE_SIZE + PAGE_SIZE /* guard page? */;
-		page_array_ptr = page;
-		ret = map_vm_area(&tmp_area, PAGE_KERNEL, &page_array_ptr);
-		if (ret) {
-			printk(KERN_ERR "[K] binder: %d: binder_alloc_buf failed "
-			       "to map page at %p in kernel\n",
-			       proc->pid, page_addr);
-			goto err_map_kernel_failed;
-		}
-		user_page_addr =
-			(uintptr_t)page_addr + proc->user_buffer_offset;
-		ret = vm_insert_page(vma, user_page_addr, page[0]);
-		if (ret) {
-			printk(KERN_ERR "[K] binder: %d: binder_alloc_buf failed "
-			       "to map page at %lx in userspace\n",
-			       proc->pid, user_page_addr);
-			goto err_vm_insert_page_failed;
+	page_addr = first_missing;
+	while (page_addr < end) {
+		if (proc->pages[(page_addr - proc->buffer) / PAGE_SIZE]) {
+			page_addr += PAGE_SIZE;
+			continue;
 		}
-		/* vm_insert_page does not seem to increment the refcount */
+		run_start = page_addr;
+		while (page_addr < end &&
+		       !proc->pages[(page_addr - proc->buffer) / PAGE_SIZE])
+			page_addr += PAGE_SIZE;
+		if (binder_map_page_run(proc, vma, run_start, page_addr))
+			goto err_map_failed;
+		proc->pages_mapped += (page_addr - run_start) / PAGE_SIZE;
 	}
 	if (mm) {
 		up_write(&mm->mmap_sem);
@@ -685,22 +1068,16 @@ static int binder_update_page_range(struct binder_proc *proc, int allocate,
 	}
 	return 0;
 
-free_range:
-	for (page_addr = end - PAGE_SIZE; page_addr >= start;
-	     page_addr -= PAGE_SIZE) {
-		page = &proc->pages[(page_addr - proc->buffer) / PAGE_SIZE];
-		if (vma)
-			zap_page_range(vma, (uintptr_t)page_addr +
-				proc->user_buffer_offset, PAGE_SIZE, NULL);
-err_vm_insert_page_failed:
-		unmap_kernel_range((unsigned long)page_addr, PAGE_SIZE);
-err_map_kernel_failed:
-		__free_page(*page);
-		*page = NULL;
-err_alloc_page_failed:
-		;
+err_map_failed:
+	/*
+	 * Everything in the range that is mapped now, whether it was warm
+	 * or mapped by an earlier run of this call, goes back on the LRU.
+	 */
+	for (page_addr = start; page_addr < end; page_addr += PAGE_SIZE) {
+		index = (page_addr - proc->buffer) / PAGE_SIZE;
+		if (proc->pages[index])
+			binder_lru_add(proc, index);
 	}
-err_no_vma:
 	if (mm) {
 		up_write(&mm->mmap_sem);
 		mmput(mm);
@@ -926,6 +1303,84 @@ static void binder_free_buf(struct binder_proc *proc,
 	binder_insert_free_buffer(proc, buffer);
 }
 
+static int binder_reclaim_page(struct binder_proc *proc, size_t index)
+{
+	void *page_addr = proc->buffer + index * PAGE_SIZE;
+	struct mm_struct *mm;
+
+	/*
+	 * Without the mm the user mapping cannot be zapped, so the page has
+	 * to stay until binder_release frees it.
+	 */
+	mm = get_task_mm(proc->tsk);
+	if (!mm)
+		return -EBUSY;
+	if (!down_read_trylock(&mm->mmap_sem)) {
+		mmput(mm);
+		return -EBUSY;
+	}
+	if (proc->vma)
+		zap_page_range(proc->vma, (uintptr_t)page_addr +
+			       proc->user_buffer_offset, PAGE_SIZE, NULL);
+	up_read(&mm->mmap_sem);
+	mmput(mm);
+
+	unmap_kernel_range((unsigned long)page_addr, PAGE_SIZE);
+	__free_page(proc->pages[index]);
+	proc->pages[index] = NULL;
+	proc->pages_mapped--;
+	return 0;
+}
+
+static int binder_shrink(struct shrinker *s, struct shrink_control *sc)
+{
+	unsigned long nr_to_scan = sc->nr_to_scan;
+	struct binder_lru_page *lru_page;
+	struct binder_proc *proc;
+	size_t index;
+	int ret;
+
+	if (nr_to_scan == 0)
+		return binder_lru_count;
+
+	if (!down_read_trylock(&binder_main_lock))
+		return -1;
+
+	spin_lock(&binder_lru_lock);
+	while (nr_to_scan-- && !list_empty(&binder_lru)) {
+		lru_page = list_first_entry(&binder_lru,
+					    struct binder_lru_page, lru);
+		proc = lru_page->proc;
+		if (!mutex_trylock(&proc->lock)) {
+			list_move_tail(&lru_page->lru, &binder_lru);
+			continue;
+		}
+		list_del_init(&lru_page->lru);
+		binder_lru_count--;
+		spin_unlock(&binder_lru_lock);
+
+		index = lru_page - proc->lru_pages;
+		ret = binder_reclaim_page(proc, index);
+		if (ret)
+			binder_lru_add(proc, index);
+		else
+			atomic_inc(&binder_lru_reclaimed);
+		mutex_unlock(&proc->lock);
+
+		spin_lock(&binder_lru_lock);
+	}
+	ret = binder_lru_count;
+	spin_unlock(&binder_lru_lock);
+
+	up_read(&binder_main_lock);
+	return ret;
+}
+
+static struct shrinker binder_shrinker = {
+	.shrink = binder_shrink,
+	.seeks = DEFAULT_SEEKS,
+};
+
 static struct binder_node *binder_get_node(struct binder_proc *proc,
 					   void __user *ptr)
 {
@@ -971,10 +1426,13 @@ static struct binder_node *binder_new_node(struct binder_proc *proc,
 	binder_stats_created(BINDER_STAT_NODE);
 	rb_link_node(&node->rb_node, parent, p);
 	rb_insert_color(&node->rb_node, &proc->nodes);
-	node->debug_id = ++binder_last_id;
+	node->debug_id = atomic_inc_return(&binder_last_id);
 	node->proc = proc;
 	node->ptr = ptr;
 	node->cookie = cookie;
+	/* no minimum until the sender's flags say otherwise: nice 0 */
+	node->sched_policy = SCHED_NORMAL;
+	node->min_priority = to_kernel_prio(SCHED_NORMAL, 0);
 	node->work.type = BINDER_WORK_NODE;
 	INIT_LIST_HEAD(&node->work.entry);
 	INIT_LIST_HEAD(&node->async_todo);
@@ -985,8 +1443,8 @@ static struct binder_node *binder_new_node(struct binder_proc *proc,
 	return node;
 }
 
-static int binder_inc_node(struct binder_node *node, int strong, int internal,
-			   struct list_head *target_list)
+static int binder_inc_node_ilocked(struct binder_node *node, int strong,
+				   int internal, struct list_head *target_list)
 {
 	if (strong) {
 		if (internal) {
@@ -1020,7 +1478,20 @@ static int binder_inc_node(struct binder_node *node, int strong, int internal,
 	return 0;
 }
 
-static int binder_dec_node(struct binder_node *node, int strong, int internal)
+static int binder_inc_node(struct binder_node *node, int strong, int internal,
+			   struct list_head *target_list)
+{
+	struct binder_proc *owner;
+	int ret;
+
+	owner = binder_node_lock(node);
+	ret = binder_inc_node_ilocked(node, strong, internal, target_list);
+	binder_node_unlock(owner);
+	return ret;
+}
+
+static int binder_dec_node_ilocked(struct binder_node *node, int strong,
+				   int internal)
 {
 	if (strong) {
 		if (internal)
@@ -1043,26 +1514,48 @@ static int binder_dec_node(struct binder_node *node, int strong, int internal)
 	} else {
 		if (hlist_empty(&node->refs) && !node->local_strong_refs &&
 		    !node->local_weak_refs) {
-			list_del_init(&node->work.entry);
 			if (node->proc) {
-				rb_erase(&node->rb_node, &node->proc->nodes);
+				/*
+				 * Only the owner may unlink a live node from
+				 * its tree.  Its next binder_thread_read frees
+				 * it, or the deferred work binder_node_unlock
+				 * queues if it does not read.
+				 */
+				if (list_empty(&node->work.entry)) {
+					list_add_tail(&node->work.entry,
+						      &node->proc->todo);
+					wake_up_interruptible(&node->proc->wait);
+				}
+				node->proc->reap_nodes = 1;
 				binder_debug(BINDER_DEBUG_INTERNAL_REFS,
-					     "binder: refless node %d deleted\n",
-					     node->debug_id);
+					     "binder: refless node %d queued "
+					     "for delete\n", node->debug_id);
 			} else {
+				list_del_init(&node->work.entry);
 				hlist_del(&node->dead_node);
 				binder_debug(BINDER_DEBUG_INTERNAL_REFS,
 					     "binder: dead node %d deleted\n",
 					     node->debug_id);
+				kfree(node);
+				binder_stats_deleted(BINDER_STAT_NODE);
 			}
-			kfree(node);
-			binder_stats_deleted(BINDER_STAT_NODE);
 		}
 	}
 
 	return 0;
 }
 
+static int binder_dec_node(struct binder_node *node, int strong, int internal)
+{
+	struct binder_proc *owner;
+	int ret;
+
+	owner = binder_node_lock(node);
+	ret = binder_dec_node_ilocked(node, strong, internal);
+	binder_node_unlock(owner);
+	return ret;
+}
+
 
 static struct binder_ref *binder_get_ref(struct binder_proc *proc,
 					 uint32_t desc)
@@ -1106,7 +1599,7 @@ static struct binder_ref *binder_get_ref_for_node(struct binder_proc *proc,
 	if (new_ref == NULL)
 		return NULL;
 	binder_stats_created(BINDER_STAT_REF);
-	new_ref->debug_id = ++binder_last_id;
+	new_ref->debug_id = atomic_inc_return(&binder_last_id);
 	new_ref->proc = proc;
 	new_ref->node = node;
 	rb_link_node(&new_ref->rb_node_node, parent, p);
@@ -1135,7 +1628,10 @@ static struct binder_ref *binder_get_ref_for_node(struct binder_proc *proc,
 	rb_link_node(&new_ref->rb_node_desc, parent, p);
 	rb_insert_color(&new_ref->rb_node_desc, &proc->refs_by_desc);
 	if (node) {
+		struct binder_proc *owner = binder_node_lock(node);
+
 		hlist_add_head(&new_ref->node_entry, &node->refs);
+		binder_node_unlock(owner);
 
 		binder_debug(BINDER_DEBUG_INTERNAL_REFS,
 			     "binder: %d new ref %d desc %d for "
@@ -1152,6 +1648,8 @@ static struct binder_ref *binder_get_ref_for_node(struct binder_proc *proc,
 
 static void binder_delete_ref(struct binder_ref *ref)
 {
+	struct binder_proc *owner;
+
 	binder_debug(BINDER_DEBUG_INTERNAL_REFS,
 		     "binder: %d delete ref %d desc %d for "
 		     "node %d\n", ref->proc->pid, ref->debug_id,
@@ -1159,16 +1657,20 @@ static void binder_delete_ref(struct binder_ref *ref)
 
 	rb_erase(&ref->rb_node_desc, &ref->proc->refs_by_desc);
 	rb_erase(&ref->rb_node_node, &ref->proc->refs_by_node);
+	owner = binder_node_lock(ref->node);
 	if (ref->strong)
-		binder_dec_node(ref->node, 1, 1);
+		binder_dec_node_ilocked(ref->node, 1, 1);
 	hlist_del(&ref->node_entry);
-	binder_dec_node(ref->node, 0, 1);
+	binder_dec_node_ilocked(ref->node, 0, 1);
+	binder_node_unlock(owner);
 	if (ref->death) {
 		binder_debug(BINDER_DEBUG_DEAD_BINDER,
 			     "binder: %d delete ref %d desc %d "
 			     "has death notification\n", ref->proc->pid,
 			     ref->debug_id, ref->desc);
+		binder_inner_lock(ref->proc);
 		list_del(&ref->death->work.entry);
+		binder_inner_unlock(ref->proc);
 		kfree(ref->death);
 		binder_stats_deleted(BINDER_STAT_DEATH);
 	}
@@ -1248,6 +1750,11 @@ static void binder_pop_transaction(struct binder_thread *target_thread,
 	binder_stats_deleted(BINDER_STAT_TRANSACTION);
 }
 
+/*
+ * Caller must hold the lock of t->from's process, or binder_main_lock for
+ * writing when t->from may be gone and the reply has to be passed up to
+ * transactions of other processes.
+ */
 static void binder_send_failed_reply(struct binder_transaction *t,
 				     uint32_t error_code)
 {
@@ -1303,6 +1810,23 @@ static void binder_send_failed_reply(struct binder_transaction *t,
 	}
 }
 
+/*
+ * Fail @t back to its callers when its sender thread is already gone.  That
+ * walks transaction stacks of processes we hold no lock for, so switch to
+ * exclusive binder_main_lock for the duration.
+ */
+static void binder_send_failed_reply_exclusive(struct binder_proc *proc,
+					       struct binder_transaction *t,
+					       uint32_t error_code)
+{
+	binder_proc_unlock(proc);
+	up_read(&binder_main_lock);
+	down_write(&binder_main_lock);
+	binder_send_failed_reply(t, error_code);
+	downgrade_write(&binder_main_lock);
+	binder_proc_lock(proc);
+}
+
 static void binder_transaction_buffer_release(struct binder_proc *proc,
 					      struct binder_buffer *buffer,
 					      size_t *failed_at)
@@ -1386,11 +1910,12 @@ static void binder_transaction(struct binder_proc *proc,
 	struct binder_work *tcomplete;
 	size_t *offp, *off_end;
 	struct binder_proc *target_proc;
-	struct binder_thread *target_thread = NULL;
-	struct binder_node *target_node = NULL;
+	struct binder_proc *locked_target = NULL;
+	struct binder_thread *target_thread;
+	struct binder_node *target_node;
 	struct list_head *target_list;
 	wait_queue_head_t *target_wait;
-	struct binder_transaction *in_reply_to = NULL;
+	struct binder_transaction *in_reply_to;
 	struct binder_transaction_log_entry *e;
 	uint32_t return_error;
 
@@ -1402,6 +1927,11 @@ static void binder_transaction(struct binder_proc *proc,
 	e->data_size = tr->data_size;
 	e->offsets_size = tr->offsets_size;
 
+retry:
+	target_proc = NULL;
+	target_thread = NULL;
+	target_node = NULL;
+	in_reply_to = NULL;
 	if (reply) {
 		in_reply_to = thread->transaction_stack;
 		if (in_reply_to == NULL) {
@@ -1411,7 +1941,7 @@ static void binder_transaction(struct binder_proc *proc,
 			return_error = BR_FAILED_REPLY;
 			goto err_empty_call_stack;
 		}
-		binder_set_nice(in_reply_to->saved_priority);
+		binder_set_priority(in_reply_to->saved_priority);
 		if (in_reply_to->to_thread != thread) {
 			binder_user_error("binder: %d:%d got reply transaction "
 				"with bad transaction stack,"
@@ -1425,12 +1955,16 @@ static void binder_transaction(struct binder_proc *proc,
 			in_reply_to = NULL;
 			goto err_bad_call_stack;
 		}
-		thread->transaction_stack = in_reply_to->to_parent;
 		target_thread = in_reply_to->from;
 		if (target_thread == NULL) {
+			thread->transaction_stack = in_reply_to->to_parent;
 			return_error = BR_DEAD_REPLY;
 			goto err_dead_binder;
 		}
+		target_proc = target_thread->proc;
+		if (binder_proc_lock_target(proc, &locked_target, target_proc))
+			goto retry;
+		thread->transaction_stack = in_reply_to->to_parent;
 		if (target_thread->transaction_stack != in_reply_to) {
 			binder_user_error("binder: %d:%d got reply transaction "
 				"with bad target transaction stack %d, "
@@ -1444,7 +1978,6 @@ static void binder_transaction(struct binder_proc *proc,
 			target_thread = NULL;
 			goto err_dead_binder;
 		}
-		target_proc = target_thread->proc;
 	} else {
 		if (tr->target.handle) {
 			struct binder_ref *ref;
@@ -1490,6 +2023,8 @@ static void binder_transaction(struct binder_proc *proc,
 				tmp = tmp->from_parent;
 			}
 		}
+		if (binder_proc_lock_target(proc, &locked_target, target_proc))
+			goto retry;
 	}
 	if (target_thread) {
 		e->to_thread = target_thread->pid;
@@ -1516,7 +2051,8 @@ static void binder_transaction(struct binder_proc *proc,
 	}
 	binder_stats_created(BINDER_STAT_TRANSACTION_COMPLETE);
 
-	t->debug_id = ++binder_last_id;
+	t->debug_id = atomic_inc_return(&binder_last_id);
+	t->start_time = ktime_get();
 	e->debug_id = t->debug_id;
 
 	if (reply)
@@ -1545,7 +2081,10 @@ static void binder_transaction(struct binder_proc *proc,
 	t->to_thread = target_thread;
 	t->code = tr->code;
 	t->flags = tr->flags;
-	t->priority = task_nice(current);
+	if (!reply && (t->flags & TF_ONE_WAY))
+		t->priority = target_proc->default_priority;
+	else
+		binder_get_priority(current, &t->priority);
 	t->buffer = binder_alloc_buf(target_proc, tr->data_size,
 		tr->offsets_size, !reply && (t->flags & TF_ONE_WAY));
 	if (t->buffer == NULL) {
@@ -1556,6 +2095,7 @@ static void binder_transaction(struct binder_proc *proc,
 	t->buffer->debug_id = t->debug_id;
 	t->buffer->transaction = t;
 	t->buffer->target_node = target_node;
+	trace_binder_transaction_alloc_buf(t->buffer);
 	if (target_node)
 		binder_inc_node(target_node, 1, 0, NULL);
 
@@ -1604,7 +2144,12 @@ static void binder_transaction(struct binder_proc *proc,
 					return_error = BR_FAILED_REPLY;
 					goto err_binder_new_node_failed;
 				}
-				node->min_priority = fp->flags & FLAT_BINDER_FLAG_PRIORITY_MASK;
+				node->sched_policy = (fp->flags &
+					FLAT_BINDER_FLAG_SCHED_POLICY_MASK) >>
+					FLAT_BINDER_FLAG_SCHED_POLICY_SHIFT;
+				node->min_priority = to_kernel_prio(
+					node->sched_policy,
+					(s8)(fp->flags & FLAT_BINDER_FLAG_PRIORITY_MASK));
 				node->accept_fds = !!(fp->flags & FLAT_BINDER_FLAG_ACCEPTS_FDS);
 			}
 			if (fp->cookie != node->cookie) {
@@ -1720,13 +2265,18 @@ static void binder_transaction(struct binder_proc *proc,
 	}
 	if (reply) {
 		BUG_ON(t->buffer->async_transaction != 0);
+		trace_binder_reply(t, in_reply_to,
+			binder_latency_add(&proc->reply_latency,
+					   in_reply_to->start_time));
 		binder_pop_transaction(target_thread, in_reply_to);
 	} else if (!(t->flags & TF_ONE_WAY)) {
 		BUG_ON(t->buffer->async_transaction != 0);
 		t->need_reply = 1;
 		t->from_parent = thread->transaction_stack;
 		thread->transaction_stack = t;
-	} else {
+	}
+	binder_inner_lock(target_proc);
+	if (!reply && (t->flags & TF_ONE_WAY)) {
 		BUG_ON(target_node == NULL);
 		BUG_ON(t->buffer->async_transaction != 1);
 		if (target_node->has_async_transaction) {
@@ -1737,10 +2287,18 @@ static void binder_transaction(struct binder_proc *proc,
 	}
 	t->work.type = BINDER_WORK_TRANSACTION;
 	list_add_tail(&t->work.entry, target_list);
+	trace_binder_transaction(reply, t, target_node);
+	if (target_wait) {
+		trace_binder_wakeup(t, target_wait == &target_proc->wait);
+		wake_up_interruptible(target_wait);
+	}
+	binder_inner_unlock(target_proc);
 	tcomplete->type = BINDER_WORK_TRANSACTION_COMPLETE;
+	binder_inner_lock(proc);
 	list_add_tail(&tcomplete->entry, &thread->todo);
-	if (target_wait)
-		wake_up_interruptible(target_wait);
+	binder_inner_unlock(proc);
+	if (locked_target)
+		binder_proc_unlock(locked_target);
 	return;
 
 err_get_unused_fd_failed:
@@ -1781,9 +2339,15 @@ err_no_context_mgr_node:
 	BUG_ON(thread->return_error != BR_OK);
 	if (in_reply_to) {
 		thread->return_error = BR_TRANSACTION_COMPLETE;
-		binder_send_failed_reply(in_reply_to, return_error);
+		if (target_thread)
+			binder_send_failed_reply(in_reply_to, return_error);
 	} else
 		thread->return_error = return_error;
+	if (locked_target)
+		binder_proc_unlock(locked_target);
+	if (in_reply_to && !target_thread)
+		binder_send_failed_reply_exclusive(proc, in_reply_to,
+						   return_error);
 }
 
 int binder_thread_write(struct binder_proc *proc, struct binder_thread *thread,
@@ -1798,9 +2362,9 @@ int binder_thread_write(struct binder_proc *proc, struct binder_thread *thread,
 			return -EFAULT;
 		ptr += sizeof(uint32_t);
 		if (_IOC_NR(cmd) < ARRAY_SIZE(binder_stats.bc)) {
-			binder_stats.bc[_IOC_NR(cmd)]++;
-			proc->stats.bc[_IOC_NR(cmd)]++;
-			thread->stats.bc[_IOC_NR(cmd)]++;
+			atomic_inc(&binder_stats.bc[_IOC_NR(cmd)]);
+			atomic_inc(&proc->stats.bc[_IOC_NR(cmd)]);
+			atomic_inc(&thread->stats.bc[_IOC_NR(cmd)]);
 		}
 		switch (cmd) {
 		case BC_INCREFS:
@@ -1892,8 +2456,10 @@ int binder_thread_write(struct binder_proc *proc, struct binder_thread *thread,
 					cookie, node->cookie);
 				break;
 			}
+			binder_inner_lock(proc);
 			if (cmd == BC_ACQUIRE_DONE) {
 				if (node->pending_strong_ref == 0) {
+					binder_inner_unlock(proc);
 					binder_user_error("binder: %d:%d "
 						"BC_ACQUIRE_DONE node %d has "
 						"no pending acquire request\n",
@@ -1904,6 +2470,7 @@ int binder_thread_write(struct binder_proc *proc, struct binder_thread *thread,
 				node->pending_strong_ref = 0;
 			} else {
 				if (node->pending_weak_ref == 0) {
+					binder_inner_unlock(proc);
 					binder_user_error("binder: %d:%d "
 						"BC_INCREFS_DONE node %d has "
 						"no pending increfs request\n",
@@ -1913,7 +2480,8 @@ int binder_thread_write(struct binder_proc *proc, struct binder_thread *thread,
 				}
 				node->pending_weak_ref = 0;
 			}
-			binder_dec_node(node, cmd == BC_ACQUIRE_DONE, 0);
+			binder_dec_node_ilocked(node, cmd == BC_ACQUIRE_DONE, 0);
+			binder_node_unlock(proc);
 			binder_debug(BINDER_DEBUG_USER_REFS,
 				     "binder: %d:%d %s node %d ls %d lw %d\n",
 				     proc->pid, thread->pid,
@@ -1960,11 +2528,13 @@ int binder_thread_write(struct binder_proc *proc, struct binder_thread *thread,
 				buffer->transaction = NULL;
 			}
 			if (buffer->async_transaction && buffer->target_node) {
+				binder_inner_lock(proc);
 				BUG_ON(!buffer->target_node->has_async_transaction);
 				if (list_empty(&buffer->target_node->async_todo))
 					buffer->target_node->has_async_transaction = 0;
 				else
 					list_move_tail(buffer->target_node->async_todo.next, &thread->todo);
+				binder_inner_unlock(proc);
 			}
 			binder_transaction_buffer_release(proc, buffer, NULL);
 			binder_free_buf(proc, buffer);
@@ -2082,12 +2652,14 @@ int binder_thread_write(struct binder_proc *proc, struct binder_thread *thread,
 				ref->death = death;
 				if (ref->node->proc == NULL) {
 					ref->death->work.type = BINDER_WORK_DEAD_BINDER;
+					binder_inner_lock(proc);
 					if (thread->looper & (BINDER_LOOPER_STATE_REGISTERED | BINDER_LOOPER_STATE_ENTERED)) {
 						list_add_tail(&ref->death->work.entry, &thread->todo);
 					} else {
 						list_add_tail(&ref->death->work.entry, &proc->todo);
 						wake_up_interruptible(&proc->wait);
 					}
+					binder_inner_unlock(proc);
 				}
 			} else {
 				if (ref->death == NULL) {
@@ -2110,6 +2682,7 @@ int binder_thread_write(struct binder_proc *proc, struct binder_thread *thread,
 					break;
 				}
 				ref->death = NULL;
+				binder_inner_lock(proc);
 				if (list_empty(&death->work.entry)) {
 					death->work.type = BINDER_WORK_CLEAR_DEATH_NOTIFICATION;
 					if (thread->looper & (BINDER_LOOPER_STATE_REGISTERED | BINDER_LOOPER_STATE_ENTERED)) {
@@ -2122,6 +2695,7 @@ int binder_thread_write(struct binder_proc *proc, struct binder_thread *thread,
 					BUG_ON(death->work.type != BINDER_WORK_DEAD_BINDER);
 					death->work.type = BINDER_WORK_DEAD_BINDER_AND_CLEAR;
 				}
+				binder_inner_unlock(proc);
 			}
 		} break;
 		case BC_DEAD_BINDER_DONE: {
@@ -2132,6 +2706,7 @@ int binder_thread_write(struct binder_proc *proc, struct binder_thread *thread,
 				return -EFAULT;
 
 			ptr += sizeof(void *);
+			binder_inner_lock(proc);
 			list_for_each_entry(w, &proc->delivered_death, entry) {
 				struct binder_ref_death *tmp_death = container_of(w, struct binder_ref_death, work);
 				if (tmp_death->cookie == cookie) {
@@ -2143,6 +2718,7 @@ int binder_thread_write(struct binder_proc *proc, struct binder_thread *thread,
 				     "binder: %d:%d BC_DEAD_BINDER_DONE %p found %p\n",
 				     proc->pid, thread->pid, cookie, death);
 			if (death == NULL) {
+				binder_inner_unlock(proc);
 				binder_user_error("binder: %d:%d BC_DEAD"
 					"_BINDER_DONE %p not found\n",
 					proc->pid, thread->pid, cookie);
@@ -2159,6 +2735,7 @@ int binder_thread_write(struct binder_proc *proc, struct binder_thread *thread,
 					wake_up_interruptible(&proc->wait);
 				}
 			}
+			binder_inner_unlock(proc);
 		} break;
 
 		default:
@@ -2175,9 +2752,9 @@ void binder_stat_br(struct binder_proc *proc, struct binder_thread *thread,
 		    uint32_t cmd)
 {
 	if (_IOC_NR(cmd) < ARRAY_SIZE(binder_stats.br)) {
-		binder_stats.br[_IOC_NR(cmd)]++;
-		proc->stats.br[_IOC_NR(cmd)]++;
-		thread->stats.br[_IOC_NR(cmd)]++;
+		atomic_inc(&binder_stats.br[_IOC_NR(cmd)]);
+		atomic_inc(&proc->stats.br[_IOC_NR(cmd)]);
+		atomic_inc(&thread->stats.br[_IOC_NR(cmd)]);
 	}
 }
 
@@ -2235,7 +2812,8 @@ retry:
 	thread->looper |= BINDER_LOOPER_STATE_WAITING;
 	if (wait_for_proc_work)
 		proc->ready_threads++;
-	mutex_unlock(&binder_lock);
+	binder_proc_unlock(proc);
+	up_read(&binder_main_lock);
 	if (wait_for_proc_work) {
 		if (!(thread->looper & (BINDER_LOOPER_STATE_REGISTERED |
 					BINDER_LOOPER_STATE_ENTERED))) {
@@ -2246,7 +2824,7 @@ retry:
 			wait_event_interruptible(binder_user_error_wait,
 						 binder_stop_on_user_error < 2);
 		}
-		binder_set_nice(proc->default_priority);
+		binder_set_priority(proc->default_priority);
 		if (non_block) {
 			if (!binder_has_proc_work(proc, thread))
 				ret = -EAGAIN;
@@ -2259,7 +2837,8 @@ retry:
 		} else
 			ret = wait_event_interruptible(thread->wait, binder_has_thread_work(thread));
 	}
-	mutex_lock(&binder_lock);
+	down_read(&binder_main_lock);
+	binder_proc_lock(proc);
 	if (wait_for_proc_work)
 		proc->ready_threads--;
 	thread->looper &= ~BINDER_LOOPER_STATE_WAITING;
@@ -2273,15 +2852,23 @@ retry:
 		struct binder_work *w;
 		struct binder_transaction *t = NULL;
 
+		/*
+		 * Work is only ever removed from our lists with proc->lock
+		 * held, which we have, so w stays put after the peek; the
+		 * inner lock just orders us against remote list_add_tail.
+		 */
+		binder_inner_lock(proc);
 		if (!list_empty(&thread->todo))
 			w = list_first_entry(&thread->todo, struct binder_work, entry);
 		else if (!list_empty(&proc->todo) && wait_for_proc_work)
 			w = list_first_entry(&proc->todo, struct binder_work, entry);
 		else {
+			binder_inner_unlock(proc);
 			if (ptr - buffer == 4 && !(thread->looper & BINDER_LOOPER_STATE_NEED_RETURN)) /* no data added */
 				goto retry;
 			break;
 		}
+		binder_inner_unlock(proc);
 
 		if (end - ptr < sizeof(tr) + 4)
 			break;
@@ -2301,7 +2888,9 @@ retry:
 				     "binder: %d:%d BR_TRANSACTION_COMPLETE\n",
 				     proc->pid, thread->pid);
 
+			binder_inner_lock(proc);
 			list_del(&w->entry);
+			binder_inner_unlock(proc);
 			kfree(w);
 			binder_stats_deleted(BINDER_STAT_TRANSACTION_COMPLETE);
 		} break;
@@ -2309,8 +2898,11 @@ retry:
 			struct binder_node *node = container_of(w, struct binder_node, work);
 			uint32_t cmd = BR_NOOP;
 			const char *cmd_name;
-			int strong = node->internal_strong_refs || node->local_strong_refs;
-			int weak = !hlist_empty(&node->refs) || node->local_weak_refs || strong;
+			int strong, weak;
+
+			binder_inner_lock(proc);
+			strong = node->internal_strong_refs || node->local_strong_refs;
+			weak = !hlist_empty(&node->refs) || node->local_weak_refs || strong;
 			if (weak && !node->has_weak_ref) {
 				cmd = BR_INCREFS;
 				cmd_name = "BR_INCREFS";
@@ -2332,6 +2924,12 @@ retry:
 				cmd_name = "BR_DECREFS";
 				node->has_weak_ref = 0;
 			}
+			if (cmd == BR_NOOP) {
+				list_del_init(&w->entry);
+				if (!weak && !strong)
+					rb_erase(&node->rb_node, &proc->nodes);
+			}
+			binder_inner_unlock(proc);
 			if (cmd != BR_NOOP) {
 				if (put_user(cmd, (uint32_t __user *)ptr))
 					return -EFAULT;
@@ -2348,13 +2946,11 @@ retry:
 					     "binder: %d:%d %s %d u%p c%p\n",
 					     proc->pid, thread->pid, cmd_name, node->debug_id, node->ptr, node->cookie);
 			} else {
-				list_del_init(&w->entry);
 				if (!weak && !strong) {
 					binder_debug(BINDER_DEBUG_INTERNAL_REFS,
 						     "binder: %d:%d node %d u%p c%p deleted\n",
 						     proc->pid, thread->pid, node->debug_id,
 						     node->ptr, node->cookie);
-					rb_erase(&node->rb_node, &proc->nodes);
 					kfree(node);
 					binder_stats_deleted(BINDER_STAT_NODE);
 				} else {
@@ -2391,11 +2987,16 @@ retry:
 				      death->cookie);
 
 			if (w->type == BINDER_WORK_CLEAR_DEATH_NOTIFICATION) {
+				binder_inner_lock(proc);
 				list_del(&w->entry);
+				binder_inner_unlock(proc);
 				kfree(death);
 				binder_stats_deleted(BINDER_STAT_DEATH);
-			} else
+			} else {
+				binder_inner_lock(proc);
 				list_move(&w->entry, &proc->delivered_death);
+				binder_inner_unlock(proc);
+			}
 			if (cmd == BR_DEAD_BINDER)
 				goto done; /* DEAD_BINDER notifications can cause transactions */
 		} break;
@@ -2409,13 +3010,8 @@ retry:
 			struct binder_node *target_node = t->buffer->target_node;
 			tr.target.ptr = target_node->ptr;
 			tr.cookie =  target_node->cookie;
-			t->saved_priority = task_nice(current);
-			if (t->priority < target_node->min_priority &&
-			    !(t->flags & TF_ONE_WAY))
-				binder_set_nice(t->priority);
-			else if (!(t->flags & TF_ONE_WAY) ||
-				 t->saved_priority > target_node->min_priority)
-				binder_set_nice(target_node->min_priority);
+			binder_get_priority(current, &t->saved_priority);
+			binder_transaction_priority(t, target_node);
 			cmd = BR_TRANSACTION;
 		} else {
 			tr.target.ptr = NULL;
@@ -2450,6 +3046,13 @@ retry:
 		ptr += sizeof(tr);
 
 		binder_stat_br(proc, thread, cmd);
+		if (cmd == BR_TRANSACTION)
+			trace_binder_transaction_received(t, thread,
+				binder_latency_add(&proc->recv_latency,
+						   t->start_time));
+		else
+			trace_binder_transaction_received(t, thread,
+				ktime_us_delta(ktime_get(), t->start_time));
 		binder_debug(BINDER_DEBUG_TRANSACTION,
 			     "binder: %d:%d %s %d %d:%d, cmd %d"
 			     "size %zd-%zd ptr %p-%p\n",
@@ -2461,7 +3064,9 @@ retry:
 			     t->buffer->data_size, t->buffer->offsets_size,
 			     tr.data.ptr.buffer, tr.data.ptr.offsets);
 
+		binder_inner_lock(proc);
 		list_del(&t->work.entry);
+		binder_inner_unlock(proc);
 		t->buffer->allow_user_free = 1;
 		if (cmd == BR_TRANSACTION && !(t->flags & TF_ONE_WAY)) {
 			t->to_parent = thread->transaction_stack;
@@ -2601,12 +3206,14 @@ static unsigned int binder_poll(struct file *filp,
 	struct binder_thread *thread = NULL;
 	int wait_for_proc_work;
 
-	mutex_lock(&binder_lock);
+	down_read(&binder_main_lock);
+	binder_proc_lock(proc);
 	thread = binder_get_thread(proc);
 
 	wait_for_proc_work = thread->transaction_stack == NULL &&
 		list_empty(&thread->todo) && thread->return_error == BR_OK;
-	mutex_unlock(&binder_lock);
+	binder_proc_unlock(proc);
+	up_read(&binder_main_lock);
 
 	if (wait_for_proc_work) {
 		if (binder_has_proc_work(proc, thread))
@@ -2631,6 +3238,8 @@ static long binder_ioctl(struct file *filp, unsigned int cmd, unsigned long arg)
 	struct binder_thread *thread;
 	unsigned int size = _IOC_SIZE(cmd);
 	void __user *ubuf = (void __user *)arg;
+	int exclusive = cmd == BINDER_SET_CONTEXT_MGR ||
+			cmd == BINDER_THREAD_EXIT;
 
 	/*printk(KERN_INFO "[K] binder_ioctl: %d:%d %x %lx\n", proc->pid, current->pid, cmd, arg);*/
 
@@ -2638,7 +3247,11 @@ static long binder_ioctl(struct file *filp, unsigned int cmd, unsigned long arg)
 	if (ret)
 		return ret;
 
-	mutex_lock(&binder_lock);
+	if (exclusive)
+		down_write(&binder_main_lock);
+	else
+		down_read(&binder_main_lock);
+	binder_proc_lock(proc);
 	thread = binder_get_thread(proc);
 	if (thread == NULL) {
 		ret = -ENOMEM;
@@ -2718,10 +3331,12 @@ static long binder_ioctl(struct file *filp, unsigned int cmd, unsigned long arg)
 			ret = -ENOMEM;
 			goto err;
 		}
+		binder_inner_lock(proc);
 		binder_context_mgr_node->local_weak_refs++;
 		binder_context_mgr_node->local_strong_refs++;
 		binder_context_mgr_node->has_strong_ref = 1;
 		binder_context_mgr_node->has_weak_ref = 1;
+		binder_inner_unlock(proc);
 		break;
 	case BINDER_THREAD_EXIT:
 		binder_debug(BINDER_DEBUG_THREADS, "binder: %d:%d exit\n",
@@ -2747,7 +3362,11 @@ static long binder_ioctl(struct file *filp, unsigned int cmd, unsigned long arg)
 err:
 	if (thread)
 		thread->looper &= ~BINDER_LOOPER_STATE_NEED_RETURN;
-	mutex_unlock(&binder_lock);
+	binder_proc_unlock(proc);
+	if (exclusive)
+		up_write(&binder_main_lock);
+	else
+		up_read(&binder_main_lock);
 	wait_event_interruptible(binder_user_error_wait, binder_stop_on_user_error < 2);
 	if (ret && ret != -ERESTARTSYS)
 		printk(KERN_INFO "[K] binder: %d:%d ioctl %x %lx returned %d\n", proc->pid, current->pid, cmd, arg, ret);
@@ -2785,6 +3404,7 @@ static struct vm_operations_struct binder_vm_ops = {
 static int binder_mmap(struct file *filp, struct vm_area_struct *vma)
 {
 	int ret;
+	int i;
 	struct vm_struct *area;
 	struct binder_proc *proc = filp->private_data;
 	const char *failure_string;
@@ -2835,7 +3455,17 @@ static int binder_mmap(struct file *filp, struct vm_area_struct *vma)
 		failure_string = "alloc page array";
 		goto err_alloc_pages_failed;
 	}
+	proc->lru_pages = kzalloc(sizeof(proc->lru_pages[0]) * ((vma->vm_end - vma->vm_start) / PAGE_SIZE), GFP_KERNEL);
+	if (proc->lru_pages == NULL) {
+		ret = -ENOMEM;
+		failure_string = "alloc lru page array";
+		goto err_alloc_lru_pages_failed;
+	}
 	proc->buffer_size = vma->vm_end - vma->vm_start;
+	for (i = 0; i < proc->buffer_size / PAGE_SIZE; i++) {
+		INIT_LIST_HEAD(&proc->lru_pages[i].lru);
+		proc->lru_pages[i].proc = proc;
+	}
 
 	vma->vm_ops = &binder_vm_ops;
 	vma->vm_private_data = proc;
@@ -2860,6 +3490,9 @@ static int binder_mmap(struct file *filp, struct vm_area_struct *vma)
 	return 0;
 
 err_alloc_small_buf_failed:
+	kfree(proc->lru_pages);
+	proc->lru_pages = NULL;
+err_alloc_lru_pages_failed:
 	kfree(proc->pages);
 	proc->pages = NULL;
 err_alloc_pages_failed:
@@ -2885,16 +3518,18 @@ static int binder_open(struct inode *nodp, struct file *filp)
 		return -ENOMEM;
 	get_task_struct(current);
 	proc->tsk = current;
+	mutex_init(&proc->lock);
+	spin_lock_init(&proc->inner_lock);
 	INIT_LIST_HEAD(&proc->todo);
 	init_waitqueue_head(&proc->wait);
-	proc->default_priority = task_nice(current);
-	mutex_lock(&binder_lock);
-	binder_stats_created(BINDER_STAT_PROC);
-	hlist_add_head(&proc->proc_node, &binder_procs);
+	binder_get_priority(current, &proc->default_priority);
 	proc->pid = current->group_leader->pid;
 	INIT_LIST_HEAD(&proc->delivered_death);
+	mutex_lock(&binder_procs_lock);
+	binder_stats_created(BINDER_STAT_PROC);
+	hlist_add_head(&proc->proc_node, &binder_procs);
 	filp->private_data = proc;
-	mutex_unlock(&binder_lock);
+	mutex_unlock(&binder_procs_lock);
 
 	if (binder_debugfs_dir_entry_proc) {
 		char strbuf[11];
@@ -2915,6 +3550,38 @@ static int binder_flush(struct file *filp, fl_owner_t id)
 	return 0;
 }
 
+/*
+ * Free the refless nodes binder_dec_node_ilocked() queued on our todo
+ * list, for a process that is not reading it.  They carry no command for
+ * userspace, so this is what binder_thread_read would have done.
+ */
+static void binder_deferred_reap_nodes(struct binder_proc *proc)
+{
+	struct binder_work *w, *tmp;
+	struct binder_node *node;
+	int reaped = 0;
+
+	binder_inner_lock(proc);
+	list_for_each_entry_safe(w, tmp, &proc->todo, entry) {
+		if (w->type != BINDER_WORK_NODE)
+			continue;
+		node = container_of(w, struct binder_node, work);
+		if (node->has_strong_ref || node->has_weak_ref ||
+		    node->internal_strong_refs || node->local_strong_refs ||
+		    node->local_weak_refs || !hlist_empty(&node->refs))
+			continue;
+		list_del_init(&w->entry);
+		rb_erase(&node->rb_node, &proc->nodes);
+		kfree(node);
+		binder_stats_deleted(BINDER_STAT_NODE);
+		reaped++;
+	}
+	binder_inner_unlock(proc);
+
+	binder_debug(BINDER_DEBUG_INTERNAL_REFS,
+		     "binder: %d reaped %d refless nodes\n", proc->pid, reaped);
+}
+
 static void binder_deferred_flush(struct binder_proc *proc)
 {
 	struct rb_node *n;
@@ -2953,7 +3620,9 @@ static void binder_deferred_release(struct binder_proc *proc)
 	BUG_ON(proc->vma);
 	BUG_ON(proc->files);
 
+	mutex_lock(&binder_procs_lock);
 	hlist_del(&proc->proc_node);
+	mutex_unlock(&binder_procs_lock);
 	if (binder_context_mgr_node && binder_context_mgr_node->proc == proc) {
 		binder_debug(BINDER_DEBUG_DEAD_BINDER,
 			     "binder_release: %d context_mgr_node gone\n",
@@ -2986,7 +3655,9 @@ static void binder_deferred_release(struct binder_proc *proc)
 			node->proc = NULL;
 			node->local_strong_refs = 0;
 			node->local_weak_refs = 0;
+			spin_lock(&binder_dead_nodes_lock);
 			hlist_add_head(&node->dead_node, &binder_dead_nodes);
+			spin_unlock(&binder_dead_nodes_lock);
 
 			hlist_for_each_entry(ref, pos, &node->refs, node_entry) {
 				incoming_refs++;
@@ -3034,24 +3705,32 @@ static void binder_deferred_release(struct binder_proc *proc)
 
 	binder_stats_deleted(BINDER_STAT_PROC);
 
+	/* dropping the refs above may have queued a reap of our nodes */
+	mutex_lock(&binder_deferred_lock);
+	hlist_del_init(&proc->deferred_work_node);
+	mutex_unlock(&binder_deferred_lock);
+
 	page_count = 0;
 	if (proc->pages) {
 		int i;
 		for (i = 0; i < proc->buffer_size / PAGE_SIZE; i++) {
 			if (proc->pages[i]) {
 				void *page_addr = proc->buffer + i * PAGE_SIZE;
-				binder_debug(BINDER_DEBUG_BUFFER_ALLOC,
-					     "binder_release: %d: "
-					     "page %d at %p not freed\n",
-					     proc->pid, i,
-					     page_addr);
+				if (!binder_lru_del(proc, i))
+					binder_debug(BINDER_DEBUG_BUFFER_ALLOC,
+						     "binder_release: %d: "
+						     "page %d at %p not freed\n",
+						     proc->pid, i,
+						     page_addr);
 				unmap_kernel_range((unsigned long)page_addr,
 					PAGE_SIZE);
 				__free_page(proc->pages[i]);
+				proc->pages_mapped--;
 				page_count++;
 			}
 		}
 		kfree(proc->pages);
+		kfree(proc->lru_pages);
 		vfree(proc->buffer);
 	}
 
@@ -3074,7 +3753,6 @@ static void binder_deferred_func(struct work_struct *work)
 
 	int defer;
 	do {
-		mutex_lock(&binder_lock);
 		mutex_lock(&binder_deferred_lock);
 		if (!hlist_empty(&binder_deferred_list)) {
 			proc = hlist_entry(binder_deferred_list.first,
@@ -3089,19 +3767,30 @@ static void binder_deferred_func(struct work_struct *work)
 		mutex_unlock(&binder_deferred_lock);
 
 		files = NULL;
-		if (defer & BINDER_DEFERRED_PUT_FILES) {
-			files = proc->files;
-			if (files)
-				proc->files = NULL;
-		}
+		if (defer & (BINDER_DEFERRED_PUT_FILES | BINDER_DEFERRED_FLUSH |
+			     BINDER_DEFERRED_REAP_NODES)) {
+			down_read(&binder_main_lock);
+			binder_proc_lock(proc);
+			if (defer & BINDER_DEFERRED_PUT_FILES) {
+				files = proc->files;
+				if (files)
+					proc->files = NULL;
+			}
 
-		if (defer & BINDER_DEFERRED_FLUSH)
-			binder_deferred_flush(proc);
+			if (defer & BINDER_DEFERRED_FLUSH)
+				binder_deferred_flush(proc);
+			if (defer & BINDER_DEFERRED_REAP_NODES)
+				binder_deferred_reap_nodes(proc);
+			binder_proc_unlock(proc);
+			up_read(&binder_main_lock);
+		}
 
-		if (defer & BINDER_DEFERRED_RELEASE)
+		if (defer & BINDER_DEFERRED_RELEASE) {
+			down_write(&binder_main_lock);
 			binder_deferred_release(proc); /* frees proc */
+			up_write(&binder_main_lock);
+		}
 
-		mutex_unlock(&binder_lock);
 		if (files)
 			put_files_struct(files);
 	} while (proc);
@@ -3125,13 +3814,14 @@ static void print_binder_transaction(struct seq_file *m, const char *prefix,
 				     struct binder_transaction *t)
 {
 	seq_printf(m,
-		   "%s %d: %p from %d:%d to %d:%d code %x flags %x pri %ld r%d",
+		   "%s %d: %p from %d:%d to %d:%d code %x flags %x pri %d:%d r%d",
 		   prefix, t->debug_id, t,
 		   t->from ? t->from->proc->pid : 0,
 		   t->from ? t->from->pid : 0,
 		   t->to_proc ? t->to_proc->pid : 0,
 		   t->to_thread ? t->to_thread->pid : 0,
-		   t->code, t->flags, t->priority, t->need_reply);
+		   t->code, t->flags, t->priority.sched_policy,
+		   t->priority.prio, t->need_reply);
 	if (t->buffer == NULL) {
 		seq_puts(m, " buffer free\n");
 		return;
@@ -3188,12 +3878,39 @@ static void print_binder_work(struct seq_file *m, const char *prefix,
 	}
 }
 
+/* todo entries printed per hold of the inner lock */
+#define BINDER_PRINT_BATCH	16
+
+/*
+ * Work only leaves a todo list with proc->lock held, which the dumps hold
+ * whenever they lock at all, so the inner lock can be dropped between
+ * batches without losing our place in the list.
+ */
+static void print_binder_todo(struct seq_file *m, struct binder_proc *proc,
+			      struct list_head *todo, const char *prefix,
+			      const char *transaction_prefix, int do_lock)
+{
+	struct binder_work *w;
+	int count = 0;
+
+	if (do_lock)
+		binder_inner_lock(proc);
+	list_for_each_entry(w, todo, entry) {
+		print_binder_work(m, prefix, transaction_prefix, w);
+		if (do_lock && ++count % BINDER_PRINT_BATCH == 0) {
+			binder_inner_unlock(proc);
+			binder_inner_lock(proc);
+		}
+	}
+	if (do_lock)
+		binder_inner_unlock(proc);
+}
+
 static void print_binder_thread(struct seq_file *m,
 				struct binder_thread *thread,
-				int print_always)
+				int print_always, int do_lock)
 {
 	struct binder_transaction *t;
-	struct binder_work *w;
 	size_t start_pos = m->count;
 	size_t header_pos;
 
@@ -3214,9 +3931,8 @@ static void print_binder_thread(struct seq_file *m,
 			t = NULL;
 		}
 	}
-	list_for_each_entry(w, &thread->todo, entry) {
-		print_binder_work(m, "    ", "    pending transaction", w);
-	}
+	print_binder_todo(m, thread->proc, &thread->todo, "    ",
+			  "    pending transaction", do_lock);
 	if (!print_always && m->count == header_pos)
 		m->count = start_pos;
 }
@@ -3255,8 +3971,14 @@ static void print_binder_ref(struct seq_file *m, struct binder_ref *ref)
 		   ref->node->debug_id, ref->strong, ref->weak, ref->death);
 }
 
+/*
+ * Called with proc->lock held unless do_lock is clear.  The inner lock is
+ * only taken per node and per batch of todo entries, so remote senders
+ * are not held off for the whole dump.
+ */
 static void print_binder_proc(struct seq_file *m,
-			      struct binder_proc *proc, int print_all)
+			      struct binder_proc *proc, int print_all,
+			      int do_lock)
 {
 	struct binder_work *w;
 	struct rb_node *n;
@@ -3268,12 +3990,17 @@ static void print_binder_proc(struct seq_file *m,
 
 	for (n = rb_first(&proc->threads); n != NULL; n = rb_next(n))
 		print_binder_thread(m, rb_entry(n, struct binder_thread,
-						rb_node), print_all);
+						rb_node), print_all, do_lock);
 	for (n = rb_first(&proc->nodes); n != NULL; n = rb_next(n)) {
 		struct binder_node *node = rb_entry(n, struct binder_node,
 						    rb_node);
-		if (print_all || node->has_async_transaction)
-			print_binder_node(m, node);
+		if (!print_all && !node->has_async_transaction)
+			continue;
+		if (do_lock)
+			binder_inner_lock(proc);
+		print_binder_node(m, node);
+		if (do_lock)
+			binder_inner_unlock(proc);
 	}
 	if (print_all) {
 		for (n = rb_first(&proc->refs_by_desc);
@@ -3285,8 +4012,8 @@ static void print_binder_proc(struct seq_file *m,
 	for (n = rb_first(&proc->allocated_buffers); n != NULL; n = rb_next(n))
 		print_binder_buffer(m, "  buffer",
 				    rb_entry(n, struct binder_buffer, rb_node));
-	list_for_each_entry(w, &proc->todo, entry)
-		print_binder_work(m, "  ", "  pending transaction", w);
+	print_binder_todo(m, proc, &proc->todo, "  ", "  pending transaction",
+			  do_lock);
 	list_for_each_entry(w, &proc->delivered_death, entry) {
 		seq_puts(m, "  has delivered dead binder\n");
 		break;
@@ -3354,17 +4081,21 @@ static void print_binder_stats(struct seq_file *m, const char *prefix,
 	BUILD_BUG_ON(ARRAY_SIZE(stats->bc) !=
 		     ARRAY_SIZE(binder_command_strings));
 	for (i = 0; i < ARRAY_SIZE(stats->bc); i++) {
-		if (stats->bc[i])
+		int temp = atomic_read(&stats->bc[i]);
+
+		if (temp)
 			seq_printf(m, "%s%s: %d\n", prefix,
-				   binder_command_strings[i], stats->bc[i]);
+				   binder_command_strings[i], temp);
 	}
 
 	BUILD_BUG_ON(ARRAY_SIZE(stats->br) !=
 		     ARRAY_SIZE(binder_return_strings));
 	for (i = 0; i < ARRAY_SIZE(stats->br); i++) {
-		if (stats->br[i])
+		int temp = atomic_read(&stats->br[i]);
+
+		if (temp)
 			seq_printf(m, "%s%s: %d\n", prefix,
-				   binder_return_strings[i], stats->br[i]);
+				   binder_return_strings[i], temp);
 	}
 
 	BUILD_BUG_ON(ARRAY_SIZE(stats->obj_created) !=
@@ -3372,16 +4103,18 @@ static void print_binder_stats(struct seq_file *m, const char *prefix,
 	BUILD_BUG_ON(ARRAY_SIZE(stats->obj_created) !=
 		     ARRAY_SIZE(stats->obj_deleted));
 	for (i = 0; i < ARRAY_SIZE(stats->obj_created); i++) {
-		if (stats->obj_created[i] || stats->obj_deleted[i])
+		int created = atomic_read(&stats->obj_created[i]);
+		int deleted = atomic_read(&stats->obj_deleted[i]);
+
+		if (created || deleted)
 			seq_printf(m, "%s%s: active %d total %d\n", prefix,
 				binder_objstat_strings[i],
-				stats->obj_created[i] - stats->obj_deleted[i],
-				stats->obj_created[i]);
+				created - deleted, created);
 	}
 }
 
 static void print_binder_proc_stats(struct seq_file *m,
-				    struct binder_proc *proc)
+				    struct binder_proc *proc, int do_lock)
 {
 	struct binder_work *w;
 	struct rb_node *n;
@@ -3417,8 +4150,12 @@ static void print_binder_proc_stats(struct seq_file *m,
 	for (n = rb_first(&proc->allocated_buffers); n != NULL; n = rb_next(n))
 		count++;
 	seq_printf(m, "  buffers: %d\n", count);
+	seq_printf(m, "  pages mapped: %lu warm hits %lu\n",
+		   proc->pages_mapped, proc->pages_warm_hits);
 
 	count = 0;
+	if (do_lock)
+		binder_inner_lock(proc);
 	list_for_each_entry(w, &proc->todo, entry) {
 		switch (w->type) {
 		case BINDER_WORK_TRANSACTION:
@@ -3428,12 +4165,16 @@ static void print_binder_proc_stats(struct seq_file *m,
 			break;
 		}
 	}
+	if (do_lock)
+		binder_inner_unlock(proc);
 	seq_printf(m, "  pending transactions: %d\n", count);
+	seq_printf(m, "  lock contention: proc %d inner %d\n",
+		   atomic_read(&proc->lock_contended),
+		   atomic_read(&proc->inner_lock_contended));
 
 	print_binder_stats(m, "  ", &proc->stats);
 }
 
-
 static int binder_state_show(struct seq_file *m, void *unused)
 {
 	struct binder_proc *proc;
@@ -3442,19 +4183,32 @@ static int binder_state_show(struct seq_file *m, void *unused)
 	int do_lock = !binder_debug_no_lock;
 
 	if (do_lock)
-		mutex_lock(&binder_lock);
+		down_read(&binder_main_lock);
 
 	seq_puts(m, "binder state:\n");
 
+	if (do_lock)
+		spin_lock(&binder_dead_nodes_lock);
 	if (!hlist_empty(&binder_dead_nodes))
 		seq_puts(m, "dead nodes:\n");
 	hlist_for_each_entry(node, pos, &binder_dead_nodes, dead_node)
 		print_binder_node(m, node);
+	if (do_lock)
+		spin_unlock(&binder_dead_nodes_lock);
 
-	hlist_for_each_entry(proc, pos, &binder_procs, proc_node)
-		print_binder_proc(m, proc, 1);
 	if (do_lock)
-		mutex_unlock(&binder_lock);
+		mutex_lock(&binder_procs_lock);
+	hlist_for_each_entry(proc, pos, &binder_procs, proc_node) {
+		if (do_lock)
+			binder_proc_lock(proc);
+		print_binder_proc(m, proc, 1, do_lock);
+		if (do_lock)
+			binder_proc_unlock(proc);
+	}
+	if (do_lock) {
+		mutex_unlock(&binder_procs_lock);
+		up_read(&binder_main_lock);
+	}
 	return 0;
 }
 
@@ -3463,18 +4217,92 @@ static int binder_stats_show(struct seq_file *m, void *unused)
 	struct binder_proc *proc;
 	struct hlist_node *pos;
 	int do_lock = !binder_debug_no_lock;
+	int lru_count;
 
 	if (do_lock)
-		mutex_lock(&binder_lock);
+		down_read(&binder_main_lock);
 
 	seq_puts(m, "binder stats:\n");
 
 	print_binder_stats(m, "", &binder_stats);
+	seq_printf(m, "lock contention: proc %d inner %d\n",
+		   atomic_read(&binder_proc_lock_contended),
+		   atomic_read(&binder_inner_lock_contended));
+	spin_lock(&binder_lru_lock);
+	lru_count = binder_lru_count;
+	spin_unlock(&binder_lru_lock);
+	seq_printf(m, "lru pages: %d reclaimed %d\n", lru_count,
+		   atomic_read(&binder_lru_reclaimed));
 
-	hlist_for_each_entry(proc, pos, &binder_procs, proc_node)
-		print_binder_proc_stats(m, proc);
 	if (do_lock)
-		mutex_unlock(&binder_lock);
+		mutex_lock(&binder_procs_lock);
+	hlist_for_each_entry(proc, pos, &binder_procs, proc_node) {
+		if (do_lock)
+			binder_proc_lock(proc);
+		print_binder_proc_stats(m, proc, do_lock);
+		if (do_lock)
+			binder_proc_unlock(proc);
+	}
+	if (do_lock) {
+		mutex_unlock(&binder_procs_lock);
+		up_read(&binder_main_lock);
+	}
+	return 0;
+}
+
+static void print_binder_latency_hist(struct seq_file *m, const char *name,
+				      struct binder_latency_hist *hist)
+{
+	int i;
+
+	seq_printf(m, "  %s:\n", name);
+	for (i = 0; i < BINDER_LATENCY_BUCKETS; i++) {
+		if (!hist->count[i])
+			continue;
+		if (i == 0)
+			seq_printf(m, "    %10s us: %u\n", "<1",
+				   hist->count[i]);
+		else if (i == BINDER_LATENCY_BUCKETS - 1)
+			seq_printf(m, "    >=%8lu us: %u\n", 1UL << (i - 1),
+				   hist->count[i]);
+		else
+			seq_printf(m, "    %4lu-%-5lu us: %u\n",
+				   1UL << (i - 1), (1UL << i) - 1,
+				   hist->count[i]);
+	}
+}
+
+static void print_binder_proc_latency(struct seq_file *m,
+				      struct binder_proc *proc)
+{
+	seq_printf(m, "proc %d\n", proc->pid);
+	print_binder_latency_hist(m, "send-to-receive", &proc->recv_latency);
+	print_binder_latency_hist(m, "send-to-reply", &proc->reply_latency);
+}
+
+static int binder_latency_show(struct seq_file *m, void *unused)
+{
+	struct binder_proc *proc;
+	struct hlist_node *pos;
+	int do_lock = !binder_debug_no_lock;
+
+	if (do_lock) {
+		down_read(&binder_main_lock);
+		mutex_lock(&binder_procs_lock);
+	}
+
+	seq_puts(m, "binder transaction latency:\n");
+	hlist_for_each_entry(proc, pos, &binder_procs, proc_node) {
+		if (do_lock)
+			binder_proc_lock(proc);
+		print_binder_proc_latency(m, proc);
+		if (do_lock)
+			binder_proc_unlock(proc);
+	}
+	if (do_lock) {
+		mutex_unlock(&binder_procs_lock);
+		up_read(&binder_main_lock);
+	}
 	return 0;
 }
 
@@ -3484,14 +4312,23 @@ static int binder_transactions_show(struct seq_file *m, void *unused)
 	struct hlist_node *pos;
 	int do_lock = !binder_debug_no_lock;
 
-	if (do_lock)
-		mutex_lock(&binder_lock);
+	if (do_lock) {
+		down_read(&binder_main_lock);
+		mutex_lock(&binder_procs_lock);
+	}
 
 	seq_puts(m, "binder transactions:\n");
-	hlist_for_each_entry(proc, pos, &binder_procs, proc_node)
-		print_binder_proc(m, proc, 0);
-	if (do_lock)
-		mutex_unlock(&binder_lock);
+	hlist_for_each_entry(proc, pos, &binder_procs, proc_node) {
+		if (do_lock)
+			binder_proc_lock(proc);
+		print_binder_proc(m, proc, 0, do_lock);
+		if (do_lock)
+			binder_proc_unlock(proc);
+	}
+	if (do_lock) {
+		mutex_unlock(&binder_procs_lock);
+		up_read(&binder_main_lock);
+	}
 	return 0;
 }
 
@@ -3500,12 +4337,16 @@ static int binder_proc_show(struct seq_file *m, void *unused)
 	struct binder_proc *proc = m->private;
 	int do_lock = !binder_debug_no_lock;
 
-	if (do_lock)
-		mutex_lock(&binder_lock);
+	if (do_lock) {
+		down_read(&binder_main_lock);
+		binder_proc_lock(proc);
+	}
 	seq_puts(m, "binder proc state:\n");
-	print_binder_proc(m, proc, 1);
-	if (do_lock)
-		mutex_unlock(&binder_lock);
+	print_binder_proc(m, proc, 1, do_lock);
+	if (do_lock) {
+		binder_proc_unlock(proc);
+		up_read(&binder_main_lock);
+	}
 	return 0;
 }
 
@@ -3554,6 +4395,7 @@ BINDER_DEBUG_ENTRY(state);
 BINDER_DEBUG_ENTRY(stats);
 BINDER_DEBUG_ENTRY(transactions);
 BINDER_DEBUG_ENTRY(transaction_log);
+BINDER_DEBUG_ENTRY(latency);
 
 static int __init binder_init(void)
 {
@@ -3568,6 +4410,7 @@ static int __init binder_init(void)
 		binder_debugfs_dir_entry_proc = debugfs_create_dir("proc",
 						 binder_debugfs_dir_entry_root);
 	ret = misc_register(&binder_miscdev);
+	register_shrinker(&binder_shrinker);
 	if (binder_debugfs_dir_entry_root) {
 		debugfs_create_file("state",
 				    S_IRUGO,
@@ -3594,6 +4437,11 @@ static int __init binder_init(void)
 				    binder_debugfs_dir_entry_root,
 				    &binder_transaction_log_failed,
 				    &binder_transaction_log_fops);
+		debugfs_create_file("latency",
+				    S_IRUGO,
+				    binder_debugfs_dir_entry_root,
+				    NULL,
+				    &binder_latency_fops);
 	}
 	return ret;
 }
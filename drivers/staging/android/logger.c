@@ -24,34 +24,61 @@
 #include <linux/uaccess.h>
 #include <linux/poll.h>
 #include <linux/slab.h>
+#include <linux/spinlock.h>
 #include <linux/time.h>
 #include "logger.h"
 
 #include <asm/ioctls.h>
 
+/*
+ * Number of writes that can be reserved but not yet committed at once.
+ * Must be a power of two.
+ */
+#define LOGGER_MAX_PENDING	32
+
+/*
+ * struct logger_pending - a write that has reserved space in the log
+ *
+ * Writers reserve their entry under log->lock and fill it in without any
+ * lock held. Entries become visible to readers strictly in reservation
+ * order, once every earlier reservation has been committed too.
+ */
+struct logger_pending {
+	size_t			end;	/* log offset just past the entry */
+	int			done;	/* entry fully written */
+};
+
 /*
  * struct logger_log - represents a specific log, such as 'main' or 'radio'
  *
  * This structure lives from module insertion until module removal, so it does
- * not need additional reference counting. The structure is protected by the
- * mutex 'mutex'.
+ * not need additional reference counting. The offsets, the pending table and
+ * the reader list are protected by the spinlock 'lock', which is never held
+ * across a copy to or from user space. The mutex 'mutex' only serializes
+ * readers against each other.
  */
 struct logger_log {
 	unsigned char 		*buffer;/* the ring buffer itself */
 	struct miscdevice	misc;	/* misc device representing the log */
 	wait_queue_head_t	wq;	/* wait queue for readers */
+	wait_queue_head_t	wwq;	/* writers waiting for a pending slot */
 	struct list_head	readers; /* this log's readers */
-	struct mutex		mutex;	/* mutex protecting buffer */
-	size_t			w_off;	/* current write head offset */
+	struct mutex		mutex;	/* mutex serializing readers */
+	spinlock_t		lock;	/* lock protecting offsets */
+	size_t			w_off;	/* next reservation starts here */
+	size_t			c_off;	/* committed data ends here */
 	size_t			head;	/* new readers start here */
 	size_t			size;	/* size of the log */
+	unsigned int		w_seq;	/* sequence of the next reservation */
+	unsigned int		c_seq;	/* sequence of the oldest uncommitted */
+	struct logger_pending	pending[LOGGER_MAX_PENDING];
 };
 
 /*
  * struct logger_reader - a logging device open for reading
  *
  * This object lives from open to release, so we don't need additional
- * reference counting. The structure is protected by log->mutex.
+ * reference counting. The structure is protected by log->lock.
  */
 struct logger_reader {
 	struct logger_log	*log;	/* associated log */
@@ -89,7 +116,7 @@ static inline struct logger_log *file_get_log(struct file *file)
  * get_entry_len - Grabs the length of the payload of the next entry starting
  * from 'off'.
  *
- * Caller needs to hold log->mutex.
+ * Caller needs to hold log->lock.
  */
 static __u32 get_entry_len(struct logger_log *log, size_t off)
 {
@@ -108,13 +135,13 @@ static __u32 get_entry_len(struct logger_log *log, size_t off)
 }
 
 /*
- * do_read_log_to_user - reads exactly 'count' bytes from 'log' into the
- * user-space buffer 'buf'. Returns 'count' on success.
+ * do_read_log_to_user - reads exactly 'count' bytes from 'log', starting at
+ * 'off', into the user-space buffer 'buf'. Returns 'count' on success.
  *
- * Caller must hold log->mutex.
+ * Caller must hold log->mutex but not log->lock. A writer may lap the reader
+ * during the copy, so the caller has to check the reader's offset afterwards.
  */
-static ssize_t do_read_log_to_user(struct logger_log *log,
-				   struct logger_reader *reader,
+static ssize_t do_read_log_to_user(struct logger_log *log, size_t off,
 				   char __user *buf,
 				   size_t count)
 {
@@ -122,11 +149,11 @@ static ssize_t do_read_log_to_user(struct logger_log *log,
 
 	/*
 	 * We read from the log in two disjoint operations. First, we read from
-	 * the current read head offset up to 'count' bytes or to the end of
-	 * the log, whichever comes first.
+	 * the read offset up to 'count' bytes or to the end of the log,
+	 * whichever comes first.
 	 */
-	len = min(count, log->size - reader->r_off);
-	if (copy_to_user(buf, log->buffer + reader->r_off, len))
+	len = min(count, log->size - off);
+	if (copy_to_user(buf, log->buffer + off, len))
 		return -EFAULT;
 
 	/*
@@ -137,28 +164,25 @@ static ssize_t do_read_log_to_user(struct logger_log *log,
 		if (copy_to_user(buf + len, log->buffer, count - len))
 			return -EFAULT;
 
-	reader->r_off = logger_offset(reader->r_off + count);
-
 	return count;
 }
 
 /*
- * logger_read - our log's read() method
- *
- * Behavior:
- *
- * 	- O_NONBLOCK works
- * 	- If there are no log entries to read, blocks until log is written to
- * 	- Atomically reads exactly one log entry
+ * do_logger_read - reads whole entries from the reader's offset into 'buf'
  *
- * Optimal read size is LOGGER_ENTRY_MAX_LEN. Will set errno to EINVAL if read
- * buffer is insufficient to hold next entry.
+ * Blocks until there is something to read, unless O_NONBLOCK is set. Reads
+ * at most 'max_entries' entries, and only as many as fit in 'count' bytes.
+ * Fails with -EINVAL if not even the next entry fits. On success returns
+ * the number of bytes read and stores the number of entries in 'nr'.
  */
-static ssize_t logger_read(struct file *file, char __user *buf,
-			   size_t count, loff_t *pos)
+static ssize_t do_logger_read(struct file *file, char __user *buf,
+			      size_t count, unsigned int max_entries,
+			      unsigned int *nr)
 {
 	struct logger_reader *reader = file->private_data;
 	struct logger_log *log = reader->log;
+	size_t off, end, len;
+	unsigned int entries;
 	ssize_t ret;
 	DEFINE_WAIT(wait);
 
@@ -166,9 +190,9 @@ start:
 	while (1) {
 		prepare_to_wait(&log->wq, &wait, TASK_INTERRUPTIBLE);
 
-		mutex_lock(&log->mutex);
-		ret = (log->w_off == reader->r_off);
-		mutex_unlock(&log->mutex);
+		spin_lock(&log->lock);
+		ret = (log->c_off == reader->r_off);
+		spin_unlock(&log->lock);
 		if (!ret)
 			break;
 
@@ -190,22 +214,52 @@ start:
 		return ret;
 
 	mutex_lock(&log->mutex);
+	spin_lock(&log->lock);
 
 	/* is there still something to read or did we race? */
-	if (unlikely(log->w_off == reader->r_off)) {
+	if (unlikely(log->c_off == reader->r_off)) {
+		spin_unlock(&log->lock);
 		mutex_unlock(&log->mutex);
 		goto start;
 	}
 
-	/* get the size of the next entry */
-	ret = get_entry_len(log, reader->r_off);
-	if (count < ret) {
+	/* add up the sizes of as many whole entries as fit */
+	off = reader->r_off;
+	end = off;
+	ret = 0;
+	entries = 0;
+	do {
+		len = get_entry_len(log, end);
+		if (ret + len > count)
+			break;
+		ret += len;
+		end = logger_offset(end + len);
+		entries++;
+	} while (end != log->c_off && entries < max_entries);
+	spin_unlock(&log->lock);
+	if (!entries) {
 		ret = -EINVAL;
 		goto out;
 	}
 
-	/* get exactly one entry from the log */
-	ret = do_read_log_to_user(log, reader, buf, ret);
+	ret = do_read_log_to_user(log, off, buf, ret);
+	if (ret < 0)
+		goto out;
+
+	/*
+	 * fix_up_readers moves r_off if a writer lapped us while we were
+	 * copying, in which case what we copied may be torn. Try again from
+	 * the new offset.
+	 */
+	spin_lock(&log->lock);
+	if (unlikely(reader->r_off != off)) {
+		spin_unlock(&log->lock);
+		mutex_unlock(&log->mutex);
+		goto start;
+	}
+	reader->r_off = end;
+	spin_unlock(&log->lock);
+	*nr = entries;
 
 out:
 	mutex_unlock(&log->mutex);
@@ -213,11 +267,62 @@ out:
 	return ret;
 }
 
+/*
+ * logger_read - our log's read() method
+ *
+ * Behavior:
+ *
+ * 	- O_NONBLOCK works
+ * 	- If there are no log entries to read, blocks until log is written to
+ * 	- Atomically reads exactly one log entry
+ *
+ * Optimal read size is LOGGER_ENTRY_MAX_LEN. Will set errno to EINVAL if read
+ * buffer is insufficient to hold next entry.
+ */
+static ssize_t logger_read(struct file *file, char __user *buf,
+			   size_t count, loff_t *pos)
+{
+	unsigned int nr;
+
+	return do_logger_read(file, buf, count, 1, &nr);
+}
+
+/*
+ * logger_read_batch - the LOGGER_READ_BATCH ioctl
+ *
+ * Like read(), but copies as many whole entries as fit in the caller's
+ * buffer, back to back, so a busy log can be drained with few syscalls.
+ * The reader's offset is the cursor, exactly as for read().
+ */
+static long logger_read_batch(struct file *file, void __user *arg)
+{
+	struct logger_read_batch batch;
+	unsigned int nr = 0;
+	ssize_t ret;
+
+	if (!(file->f_mode & FMODE_READ))
+		return -EBADF;
+
+	if (copy_from_user(&batch, arg, sizeof(batch)))
+		return -EFAULT;
+
+	ret = do_logger_read(file, (char __user *)(uintptr_t)batch.buf,
+			     batch.size, UINT_MAX, &nr);
+	if (ret < 0)
+		return ret;
+
+	batch.count = nr;
+	if (copy_to_user(arg, &batch, sizeof(batch)))
+		return -EFAULT;
+
+	return ret;
+}
+
 /*
  * get_next_entry - return the offset of the first valid entry at least 'len'
  * bytes after 'off'.
  *
- * Caller must hold log->mutex.
+ * Caller must hold log->lock.
  */
 static size_t get_next_entry(struct logger_log *log, size_t off, size_t len)
 {
@@ -255,7 +360,7 @@ static inline int clock_interval(size_t a, size_t b, size_t c)
  * We do this by "pulling forward" the readers and start head to the first
  * entry after the new write head.
  *
- * The caller needs to hold log->mutex.
+ * The caller needs to hold log->lock.
  */
 static void fix_up_readers(struct logger_log *log, size_t len)
 {
@@ -272,62 +377,147 @@ static void fix_up_readers(struct logger_log *log, size_t len)
 }
 
 /*
- * do_write_log - writes 'len' bytes from 'buf' to 'log'
+ * do_write_log - writes 'len' bytes from 'buf' to 'log' at offset 'off'
  *
- * The caller needs to hold log->mutex.
+ * The caller must own the reservation covering the range.
  */
-static void do_write_log(struct logger_log *log, const void *buf, size_t count)
+static void do_write_log(struct logger_log *log, size_t off, const void *buf,
+			 size_t count)
 {
 	size_t len;
 
-	len = min(count, log->size - log->w_off);
-	memcpy(log->buffer + log->w_off, buf, len);
+	len = min(count, log->size - off);
+	memcpy(log->buffer + off, buf, len);
 
 	if (count != len)
 		memcpy(log->buffer, buf + len, count - len);
-
-	log->w_off = logger_offset(log->w_off + count);
-
 }
 
 /*
  * do_write_log_user - writes 'len' bytes from the user-space buffer 'buf' to
- * the log 'log'
+ * the log 'log' at offset 'off'
  *
- * The caller needs to hold log->mutex.
+ * The caller must own the reservation covering the range.
  *
  * Returns 'count' on success, negative error code on failure.
  */
-static ssize_t do_write_log_from_user(struct logger_log *log,
+static ssize_t do_write_log_from_user(struct logger_log *log, size_t off,
 				      const void __user *buf, size_t count)
 {
 	size_t len;
 
-	len = min(count, log->size - log->w_off);
-	if (len && copy_from_user(log->buffer + log->w_off, buf, len))
+	len = min(count, log->size - off);
+	if (len && copy_from_user(log->buffer + off, buf, len))
 		return -EFAULT;
 
 	if (count != len)
 		if (copy_from_user(log->buffer, buf + len, count - len))
 			return -EFAULT;
 
-	log->w_off = logger_offset(log->w_off + count);
-
 	return count;
 }
 
+/*
+ * do_clear_log - zeroes 'count' bytes of 'log' at offset 'off'
+ *
+ * Used to scrub the rest of an entry whose payload could not be copied in.
+ * The caller must own the reservation covering the range.
+ */
+static void do_clear_log(struct logger_log *log, size_t off, size_t count)
+{
+	size_t len;
+
+	len = min(count, log->size - off);
+	memset(log->buffer + off, 0, len);
+
+	if (count != len)
+		memset(log->buffer, 0, count - len);
+}
+
+/*
+ * reserve_log - reserves 'count' bytes at the write head of 'log'
+ *
+ * Readers that the new entry would lap are pulled forward first. Returns the
+ * offset of the reservation and stores its sequence number in 'seq'. Only
+ * sleeps if LOGGER_MAX_PENDING writes are already in flight.
+ */
+static size_t reserve_log(struct logger_log *log, size_t count,
+			  unsigned int *seq)
+{
+	size_t off;
+
+	spin_lock(&log->lock);
+	while (unlikely(log->w_seq - log->c_seq >= LOGGER_MAX_PENDING)) {
+		spin_unlock(&log->lock);
+		wait_event(log->wwq,
+			   log->w_seq - log->c_seq < LOGGER_MAX_PENDING);
+		spin_lock(&log->lock);
+	}
+
+	/*
+	 * Fix up any readers, pulling them forward to the first readable
+	 * entry after (what will be) the new write offset. We do this now
+	 * because if we partially fail, we can end up with clobbered log
+	 * entries that encroach on readable buffer.
+	 */
+	fix_up_readers(log, count);
+
+	off = log->w_off;
+	log->w_off = logger_offset(off + count);
+	*seq = log->w_seq++;
+	log->pending[*seq & (LOGGER_MAX_PENDING - 1)].end = log->w_off;
+	spin_unlock(&log->lock);
+
+	return off;
+}
+
+/*
+ * commit_log - marks the reservation 'seq' as fully written
+ *
+ * Advances the committed offset over every finished reservation that no
+ * earlier, still unfinished one holds back. Returns nonzero if readers can
+ * see new data.
+ */
+static int commit_log(struct logger_log *log, unsigned int seq)
+{
+	struct logger_pending *p;
+	int advanced = 0;
+
+	spin_lock(&log->lock);
+	log->pending[seq & (LOGGER_MAX_PENDING - 1)].done = 1;
+	while (log->c_seq != log->w_seq) {
+		p = &log->pending[log->c_seq & (LOGGER_MAX_PENDING - 1)];
+		if (!p->done)
+			break;
+		p->done = 0;
+		log->c_off = p->end;
+		log->c_seq++;
+		advanced = 1;
+	}
+	spin_unlock(&log->lock);
+
+	if (advanced && waitqueue_active(&log->wwq))
+		wake_up(&log->wwq);
+
+	return advanced;
+}
+
 /*
  * logger_aio_write - our write method, implementing support for write(),
  * writev(), and aio_write(). Writes are our fast path, and we try to optimize
  * them above all else.
+ *
+ * Writers never wait for each other: each one reserves its entry under
+ * log->lock, then copies the header and payload in with no lock held.
  */
 ssize_t logger_aio_write(struct kiocb *iocb, const struct iovec *iov,
 			 unsigned long nr_segs, loff_t ppos)
 {
 	struct logger_log *log = file_get_log(iocb->ki_filp);
-	size_t orig = log->w_off;
 	struct logger_entry header;
 	struct timespec now;
+	unsigned int seq;
+	size_t off;
 	ssize_t ret = 0;
 
 	now = current_kernel_time();
@@ -342,17 +532,10 @@ ssize_t logger_aio_write(struct kiocb *iocb, const struct iovec *iov,
 	if (unlikely(!header.len))
 		return 0;
 
-	mutex_lock(&log->mutex);
+	off = reserve_log(log, sizeof(struct logger_entry) + header.len, &seq);
 
-	/*
-	 * Fix up any readers, pulling them forward to the first readable
-	 * entry after (what will be) the new write offset. We do this now
-	 * because if we partially fail, we can end up with clobbered log
-	 * entries that encroach on readable buffer.
-	 */
-	fix_up_readers(log, sizeof(struct logger_entry) + header.len);
-
-	do_write_log(log, &header, sizeof(struct logger_entry));
+	do_write_log(log, off, &header, sizeof(struct logger_entry));
+	off = logger_offset(off + sizeof(struct logger_entry));
 
 	while (nr_segs-- > 0) {
 		size_t len;
@@ -362,21 +545,26 @@ ssize_t logger_aio_write(struct kiocb *iocb, const struct iovec *iov,
 		len = min_t(size_t, iov->iov_len, header.len - ret);
 
 		/* write out this segment's payload */
-		nr = do_write_log_from_user(log, iov->iov_base, len);
+		nr = do_write_log_from_user(log, off, iov->iov_base, len);
 		if (unlikely(nr < 0)) {
-			log->w_off = orig;
-			mutex_unlock(&log->mutex);
-			return nr;
+			/*
+			 * Later writers may already own the space after us,
+			 * so the entry cannot be taken back. Blank out the
+			 * rest of its payload instead.
+			 */
+			do_clear_log(log, off, header.len - ret);
+			ret = nr;
+			break;
 		}
 
+		off = logger_offset(off + nr);
 		iov++;
 		ret += nr;
 	}
 
-	mutex_unlock(&log->mutex);
-
 	/* wake up any blocked readers */
-	wake_up_interruptible(&log->wq);
+	if (commit_log(log, seq))
+		wake_up_interruptible(&log->wq);
 
 	return ret;
 }
@@ -411,10 +599,10 @@ static int logger_open(struct inode *inode, struct file *file)
 		reader->log = log;
 		INIT_LIST_HEAD(&reader->list);
 
-		mutex_lock(&log->mutex);
+		spin_lock(&log->lock);
 		reader->r_off = log->head;
 		list_add_tail(&reader->list, &log->readers);
-		mutex_unlock(&log->mutex);
+		spin_unlock(&log->lock);
 
 		file->private_data = reader;
 	} else
@@ -433,9 +621,9 @@ static int logger_release(struct inode *ignored, struct file *file)
 	if (file->f_mode & FMODE_READ) {
 		struct logger_reader *reader = file->private_data;
 		struct logger_log *log = reader->log;
-		mutex_lock(&log->mutex);
+		spin_lock(&log->lock);
 		list_del(&reader->list);
-		mutex_unlock(&log->mutex);
+		spin_unlock(&log->lock);
 		kfree(reader);
 	}
 
@@ -465,10 +653,10 @@ static unsigned int logger_poll(struct file *file, poll_table *wait)
 
 	poll_wait(file, &log->wq, wait);
 
-	mutex_lock(&log->mutex);
-	if (log->w_off != reader->r_off)
+	spin_lock(&log->lock);
+	if (log->c_off != reader->r_off)
 		ret |= POLLIN | POLLRDNORM;
-	mutex_unlock(&log->mutex);
+	spin_unlock(&log->lock);
 
 	return ret;
 }
@@ -479,7 +667,10 @@ static long logger_ioctl(struct file *file, unsigned int cmd, unsigned long arg)
 	struct logger_reader *reader;
 	long ret = -ENOTTY;
 
-	mutex_lock(&log->mutex);
+	if (cmd == LOGGER_READ_BATCH)
+		return logger_read_batch(file, (void __user *)arg);
+
+	spin_lock(&log->lock);
 
 	switch (cmd) {
 	case LOGGER_GET_LOG_BUF_SIZE:
@@ -491,10 +682,10 @@ static long logger_ioctl(struct file *file, unsigned int cmd, unsigned long arg)
 			break;
 		}
 		reader = file->private_data;
-		if (log->w_off >= reader->r_off)
-			ret = log->w_off - reader->r_off;
+		if (log->c_off >= reader->r_off)
+			ret = log->c_off - reader->r_off;
 		else
-			ret = (log->size - reader->r_off) + log->w_off;
+			ret = (log->size - reader->r_off) + log->c_off;
 		break;
 	case LOGGER_GET_NEXT_ENTRY_LEN:
 		if (!(file->f_mode & FMODE_READ)) {
@@ -502,7 +693,7 @@ static long logger_ioctl(struct file *file, unsigned int cmd, unsigned long arg)
 			break;
 		}
 		reader = file->private_data;
-		if (log->w_off != reader->r_off)
+		if (log->c_off != reader->r_off)
 			ret = get_entry_len(log, reader->r_off);
 		else
 			ret = 0;
@@ -513,13 +704,13 @@ static long logger_ioctl(struct file *file, unsigned int cmd, unsigned long arg)
 			break;
 		}
 		list_for_each_entry(reader, &log->readers, list)
-			reader->r_off = log->w_off;
-		log->head = log->w_off;
+			reader->r_off = log->c_off;
+		log->head = log->c_off;
 		ret = 0;
 		break;
 	}
 
-	mutex_unlock(&log->mutex);
+	spin_unlock(&log->lock);
 
 	return ret;
 }
@@ -551,9 +742,12 @@ static struct logger_log VAR = { \
 		.parent = NULL, \
 	}, \
 	.wq = __WAIT_QUEUE_HEAD_INITIALIZER(VAR .wq), \
+	.wwq = __WAIT_QUEUE_HEAD_INITIALIZER(VAR .wwq), \
 	.readers = LIST_HEAD_INIT(VAR .readers), \
 	.mutex = __MUTEX_INITIALIZER(VAR .mutex), \
+	.lock = __SPIN_LOCK_UNLOCKED(VAR .lock), \
 	.w_off = 0, \
+	.c_off = 0, \
 	.head = 0, \
 	.size = SIZE, \
 };
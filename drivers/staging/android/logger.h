@@ -30,6 +30,17 @@ struct logger_entry {
 	char		msg[0];	/* the entry's payload */
 };
 
+/*
+ * Argument of LOGGER_READ_BATCH. 'buf' is a user pointer widened to 64 bits
+ * so the layout is the same for 32- and 64-bit callers. On return 'count'
+ * holds the number of entries copied, packed back to back.
+ */
+struct logger_read_batch {
+	__u64		buf;	/* destination buffer */
+	__u32		size;	/* size of the destination buffer */
+	__u32		count;	/* entries read */
+};
+
 #define LOGGER_LOG_RADIO	"log_radio"	/* radio-related messages */
 #define LOGGER_LOG_EVENTS	"log_events"	/* system/hardware events */
 #define LOGGER_LOG_SYSTEM	"log_system"	/* system/framework messages */
@@ -45,5 +56,7 @@ struct logger_entry {
 #define LOGGER_GET_LOG_LEN		_IO(__LOGGERIO, 2) /* used log len */
 #define LOGGER_GET_NEXT_ENTRY_LEN	_IO(__LOGGERIO, 3) /* next entry len */
 #define LOGGER_FLUSH_LOG		_IO(__LOGGERIO, 4) /* flush log */
+#define LOGGER_READ_BATCH		\
+	_IOWR(__LOGGERIO, 5, struct logger_read_batch) /* batched read */
 
 #endif /* _LINUX_LOGGER_H */
@@ -16,6 +16,15 @@
  * percentage of the cached memory is locked this can be very inaccurate
  * and processes may not get killed until the normal oom killer is triggered.
  *
+ * Free memory is counted only in the zones the allocation can use (zone_aware,
+ * not applied to kswapd) and excludes reserved pages. Part of free swap and
+ * of unpinned ashmem can be counted as free as well, see the swap_credit and
+ * ashmem_credit parameters (percentages, off by default).
+ *
+ * Candidates are kept in an index of processes bucketed by oom_adj, which is
+ * maintained from the fork, free and oom_adj notifiers. Picking a victim only
+ * walks the highest bucket holding a process with an mm instead of every task.
+ *
  * Copyright (C) 2007-2008 Google, Inc.
  *
  * This software is licensed under the terms of the GNU General Public
@@ -39,6 +48,12 @@
 #include <linux/memory_hotplug.h>
 #include <linux/dcache.h>
 #include <linux/fs.h>
+#include <linux/hash.h>
+#include <linux/slab.h>
+#include <linux/spinlock.h>
+#include <linux/mutex.h>
+#include <linux/swap.h>
+#include <linux/ashmem.h>
 #include <../../../fs/proc/internal.h>
 
 static uint32_t lowmem_debug_level = 2;
@@ -80,6 +95,9 @@ static struct task_struct *lowmem_deathpending;
 static unsigned long lowmem_deathpending_timeout;
 static unsigned long lowmem_fork_boost_timeout;
 static uint32_t lowmem_fork_boost = 1;
+static uint32_t lowmem_zone_aware = 1;
+static uint32_t lowmem_swap_credit;	/* percent of free swap */
+static uint32_t lowmem_ashmem_credit;	/* percent of unpinned ashmem */
 static int last_min_adj = OOM_ADJUST_MAX + 1;;
 
 #define lowmem_print(level, x...)			\
@@ -90,6 +108,139 @@ static int last_min_adj = OOM_ADJUST_MAX + 1;;
 
 extern void show_meminfo(void);
 
+/*
+ * struct lowmem_candidate - a process in the victim index
+ *
+ * One exists for every thread group leader we have seen fork, or whose
+ * oom_adj was written, until the task is freed. Protected by
+ * lowmem_index_lock, which may be taken from softirq context by the task
+ * free notifier and nests inside task_lock and the sighand lock.
+ * scan_node is only used by the shrinker, under lowmem_scan_lock.
+ */
+struct lowmem_candidate {
+	struct hlist_node	hash_node;	/* in lowmem_index_hash */
+	struct list_head	adj_node;	/* in lowmem_index_adj[adj] */
+	struct list_head	scan_node;	/* in lowmem_shrink's scan list */
+	struct task_struct	*task;
+	int			adj;
+};
+
+#define LOWMEM_INDEX_HASH_BITS	8
+#define LOWMEM_INDEX_ADJ_LEVELS	(OOM_ADJUST_MAX - OOM_DISABLE + 1)
+
+static DEFINE_SPINLOCK(lowmem_index_lock);
+static DEFINE_MUTEX(lowmem_scan_lock);
+static struct hlist_head lowmem_index_hash[1 << LOWMEM_INDEX_HASH_BITS];
+static struct list_head lowmem_index_adj[LOWMEM_INDEX_ADJ_LEVELS];
+static struct kmem_cache *lowmem_candidate_cachep;
+
+static inline struct hlist_head *lowmem_index_bucket(struct task_struct *task)
+{
+	return &lowmem_index_hash[hash_ptr(task, LOWMEM_INDEX_HASH_BITS)];
+}
+
+/* Caller must hold lowmem_index_lock. */
+static struct lowmem_candidate *lowmem_index_find(struct task_struct *task)
+{
+	struct lowmem_candidate *c;
+	struct hlist_node *pos;
+
+	hlist_for_each_entry(c, pos, lowmem_index_bucket(task), hash_node)
+		if (c->task == task)
+			return c;
+	return NULL;
+}
+
+/*
+ * lowmem_index_update - file 'task' under oom_adj 'adj', adding it to the
+ * index if it is not there yet. Safe in atomic context.
+ */
+static void lowmem_index_update(struct task_struct *task, int adj)
+{
+	struct lowmem_candidate *c;
+	unsigned long flags;
+
+	if (adj < OOM_DISABLE)
+		adj = OOM_DISABLE;
+	if (adj > OOM_ADJUST_MAX)
+		adj = OOM_ADJUST_MAX;
+
+	spin_lock_irqsave(&lowmem_index_lock, flags);
+	c = lowmem_index_find(task);
+	if (!c) {
+		c = kmem_cache_alloc(lowmem_candidate_cachep, GFP_ATOMIC);
+		if (!c) {
+			spin_unlock_irqrestore(&lowmem_index_lock, flags);
+			lowmem_print(1, "lowmem_index: no memory to track %d\n",
+				     task->pid);
+			return;
+		}
+		c->task = task;
+		hlist_add_head(&c->hash_node, lowmem_index_bucket(task));
+		INIT_LIST_HEAD(&c->adj_node);
+	}
+	c->adj = adj;
+	list_move_tail(&c->adj_node, &lowmem_index_adj[adj - OOM_DISABLE]);
+	spin_unlock_irqrestore(&lowmem_index_lock, flags);
+}
+
+static void lowmem_index_remove(struct task_struct *task)
+{
+	struct lowmem_candidate *c;
+	unsigned long flags;
+
+	spin_lock_irqsave(&lowmem_index_lock, flags);
+	c = lowmem_index_find(task);
+	if (c) {
+		hlist_del(&c->hash_node);
+		list_del(&c->adj_node);
+	}
+	spin_unlock_irqrestore(&lowmem_index_lock, flags);
+
+	if (c)
+		kmem_cache_free(lowmem_candidate_cachep, c);
+}
+
+/*
+ * lowmem_index_collect - take a reference on every live task filed under
+ * 'adj' that still has an mm and put its candidate on 'scan'. The
+ * references keep the candidates from being freed until
+ * lowmem_index_release. Caller must hold lowmem_scan_lock.
+ */
+static void lowmem_index_collect(int adj, struct list_head *scan)
+{
+	struct lowmem_candidate *c;
+	unsigned long flags;
+
+	spin_lock_irqsave(&lowmem_index_lock, flags);
+	list_for_each_entry(c, &lowmem_index_adj[adj - OOM_DISABLE], adj_node) {
+		/*
+		 * Kernel threads and tasks past exit_mm have nothing to
+		 * free. This is only a hint, the mm is checked again under
+		 * task_lock.
+		 */
+		if (!c->task->mm)
+			continue;
+		/* the task may already be on its way to the free notifier */
+		if (atomic_inc_not_zero(&c->task->usage))
+			list_add_tail(&c->scan_node, scan);
+	}
+	spin_unlock_irqrestore(&lowmem_index_lock, flags);
+}
+
+static void lowmem_index_release(struct list_head *scan)
+{
+	struct lowmem_candidate *c, *tmp;
+	struct task_struct *task;
+
+	list_for_each_entry_safe(c, tmp, scan, scan_node) {
+		task = c->task;
+		list_del(&c->scan_node);
+		/* may free c through the task free notifier */
+		put_task_struct(task);
+	}
+}
+
 /**
  * dump_tasks - dump current memory state of all system tasks
  *
@@ -147,6 +298,8 @@ task_free_notify_func(struct notifier_block *self, unsigned long val, void *data
 	if (task == lowmem_deathpending)
 		lowmem_deathpending = NULL;
 
+	lowmem_index_remove(task);
+
 	return NOTIFY_OK;
 }
 
@@ -160,8 +313,30 @@ static struct notifier_block task_fork_nb = {
 static int
 task_fork_notify_func(struct notifier_block *self, unsigned long val, void *data)
 {
+	struct task_struct *task = data;
+
 	lowmem_fork_boost_timeout = jiffies + (HZ << 1);
 
+	if (thread_group_leader(task))
+		lowmem_index_update(task, task->signal->oom_adj);
+
+	return NOTIFY_OK;
+}
+
+static int
+oom_adj_notify_func(struct notifier_block *self, unsigned long val, void *data);
+
+static struct notifier_block oom_adj_nb = {
+	.notifier_call	= oom_adj_notify_func,
+};
+
+static int
+oom_adj_notify_func(struct notifier_block *self, unsigned long val, void *data)
+{
+	struct task_struct *task = data;
+
+	lowmem_index_update(task->group_leader, (int)val);
+
 	return NOTIFY_OK;
 }
 
@@ -191,10 +366,71 @@ static int lmk_hotplug_callback(struct notifier_block *self,
 
 
 
+/*
+ * lowmem_count_free - work out how much memory the allocation described by
+ * 'gfp_mask' can still get at
+ *
+ * With zone_aware set, zones above the allocation's class zone are left out
+ * and the lowmem reserves the lower zones keep against it are not counted.
+ * Otherwise, and always for kswapd, whose GFP_KERNEL mask says nothing about
+ * the zones it is balancing, every zone counts and totalreserve_pages is
+ * left out instead. totalreserve_pages already includes the lowmem
+ * reserves, so only one of the two is ever subtracted. swap_credit and
+ * ashmem_credit optionally count a percentage of free swap as free and of
+ * unpinned ashmem as cache.
+ */
+static void lowmem_count_free(gfp_t gfp_mask, int *other_free,
+			      int *other_file)
+{
+	int classzone_idx = gfp_zone(gfp_mask);
+	int zone_aware = lowmem_zone_aware && !current_is_kswapd();
+	long free = global_page_state(NR_FREE_PAGES);
+	long file = global_page_state(NR_FILE_PAGES) -
+		global_page_state(NR_SHMEM) - global_page_state(NR_MLOCK);
+	struct zone *zone;
+
+	if (!zone_aware)
+		free -= totalreserve_pages;
+
+	for_each_populated_zone(zone) {
+		int skip = zone_aware && zone_idx(zone) > classzone_idx;
+
+		if (skip) {
+			free -= zone_page_state(zone, NR_FREE_PAGES);
+			file -= zone_page_state(zone, NR_FILE_PAGES) -
+				zone_page_state(zone, NR_SHMEM) -
+				zone_page_state(zone, NR_MLOCK);
+		} else if (zone_aware) {
+			free -= zone->lowmem_reserve[classzone_idx];
+		}
+
+		if (offlining && !skip && zone_idx(zone) == ZONE_MOVABLE) {
+			/* Discount all free space in the section being offlined */
+			free -= zone_page_state(zone, NR_FREE_PAGES);
+			lowmem_print(4, "lowmem_shrink discounted "
+				"%lu pages in movable zone\n",
+				zone_page_state(zone, NR_FREE_PAGES));
+		}
+	}
+
+	if (lowmem_swap_credit)
+		free += nr_swap_pages * lowmem_swap_credit / 100;
+#ifdef CONFIG_ASHMEM
+	if (lowmem_ashmem_credit)
+		file += ashmem_unpinned_pages() * lowmem_ashmem_credit / 100;
+#endif
+
+	*other_free = max(free, 0L);
+	*other_file = max(file, 0L);
+}
+
 static int lowmem_shrink(struct shrinker *s, struct shrink_control *sc)
 {
 	struct task_struct *p;
 	struct task_struct *selected = NULL;
+	struct lowmem_candidate *c;
+	LIST_HEAD(scan);
+	int adj;
 	int rem = 0;
 	int tasksize;
 	int i;
@@ -202,39 +438,26 @@ static int lowmem_shrink(struct shrinker *s, struct shrink_control *sc)
 	int selected_tasksize = 0;
 	int selected_oom_adj;
 	int array_size = ARRAY_SIZE(lowmem_adj);
-	int other_free = global_page_state(NR_FREE_PAGES);
-	int other_file = global_page_state(NR_FILE_PAGES) -
-		global_page_state(NR_SHMEM) - global_page_state(NR_MLOCK);
+	int other_free;
+	int other_file;
 
 	int fork_boost = 0;
 	int *adj_array;
 	size_t *min_array;
 
-	struct zone *zone;
-
-	if (offlining) {
-		/* Discount all free space in the section being offlined */
-		for_each_zone(zone) {
-			 if (zone_idx(zone) == ZONE_MOVABLE) {
-				other_free -= zone_page_state(zone,
-						NR_FREE_PAGES);
-				lowmem_print(4, "lowmem_shrink discounted "
-					"%lu pages in movable zone\n",
-					zone_page_state(zone, NR_FREE_PAGES));
-			}
-		}
-	}
 	/*
 	 * If we already have a death outstanding, then
 	 * bail out right away; indicating to vmscan
 	 * that we have nothing further to offer on
-	 * this pass.
-	 *
+	 * this pass. Do this before anything else so that
+	 * reclaim is not held up while the victim exits.
 	 */
 	if (lowmem_deathpending &&
 	    time_before_eq(jiffies, lowmem_deathpending_timeout))
 		return 0;
 
+	lowmem_count_free(sc->gfp_mask, &other_free, &other_file);
+
 	if (lowmem_fork_boost &&
 	    time_before_eq(jiffies, lowmem_fork_boost_timeout)) {
 		for (i = 0; i < lowmem_minfree_size; i++)
@@ -277,42 +500,60 @@ static int lowmem_shrink(struct shrinker *s, struct shrink_control *sc)
 	}
 	selected_oom_adj = min_adj;
 
-	read_lock(&tasklist_lock);
-	for_each_process(p) {
-		struct mm_struct *mm;
-		struct signal_struct *sig;
-		int oom_adj;
-
-		task_lock(p);
-		mm = p->mm;
-		sig = p->signal;
-		if (!mm || !sig) {
-			task_unlock(p);
-			continue;
-		}
-		oom_adj = sig->oom_adj;
+	/* Another reclaimer is already picking a victim */
+	if (!mutex_trylock(&lowmem_scan_lock))
+		return 0;
 
-		if (oom_adj < min_adj) {
-			task_unlock(p);
-			continue;
-		}
-		tasksize = get_mm_rss(mm);
-		task_unlock(p);
-		if (tasksize <= 0)
-			continue;
-		if (selected) {
-			if (oom_adj < selected_oom_adj)
+	/*
+	 * Walk the index from the highest adj down. Within a bucket the
+	 * largest resident set wins; the first bucket that holds a live
+	 * process with an mm decides the victim.
+	 */
+	for (adj = OOM_ADJUST_MAX; adj >= min_adj && !selected; adj--) {
+		lowmem_index_collect(adj, &scan);
+
+		list_for_each_entry(c, &scan, scan_node) {
+			struct mm_struct *mm;
+			struct signal_struct *sig;
+			int oom_adj;
+
+			p = c->task;
+			task_lock(p);
+			mm = p->mm;
+			sig = p->signal;
+			if (!mm || !sig) {
+				task_unlock(p);
+				continue;
+			}
+			oom_adj = sig->oom_adj;
+
+			if (oom_adj < min_adj) {
+				task_unlock(p);
 				continue;
-			if (oom_adj == selected_oom_adj &&
-			    tasksize <= selected_tasksize)
+			}
+			tasksize = get_mm_rss(mm);
+			task_unlock(p);
+			if (tasksize <= 0)
 				continue;
+			if (selected) {
+				if (oom_adj < selected_oom_adj)
+					continue;
+				if (oom_adj == selected_oom_adj &&
+				    tasksize <= selected_tasksize)
+					continue;
+			}
+			selected = p;
+			selected_tasksize = tasksize;
+			selected_oom_adj = oom_adj;
+			lowmem_print(2, "select %d (%s), adj %d, size %d, to kill\n",
+				     p->pid, p->comm, oom_adj, tasksize);
 		}
-		selected = p;
-		selected_tasksize = tasksize;
-		selected_oom_adj = oom_adj;
-		lowmem_print(2, "select %d (%s), adj %d, size %d, to kill\n",
-			     p->pid, p->comm, oom_adj, tasksize);
+
+		if (selected)
+			get_task_struct(selected);
+		lowmem_index_release(&scan);
 	}
+	mutex_unlock(&lowmem_scan_lock);
 
 	if (selected) {
 		if (last_min_adj > selected_oom_adj &&
@@ -320,7 +561,9 @@ static int lowmem_shrink(struct shrinker *s, struct shrink_control *sc)
 			last_min_adj = selected_oom_adj;
 			lowmem_print(1, "lowmem_shrink: monitor memory status at selected_oom_adj=%d\n", selected_oom_adj);
 			show_meminfo();
+			read_lock(&tasklist_lock);
 			dump_tasks();
+			read_unlock(&tasklist_lock);
 		}
 
 		lowmem_print(1, "[%s] send sigkill to %d (%s), adj %d, size %dK, min_adj=%d,"
@@ -333,14 +576,17 @@ static int lowmem_shrink(struct shrinker *s, struct shrink_control *sc)
 		if (selected_oom_adj < 7)
 		{
 			show_meminfo();
+			read_lock(&tasklist_lock);
 			dump_tasks();
+			read_unlock(&tasklist_lock);
 		}
-		force_sig(SIGKILL, selected);
+		/* selected may have exited since, send_sig copes with that */
+		send_sig(SIGKILL, selected, 0);
+		put_task_struct(selected);
 		rem -= selected_tasksize;
 	}
 	lowmem_print(4, "lowmem_shrink %lu, %x, return %d\n",
 		     sc->nr_to_scan, sc->gfp_mask, rem);
-	read_unlock(&tasklist_lock);
 	return rem;
 }
 
@@ -351,8 +597,25 @@ static struct shrinker lowmem_shrinker = {
 
 static int __init lowmem_init(void)
 {
+	struct task_struct *p;
+	int i;
+
+	lowmem_candidate_cachep = KMEM_CACHE(lowmem_candidate, 0);
+	if (!lowmem_candidate_cachep)
+		return -ENOMEM;
+	for (i = 0; i < LOWMEM_INDEX_ADJ_LEVELS; i++)
+		INIT_LIST_HEAD(&lowmem_index_adj[i]);
+
 	task_free_register(&task_free_nb);
 	task_fork_register(&task_fork_nb);
+	register_oom_adj_notifier(&oom_adj_nb);
+
+	/* index the processes that were forked before we got here */
+	read_lock(&tasklist_lock);
+	for_each_process(p)
+		lowmem_index_update(p, p->signal->oom_adj);
+	read_unlock(&tasklist_lock);
+
 	register_shrinker(&lowmem_shrinker);
 #ifdef CONFIG_MEMORY_HOTPLUG
 	hotplug_memory_notifier(lmk_hotplug_callback, 0);
@@ -362,9 +625,23 @@ static int __init lowmem_init(void)
 
 static void __exit lowmem_exit(void)
 {
+	struct lowmem_candidate *c, *tmp;
+	int i;
+
 	unregister_shrinker(&lowmem_shrinker);
+	unregister_oom_adj_notifier(&oom_adj_nb);
 	task_fork_unregister(&task_fork_nb);
 	task_free_unregister(&task_free_nb);
+
+	for (i = 0; i < LOWMEM_INDEX_ADJ_LEVELS; i++) {
+		list_for_each_entry_safe(c, tmp, &lowmem_index_adj[i],
+					 adj_node) {
+			hlist_del(&c->hash_node);
+			list_del(&c->adj_node);
+			kmem_cache_free(lowmem_candidate_cachep, c);
+		}
+	}
+	kmem_cache_destroy(lowmem_candidate_cachep);
 }
 
 module_param_named(cost, lowmem_shrinker.seeks, int, S_IRUGO | S_IWUSR);
@@ -374,6 +651,10 @@ module_param_array_named(minfree, lowmem_minfree, uint, &lowmem_minfree_size,
 			 S_IRUGO | S_IWUSR);
 module_param_named(debug_level, lowmem_debug_level, uint, S_IRUGO | S_IWUSR);
 module_param_named(fork_boost, lowmem_fork_boost, uint, S_IRUGO | S_IWUSR);
+module_param_named(zone_aware, lowmem_zone_aware, uint, S_IRUGO | S_IWUSR);
+module_param_named(swap_credit, lowmem_swap_credit, uint, S_IRUGO | S_IWUSR);
+module_param_named(ashmem_credit, lowmem_ashmem_credit, uint,
+		   S_IRUGO | S_IWUSR);
 module_param_array_named(fork_boost_minfree, lowmem_fork_boost_minfree, uint, &lowmem_minfree_size,
 			 S_IRUGO | S_IWUSR);
 
@@ -27,6 +27,11 @@
 #include <linux/spinlock.h>
 #include <linux/types.h>
 #include <linux/atomic.h>
+#include <linux/kthread.h>
+#include <linux/math64.h>
+#include <linux/moduleparam.h>
+#include <linux/mutex.h>
+#include <linux/workqueue.h>
 #include "tmem.h"
 
 #include "../zram/xvmalloc.h" /* if built in drivers/staging */
@@ -63,7 +68,12 @@
  * "buddied" list if it is fully populated  with two zbuds; or
  * (3) one of PAGE_SIZE/64 "unbuddied" lists indexed by how many chunks
  * the one unbuddied zbud uses.  The data inside a zbpg cannot be
- * read or written unless the zbpg's lock is held.
+ * read or written unless the zbpg's lock is held.  Every unbuddied list,
+ * the buddied list and each cpu's unused list has its own lock, always
+ * taken after (or trylocked under) a zbpg's lock.
+ *
+ * Independently of those lists, every zbpg holding data is also on a
+ * single LRU list which decides the eviction order, see zbud_evict_pages().
  */
 
 #define ZBH_SENTINEL  0x43214321
@@ -81,6 +91,8 @@ struct zbud_hdr {
 
 struct zbud_page {
 	struct list_head bud_list;
+	struct list_head lru;
+	bool referenced;	/* second chance, set on a get hit */
 	spinlock_t lock;
 	struct zbud_hdr buddy[ZBUD_MAX_BUDS];
 	DECL_SENTINEL
@@ -94,32 +106,95 @@ struct zbud_page {
 				CHUNK_MASK) >> CHUNK_SHIFT)
 #define MAX_CHUNK	(NCHUNKS-1)
 
-static struct {
+struct zbud_unbuddied {
+	spinlock_t lock;
 	struct list_head list;
 	unsigned count;
-} zbud_unbuddied[NCHUNKS];
+} ____cacheline_aligned_in_smp;
+
+static struct zbud_unbuddied zbud_unbuddied[NCHUNKS];
 /* list N contains pages with N chunks USED and NCHUNKS-N unused */
 /* element 0 is never used but optimizing that isn't worth it */
-static unsigned long zbud_cumul_chunk_counts[NCHUNKS];
+/* each unbuddied list is protected by its own lock */
 
 struct list_head zbud_buddied_list;
 static unsigned long zcache_zbud_buddied_count;
 
-/* protects the buddied list and all unbuddied lists */
-static DEFINE_SPINLOCK(zbud_budlists_spinlock);
+/* protects the buddied list */
+static DEFINE_SPINLOCK(zbud_buddied_list_spinlock);
 
-static LIST_HEAD(zbpg_unused_list);
-static unsigned long zcache_zbpg_unused_list_count;
+/* eviction order, coldest first; nests inside zbpg locks like the lists */
+static LIST_HEAD(zbud_lru_list);
+static DEFINE_SPINLOCK(zbud_lru_spinlock);
 
-/* protects the unused page list */
-static DEFINE_SPINLOCK(zbpg_unused_list_spinlock);
+/*
+ * Pages with no zbuds are parked on a per-cpu unused list so that puts
+ * and flushes on different cpus do not contend; the shrinker drains all
+ * of them.
+ */
+struct zbpg_unused_list {
+	spinlock_t lock;
+	struct list_head list;
+	unsigned long count;
+};
+static DEFINE_PER_CPU(struct zbpg_unused_list, zbpg_unused_lists);
 
 static atomic_t zcache_zbud_curr_raw_pages;
 static atomic_t zcache_zbud_curr_zpages;
-static unsigned long zcache_zbud_curr_zbytes;
-static unsigned long zcache_zbud_cumul_zpages;
-static unsigned long zcache_zbud_cumul_zbytes;
-static unsigned long zcache_compress_poor;
+static atomic_t zcache_zbud_curr_zbytes;
+
+/* cap on raw pages used by zbud, 0 means only the shrinker limits it */
+static unsigned long zcache_zbud_target_pages;
+
+#define MAX_POOLS_PER_CLIENT 16
+
+struct zcache_pool_stats {
+	unsigned long puts;
+	unsigned long hits;
+	unsigned long misses;
+	unsigned long evicts;
+};
+
+/*
+ * Event counters are bumped from every cpu on every put, get and flush,
+ * so keep them per-cpu and only sum them when they are read.  Updaters
+ * always run with preemption disabled and never from hardirq context.
+ */
+struct zcache_stats {
+	unsigned long zbud_cumul_zpages;
+	unsigned long zbud_cumul_zbytes;
+	unsigned long zbud_cumul_chunk_counts[NCHUNKS];
+	unsigned long compress_poor;
+	unsigned long evicted_raw_pages;
+	unsigned long evicted_buddied_pages;
+	unsigned long evicted_unbuddied_pages;
+	unsigned long evict_lru_rotated;
+	unsigned long flush_total;
+	unsigned long flush_found;
+	unsigned long flobj_total;
+	unsigned long flobj_found;
+	unsigned long failed_eph_puts;
+	unsigned long failed_pers_puts;
+	unsigned long failed_get_free_pages;
+	unsigned long failed_alloc;
+	unsigned long put_to_flush;
+	unsigned long aborted_preload;
+	unsigned long aborted_shrink;
+	struct zcache_pool_stats pool[MAX_POOLS_PER_CLIENT];
+};
+static DEFINE_PER_CPU(struct zcache_stats, zcache_stats);
+
+#define zcache_stat_inc(_field)	this_cpu_inc(zcache_stats._field)
+#define zcache_stat_add(_field, _val) \
+	this_cpu_add(zcache_stats._field, (_val))
+#define zcache_stat_sum(_field) \
+	({ \
+		unsigned long __sum = 0; \
+		int __cpu; \
+		for_each_possible_cpu(__cpu) \
+			__sum += per_cpu(zcache_stats, __cpu)._field; \
+		__sum; \
+	})
 
 /* forward references */
 static void *zcache_get_free_page(void);
@@ -184,23 +259,26 @@ static struct zbud_page *zbud_alloc_raw_page(void)
 {
 	struct zbud_page *zbpg = NULL;
 	struct zbud_hdr *zh0, *zh1;
+	struct zbpg_unused_list *ul = &__get_cpu_var(zbpg_unused_lists);
 	bool recycled = 0;
 
-	/* if any pages on the zbpg list, use one */
-	spin_lock(&zbpg_unused_list_spinlock);
-	if (!list_empty(&zbpg_unused_list)) {
-		zbpg = list_first_entry(&zbpg_unused_list,
+	/* if any pages on this cpu's zbpg list, use one */
+	spin_lock(&ul->lock);
+	if (!list_empty(&ul->list)) {
+		zbpg = list_first_entry(&ul->list,
 				struct zbud_page, bud_list);
 		list_del_init(&zbpg->bud_list);
-		zcache_zbpg_unused_list_count--;
+		ul->count--;
 		recycled = 1;
 	}
-	spin_unlock(&zbpg_unused_list_spinlock);
+	spin_unlock(&ul->lock);
 	if (zbpg == NULL)
 		/* none on zbpg list, try to get a kernel page */
 		zbpg = zcache_get_free_page();
 	if (likely(zbpg != NULL)) {
 		INIT_LIST_HEAD(&zbpg->bud_list);
+		INIT_LIST_HEAD(&zbpg->lru);
+		zbpg->referenced = 0;
 		zh0 = &zbpg->buddy[0]; zh1 = &zbpg->buddy[1];
 		spin_lock_init(&zbpg->lock);
 		if (recycled) {
@@ -223,6 +301,7 @@ static struct zbud_page *zbud_alloc_raw_page(void)
 static void zbud_free_raw_page(struct zbud_page *zbpg)
 {
 	struct zbud_hdr *zh0 = &zbpg->buddy[0], *zh1 = &zbpg->buddy[1];
+	struct zbpg_unused_list *ul;
 
 	ASSERT_SENTINEL(zbpg, ZBPG);
 	BUG_ON(!list_empty(&zbpg->bud_list));
@@ -230,11 +309,16 @@ static void zbud_free_raw_page(struct zbud_page *zbpg)
 	BUG_ON(zh0->size != 0 || tmem_oid_valid(&zh0->oid));
 	BUG_ON(zh1->size != 0 || tmem_oid_valid(&zh1->oid));
 	INVERT_SENTINEL(zbpg, ZBPG);
+	spin_lock(&zbud_lru_spinlock);
+	list_del_init(&zbpg->lru);
+	spin_unlock(&zbud_lru_spinlock);
+	/* still non-preemptible here: we are holding zbpg->lock */
+	ul = &__get_cpu_var(zbpg_unused_lists);
+	spin_lock(&ul->lock);
 	spin_unlock(&zbpg->lock);
-	spin_lock(&zbpg_unused_list_spinlock);
-	list_add(&zbpg->bud_list, &zbpg_unused_list);
-	zcache_zbpg_unused_list_count++;
-	spin_unlock(&zbpg_unused_list_spinlock);
+	list_add(&zbpg->bud_list, &ul->list);
+	ul->count++;
+	spin_unlock(&ul->lock);
 }
 
 /*
@@ -252,7 +336,7 @@ static unsigned zbud_free(struct zbud_hdr *zh)
 	zh->size = 0;
 	tmem_oid_set_invalid(&zh->oid);
 	INVERT_SENTINEL(zh, ZBH);
-	zcache_zbud_curr_zbytes -= size;
+	atomic_sub(size, &zcache_zbud_curr_zbytes);
 	atomic_dec(&zcache_zbud_curr_zpages);
 	return size;
 }
@@ -264,6 +348,7 @@ static void zbud_free_and_delist(struct zbud_hdr *zh)
 	unsigned budnum = zbud_budnum(zh), size;
 	struct zbud_page *zbpg =
 		container_of(zh, struct zbud_page, buddy[budnum]);
+	struct zbud_unbuddied *ub;
 
 	spin_lock(&zbpg->lock);
 	if (list_empty(&zbpg->bud_list)) {
@@ -276,20 +361,25 @@ static void zbud_free_and_delist(struct zbud_hdr *zh)
 	zh_other = &zbpg->buddy[(budnum == 0) ? 1 : 0];
 	if (zh_other->size == 0) { /* was unbuddied: unlist and free */
 		chunks = zbud_size_to_chunks(size) ;
-		spin_lock(&zbud_budlists_spinlock);
-		BUG_ON(list_empty(&zbud_unbuddied[chunks].list));
+		ub = &zbud_unbuddied[chunks];
+		spin_lock(&ub->lock);
+		BUG_ON(list_empty(&ub->list));
 		list_del_init(&zbpg->bud_list);
-		zbud_unbuddied[chunks].count--;
-		spin_unlock(&zbud_budlists_spinlock);
+		ub->count--;
+		spin_unlock(&ub->lock);
 		zbud_free_raw_page(zbpg);
 	} else { /* was buddied: move remaining buddy to unbuddied list */
 		chunks = zbud_size_to_chunks(zh_other->size) ;
-		spin_lock(&zbud_budlists_spinlock);
+		ub = &zbud_unbuddied[chunks];
+		spin_lock(&zbud_buddied_list_spinlock);
 		list_del_init(&zbpg->bud_list);
 		zcache_zbud_buddied_count--;
-		list_add_tail(&zbpg->bud_list, &zbud_unbuddied[chunks].list);
-		zbud_unbuddied[chunks].count++;
-		spin_unlock(&zbud_budlists_spinlock);
+		spin_unlock(&zbud_buddied_list_spinlock);
+		/* off all lists briefly, but zbpg->lock keeps evict away */
+		spin_lock(&ub->lock);
+		list_add_tail(&zbpg->bud_list, &ub->list);
+		ub->count++;
+		spin_unlock(&ub->lock);
 		spin_unlock(&zbpg->lock);
 	}
 }
@@ -300,33 +390,34 @@ static struct zbud_hdr *zbud_create(uint32_t pool_id, struct tmem_oid *oid,
 {
 	struct zbud_hdr *zh0, *zh1, *zh = NULL;
 	struct zbud_page *zbpg = NULL, *ztmp;
+	struct zbud_unbuddied *ub;
 	unsigned nchunks;
 	char *to;
-	int i, found_good_buddy = 0;
+	int i;
 
 	nchunks = zbud_size_to_chunks(size) ;
 	for (i = MAX_CHUNK - nchunks + 1; i > 0; i--) {
-		spin_lock(&zbud_budlists_spinlock);
-		if (!list_empty(&zbud_unbuddied[i].list)) {
-			list_for_each_entry_safe(zbpg, ztmp,
-				    &zbud_unbuddied[i].list, bud_list) {
-				if (spin_trylock(&zbpg->lock)) {
-					found_good_buddy = i;
-					goto found_unbuddied;
-				}
-			}
+		ub = &zbud_unbuddied[i];
+		/* unlocked peek, rechecked below, saves a lock per empty list */
+		if (list_empty(&ub->list))
+			continue;
+		spin_lock(&ub->lock);
+		list_for_each_entry_safe(zbpg, ztmp, &ub->list, bud_list) {
+			if (spin_trylock(&zbpg->lock))
+				goto found_unbuddied;
 		}
-		spin_unlock(&zbud_budlists_spinlock);
+		spin_unlock(&ub->lock);
 	}
 	/* didn't find a good buddy, try allocating a new page */
 	zbpg = zbud_alloc_raw_page();
 	if (unlikely(zbpg == NULL))
 		goto out;
-	/* ok, have a page, now compress the data before taking locks */
 	spin_lock(&zbpg->lock);
-	spin_lock(&zbud_budlists_spinlock);
-	list_add_tail(&zbpg->bud_list, &zbud_unbuddied[nchunks].list);
-	zbud_unbuddied[nchunks].count++;
+	ub = &zbud_unbuddied[nchunks];
+	spin_lock(&ub->lock);
+	list_add_tail(&zbpg->bud_list, &ub->list);
+	ub->count++;
+	spin_unlock(&ub->lock);
 	zh = &zbpg->buddy[0];
 	goto init_zh;
 
@@ -343,27 +434,32 @@ found_unbuddied:
 	} else
 		BUG();
 	list_del_init(&zbpg->bud_list);
-	zbud_unbuddied[found_good_buddy].count--;
+	ub->count--;
+	spin_unlock(&ub->lock);
+	spin_lock(&zbud_buddied_list_spinlock);
 	list_add_tail(&zbpg->bud_list, &zbud_buddied_list);
 	zcache_zbud_buddied_count++;
+	spin_unlock(&zbud_buddied_list_spinlock);
 
 init_zh:
+	/* the list locks are dropped, only zbpg->lock is held from here */
 	SET_SENTINEL(zh, ZBH);
 	zh->size = size;
 	zh->index = index;
 	zh->oid = *oid;
 	zh->pool_id = pool_id;
-	/* can wait to copy the data until the list locks are dropped */
-	spin_unlock(&zbud_budlists_spinlock);
-
 	to = zbud_data(zh, size);
 	memcpy(to, cdata, size);
+	/* fresh data makes the whole zbpg the most recently used */
+	spin_lock(&zbud_lru_spinlock);
+	list_move_tail(&zbpg->lru, &zbud_lru_list);
+	spin_unlock(&zbud_lru_spinlock);
 	spin_unlock(&zbpg->lock);
-	zbud_cumul_chunk_counts[nchunks]++;
+	zcache_stat_inc(zbud_cumul_chunk_counts[nchunks]);
 	atomic_inc(&zcache_zbud_curr_zpages);
-	zcache_zbud_cumul_zpages++;
-	zcache_zbud_curr_zbytes += size;
-	zcache_zbud_cumul_zbytes += size;
+	zcache_stat_inc(zbud_cumul_zpages);
+	atomic_add(size, &zcache_zbud_curr_zbytes);
+	zcache_stat_add(zbud_cumul_zbytes, size);
 out:
 	return zh;
 }
@@ -393,6 +489,12 @@ static int zbud_decompress(struct page *page, struct zbud_hdr *zh)
 	BUG_ON(ret != LZO_E_OK);
 	BUG_ON(out_len != PAGE_SIZE);
 	kunmap_atomic(to_va, KM_USER0);
+	/*
+	 * The ephemeral get frees this zbud, but its buddy was put next to
+	 * it (usually the neighbouring page of the same file), so a hit
+	 * here buys the remaining buddy a second chance.
+	 */
+	zbpg->referenced = 1;
 out:
 	spin_unlock(&zbpg->lock);
 	return ret;
@@ -403,10 +505,6 @@ out:
  * pages "least valuable" first.
  */
 
-static unsigned long zcache_evicted_raw_pages;
-static unsigned long zcache_evicted_buddied_pages;
-static unsigned long zcache_evicted_unbuddied_pages;
-
 static struct tmem_pool *zcache_get_pool_by_id(uint32_t poolid);
 static void zcache_put_pool(struct tmem_pool *pool);
 
@@ -437,6 +535,7 @@ static void zbud_evict_zbpg(struct zbud_page *zbpg)
 	for (i = 0; i < j; i++) {
 		pool = zcache_get_pool_by_id(pool_id[i]);
 		if (pool != NULL) {
+			zcache_stat_inc(pool[pool_id[i]].evicts);
 			tmem_flush_page(pool, &oid[i], index[i]);
 			zcache_put_pool(pool);
 		}
@@ -446,99 +545,166 @@ static void zbud_evict_zbpg(struct zbud_page *zbpg)
 	zbud_free_raw_page(zbpg);
 }
 
+/* how far zbud_lru_isolate() looks for a cold unbuddied page */
+#define ZBUD_LRU_SCAN	32
+
 /*
- * Free nr pages.  This code is funky because we want to hold the locks
- * protecting various lists for as short a time as possible, and in some
- * circumstances the list may change asynchronously when the list lock is
- * not held.  In some cases we also trylock not only to avoid waiting on a
- * page in use by another cpu, but also to avoid potential deadlock due to
- * lock inversion.
+ * Take a locked zbpg off its buddied or unbuddied list.
  */
-static void zbud_evict_pages(int nr)
+static void zbud_unlist(struct zbud_page *zbpg)
 {
-	struct zbud_page *zbpg;
-	int i;
+	struct zbud_hdr *zh0 = &zbpg->buddy[0], *zh1 = &zbpg->buddy[1];
+	struct zbud_unbuddied *ub;
 
-	/* first try freeing any pages on unused list */
-retry_unused_list:
-	spin_lock_bh(&zbpg_unused_list_spinlock);
-	if (!list_empty(&zbpg_unused_list)) {
-		/* can't walk list here, since it may change when unlocked */
-		zbpg = list_first_entry(&zbpg_unused_list,
-				struct zbud_page, bud_list);
+	ASSERT_SPINLOCK(&zbpg->lock);
+	if (zh0->size != 0 && zh1->size != 0) {
+		spin_lock(&zbud_buddied_list_spinlock);
 		list_del_init(&zbpg->bud_list);
-		zcache_zbpg_unused_list_count--;
-		atomic_dec(&zcache_zbud_curr_raw_pages);
-		spin_unlock_bh(&zbpg_unused_list_spinlock);
-		zcache_free_page(zbpg);
-		zcache_evicted_raw_pages++;
-		if (--nr <= 0)
-			goto out;
-		goto retry_unused_list;
+		zcache_zbud_buddied_count--;
+		spin_unlock(&zbud_buddied_list_spinlock);
+		zcache_stat_inc(evicted_buddied_pages);
+	} else {
+		ub = &zbud_unbuddied[zbud_size_to_chunks(zh0->size ?
+							 zh0->size : zh1->size)];
+		spin_lock(&ub->lock);
+		list_del_init(&zbpg->bud_list);
+		ub->count--;
+		spin_unlock(&ub->lock);
+		zcache_stat_inc(evicted_unbuddied_pages);
 	}
-	spin_unlock_bh(&zbpg_unused_list_spinlock);
-
-	/* now try freeing unbuddied pages, starting with least space avail */
-	for (i = 0; i < MAX_CHUNK; i++) {
-retry_unbud_list_i:
-		spin_lock_bh(&zbud_budlists_spinlock);
-		if (list_empty(&zbud_unbuddied[i].list)) {
-			spin_unlock_bh(&zbud_budlists_spinlock);
+}
+
+/*
+ * Pick the next zbpg to evict.  Scan from the cold end of the LRU and
+ * rotate referenced pages to the hot end once (second chance), as well as
+ * pages whose lock is busy.  Within the first ZBUD_LRU_SCAN pages prefer
+ * one holding a single zbud: evicting a buddied page throws away two
+ * compressed pages to reclaim a single pageframe.  Past that any page
+ * will do, and after one lap the rotated pages get a second look, so this
+ * only fails when every page is busy.
+ * Returns the zbpg locked, off every list and with bottom halves
+ * disabled, or NULL (bottom halves enabled) if nothing could be taken.
+ */
+static struct zbud_page *zbud_lru_isolate(void)
+{
+	struct zbud_page *zbpg, *ztmp, *buddied = NULL, *stop = NULL;
+	int scanned = 0, lap = 0;
+	bool window;
+
+	spin_lock_bh(&zbud_lru_spinlock);
+	list_for_each_entry_safe(zbpg, ztmp, &zbud_lru_list, lru) {
+		/* back at the first page we rotated: no more rotating */
+		if (zbpg == stop)
+			lap = 1;
+		window = scanned++ < ZBUD_LRU_SCAN;
+		if (!window && buddied != NULL) {
+			if (spin_trylock(&buddied->lock)) {
+				zbpg = buddied;
+				goto found;
+			}
+			buddied = NULL;
+		}
+		if (zbpg->referenced) {
+			zbpg->referenced = 0;
+			zcache_stat_inc(evict_lru_rotated);
+			goto rotate;
+		}
+		/* unlocked peek; any zbpg found here is safe to evict */
+		if (window && zbpg->buddy[0].size != 0 &&
+		    zbpg->buddy[1].size != 0) {
+			if (buddied == NULL)
+				buddied = zbpg;
 			continue;
 		}
-		list_for_each_entry(zbpg, &zbud_unbuddied[i].list, bud_list) {
-			if (unlikely(!spin_trylock(&zbpg->lock)))
-				continue;
+		if (spin_trylock(&zbpg->lock))
+			goto found;
+rotate:
+		if (lap)
+			continue;
+		list_move_tail(&zbpg->lru, &zbud_lru_list);
+		if (stop == NULL)
+			stop = zbpg;
+	}
+	/* nothing cold with a single zbud, fall back to the oldest pair */
+	zbpg = buddied;
+	if (zbpg != NULL && spin_trylock(&zbpg->lock))
+		goto found;
+	spin_unlock_bh(&zbud_lru_spinlock);
+	return NULL;
+
+found:
+	list_del_init(&zbpg->lru);
+	spin_unlock(&zbud_lru_spinlock);
+	zbud_unlist(zbpg);
+	return zbpg;
+}
+
+/*
+ * Free nr pages.  Raw pages with no zbuds go first, then zbpgs in LRU
+ * order.  The lru and list locks are held for as short a time as possible
+ * and zbpg locks are only ever trylocked under them, both to avoid waiting
+ * on a page in use by another cpu and to avoid lock inversion.
+ */
+static void zbud_evict_pages(int nr)
+{
+	struct zbud_page *zbpg;
+	struct zbpg_unused_list *ul;
+	int cpu;
+
+	/* first try freeing any pages on the unused lists */
+	for_each_possible_cpu(cpu) {
+		ul = &per_cpu(zbpg_unused_lists, cpu);
+retry_unused_list:
+		spin_lock_bh(&ul->lock);
+		if (!list_empty(&ul->list)) {
+			/* can't walk list here, it may change when unlocked */
+			zbpg = list_first_entry(&ul->list,
+					struct zbud_page, bud_list);
 			list_del_init(&zbpg->bud_list);
-			zbud_unbuddied[i].count--;
-			spin_unlock(&zbud_budlists_spinlock);
-			zcache_evicted_unbuddied_pages++;
-			/* want budlists unlocked when doing zbpg eviction */
-			zbud_evict_zbpg(zbpg);
-			local_bh_enable();
+			ul->count--;
+			atomic_dec(&zcache_zbud_curr_raw_pages);
+			spin_unlock_bh(&ul->lock);
+			zcache_free_page(zbpg);
+			zcache_stat_inc(evicted_raw_pages);
 			if (--nr <= 0)
 				goto out;
-			goto retry_unbud_list_i;
+			goto retry_unused_list;
 		}
-		spin_unlock_bh(&zbud_budlists_spinlock);
+		spin_unlock_bh(&ul->lock);
 	}
 
-	/* as a last resort, free buddied pages */
-retry_bud_list:
-	spin_lock_bh(&zbud_budlists_spinlock);
-	if (list_empty(&zbud_buddied_list)) {
-		spin_unlock_bh(&zbud_budlists_spinlock);
-		goto out;
-	}
-	list_for_each_entry(zbpg, &zbud_buddied_list, bud_list) {
-		if (unlikely(!spin_trylock(&zbpg->lock)))
-			continue;
-		list_del_init(&zbpg->bud_list);
-		zcache_zbud_buddied_count--;
-		spin_unlock(&zbud_budlists_spinlock);
-		zcache_evicted_buddied_pages++;
-		/* want budlists unlocked when doing zbpg eviction */
+	/* now evict zbpgs, coldest first */
+	while (nr > 0) {
+		zbpg = zbud_lru_isolate();
+		if (zbpg == NULL)
+			break;
+		/* want lru and budlists unlocked when doing zbpg eviction */
 		zbud_evict_zbpg(zbpg);
 		local_bh_enable();
-		if (--nr <= 0)
-			goto out;
-		goto retry_bud_list;
+		nr--;
 	}
-	spin_unlock_bh(&zbud_budlists_spinlock);
 out:
 	return;
 }
 
 static void zbud_init(void)
 {
-	int i;
+	struct zbpg_unused_list *ul;
+	int i, cpu;
 
 	INIT_LIST_HEAD(&zbud_buddied_list);
 	zcache_zbud_buddied_count = 0;
 	for (i = 0; i < NCHUNKS; i++) {
+		spin_lock_init(&zbud_unbuddied[i].lock);
 		INIT_LIST_HEAD(&zbud_unbuddied[i].list);
 		zbud_unbuddied[i].count = 0;
 	}
+	for_each_possible_cpu(cpu) {
+		ul = &per_cpu(zbpg_unused_lists, cpu);
+		spin_lock_init(&ul->lock);
+		INIT_LIST_HEAD(&ul->list);
+		ul->count = 0;
+	}
 }
 
 #ifdef CONFIG_SYSFS
@@ -562,14 +728,15 @@ static int zbud_show_cumul_chunk_counts(char *buf)
 {
 	unsigned long i, chunks = 0, total_chunks = 0, sum_total_chunks = 0;
 	unsigned long total_chunks_lte_21 = 0, total_chunks_lte_32 = 0;
-	unsigned long total_chunks_lte_42 = 0;
+	unsigned long total_chunks_lte_42 = 0, count;
 	char *p = buf;
 
 	for (i = 0; i < NCHUNKS; i++) {
-		p += sprintf(p, "%lu ", zbud_cumul_chunk_counts[i]);
-		chunks += zbud_cumul_chunk_counts[i];
-		total_chunks += zbud_cumul_chunk_counts[i];
-		sum_total_chunks += i * zbud_cumul_chunk_counts[i];
+		count = zcache_stat_sum(zbud_cumul_chunk_counts[i]);
+		p += sprintf(p, "%lu ", count);
+		chunks += count;
+		total_chunks += count;
+		sum_total_chunks += i * count;
 		if (i == 21)
 			total_chunks_lte_21 = total_chunks;
 		if (i == 32)
@@ -582,6 +749,16 @@ static int zbud_show_cumul_chunk_counts(char *buf)
 		chunks == 0 ? 0 : sum_total_chunks / chunks);
 	return p - buf;
 }
+
+static int zbpg_show_unused_list_count(char *buf)
+{
+	unsigned long count = 0;
+	int cpu;
+
+	for_each_possible_cpu(cpu)
+		count += per_cpu(zbpg_unused_lists, cpu).count;
+	return sprintf(buf, "%lu\n", count);
+}
 #endif
 
 /**********
@@ -669,16 +846,6 @@ static void zv_decompress(struct page *page, struct zv_hdr *zv)
  * zcache core code starts here
  */
 
-/* useful stats not collected by cleancache or frontswap */
-static unsigned long zcache_flush_total;
-static unsigned long zcache_flush_found;
-static unsigned long zcache_flobj_total;
-static unsigned long zcache_flobj_found;
-static unsigned long zcache_failed_eph_puts;
-static unsigned long zcache_failed_pers_puts;
-
-#define MAX_POOLS_PER_CLIENT 16
-
 static struct {
 	struct tmem_pool *tmem_pools[MAX_POOLS_PER_CLIENT];
 	struct xv_pool *xvpool;
@@ -709,13 +876,6 @@ static void zcache_put_pool(struct tmem_pool *pool)
 		atomic_dec(&pool->refcount);
 }
 
-/* counters for debugging */
-static unsigned long zcache_failed_get_free_pages;
-static unsigned long zcache_failed_alloc;
-static unsigned long zcache_put_to_flush;
-static unsigned long zcache_aborted_preload;
-static unsigned long zcache_aborted_shrink;
-
 /*
  * Ensure that memory allocation requests in zcache don't result
  * in direct reclaim requests via the shrinker, which would cause
@@ -745,6 +905,9 @@ struct zcache_preload {
 	struct tmem_obj *obj;
 	int nr;
 	struct tmem_objnode *objnodes[OBJNODE_TREE_MAX_PATH];
+	/* page compressed by zcache_put_page before any tmem lock is taken */
+	void *cdata;
+	size_t clen;
 };
 static DEFINE_PER_CPU(struct zcache_preload, zcache_preloads) = { 0, };
 
@@ -761,7 +924,7 @@ static int zcache_do_preload(struct tmem_pool *pool)
 	if (unlikely(zcache_obj_cache == NULL))
 		goto out;
 	if (!spin_trylock(&zcache_direct_reclaim_lock)) {
-		zcache_aborted_preload++;
+		zcache_stat_inc(aborted_preload);
 		goto out;
 	}
 	preempt_disable();
@@ -771,7 +934,7 @@ static int zcache_do_preload(struct tmem_pool *pool)
 		objnode = kmem_cache_alloc(zcache_objnode_cache,
 				ZCACHE_GFP_MASK);
 		if (unlikely(objnode == NULL)) {
-			zcache_failed_alloc++;
+			zcache_stat_inc(failed_alloc);
 			goto unlock_out;
 		}
 		preempt_disable();
@@ -784,12 +947,12 @@ static int zcache_do_preload(struct tmem_pool *pool)
 	preempt_enable_no_resched();
 	obj = kmem_cache_alloc(zcache_obj_cache, ZCACHE_GFP_MASK);
 	if (unlikely(obj == NULL)) {
-		zcache_failed_alloc++;
+		zcache_stat_inc(failed_alloc);
 		goto unlock_out;
 	}
 	page = (void *)__get_free_page(ZCACHE_GFP_MASK);
 	if (unlikely(page == NULL)) {
-		zcache_failed_get_free_pages++;
+		zcache_stat_inc(failed_get_free_pages);
 		kmem_cache_free(zcache_obj_cache, obj);
 		goto unlock_out;
 	}
@@ -898,25 +1061,24 @@ static unsigned long zcache_curr_eph_pampd_count_max;
 static atomic_t zcache_curr_pers_pampd_count = ATOMIC_INIT(0);
 static unsigned long zcache_curr_pers_pampd_count_max;
 
-/* forward reference */
-static int zcache_compress(struct page *from, void **out_va, size_t *out_len);
-
 static void *zcache_pampd_create(struct tmem_pool *pool, struct tmem_oid *oid,
 				 uint32_t index, struct page *page)
 {
 	void *pampd = NULL, *cdata;
 	size_t clen;
-	int ret;
 	bool ephemeral = is_ephemeral(pool);
 	unsigned long count;
+	struct zcache_preload *kp = &__get_cpu_var(zcache_preloads);
 
+	/* consume the data compressed by zcache_put_page() */
+	cdata = kp->cdata;
+	clen = kp->clen;
+	kp->cdata = NULL;
+	if (cdata == NULL)
+		goto out;
 	if (ephemeral) {
-		ret = zcache_compress(page, &cdata, &clen);
-		if (ret == 0)
-
-			goto out;
 		if (clen == 0 || clen > zbud_max_buddy_size()) {
-			zcache_compress_poor++;
+			zcache_stat_inc(compress_poor);
 			goto out;
 		}
 		pampd = (void *)zbud_create(pool->pool_id, oid, index,
@@ -935,11 +1097,8 @@ static void *zcache_pampd_create(struct tmem_pool *pool, struct tmem_oid *oid,
 		if (atomic_read(&zcache_curr_pers_pampd_count) >
 							3 * totalram_pages / 4)
 			goto out;
-		ret = zcache_compress(page, &cdata, &clen);
-		if (ret == 0)
-			goto out;
 		if (clen > zv_max_page_size) {
-			zcache_compress_poor++;
+			zcache_stat_inc(compress_poor);
 			goto out;
 		}
 		pampd = (void *)zv_create(zcache_client.xvpool, pool->pool_id,
@@ -1067,6 +1226,33 @@ static struct notifier_block zcache_cpu_notifier_block = {
 };
 
 #ifdef CONFIG_SYSFS
+/*
+ * One line per live pool; "hit%" is hits over all gets since the pool
+ * was created, rates are left to userspace sampling the counters.
+ */
+static int zcache_show_pool_stats(char *buf)
+{
+	struct tmem_pool *pool;
+	unsigned long hits, misses;
+	char *p = buf;
+	int i;
+
+	for (i = 0; i < MAX_POOLS_PER_CLIENT; i++) {
+		pool = zcache_client.tmem_pools[i];
+		if (pool == NULL)
+			continue;
+		hits = zcache_stat_sum(pool[i].hits);
+		misses = zcache_stat_sum(pool[i].misses);
+		p += sprintf(p, "%d %s puts:%lu hits:%lu misses:%lu "
+			"evicts:%lu hit%%:%lu\n", i,
+			is_ephemeral(pool) ? "eph" : "pers",
+			zcache_stat_sum(pool[i].puts), hits, misses,
+			zcache_stat_sum(pool[i].evicts),
+			hits + misses ? hits * 100 / (hits + misses) : 0);
+	}
+	return p - buf;
+}
+
 #define ZCACHE_SYSFS_RO(_name) \
 	static ssize_t zcache_##_name##_show(struct kobject *kobj, \
 				struct kobj_attribute *attr, char *buf) \
@@ -1078,6 +1264,17 @@ static struct notifier_block zcache_cpu_notifier_block = {
 		.show = zcache_##_name##_show, \
 	}
 
+#define ZCACHE_SYSFS_RO_PERCPU(_name) \
+	static ssize_t zcache_##_name##_show(struct kobject *kobj, \
+				struct kobj_attribute *attr, char *buf) \
+	{ \
+		return sprintf(buf, "%lu\n", zcache_stat_sum(_name)); \
+	} \
+	static struct kobj_attribute zcache_##_name##_attr = { \
+		.attr = { .name = __stringify(_name), .mode = 0444 }, \
+		.show = zcache_##_name##_show, \
+	}
+
 #define ZCACHE_SYSFS_RO_ATOMIC(_name) \
 	static ssize_t zcache_##_name##_show(struct kobject *kobj, \
 				struct kobj_attribute *attr, char *buf) \
@@ -1102,34 +1299,60 @@ static struct notifier_block zcache_cpu_notifier_block = {
 
 ZCACHE_SYSFS_RO(curr_obj_count_max);
 ZCACHE_SYSFS_RO(curr_objnode_count_max);
-ZCACHE_SYSFS_RO(flush_total);
-ZCACHE_SYSFS_RO(flush_found);
-ZCACHE_SYSFS_RO(flobj_total);
-ZCACHE_SYSFS_RO(flobj_found);
-ZCACHE_SYSFS_RO(failed_eph_puts);
-ZCACHE_SYSFS_RO(failed_pers_puts);
-ZCACHE_SYSFS_RO(zbud_curr_zbytes);
-ZCACHE_SYSFS_RO(zbud_cumul_zpages);
-ZCACHE_SYSFS_RO(zbud_cumul_zbytes);
+ZCACHE_SYSFS_RO_PERCPU(flush_total);
+ZCACHE_SYSFS_RO_PERCPU(flush_found);
+ZCACHE_SYSFS_RO_PERCPU(flobj_total);
+ZCACHE_SYSFS_RO_PERCPU(flobj_found);
+ZCACHE_SYSFS_RO_PERCPU(failed_eph_puts);
+ZCACHE_SYSFS_RO_PERCPU(failed_pers_puts);
+ZCACHE_SYSFS_RO_PERCPU(zbud_cumul_zpages);
+ZCACHE_SYSFS_RO_PERCPU(zbud_cumul_zbytes);
 ZCACHE_SYSFS_RO(zbud_buddied_count);
-ZCACHE_SYSFS_RO(zbpg_unused_list_count);
-ZCACHE_SYSFS_RO(evicted_raw_pages);
-ZCACHE_SYSFS_RO(evicted_unbuddied_pages);
-ZCACHE_SYSFS_RO(evicted_buddied_pages);
-ZCACHE_SYSFS_RO(failed_get_free_pages);
-ZCACHE_SYSFS_RO(failed_alloc);
-ZCACHE_SYSFS_RO(put_to_flush);
-ZCACHE_SYSFS_RO(aborted_preload);
-ZCACHE_SYSFS_RO(aborted_shrink);
-ZCACHE_SYSFS_RO(compress_poor);
+ZCACHE_SYSFS_RO_PERCPU(evicted_raw_pages);
+ZCACHE_SYSFS_RO_PERCPU(evicted_unbuddied_pages);
+ZCACHE_SYSFS_RO_PERCPU(evicted_buddied_pages);
+ZCACHE_SYSFS_RO_PERCPU(evict_lru_rotated);
+ZCACHE_SYSFS_RO_PERCPU(failed_get_free_pages);
+ZCACHE_SYSFS_RO_PERCPU(failed_alloc);
+ZCACHE_SYSFS_RO_PERCPU(put_to_flush);
+ZCACHE_SYSFS_RO_PERCPU(aborted_preload);
+ZCACHE_SYSFS_RO_PERCPU(aborted_shrink);
+ZCACHE_SYSFS_RO_PERCPU(compress_poor);
 ZCACHE_SYSFS_RO_ATOMIC(zbud_curr_raw_pages);
 ZCACHE_SYSFS_RO_ATOMIC(zbud_curr_zpages);
+ZCACHE_SYSFS_RO_ATOMIC(zbud_curr_zbytes);
 ZCACHE_SYSFS_RO_ATOMIC(curr_obj_count);
 ZCACHE_SYSFS_RO_ATOMIC(curr_objnode_count);
 ZCACHE_SYSFS_RO_CUSTOM(zbud_unbuddied_list_counts,
 			zbud_show_unbuddied_list_counts);
 ZCACHE_SYSFS_RO_CUSTOM(zbud_cumul_chunk_counts,
 			zbud_show_cumul_chunk_counts);
+ZCACHE_SYSFS_RO_CUSTOM(zbpg_unused_list_count,
+			zbpg_show_unused_list_count);
+ZCACHE_SYSFS_RO_CUSTOM(pool_stats, zcache_show_pool_stats);
+
+static ssize_t zcache_zbud_target_pages_show(struct kobject *kobj,
+				struct kobj_attribute *attr, char *buf)
+{
+	return sprintf(buf, "%lu\n", zcache_zbud_target_pages);
+}
+
+static ssize_t zcache_zbud_target_pages_store(struct kobject *kobj,
+				struct kobj_attribute *attr,
+				const char *buf, size_t count)
+{
+	unsigned long val;
+
+	if (strict_strtoul(buf, 10, &val))
+		return -EINVAL;
+	/* takes effect on the next ephemeral put */
+	zcache_zbud_target_pages = val;
+	return count;
+}
+
+static struct kobj_attribute zcache_zbud_target_pages_attr =
+	__ATTR(zbud_target_pages, 0644, zcache_zbud_target_pages_show,
+		zcache_zbud_target_pages_store);
 
 static struct attribute *zcache_attrs[] = {
 	&zcache_curr_obj_count_attr.attr,
@@ -1153,6 +1376,9 @@ static struct attribute *zcache_attrs[] = {
 	&zcache_evicted_raw_pages_attr.attr,
 	&zcache_evicted_unbuddied_pages_attr.attr,
 	&zcache_evicted_buddied_pages_attr.attr,
+	&zcache_evict_lru_rotated_attr.attr,
+	&zcache_zbud_target_pages_attr.attr,
+	&zcache_pool_stats_attr.attr,
 	&zcache_failed_get_free_pages_attr.attr,
 	&zcache_failed_alloc_attr.attr,
 	&zcache_put_to_flush_attr.attr,
@@ -1196,7 +1422,7 @@ static int shrink_zcache_memory(struct shrinker *shrink,
 			zbud_evict_pages(nr);
 			spin_unlock(&zcache_direct_reclaim_lock);
 		} else
-			zcache_aborted_shrink++;
+			zcache_stat_inc(aborted_shrink);
 	}
 	ret = (int)atomic_read(&zcache_zbud_curr_raw_pages);
 out:
@@ -1208,6 +1434,34 @@ static struct shrinker zcache_shrinker = {
 	.seeks = DEFAULT_SEEKS,
 };
 
+/*
+ * Puts cannot evict synchronously (interrupts are off and the victim may
+ * live in a hashbucket the caller still holds), so going over the zbud
+ * target kicks a work item that evicts the coldest zbpgs down to it.
+ */
+static void zbud_evict_work_fn(struct work_struct *work)
+{
+	unsigned long target = ACCESS_ONCE(zcache_zbud_target_pages);
+	unsigned long curr = atomic_read(&zcache_zbud_curr_raw_pages);
+
+	if (target == 0 || curr <= target)
+		return;
+	if (spin_trylock(&zcache_direct_reclaim_lock)) {
+		zbud_evict_pages(curr - target);
+		spin_unlock(&zcache_direct_reclaim_lock);
+	}
+}
+
+static DECLARE_WORK(zbud_evict_work, zbud_evict_work_fn);
+
+static void zbud_check_target(void)
+{
+	unsigned long target = ACCESS_ONCE(zcache_zbud_target_pages);
+
+	if (target && atomic_read(&zcache_zbud_curr_raw_pages) > target)
+		schedule_work(&zbud_evict_work);
+}
+
 /*
  * zcache shims between cleancache/frontswap ops and tmem
  */
@@ -1224,17 +1478,28 @@ static int zcache_put_page(int pool_id, struct tmem_oid *oidp,
 		goto out;
 	if (!zcache_freeze && zcache_do_preload(pool) == 0) {
 		/* preload does preempt_disable on success */
+		struct zcache_preload *kp = &__get_cpu_var(zcache_preloads);
+
+		/*
+		 * Compress into this cpu's buffer now so tmem_put() only
+		 * holds the object hashbucket lock for the copy and insert.
+		 */
+		if (!zcache_compress(page, &kp->cdata, &kp->clen))
+			kp->cdata = NULL;
 		ret = tmem_put(pool, oidp, index, page);
+		kp->cdata = NULL;
+		zcache_stat_inc(pool[pool_id].puts);
 		if (ret < 0) {
 			if (is_ephemeral(pool))
-				zcache_failed_eph_puts++;
+				zcache_stat_inc(failed_eph_puts);
 			else
-				zcache_failed_pers_puts++;
-		}
+				zcache_stat_inc(failed_pers_puts);
+		} else if (is_ephemeral(pool))
+			zbud_check_target();
 		zcache_put_pool(pool);
 		preempt_enable_no_resched();
 	} else {
-		zcache_put_to_flush++;
+		zcache_stat_inc(put_to_flush);
 		if (atomic_read(&pool->obj_count) > 0)
 			/* the put fails whether the flush succeeds or not */
 			(void)tmem_flush_page(pool, oidp, index);
@@ -1256,6 +1521,10 @@ static int zcache_get_page(int pool_id, struct tmem_oid *oidp,
 	if (likely(pool != NULL)) {
 		if (atomic_read(&pool->obj_count) > 0)
 			ret = tmem_get(pool, oidp, index, page);
+		if (ret == 0)
+			zcache_stat_inc(pool[pool_id].hits);
+		else
+			zcache_stat_inc(pool[pool_id].misses);
 		zcache_put_pool(pool);
 	}
 	local_irq_restore(flags);
@@ -1269,7 +1538,7 @@ static int zcache_flush_page(int pool_id, struct tmem_oid *oidp, uint32_t index)
 	unsigned long flags;
 
 	local_irq_save(flags);
-	zcache_flush_total++;
+	zcache_stat_inc(flush_total);
 	pool = zcache_get_pool_by_id(pool_id);
 	if (likely(pool != NULL)) {
 		if (atomic_read(&pool->obj_count) > 0)
@@ -1277,7 +1546,7 @@ static int zcache_flush_page(int pool_id, struct tmem_oid *oidp, uint32_t index)
 		zcache_put_pool(pool);
 	}
 	if (ret >= 0)
-		zcache_flush_found++;
+		zcache_stat_inc(flush_found);
 	local_irq_restore(flags);
 	return ret;
 }
@@ -1289,7 +1558,7 @@ static int zcache_flush_object(int pool_id, struct tmem_oid *oidp)
 	unsigned long flags;
 
 	local_irq_save(flags);
-	zcache_flobj_total++;
+	zcache_stat_inc(flobj_total);
 	pool = zcache_get_pool_by_id(pool_id);
 	if (likely(pool != NULL)) {
 		if (atomic_read(&pool->obj_count) > 0)
@@ -1297,7 +1566,7 @@ static int zcache_flush_object(int pool_id, struct tmem_oid *oidp)
 		zcache_put_pool(pool);
 	}
 	if (ret >= 0)
-		zcache_flobj_found++;
+		zcache_stat_inc(flobj_found);
 	local_irq_restore(flags);
 	return ret;
 }
@@ -1327,7 +1596,7 @@ out:
 
 static int zcache_new_pool(uint32_t flags)
 {
-	int poolid = -1;
+	int poolid = -1, cpu;
 	struct tmem_pool *pool;
 
 	pool = kmalloc(sizeof(struct tmem_pool), GFP_KERNEL);
@@ -1345,6 +1614,9 @@ static int zcache_new_pool(uint32_t flags)
 		poolid = -1;
 		goto out;
 	}
+	for_each_possible_cpu(cpu)
+		memset(&per_cpu(zcache_stats, cpu).pool[poolid], 0,
+			sizeof(struct zcache_pool_stats));
 	atomic_set(&pool->refcount, 0);
 	pool->client = &zcache_client;
 	pool->pool_id = poolid;
@@ -1592,6 +1864,170 @@ static int __init no_frontswap(char *s)
 
 __setup("nofrontswap", no_frontswap);
 
+#ifdef CONFIG_ZCACHE_SELFTEST
+/*
+ * Multi-threaded self-test.  "echo N > /sys/kernel/mm/zcache/selftest"
+ * starts N threads that hammer a private ephemeral pool with put, get and
+ * flush for selftest_ms milliseconds; reading the file reports the result
+ * of the last run, including the aggregate tmem operations per second.
+ */
+
+#define ZCACHE_SELFTEST_MAX_THREADS	32
+#define ZCACHE_SELFTEST_OBJS		64
+#define ZCACHE_SELFTEST_INDICES		16
+
+static unsigned int zcache_selftest_ms = 1000;
+module_param_named(selftest_ms, zcache_selftest_ms, uint, 0644);
+
+struct zcache_selftest_thread {
+	unsigned int id;
+	int pool_id;
+	unsigned long deadline;
+	unsigned long ops;
+	unsigned long hits;
+	unsigned long errors;
+	struct completion done;
+};
+
+static DEFINE_MUTEX(zcache_selftest_lock);
+static char zcache_selftest_result[128] = "not run\n";
+
+/* mostly zero, so every put compresses into a zbud */
+static void zcache_selftest_fill(unsigned long *p, unsigned int id,
+				 unsigned long seq)
+{
+	int i;
+
+	for (i = 0; i < PAGE_SIZE / sizeof(*p); i++)
+		p[i] = (i & 7) ? 0 : ((unsigned long)id << 24) ^ seq ^ i;
+}
+
+static int zcache_selftest_fn(void *data)
+{
+	struct zcache_selftest_thread *t = data;
+	struct tmem_oid oid = { .oid = { 0 } };
+	struct page *src, *dst;
+	unsigned long flags, seq = 0;
+	uint32_t index;
+	int ret;
+
+	src = alloc_page(GFP_KERNEL);
+	dst = alloc_page(GFP_KERNEL);
+	if (src == NULL || dst == NULL) {
+		t->errors++;
+		goto out;
+	}
+	while (time_before(jiffies, t->deadline)) {
+		oid.oid[0] = ((uint64_t)t->id << 32) |
+				(seq % ZCACHE_SELFTEST_OBJS);
+		index = (seq / ZCACHE_SELFTEST_OBJS) % ZCACHE_SELFTEST_INDICES;
+		zcache_selftest_fill(page_address(src), t->id, seq);
+
+		local_irq_save(flags);
+		(void)zcache_put_page(t->pool_id, &oid, index, src);
+		local_irq_restore(flags);
+		ret = zcache_get_page(t->pool_id, &oid, index, dst);
+		if (ret == 0) {
+			t->hits++;
+			if (memcmp(page_address(src), page_address(dst),
+					PAGE_SIZE))
+				t->errors++;
+		}
+		local_irq_save(flags);
+		(void)zcache_put_page(t->pool_id, &oid, index, src);
+		local_irq_restore(flags);
+		(void)zcache_flush_page(t->pool_id, &oid, index);
+		t->ops += 4;
+		seq++;
+		cond_resched();
+	}
+out:
+	if (dst)
+		__free_page(dst);
+	if (src)
+		__free_page(src);
+	complete(&t->done);
+	return 0;
+}
+
+static ssize_t zcache_selftest_show(struct kobject *kobj,
+				struct kobj_attribute *attr, char *buf)
+{
+	ssize_t ret;
+
+	mutex_lock(&zcache_selftest_lock);
+	ret = sprintf(buf, "%s", zcache_selftest_result);
+	mutex_unlock(&zcache_selftest_lock);
+	return ret;
+}
+
+static ssize_t zcache_selftest_store(struct kobject *kobj,
+				struct kobj_attribute *attr,
+				const char *buf, size_t count)
+{
+	struct zcache_selftest_thread *threads;
+	struct task_struct *task;
+	unsigned long nr, i, start, ops = 0, hits = 0, errors = 0;
+	unsigned int ms;
+	int pool_id;
+	ssize_t ret = count;
+
+	if (strict_strtoul(buf, 10, &nr) || nr == 0 ||
+			nr > ZCACHE_SELFTEST_MAX_THREADS)
+		return -EINVAL;
+	/* ephemeral pools live in zbud, which only cleancache sets up */
+	if (!zcache_enabled || !use_cleancache)
+		return -ENODEV;
+
+	threads = kcalloc(nr, sizeof(*threads), GFP_KERNEL);
+	if (threads == NULL)
+		return -ENOMEM;
+	mutex_lock(&zcache_selftest_lock);
+	pool_id = zcache_new_pool(0);
+	if (pool_id < 0) {
+		ret = -ENOMEM;
+		goto out;
+	}
+	start = jiffies;
+	for (i = 0; i < nr; i++) {
+		threads[i].id = i;
+		threads[i].pool_id = pool_id;
+		threads[i].deadline = start +
+				msecs_to_jiffies(zcache_selftest_ms);
+		init_completion(&threads[i].done);
+		task = kthread_run(zcache_selftest_fn, &threads[i],
+					"zcache_test/%lu", i);
+		if (IS_ERR(task)) {
+			threads[i].errors++;
+			complete(&threads[i].done);
+		}
+	}
+	for (i = 0; i < nr; i++) {
+		wait_for_completion(&threads[i].done);
+		ops += threads[i].ops;
+		hits += threads[i].hits;
+		errors += threads[i].errors;
+	}
+	ms = jiffies_to_msecs(jiffies - start) ? : 1;
+	zcache_destroy_pool(pool_id);
+
+	snprintf(zcache_selftest_result, sizeof(zcache_selftest_result),
+		"threads:%lu ms:%u ops:%lu hits:%lu errors:%lu ops/s:%llu\n",
+		nr, ms, ops, hits, errors,
+		div_u64((u64)ops * MSEC_PER_SEC, ms));
+	pr_info("zcache: selftest %s", zcache_selftest_result);
+	if (errors)
+		ret = -EIO;
+out:
+	mutex_unlock(&zcache_selftest_lock);
+	kfree(threads);
+	return ret;
+}
+
+static struct kobj_attribute zcache_selftest_attr =
+	__ATTR(selftest, 0644, zcache_selftest_show, zcache_selftest_store);
+#endif /* CONFIG_ZCACHE_SELFTEST */
+
 static int __init zcache_init(void)
 {
 #ifdef CONFIG_SYSFS
@@ -1602,6 +2038,11 @@ static int __init zcache_init(void)
 		pr_err("zcache: can't create sysfs\n");
 		goto out;
 	}
+#ifdef CONFIG_ZCACHE_SELFTEST
+	if (sysfs_add_file_to_group(mm_kobj, &zcache_selftest_attr.attr,
+					zcache_attr_group.name))
+		pr_warning("zcache: can't create selftest sysfs file\n");
+#endif
 #endif /* CONFIG_SYSFS */
 #if defined(CONFIG_CLEANCACHE) || defined(CONFIG_FRONTSWAP)
 	if (zcache_enabled) {
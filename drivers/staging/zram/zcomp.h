@@ -0,0 +1,85 @@
+/*
+ * Compressed RAM block device
+ *
+ * Copyright (C) 2008, 2009, 2010  Nitin Gupta
+ *
+ * This code is released using a dual license strategy: BSD/GPL
+ * You can choose the licence that better fits your requirements.
+ *
+ * Released under the terms of 3-clause BSD License
+ * Released under the terms of GNU General Public License Version 2.0
+ *
+ * Project home: http://compcache.googlecode.com
+ */
+
+#ifndef _ZCOMP_H_
+#define _ZCOMP_H_
+
+#include <linux/list.h>
+#include <linux/spinlock.h>
+#include <linux/wait.h>
+
+/* Size of the largest compressor name, including the terminating NUL */
+#define ZCOMP_NAME_LEN		16
+
+/*
+ * A compression stream: everything one compression or decompression
+ * needs to run on its own, so that several can run concurrently.
+ */
+struct zcomp_strm {
+	/* compression/decompression buffer, two pages */
+	void *buffer;
+	/* backend working memory */
+	void *private;
+	/* entry in zcomp->idle_strm */
+	struct list_head list;
+};
+
+struct zcomp_backend {
+	int (*compress)(const unsigned char *src, unsigned char *dst,
+			size_t *dst_len, void *private);
+
+	int (*decompress)(const unsigned char *src, size_t src_len,
+			unsigned char *dst, void *private);
+
+	void *(*create)(void);
+	void (*destroy)(void *private);
+
+	const char *name;
+	/* decompress() uses 'private' and so needs a stream of its own */
+	int decompress_needs_strm;
+};
+
+struct zcomp {
+	/* protects idle_strm, avail_strm, max_strm and strm_waits */
+	spinlock_t strm_lock;
+	struct list_head idle_strm;
+	wait_queue_head_t strm_wait;
+	/* number of allocated streams, idle or busy */
+	int avail_strm;
+	int max_strm;
+	/* number of times a caller had to wait for an idle stream */
+	u64 strm_waits;
+	struct zcomp_backend *backend;
+};
+
+ssize_t zcomp_available_show(const char *comp, char *buf);
+int zcomp_available_algorithm(const char *comp);
+
+struct zcomp *zcomp_create(const char *comp, int max_strm);
+void zcomp_destroy(struct zcomp *comp);
+int zcomp_set_max_streams(struct zcomp *comp, int num_strm);
+u64 zcomp_strm_waits(struct zcomp *comp);
+
+struct zcomp_strm *zcomp_strm_find(struct zcomp *comp);
+void zcomp_strm_release(struct zcomp *comp, struct zcomp_strm *zstrm);
+
+int zcomp_compress(struct zcomp *comp, struct zcomp_strm *zstrm,
+		const unsigned char *src, size_t *dst_len);
+
+struct zcomp_strm *zcomp_decompress_begin(struct zcomp *comp);
+void zcomp_decompress_end(struct zcomp *comp, struct zcomp_strm *zstrm);
+int zcomp_decompress(struct zcomp *comp, struct zcomp_strm *zstrm,
+		const unsigned char *src, size_t src_len, unsigned char *dst);
+
+#endif /* _ZCOMP_H_ */
@@ -25,13 +25,18 @@
 #include <linux/bitops.h>
 #include <linux/blkdev.h>
 #include <linux/buffer_head.h>
+#include <linux/completion.h>
+#include <linux/cpumask.h>
 #include <linux/device.h>
+#include <linux/err.h>
+#include <linux/fs.h>
 #include <linux/genhd.h>
 #include <linux/highmem.h>
+#include <linux/sched.h>
 #include <linux/slab.h>
-#include <linux/lzo.h>
 #include <linux/string.h>
 #include <linux/vmalloc.h>
+#include <linux/workqueue.h>
 
 #include "zram_drv.h"
 
@@ -89,18 +94,25 @@ static void zram_clear_flag(struct zram *zram, u32 index,
 	zram->table[index].flags &= ~BIT(flag);
 }
 
-static int page_zero_filled(void *ptr)
+/*
+ * Check if the page is one word repeated; if so, return that word in
+ * @element. Zero filled pages are the common case of this.
+ */
+static int page_same_filled(void *ptr, unsigned long *element)
 {
 	unsigned int pos;
 	unsigned long *page;
+	unsigned long val;
 
 	page = (unsigned long *)ptr;
+	val = page[0];
 
-	for (pos = 0; pos != PAGE_SIZE / sizeof(*page); pos++) {
-		if (page[pos])
+	for (pos = 1; pos != PAGE_SIZE / sizeof(*page); pos++) {
+		if (page[pos] != val)
 			return 0;
 	}
 
+	*element = val;
 	return 1;
 }
 
@@ -133,140 +145,298 @@ static void zram_set_disksize(struct zram *zram, size_t totalram_bytes)
 	zram->disksize &= PAGE_MASK;
 }
 
-static void zram_free_page(struct zram *zram, size_t index)
+#ifdef CONFIG_ZRAM_WRITEBACK
+static struct workqueue_struct *zram_wb_wq;
+
+static void __zram_read(struct zram *zram, struct bio *bio);
+
+struct zram_read_work {
+	struct work_struct work;
+	struct zram *zram;
+	struct bio *bio;
+};
+
+/* Backing device blocks are numbered from 1; 0 means "none". */
+static unsigned long zram_alloc_bd_page(struct zram *zram)
 {
-	u32 clen;
-	void *obj;
+	unsigned long blk_idx;
 
-	struct page *page = zram->table[index].page;
-	u32 offset = zram->table[index].offset;
+	spin_lock(&zram->bd_bitmap_lock);
+	blk_idx = find_next_zero_bit(zram->bd_bitmap, zram->nr_bd_pages, 1);
+	if (blk_idx < zram->nr_bd_pages)
+		set_bit(blk_idx, zram->bd_bitmap);
+	else
+		blk_idx = 0;
+	spin_unlock(&zram->bd_bitmap_lock);
 
-	if (unlikely(!page)) {
-		/*
-		 * No memory is allocated for zero filled pages.
-		 * Simply clear zero page flag.
-		 */
-		if (zram_test_flag(zram, index, ZRAM_ZERO)) {
-			zram_clear_flag(zram, index, ZRAM_ZERO);
-			zram_stat_dec(&zram->stats.pages_zero);
-		}
+	return blk_idx;
+}
+
+static void zram_free_bd_page(struct zram *zram, unsigned long blk_idx)
+{
+	spin_lock(&zram->bd_bitmap_lock);
+	WARN_ON_ONCE(!test_bit(blk_idx, zram->bd_bitmap));
+	clear_bit(blk_idx, zram->bd_bitmap);
+	spin_unlock(&zram->bd_bitmap_lock);
+}
+
+static void zram_bd_end_io(struct bio *bio, int err)
+{
+	complete(bio->bi_private);
+}
+
+/*
+ * Synchronous one page I/O on the backing device. Must not be called
+ * from within make_request, see __zram_read().
+ */
+static int zram_bd_rw(struct zram *zram, int rw, unsigned long blk_idx,
+			struct page *page)
+{
+	int ret = 0;
+	struct bio *bio;
+	DECLARE_COMPLETION_ONSTACK(done);
+
+	bio = bio_alloc(GFP_NOIO, 1);
+	if (!bio)
+		return -ENOMEM;
+
+	bio->bi_sector = blk_idx << SECTORS_PER_PAGE_SHIFT;
+	bio->bi_bdev = zram->bdev;
+	bio->bi_end_io = zram_bd_end_io;
+	bio->bi_private = &done;
+	if (!bio_add_page(bio, page, PAGE_SIZE, 0)) {
+		bio_put(bio);
+		return -EIO;
+	}
+
+	submit_bio(rw, bio);
+	wait_for_completion(&done);
+
+	if (!test_bit(BIO_UPTODATE, &bio->bi_flags))
+		ret = -EIO;
+	bio_put(bio);
+
+	return ret;
+}
+
+static void zram_read_work_fn(struct work_struct *work)
+{
+	struct zram_read_work *rw;
+
+	rw = container_of(work, struct zram_read_work, work);
+	__zram_read(rw->zram, rw->bio);
+	kfree(rw);
+}
+
+static int zram_defer_read(struct zram *zram, struct bio *bio)
+{
+	struct zram_read_work *rw;
+
+	rw = kmalloc(sizeof(*rw), GFP_NOIO);
+	if (!rw)
+		return -ENOMEM;
+
+	INIT_WORK(&rw->work, zram_read_work_fn);
+	rw->zram = zram;
+	rw->bio = bio;
+	queue_work(zram_wb_wq, &rw->work);
+
+	return 0;
+}
+
+#endif
+
+static void zram_free_page(struct zram *zram, size_t index)
+{
+	unsigned long handle = zram->table[index].handle;
+	u16 size = zram->table[index].size;
+
+	/* a writeback in progress sees this and drops its copy */
+	zram_clear_flag(zram, index, ZRAM_UNDER_WB);
+	zram_clear_flag(zram, index, ZRAM_IDLE);
+
+#ifdef CONFIG_ZRAM_WRITEBACK
+	if (unlikely(zram_test_flag(zram, index, ZRAM_WB))) {
+		zram_clear_flag(zram, index, ZRAM_WB);
+		zram_free_bd_page(zram, handle);
+		zram_stat_dec(&zram->stats.bd_count);
+		zram->table[index].handle = 0;
 		return;
 	}
+#endif
 
-	if (unlikely(zram_test_flag(zram, index, ZRAM_UNCOMPRESSED))) {
-		clen = PAGE_SIZE;
-		__free_page(page);
-		zram_clear_flag(zram, index, ZRAM_UNCOMPRESSED);
-		zram_stat_dec(&zram->stats.pages_expand);
-		goto out;
+	/*
+	 * No memory is allocated for same filled pages, the handle holds
+	 * the repeated word. Simply clear same page flag.
+	 */
+	if (zram_test_flag(zram, index, ZRAM_SAME)) {
+		zram_clear_flag(zram, index, ZRAM_SAME);
+		zram_stat_dec(&zram->stats.pages_same);
+		if (!handle)
+			zram_stat_dec(&zram->stats.pages_zero);
+		zram->table[index].handle = 0;
+		return;
 	}
 
-	obj = kmap_atomic(page, KM_USER0) + offset;
-	clen = xv_get_object_size(obj) - sizeof(struct zobj_header);
-	kunmap_atomic(obj, KM_USER0);
+	if (unlikely(!handle))
+		return;
 
-	xv_free(zram->mem_pool, page, offset);
-	if (clen <= PAGE_SIZE / 2)
+	if (unlikely(size == PAGE_SIZE))
+		zram_stat_dec(&zram->stats.pages_expand);
+	else if (size <= PAGE_SIZE / 2)
 		zram_stat_dec(&zram->stats.good_compress);
 
-out:
-	zram_stat64_sub(zram, &zram->stats.compr_size, clen);
+	zs_free(zram->mem_pool, handle);
+
+	zram_stat64_sub(zram, &zram->stats.compr_size, size);
 	zram_stat_dec(&zram->stats.pages_stored);
 
-	zram->table[index].page = NULL;
-	zram->table[index].offset = 0;
+	zram->table[index].handle = 0;
+	zram->table[index].size = 0;
 }
 
-static void handle_zero_page(struct page *page)
+static void handle_same_page(struct page *page, unsigned long element)
 {
 	void *user_mem;
 
 	user_mem = kmap_atomic(page, KM_USER0);
-	memset(user_mem, 0, PAGE_SIZE);
+	if (!element) {
+		memset(user_mem, 0, PAGE_SIZE);
+	} else {
+		unsigned long *p = user_mem;
+		unsigned int pos;
+
+		for (pos = 0; pos != PAGE_SIZE / sizeof(*p); pos++)
+			p[pos] = element;
+	}
 	kunmap_atomic(user_mem, KM_USER0);
 
 	flush_dcache_page(page);
 }
 
-static void handle_uncompressed_page(struct zram *zram,
-				struct page *page, u32 index)
+/*
+ * Decompress slot @index into @page. Called with tb_lock held and a
+ * stored object in the slot.
+ */
+static int zram_decompress_page(struct zram *zram, struct page *page,
+				u32 index, struct zcomp_strm *zstrm)
 {
+	int ret = 0;
+	size_t clen;
 	unsigned char *user_mem, *cmem;
 
 	user_mem = kmap_atomic(page, KM_USER0);
-	cmem = kmap_atomic(zram->table[index].page, KM_USER1) +
-			zram->table[index].offset;
-
-	memcpy(user_mem, cmem, PAGE_SIZE);
+	cmem = zs_map_object(zram->mem_pool, zram->table[index].handle,
+				ZS_MM_RO);
+	clen = zram->table[index].size;
+
+	/* Page is stored uncompressed since it's incompressible */
+	if (unlikely(clen == PAGE_SIZE))
+		memcpy(user_mem, cmem, PAGE_SIZE);
+	else
+		ret = zcomp_decompress(zram->comp, zstrm, cmem, clen,
+				user_mem);
+
+	zs_unmap_object(zram->mem_pool, zram->table[index].handle);
 	kunmap_atomic(user_mem, KM_USER0);
-	kunmap_atomic(cmem, KM_USER1);
 
-	flush_dcache_page(page);
+	return ret;
 }
 
-static void zram_read(struct zram *zram, struct bio *bio)
+static void __zram_read(struct zram *zram, struct bio *bio)
 {
 
 	int i;
 	u32 index;
 	struct bio_vec *bvec;
 
-	zram_stat64_inc(zram, &zram->stats.num_reads);
 	index = bio->bi_sector >> SECTORS_PER_PAGE_SHIFT;
 
 	bio_for_each_segment(bvec, bio, i) {
-		int ret;
-		size_t clen;
+		int ret, idle;
 		struct page *page;
-		struct zobj_header *zheader;
-		unsigned char *user_mem, *cmem;
+		struct zcomp_strm *zstrm;
 
 		page = bvec->bv_page;
 
-		if (zram_test_flag(zram, index, ZRAM_ZERO)) {
-			handle_zero_page(page);
+		/* may sleep, so get it before taking tb_lock */
+		zstrm = zcomp_decompress_begin(zram->comp);
+		read_lock(&zram->tb_lock);
+
+		if (zram_test_flag(zram, index, ZRAM_SAME)) {
+			unsigned long element = zram->table[index].handle;
+
+			read_unlock(&zram->tb_lock);
+			zcomp_decompress_end(zram->comp, zstrm);
+			handle_same_page(page, element);
 			index++;
 			continue;
 		}
 
-		/* Requested page is not present in compressed area */
-		if (unlikely(!zram->table[index].page)) {
-			pr_debug("Read before write: sector=%lu, size=%u",
-				(ulong)(bio->bi_sector), bio->bi_size);
-			handle_zero_page(page);
+#ifdef CONFIG_ZRAM_WRITEBACK
+		if (unlikely(zram_test_flag(zram, index, ZRAM_WB))) {
+			unsigned long blk_idx = zram->table[index].handle;
+
+			read_unlock(&zram->tb_lock);
+			zcomp_decompress_end(zram->comp, zstrm);
+
+			/*
+			 * Bios submitted from inside make_request are only
+			 * issued once it returns, so waiting for the backing
+			 * device here would deadlock. Finish in a worker.
+			 */
+			if (current->bio_list) {
+				if (zram_defer_read(zram, bio))
+					goto out;
+				return;
+			}
+
+			ret = zram_bd_rw(zram, READ, blk_idx, page);
+			if (unlikely(ret)) {
+				pr_err("Backing device read failed! err=%d, "
+					"page=%u\n", ret, index);
+				zram_stat64_inc(zram,
+					&zram->stats.failed_reads);
+				goto out;
+			}
+			zram_stat64_inc(zram, &zram->stats.bd_reads);
+			flush_dcache_page(page);
 			index++;
 			continue;
 		}
+#endif
 
-		/* Page is stored uncompressed since it's incompressible */
-		if (unlikely(zram_test_flag(zram, index, ZRAM_UNCOMPRESSED))) {
-			handle_uncompressed_page(zram, page, index);
+		/* Requested page is not present in compressed area */
+		if (unlikely(!zram->table[index].handle)) {
+			read_unlock(&zram->tb_lock);
+			zcomp_decompress_end(zram->comp, zstrm);
+			pr_debug("Read before write: sector=%lu, size=%u",
+				(ulong)(bio->bi_sector), bio->bi_size);
+			handle_same_page(page, 0);
 			index++;
 			continue;
 		}
 
-		user_mem = kmap_atomic(page, KM_USER0);
-		clen = PAGE_SIZE;
-
-		cmem = kmap_atomic(zram->table[index].page, KM_USER1) +
-				zram->table[index].offset;
-
-		ret = lzo1x_decompress_safe(
-			cmem + sizeof(*zheader),
-			xv_get_object_size(cmem) - sizeof(*zheader),
-			user_mem, &clen);
-
-		kunmap_atomic(user_mem, KM_USER0);
-		kunmap_atomic(cmem, KM_USER1);
+		ret = zram_decompress_page(zram, page, index, zstrm);
+		idle = zram_test_flag(zram, index, ZRAM_IDLE);
+		read_unlock(&zram->tb_lock);
+		zcomp_decompress_end(zram->comp, zstrm);
 
 		/* Should NEVER happen. Return bio error if it does. */
-		if (unlikely(ret != LZO_E_OK)) {
+		if (unlikely(ret)) {
 			pr_err("Decompression failed! err=%d, page=%u\n",
 				ret, index);
 			zram_stat64_inc(zram, &zram->stats.failed_reads);
 			goto out;
 		}
 
+		/* the page is in use again, keep it out of idle writeback */
+		if (unlikely(idle)) {
+			write_lock(&zram->tb_lock);
+			zram_clear_flag(zram, index, ZRAM_IDLE);
+			write_unlock(&zram->tb_lock);
+		}
+
 		flush_dcache_page(page);
 		index++;
 	}
@@ -279,6 +449,12 @@ out:
 	bio_io_error(bio);
 }
 
+static void zram_read(struct zram *zram, struct bio *bio)
+{
+	zram_stat64_inc(zram, &zram->stats.num_reads);
+	__zram_read(zram, bio);
+}
+
 static void zram_write(struct zram *zram, struct bio *bio)
 {
 	int i;
@@ -290,42 +466,50 @@ static void zram_write(struct zram *zram, struct bio *bio)
 
 	bio_for_each_segment(bvec, bio, i) {
 		int ret;
-		u32 offset;
 		size_t clen;
-		struct zobj_header *zheader;
-		struct page *page, *page_store;
+		unsigned long handle, element;
+		struct zcomp_strm *zstrm;
+		struct page *page;
 		unsigned char *user_mem, *cmem, *src;
 
 		page = bvec->bv_page;
-		src = zram->compress_buffer;
-
-		/*
-		 * System overwrites unused sectors. Free memory associated
-		 * with this sector now.
-		 */
-		if (zram->table[index].page ||
-				zram_test_flag(zram, index, ZRAM_ZERO))
-			zram_free_page(zram, index);
-
-		mutex_lock(&zram->lock);
 
+		/* same filled pages need neither a stream nor memory */
 		user_mem = kmap_atomic(page, KM_USER0);
-		if (page_zero_filled(user_mem)) {
+		if (page_same_filled(user_mem, &element)) {
 			kunmap_atomic(user_mem, KM_USER0);
-			mutex_unlock(&zram->lock);
-			zram_stat_inc(&zram->stats.pages_zero);
-			zram_set_flag(zram, index, ZRAM_ZERO);
+
+			/*
+			 * System overwrites unused sectors. Free memory
+			 * associated with this sector now.
+			 */
+			write_lock(&zram->tb_lock);
+			zram_free_page(zram, index);
+			zram->table[index].handle = element;
+			zram_set_flag(zram, index, ZRAM_SAME);
+			zram_stat_inc(&zram->stats.pages_same);
+			if (!element)
+				zram_stat_inc(&zram->stats.pages_zero);
+			write_unlock(&zram->tb_lock);
 			index++;
 			continue;
 		}
+		kunmap_atomic(user_mem, KM_USER0);
+
+		/*
+		 * Compression runs on a stream of its own, so writers on
+		 * different CPUs only meet at tb_lock, which is held just
+		 * long enough to swap the table entry.
+		 */
+		zstrm = zcomp_strm_find(zram->comp);
 
-		ret = lzo1x_1_compress(user_mem, PAGE_SIZE, src, &clen,
-					zram->compress_workmem);
+		user_mem = kmap_atomic(page, KM_USER0);
+		ret = zcomp_compress(zram->comp, zstrm, user_mem, &clen);
 
 		kunmap_atomic(user_mem, KM_USER0);
 
-		if (unlikely(ret != LZO_E_OK)) {
-			mutex_unlock(&zram->lock);
+		if (unlikely(ret)) {
+			zcomp_strm_release(zram->comp, zstrm);
 			pr_err("Compression failed! err=%d\n", ret);
 			zram_stat64_inc(zram, &zram->stats.failed_writes);
 			goto out;
@@ -336,64 +520,51 @@ static void zram_write(struct zram *zram, struct bio *bio)
 		 * since we do not want to return too many disk write
 		 * errors which has side effect of hanging the system.
 		 */
-		if (unlikely(clen > max_zpage_size)) {
+		if (unlikely(clen > max_zpage_size))
 			clen = PAGE_SIZE;
-			page_store = alloc_page(GFP_NOIO | __GFP_HIGHMEM);
-			if (unlikely(!page_store)) {
-				mutex_unlock(&zram->lock);
-				pr_info("Error allocating memory for "
-					"incompressible page: %u\n", index);
-				zram_stat64_inc(zram,
-					&zram->stats.failed_writes);
-				goto out;
-			}
 
-			offset = 0;
-			zram_set_flag(zram, index, ZRAM_UNCOMPRESSED);
-			zram_stat_inc(&zram->stats.pages_expand);
-			zram->table[index].page = page_store;
-			src = kmap_atomic(page, KM_USER0);
-			goto memstore;
-		}
-
-		if (xv_malloc(zram->mem_pool, clen + sizeof(*zheader),
-				&zram->table[index].page, &offset,
-				GFP_NOIO | __GFP_HIGHMEM)) {
-			mutex_unlock(&zram->lock);
+		handle = zs_malloc(zram->mem_pool, clen,
+				GFP_NOIO | __GFP_HIGHMEM);
+		if (unlikely(!handle)) {
+			zcomp_strm_release(zram->comp, zstrm);
 			pr_info("Error allocating memory for compressed "
 				"page: %u, size=%zu\n", index, clen);
 			zram_stat64_inc(zram, &zram->stats.failed_writes);
 			goto out;
 		}
 
-memstore:
-		zram->table[index].offset = offset;
+		cmem = zs_map_object(zram->mem_pool, handle, ZS_MM_WO);
 
-		cmem = kmap_atomic(zram->table[index].page, KM_USER1) +
-				zram->table[index].offset;
-
-#if 0
-		/* Back-reference needed for memory defragmentation */
-		if (!zram_test_flag(zram, index, ZRAM_UNCOMPRESSED)) {
-			zheader = (struct zobj_header *)cmem;
-			zheader->table_idx = index;
-			cmem += sizeof(*zheader);
+		if (unlikely(clen == PAGE_SIZE)) {
+			src = kmap_atomic(page, KM_USER0);
+			memcpy(cmem, src, PAGE_SIZE);
+			kunmap_atomic(src, KM_USER0);
+		} else {
+			memcpy(cmem, zstrm->buffer, clen);
 		}
-#endif
 
-		memcpy(cmem, src, clen);
+		zs_unmap_object(zram->mem_pool, handle);
+		zcomp_strm_release(zram->comp, zstrm);
 
-		kunmap_atomic(cmem, KM_USER1);
-		if (unlikely(zram_test_flag(zram, index, ZRAM_UNCOMPRESSED)))
-			kunmap_atomic(src, KM_USER0);
+		/*
+		 * System overwrites unused sectors. Free memory associated
+		 * with this sector now and install the new object.
+		 */
+		write_lock(&zram->tb_lock);
+		zram_free_page(zram, index);
+
+		zram->table[index].handle = handle;
+		zram->table[index].size = clen;
 
 		/* Update stats */
 		zram_stat64_add(zram, &zram->stats.compr_size, clen);
 		zram_stat_inc(&zram->stats.pages_stored);
-		if (clen <= PAGE_SIZE / 2)
+		if (unlikely(clen == PAGE_SIZE))
+			zram_stat_inc(&zram->stats.pages_expand);
+		else if (clen <= PAGE_SIZE / 2)
 			zram_stat_inc(&zram->stats.good_compress);
 
-		mutex_unlock(&zram->lock);
+		write_unlock(&zram->tb_lock);
 		index++;
 	}
 
@@ -405,6 +576,215 @@ out:
 	bio_io_error(bio);
 }
 
+#ifdef CONFIG_ZRAM_WRITEBACK
+int zram_set_backing_dev(struct zram *zram, const char *path)
+{
+	int ret;
+	unsigned long nr_pages;
+	struct block_device *bdev;
+
+	if (zram->bdev)
+		return -EEXIST;
+
+	bdev = blkdev_get_by_path(path, FMODE_READ | FMODE_WRITE |
+				FMODE_EXCL, zram);
+	if (IS_ERR(bdev)) {
+		pr_info("Cannot open backing device %s\n", path);
+		return PTR_ERR(bdev);
+	}
+
+	nr_pages = i_size_read(bdev->bd_inode) >> PAGE_SHIFT;
+	if (nr_pages < 2) {
+		ret = -EINVAL;
+		goto fail;
+	}
+
+	ret = set_blocksize(bdev, PAGE_SIZE);
+	if (ret)
+		goto fail;
+
+	zram->bd_bitmap = vzalloc(BITS_TO_LONGS(nr_pages) * sizeof(long));
+	if (!zram->bd_bitmap) {
+		ret = -ENOMEM;
+		goto fail;
+	}
+
+	zram->backing_dev_path = kstrdup(path, GFP_KERNEL);
+	if (!zram->backing_dev_path) {
+		vfree(zram->bd_bitmap);
+		zram->bd_bitmap = NULL;
+		ret = -ENOMEM;
+		goto fail;
+	}
+
+	zram->bdev = bdev;
+	zram->nr_bd_pages = nr_pages;
+	pr_info("Using %s as backing device, %lu pages\n", path, nr_pages);
+
+	return 0;
+
+fail:
+	blkdev_put(bdev, FMODE_READ | FMODE_WRITE | FMODE_EXCL);
+	return ret;
+}
+
+static void zram_reset_backing_dev(struct zram *zram)
+{
+	if (!zram->bdev)
+		return;
+
+	blkdev_put(zram->bdev, FMODE_READ | FMODE_WRITE | FMODE_EXCL);
+	zram->bdev = NULL;
+	vfree(zram->bd_bitmap);
+	zram->bd_bitmap = NULL;
+	kfree(zram->backing_dev_path);
+	zram->backing_dev_path = NULL;
+	zram->nr_bd_pages = 0;
+}
+
+/* Mark every stored page idle; any later access clears the mark. */
+void zram_mark_idle(struct zram *zram)
+{
+	size_t index;
+
+	mutex_lock(&zram->init_lock);
+	if (!zram->init_done)
+		goto out;
+
+	for (index = 0; index < zram->disksize >> PAGE_SHIFT; index++) {
+		write_lock(&zram->tb_lock);
+		if (zram->table[index].handle &&
+		    !zram_test_flag(zram, index, ZRAM_WB) &&
+		    !zram_test_flag(zram, index, ZRAM_SAME))
+			zram_set_flag(zram, index, ZRAM_IDLE);
+		write_unlock(&zram->tb_lock);
+	}
+out:
+	mutex_unlock(&zram->init_lock);
+}
+
+static int zram_wb_eligible(struct zram *zram, u32 index,
+				enum zram_wb_mode mode)
+{
+	if (!zram->table[index].handle ||
+	    zram_test_flag(zram, index, ZRAM_SAME) ||
+	    zram_test_flag(zram, index, ZRAM_WB) ||
+	    zram_test_flag(zram, index, ZRAM_UNDER_WB))
+		return 0;
+
+	if (mode == ZRAM_WB_HUGE)
+		return zram->table[index].size == PAGE_SIZE;
+	return zram_test_flag(zram, index, ZRAM_IDLE);
+}
+
+/*
+ * Move incompressible (ZRAM_WB_HUGE) or idle (ZRAM_WB_IDLE) pages to the
+ * backing device. Returns the number of pages written back, or an
+ * error if nothing could be written.
+ */
+ssize_t zram_writeback(struct zram *zram, enum zram_wb_mode mode)
+{
+	int ret = 0;
+	ssize_t nr_written = 0;
+	size_t index;
+	struct page *page;
+
+	page = alloc_page(GFP_KERNEL);
+	if (!page)
+		return -ENOMEM;
+
+	mutex_lock(&zram->init_lock);
+	if (!zram->init_done || !zram->bdev) {
+		ret = -EINVAL;
+		goto out;
+	}
+
+	for (index = 0; index < zram->disksize >> PAGE_SHIFT; index++) {
+		unsigned long blk_idx;
+		struct zcomp_strm *zstrm;
+
+		zstrm = zcomp_decompress_begin(zram->comp);
+		write_lock(&zram->tb_lock);
+		if (!zram_wb_eligible(zram, index, mode)) {
+			write_unlock(&zram->tb_lock);
+			zcomp_decompress_end(zram->comp, zstrm);
+			continue;
+		}
+		zram_set_flag(zram, index, ZRAM_UNDER_WB);
+		ret = zram_decompress_page(zram, page, index, zstrm);
+		write_unlock(&zram->tb_lock);
+		zcomp_decompress_end(zram->comp, zstrm);
+
+		blk_idx = 0;
+		if (!ret) {
+			blk_idx = zram_alloc_bd_page(zram);
+			if (blk_idx)
+				ret = zram_bd_rw(zram, WRITE, blk_idx, page);
+			else
+				ret = -ENOSPC;
+		}
+
+		write_lock(&zram->tb_lock);
+		/* freed or rewritten while we were writing it out */
+		if (ret || !zram_test_flag(zram, index, ZRAM_UNDER_WB)) {
+			zram_clear_flag(zram, index, ZRAM_UNDER_WB);
+			write_unlock(&zram->tb_lock);
+			if (blk_idx)
+				zram_free_bd_page(zram, blk_idx);
+			if (ret)
+				break;
+			continue;
+		}
+
+		zram_free_page(zram, index);
+		zram->table[index].handle = blk_idx;
+		zram_set_flag(zram, index, ZRAM_WB);
+		zram_stat_inc(&zram->stats.bd_count);
+		write_unlock(&zram->tb_lock);
+
+		zram_stat64_inc(zram, &zram->stats.bd_writes);
+		nr_written++;
+		cond_resched();
+	}
+out:
+	mutex_unlock(&zram->init_lock);
+	__free_page(page);
+
+	if (!nr_written && ret && ret != -ENOSPC)
+		return ret;
+	return nr_written;
+}
+#else
+static inline void zram_reset_backing_dev(struct zram *zram) {}
+#endif
+
+/*
+ * Free the pages a discard request fully covers. Partial pages at
+ * either end are left alone, their remaining sectors may still be
+ * live.
+ */
+static void zram_bio_discard(struct zram *zram, struct bio *bio)
+{
+	u64 start = (u64)bio->bi_sector << SECTOR_SHIFT;
+	u64 end = start + bio->bi_size;
+	size_t index;
+
+	if (end > zram->disksize)
+		end = zram->disksize;
+
+	start = round_up(start, PAGE_SIZE);
+	for (index = start >> PAGE_SHIFT; index < end >> PAGE_SHIFT;
+	     index++) {
+		write_lock(&zram->tb_lock);
+		zram_free_page(zram, index);
+		write_unlock(&zram->tb_lock);
+		zram_stat64_inc(zram, &zram->stats.discard);
+	}
+
+	set_bit(BIO_UPTODATE, &bio->bi_flags);
+	bio_endio(bio, 0);
+}
+
 /*
  * Check if request is within bounds and page aligned.
  */
@@ -429,6 +809,18 @@ static int zram_make_request(struct request_queue *queue, struct bio *bio)
 {
 	struct zram *zram = queue->queuedata;
 
+	/* discards are not page aligned, and need no device setup */
+	if (unlikely(bio->bi_rw & REQ_DISCARD)) {
+		if (zram->init_done &&
+		    bio->bi_sector < (zram->disksize >> SECTOR_SHIFT)) {
+			zram_bio_discard(zram, bio);
+		} else {
+			set_bit(BIO_UPTODATE, &bio->bi_flags);
+			bio_endio(bio, 0);
+		}
+		return 0;
+	}
+
 	if (!valid_io_request(zram, bio)) {
 		zram_stat64_inc(zram, &zram->stats.invalid_io);
 		bio_io_error(bio);
@@ -460,36 +852,35 @@ void zram_reset_device(struct zram *zram)
 	mutex_lock(&zram->init_lock);
 	zram->init_done = 0;
 
-	/* Free various per-device buffers */
-	kfree(zram->compress_workmem);
-	free_pages((unsigned long)zram->compress_buffer, 1);
-
-	zram->compress_workmem = NULL;
-	zram->compress_buffer = NULL;
+	/* Free compression streams */
+	if (zram->comp)
+		zcomp_destroy(zram->comp);
+	zram->comp = NULL;
 
 	/* Free all pages that are still in this zram device */
 	for (index = 0; index < zram->disksize >> PAGE_SHIFT; index++) {
-		struct page *page;
-		u16 offset;
-
-		page = zram->table[index].page;
-		offset = zram->table[index].offset;
+		unsigned long handle = zram->table[index].handle;
 
-		if (!page)
+		/*
+		 * Same filled pages hold no memory, written back pages go
+		 * with the backing device below.
+		 */
+		if (!handle || zram_test_flag(zram, index, ZRAM_SAME) ||
+		    zram_test_flag(zram, index, ZRAM_WB))
 			continue;
 
-		if (unlikely(zram_test_flag(zram, index, ZRAM_UNCOMPRESSED)))
-			__free_page(page);
-		else
-			xv_free(zram->mem_pool, page, offset);
+		zs_free(zram->mem_pool, handle);
 	}
 
 	vfree(zram->table);
 	zram->table = NULL;
 
-	xv_destroy_pool(zram->mem_pool);
+	if (zram->mem_pool)
+		zs_destroy_pool(zram->mem_pool);
 	zram->mem_pool = NULL;
 
+	zram_reset_backing_dev(zram);
+
 	/* Reset stats */
 	memset(&zram->stats, 0, sizeof(zram->stats));
 
@@ -511,17 +902,12 @@ int zram_init_device(struct zram *zram)
 
 	zram_set_disksize(zram, totalram_pages << PAGE_SHIFT);
 
-	zram->compress_workmem = kzalloc(LZO1X_MEM_COMPRESS, GFP_KERNEL);
-	if (!zram->compress_workmem) {
-		pr_err("Error allocating compressor working memory!\n");
-		ret = -ENOMEM;
-		goto fail;
-	}
-
-	zram->compress_buffer = (void *)__get_free_pages(__GFP_ZERO, 1);
-	if (!zram->compress_buffer) {
-		pr_err("Error allocating compressor buffer space\n");
-		ret = -ENOMEM;
+	zram->comp = zcomp_create(zram->compressor, zram->max_comp_streams);
+	if (IS_ERR(zram->comp)) {
+		pr_err("Cannot initialise %s compressing backend\n",
+			zram->compressor);
+		ret = PTR_ERR(zram->comp);
+		zram->comp = NULL;
 		goto fail;
 	}
 
@@ -540,7 +926,7 @@ int zram_init_device(struct zram *zram)
 	/* zram devices sort of resembles non-rotational disks */
 	queue_flag_set_unlocked(QUEUE_FLAG_NONROT, zram->disk->queue);
 
-	zram->mem_pool = xv_create_pool();
+	zram->mem_pool = zs_create_pool();
 	if (!zram->mem_pool) {
 		pr_err("Error creating memory pool\n");
 		ret = -ENOMEM;
@@ -561,12 +947,32 @@ fail:
 	return ret;
 }
 
+/*
+ * Move stored objects together so that sparsely used zsmalloc pages can
+ * be freed. Returns the number of pages given back.
+ */
+unsigned long zram_compact(struct zram *zram)
+{
+	unsigned long nr_pages = 0;
+
+	mutex_lock(&zram->init_lock);
+	if (zram->init_done) {
+		nr_pages = zs_compact(zram->mem_pool);
+		zram_stat64_add(zram, &zram->stats.pages_compacted, nr_pages);
+	}
+	mutex_unlock(&zram->init_lock);
+
+	return nr_pages;
+}
+
 void zram_slot_free_notify(struct block_device *bdev, unsigned long index)
 {
 	struct zram *zram;
 
 	zram = bdev->bd_disk->private_data;
+	write_lock(&zram->tb_lock);
 	zram_free_page(zram, index);
+	write_unlock(&zram->tb_lock);
 	zram_stat64_inc(zram, &zram->stats.notify_free);
 }
 
@@ -579,9 +985,15 @@ static int create_device(struct zram *zram, int device_id)
 {
 	int ret = 0;
 
-	mutex_init(&zram->lock);
 	mutex_init(&zram->init_lock);
+	rwlock_init(&zram->tb_lock);
 	spin_lock_init(&zram->stat64_lock);
+#ifdef CONFIG_ZRAM_WRITEBACK
+	spin_lock_init(&zram->bd_bitmap_lock);
+#endif
+
+	strlcpy(zram->compressor, default_compressor, sizeof(zram->compressor));
+	zram->max_comp_streams = num_online_cpus();
 
 	zram->queue = blk_alloc_queue(GFP_KERNEL);
 	if (!zram->queue) {
@@ -624,6 +1036,12 @@ static int create_device(struct zram *zram, int device_id)
 	blk_queue_io_min(zram->disk->queue, PAGE_SIZE);
 	blk_queue_io_opt(zram->disk->queue, PAGE_SIZE);
 
+	/* Freed swap slots and fs blocks are released by discard */
+	zram->disk->queue->limits.discard_granularity = PAGE_SIZE;
+	zram->disk->queue->limits.discard_zeroes_data = 0;
+	blk_queue_max_discard_sectors(zram->disk->queue, UINT_MAX);
+	queue_flag_set_unlocked(QUEUE_FLAG_DISCARD, zram->disk->queue);
+
 	add_disk(zram->disk);
 
 	ret = sysfs_create_group(&disk_to_dev(zram->disk)->kobj,
@@ -664,6 +1082,15 @@ static int __init zram_init(void)
 		goto out;
 	}
 
+#ifdef CONFIG_ZRAM_WRITEBACK
+	/* completes reads of written back pages, see __zram_read() */
+	zram_wb_wq = alloc_workqueue("zram_wb", WQ_MEM_RECLAIM, 0);
+	if (!zram_wb_wq) {
+		ret = -ENOMEM;
+		goto out;
+	}
+#endif
+
 	zram_major = register_blkdev(0, "zram");
 	if (zram_major <= 0) {
 		pr_warning("Unable to get major number\n");
@@ -699,6 +1126,10 @@ free_devices:
 unregister:
 	unregister_blkdev(zram_major, "zram");
 out:
+#ifdef CONFIG_ZRAM_WRITEBACK
+	if (zram_wb_wq)
+		destroy_workqueue(zram_wb_wq);
+#endif
 	return ret;
 }
 
@@ -713,9 +1144,14 @@ static void __exit zram_exit(void)
 		destroy_device(zram);
 		if (zram->init_done)
 			zram_reset_device(zram);
+		else
+			zram_reset_backing_dev(zram);
 	}
 
 	unregister_blkdev(zram_major, "zram");
+#ifdef CONFIG_ZRAM_WRITEBACK
+	destroy_workqueue(zram_wb_wq);
+#endif
 
 	kfree(devices);
 	pr_debug("Cleanup done!\n");
@@ -18,7 +18,8 @@
 #include <linux/spinlock.h>
 #include <linux/mutex.h>
 
-#include "xvmalloc.h"
+#include "zsmalloc.h"
+#include "zcomp.h"
 
 /*
  * Some arbitrary value. This is just to catch
@@ -26,23 +27,14 @@
  */
 static const unsigned max_num_devices = 32;
 
-/*
- * Stored at beginning of each compressed object.
- *
- * It stores back-reference to table entry which points to this
- * object. This is required to support memory defragmentation.
- */
-struct zobj_header {
-#if 0
-	u32 table_idx;
-#endif
-};
-
 /*-- Configurable parameters */
 
 /* Default zram disk size: 25% of total RAM */
 static const unsigned default_disksize_perc_ram = 25;
 
+/* Compression backend used unless comp_algorithm is set */
+static const char default_compressor[] = "lzo";
+
 /*
  * Pages that compress to size greater than this are stored
  * uncompressed in memory.
@@ -50,9 +42,8 @@ static const unsigned default_disksize_perc_ram = 25;
 static const unsigned max_zpage_size = PAGE_SIZE / 4 * 3;
 
 /*
- * NOTE: max_zpage_size must be less than or equal to:
- *   XV_MAX_ALLOC_SIZE - sizeof(struct zobj_header)
- * otherwise, xv_malloc() would always return failure.
+ * NOTE: zsmalloc stores objects of up to PAGE_SIZE, so incompressible
+ * pages go to the same pool as compressed ones.
  */
 
 /*-- End of configurable params */
@@ -65,11 +56,17 @@ static const unsigned max_zpage_size = PAGE_SIZE / 4 * 3;
 
 /* Flags for zram pages (table[page_no].flags) */
 enum zram_pageflags {
-	/* Page is stored uncompressed */
-	ZRAM_UNCOMPRESSED,
+	/* Page is one repeated word; handle holds that word */
+	ZRAM_SAME,
 
-	/* Page consists entirely of zeros */
-	ZRAM_ZERO,
+	/* Page lives on the backing device; handle is its block index */
+	ZRAM_WB,
+
+	/* Page is being written to the backing device */
+	ZRAM_UNDER_WB,
+
+	/* Page has not been accessed since it was last marked idle */
+	ZRAM_IDLE,
 
 	__NR_ZRAM_PAGEFLAGS,
 };
@@ -78,8 +75,10 @@ enum zram_pageflags {
 
 /* Allocated for each disk page */
 struct table {
-	struct page *page;
-	u16 offset;
+	unsigned long handle;	/* zsmalloc handle, backing device block
+				 * if ZRAM_WB, fill word if ZRAM_SAME;
+				 * 0 if not stored */
+	u16 size;		/* object size; PAGE_SIZE if uncompressed */
 	u8 count;	/* object ref count (not yet used) */
 	u8 flags;
 } __attribute__((aligned(4)));
@@ -92,20 +91,26 @@ struct zram_stats {
 	u64 failed_writes;	/* can happen when memory is too low */
 	u64 invalid_io;		/* non-page-aligned I/O requests */
 	u64 notify_free;	/* no. of swap slot free notifications */
+	u64 discard;		/* no. of pages discarded */
+	u64 pages_compacted;	/* pages freed by compaction */
+	u64 bd_reads;		/* no. of pages read from backing device */
+	u64 bd_writes;		/* no. of pages written back */
 	u32 pages_zero;		/* no. of zero filled pages */
+	u32 pages_same;		/* no. of same filled pages, incl. zero */
 	u32 pages_stored;	/* no. of pages currently stored */
 	u32 good_compress;	/* % of pages with compression ratio<=50% */
 	u32 pages_expand;	/* % of incompressible pages */
+	u32 bd_count;		/* no. of pages on backing device */
 };
 
 struct zram {
-	struct xv_pool *mem_pool;
-	void *compress_workmem;
-	void *compress_buffer;
+	struct zs_pool *mem_pool;
+	struct zcomp *comp;
 	struct table *table;
 	spinlock_t stat64_lock;	/* protect 64-bit stats */
-	struct mutex lock;	/* protect compression buffers against
-				 * concurrent writes */
+	rwlock_t tb_lock;	/* protect table entries; compression
+				 * itself runs outside it on per-stream
+				 * buffers */
 	struct request_queue *queue;
 	struct gendisk *disk;
 	int init_done;
@@ -116,6 +121,18 @@ struct zram {
 	 * we can store in a disk.
 	 */
 	u64 disksize;	/* bytes */
+	/* Compression backend, fixed once initialized */
+	char compressor[ZCOMP_NAME_LEN];
+	/* Number of compression streams, may be changed at any time */
+	int max_comp_streams;
+#ifdef CONFIG_ZRAM_WRITEBACK
+	/* Optional block device that idle/incompressible pages go to */
+	struct block_device *bdev;
+	char *backing_dev_path;
+	unsigned long nr_bd_pages;
+	unsigned long *bd_bitmap;	/* allocated backing device blocks */
+	spinlock_t bd_bitmap_lock;
+#endif
 
 	struct zram_stats stats;
 };
@@ -128,5 +145,16 @@ extern struct attribute_group zram_disk_attr_group;
 
 extern int zram_init_device(struct zram *zram);
 extern void zram_reset_device(struct zram *zram);
+extern unsigned long zram_compact(struct zram *zram);
+#ifdef CONFIG_ZRAM_WRITEBACK
+enum zram_wb_mode {
+	ZRAM_WB_HUGE,	/* incompressible pages */
+	ZRAM_WB_IDLE,	/* pages not accessed since marked idle */
+};
+
+extern int zram_set_backing_dev(struct zram *zram, const char *path);
+extern void zram_mark_idle(struct zram *zram);
+extern ssize_t zram_writeback(struct zram *zram, enum zram_wb_mode mode);
+#endif
 
 #endif
@@ -0,0 +1,698 @@
+/*
+ * zsmalloc memory allocator
+ *
+ * Copyright (C) 2008, 2009, 2010  Nitin Gupta
+ *
+ * This code is released using a dual license strategy: BSD/GPL
+ * You can choose the licence that better fits your requirements.
+ *
+ * Released under the terms of 3-clause BSD License
+ * Released under the terms of GNU General Public License Version 2.0
+ */
+
+/*
+ * Unlike xvmalloc, which packs variable sized blocks into single pages,
+ * zsmalloc keeps one size class per ZS_SIZE_CLASS_DELTA bytes and carves
+ * each "zspage" of up to ZS_MAX_PAGES_PER_ZSPAGE pages into equal
+ * objects, so objects up to PAGE_SIZE can be stored and internal
+ * fragmentation is bounded by the class delta.
+ *
+ * Callers never see object addresses, only handles, and must map an
+ * object to access it. That indirection lets zs_compact() move objects
+ * out of sparsely used zspages and give the pages back.
+ */
+
+#ifdef CONFIG_ZRAM_DEBUG
+#define DEBUG
+#endif
+
+#include <linux/module.h>
+#include <linux/kernel.h>
+#include <linux/bit_spinlock.h>
+#include <linux/bitops.h>
+#include <linux/errno.h>
+#include <linux/highmem.h>
+#include <linux/init.h>
+#include <linux/percpu.h>
+#include <linux/sched.h>
+#include <linux/string.h>
+#include <linux/slab.h>
+
+#include "zsmalloc.h"
+#include "zsmalloc_int.h"
+
+static struct kmem_cache *handle_cachep;
+static DEFINE_PER_CPU(struct mapping_area, zs_map_area);
+
+static int get_size_class_index(int size)
+{
+	int idx = 0;
+
+	if (likely(size > ZS_MIN_ALLOC_SIZE))
+		idx = DIV_ROUND_UP(size - ZS_MIN_ALLOC_SIZE,
+				ZS_SIZE_CLASS_DELTA);
+
+	return idx;
+}
+
+/*
+ * Pick the zspage size, in pages, that wastes the least space at the
+ * end of the zspage for objects of the given class size.
+ */
+static int get_pages_per_zspage(int class_size)
+{
+	int i, max_usedpc = 0;
+	/* zspage order which gives maximum used size per KB */
+	int max_usedpc_order = 1;
+
+	for (i = 1; i <= ZS_MAX_PAGES_PER_ZSPAGE; i++) {
+		int zspage_size;
+		int waste, usedpc;
+
+		zspage_size = i * PAGE_SIZE;
+		waste = zspage_size % class_size;
+		usedpc = (zspage_size - waste) * 100 / zspage_size;
+
+		if (usedpc > max_usedpc) {
+			max_usedpc = usedpc;
+			max_usedpc_order = i;
+		}
+	}
+
+	return max_usedpc_order;
+}
+
+static unsigned long location_to_obj(struct zspage *zspage, u32 idx)
+{
+	return (page_to_pfn(zspage->pages[0]) << OBJ_INDEX_BITS) | idx;
+}
+
+static struct zspage *obj_to_location(unsigned long obj, u32 *idx)
+{
+	struct page *page = pfn_to_page(obj >> OBJ_INDEX_BITS);
+
+	*idx = obj & OBJ_INDEX_MASK;
+	return (struct zspage *)page_private(page);
+}
+
+static unsigned long handle_to_obj(unsigned long handle)
+{
+	return *(unsigned long *)handle >> 1;
+}
+
+static void pin_handle(unsigned long handle)
+{
+	bit_spin_lock(HANDLE_PIN_BIT, (unsigned long *)handle);
+}
+
+static int trypin_handle(unsigned long handle)
+{
+	return bit_spin_trylock(HANDLE_PIN_BIT, (unsigned long *)handle);
+}
+
+static void unpin_handle(unsigned long handle)
+{
+	bit_spin_unlock(HANDLE_PIN_BIT, (unsigned long *)handle);
+}
+
+static enum fullness_group get_fullness_group(struct size_class *class,
+					struct zspage *zspage)
+{
+	if (zspage->inuse == 0)
+		return ZS_EMPTY;
+	if (zspage->inuse == class->objs_per_zspage)
+		return ZS_FULL;
+	if (zspage->inuse <= class->objs_per_zspage * 3 / 4)
+		return ZS_ALMOST_EMPTY;
+	return ZS_ALMOST_FULL;
+}
+
+/* Re-file a zspage whose inuse count changed. Called with class->lock. */
+static void fix_fullness_group(struct size_class *class,
+				struct zspage *zspage)
+{
+	enum fullness_group fg = get_fullness_group(class, zspage);
+
+	if (fg == zspage->fullness)
+		return;
+
+	list_del_init(&zspage->list);
+	zspage->fullness = fg;
+	if (fg != ZS_EMPTY)
+		list_add(&zspage->list, &class->fullness_list[fg]);
+}
+
+static struct zspage *alloc_zspage(struct size_class *class, gfp_t flags)
+{
+	int i;
+	struct zspage *zspage;
+
+	zspage = kmalloc(sizeof(*zspage) +
+			class->objs_per_zspage * sizeof(unsigned long),
+			flags & ~__GFP_HIGHMEM);
+	if (!zspage)
+		return NULL;
+
+	zspage->class = class;
+	zspage->inuse = 0;
+	zspage->freeobj = 0;
+	zspage->fullness = ZS_EMPTY;
+	zspage->nr_pages = 0;
+	INIT_LIST_HEAD(&zspage->list);
+
+	for (i = 0; i < class->pages_per_zspage; i++) {
+		struct page *page = alloc_page(flags);
+		if (!page)
+			goto fail;
+		set_page_private(page, (unsigned long)zspage);
+		zspage->pages[zspage->nr_pages++] = page;
+	}
+
+	/* every object starts out on the free list */
+	for (i = 0; i < class->objs_per_zspage; i++)
+		zspage->slot[i] = ((unsigned long)(i + 1) << 1) | ZS_SLOT_FREE;
+
+	return zspage;
+
+fail:
+	while (zspage->nr_pages) {
+		struct page *page = zspage->pages[--zspage->nr_pages];
+		set_page_private(page, 0);
+		__free_page(page);
+	}
+	kfree(zspage);
+	return NULL;
+}
+
+static void free_zspage(struct zspage *zspage)
+{
+	int i;
+
+	for (i = 0; i < zspage->nr_pages; i++) {
+		set_page_private(zspage->pages[i], 0);
+		__free_page(zspage->pages[i]);
+	}
+	kfree(zspage);
+}
+
+/* Take a free slot from a non-full zspage. Called with class->lock. */
+static u32 obj_alloc(struct size_class *class, struct zspage *zspage,
+			unsigned long handle)
+{
+	u32 idx = zspage->freeobj;
+
+	zspage->freeobj = zspage->slot[idx] >> 1;
+	zspage->slot[idx] = handle;
+	zspage->inuse++;
+	class->objs_inuse++;
+
+	return idx;
+}
+
+static void obj_free(struct size_class *class, struct zspage *zspage,
+			u32 idx)
+{
+	zspage->slot[idx] = ((unsigned long)zspage->freeobj << 1) |
+				ZS_SLOT_FREE;
+	zspage->freeobj = idx;
+	zspage->inuse--;
+	class->objs_inuse--;
+}
+
+static struct zspage *find_get_zspage(struct size_class *class)
+{
+	int i;
+	struct zspage *zspage;
+
+	for (i = ZS_ALMOST_FULL; i >= ZS_ALMOST_EMPTY; i--) {
+		if (list_empty(&class->fullness_list[i]))
+			continue;
+		zspage = list_first_entry(&class->fullness_list[i],
+					struct zspage, list);
+		return zspage;
+	}
+
+	return NULL;
+}
+
+/*
+ * Copy an object between two locations of the same class. Either side
+ * may span a page boundary, so copy in chunks that stay within a page
+ * on both sides.
+ */
+static void copy_object(struct size_class *class,
+			struct zspage *d_zspage, u32 d_idx,
+			struct zspage *s_zspage, u32 s_idx)
+{
+	unsigned long d_off = d_idx * class->size;
+	unsigned long s_off = s_idx * class->size;
+	u32 written = 0;
+
+	while (written < class->size) {
+		u32 d_pos = d_off & ~PAGE_MASK;
+		u32 s_pos = s_off & ~PAGE_MASK;
+		u32 len = class->size - written;
+		void *d_addr, *s_addr;
+
+		len = min_t(u32, len, PAGE_SIZE - d_pos);
+		len = min_t(u32, len, PAGE_SIZE - s_pos);
+
+		s_addr = kmap_atomic(s_zspage->pages[s_off >> PAGE_SHIFT],
+					KM_USER0);
+		d_addr = kmap_atomic(d_zspage->pages[d_off >> PAGE_SHIFT],
+					KM_USER1);
+		memcpy(d_addr + d_pos, s_addr + s_pos, len);
+		kunmap_atomic(d_addr, KM_USER1);
+		kunmap_atomic(s_addr, KM_USER0);
+
+		written += len;
+		d_off += len;
+		s_off += len;
+	}
+}
+
+/**
+ * zs_create_pool - Creates an allocation pool to work from.
+ *
+ * This function must be called before anything when using
+ * the zsmalloc allocator.
+ *
+ * On success, a pointer to the newly created pool is returned,
+ * otherwise NULL.
+ */
+struct zs_pool *zs_create_pool(void)
+{
+	int i, j;
+	struct zs_pool *pool;
+
+	pool = kzalloc(sizeof(*pool), GFP_KERNEL);
+	if (!pool)
+		return NULL;
+
+	for (i = 0; i < ZS_SIZE_CLASSES; i++) {
+		struct size_class *class;
+
+		class = kzalloc(sizeof(*class), GFP_KERNEL);
+		if (!class) {
+			zs_destroy_pool(pool);
+			return NULL;
+		}
+
+		class->size = ZS_MIN_ALLOC_SIZE + i * ZS_SIZE_CLASS_DELTA;
+		class->pages_per_zspage = get_pages_per_zspage(class->size);
+		class->objs_per_zspage = class->pages_per_zspage *
+					PAGE_SIZE / class->size;
+		spin_lock_init(&class->lock);
+		for (j = 0; j < _ZS_NR_FULLNESS_GROUPS; j++)
+			INIT_LIST_HEAD(&class->fullness_list[j]);
+
+		pool->size_class[i] = class;
+	}
+
+	return pool;
+}
+EXPORT_SYMBOL_GPL(zs_create_pool);
+
+void zs_destroy_pool(struct zs_pool *pool)
+{
+	int i, fg;
+
+	for (i = 0; i < ZS_SIZE_CLASSES; i++) {
+		struct size_class *class = pool->size_class[i];
+		struct zspage *zspage, *tmp;
+
+		if (!class)
+			continue;
+
+		for (fg = 0; fg < _ZS_NR_FULLNESS_GROUPS; fg++) {
+			if (!list_empty(&class->fullness_list[fg]))
+				pr_info("Freeing non-empty class with size "
+					"%u, fullness group %d\n",
+					class->size, fg);
+			list_for_each_entry_safe(zspage, tmp,
+					&class->fullness_list[fg], list)
+				free_zspage(zspage);
+		}
+		kfree(class);
+	}
+
+	kfree(pool);
+}
+EXPORT_SYMBOL_GPL(zs_destroy_pool);
+
+/**
+ * zs_malloc - Allocate block of given size from pool.
+ * @pool: pool to allocate from
+ * @size: size of block to allocate
+ * @flags: flags for the handle and any new zspage pages
+ *
+ * Returns a handle for the object, or 0 on failure. The object must
+ * be mapped with zs_map_object() to be accessed.
+ */
+unsigned long zs_malloc(struct zs_pool *pool, size_t size, gfp_t flags)
+{
+	unsigned long handle;
+	struct size_class *class;
+	struct zspage *zspage;
+	u32 idx;
+
+	if (unlikely(!size || size > ZS_MAX_ALLOC_SIZE))
+		return 0;
+
+	handle = (unsigned long)kmem_cache_alloc(handle_cachep,
+						flags & ~__GFP_HIGHMEM);
+	if (!handle)
+		return 0;
+
+	class = pool->size_class[get_size_class_index(size)];
+
+	spin_lock(&class->lock);
+	zspage = find_get_zspage(class);
+	if (!zspage) {
+		spin_unlock(&class->lock);
+		zspage = alloc_zspage(class, flags);
+		if (unlikely(!zspage)) {
+			kmem_cache_free(handle_cachep, (void *)handle);
+			return 0;
+		}
+		atomic_long_add(class->pages_per_zspage,
+				&pool->pages_allocated);
+		spin_lock(&class->lock);
+		class->zspages++;
+	}
+
+	idx = obj_alloc(class, zspage, handle);
+	*(unsigned long *)handle = location_to_obj(zspage, idx) << 1;
+	fix_fullness_group(class, zspage);
+	spin_unlock(&class->lock);
+
+	return handle;
+}
+EXPORT_SYMBOL_GPL(zs_malloc);
+
+void zs_free(struct zs_pool *pool, unsigned long handle)
+{
+	struct size_class *class;
+	struct zspage *zspage;
+	u32 idx;
+	int freed = 0;
+
+	if (unlikely(!handle))
+		return;
+
+	/* the pin keeps zs_compact() from moving the object under us */
+	pin_handle(handle);
+	zspage = obj_to_location(handle_to_obj(handle), &idx);
+	class = zspage->class;
+
+	spin_lock(&class->lock);
+	obj_free(class, zspage, idx);
+	fix_fullness_group(class, zspage);
+	if (zspage->fullness == ZS_EMPTY) {
+		class->zspages--;
+		freed = 1;
+	}
+	spin_unlock(&class->lock);
+	unpin_handle(handle);
+
+	if (freed) {
+		atomic_long_sub(class->pages_per_zspage,
+				&pool->pages_allocated);
+		free_zspage(zspage);
+	}
+
+	kmem_cache_free(handle_cachep, (void *)handle);
+}
+EXPORT_SYMBOL_GPL(zs_free);
+
+/**
+ * zs_map_object - get address of allocated object from handle.
+ * @pool: pool from which the object was allocated
+ * @handle: handle returned from zs_malloc
+ * @mm: mapping mode to use
+ *
+ * The object stays pinned, and preemption disabled, until
+ * zs_unmap_object(). Only one object can be mapped at a time per CPU,
+ * and no sleeping is allowed while it is. An object that spans two
+ * pages is copied into a per-cpu buffer (and back on unmap, unless
+ * @mm is ZS_MM_RO).
+ */
+void *zs_map_object(struct zs_pool *pool, unsigned long handle,
+			enum zs_mapmode mm)
+{
+	struct zspage *zspage;
+	struct size_class *class;
+	struct mapping_area *area;
+	unsigned long off;
+	u32 idx, pos;
+
+	BUG_ON(!handle);
+
+	pin_handle(handle);
+	zspage = obj_to_location(handle_to_obj(handle), &idx);
+	class = zspage->class;
+	off = idx * class->size;
+	pos = off & ~PAGE_MASK;
+
+	area = &get_cpu_var(zs_map_area);
+	area->vm_mm = mm;
+	if (pos + class->size <= PAGE_SIZE) {
+		/* this object is contained entirely within a page */
+		area->vm_addr = kmap_atomic(zspage->pages[off >> PAGE_SHIFT],
+						KM_USER1);
+		return area->vm_addr + pos;
+	}
+
+	/* this object spans two pages */
+	area->vm_addr = NULL;
+	if (mm != ZS_MM_WO) {
+		int first = PAGE_SIZE - pos;
+		char *addr;
+
+		addr = kmap_atomic(zspage->pages[off >> PAGE_SHIFT], KM_USER1);
+		memcpy(area->vm_buf, addr + pos, first);
+		kunmap_atomic(addr, KM_USER1);
+		addr = kmap_atomic(zspage->pages[(off >> PAGE_SHIFT) + 1],
+					KM_USER1);
+		memcpy(area->vm_buf + first, addr, class->size - first);
+		kunmap_atomic(addr, KM_USER1);
+	}
+	return area->vm_buf;
+}
+EXPORT_SYMBOL_GPL(zs_map_object);
+
+void zs_unmap_object(struct zs_pool *pool, unsigned long handle)
+{
+	struct zspage *zspage;
+	struct size_class *class;
+	struct mapping_area *area;
+	unsigned long off;
+	u32 idx, pos;
+
+	BUG_ON(!handle);
+
+	zspage = obj_to_location(handle_to_obj(handle), &idx);
+	class = zspage->class;
+	off = idx * class->size;
+	pos = off & ~PAGE_MASK;
+
+	area = &__get_cpu_var(zs_map_area);
+	if (area->vm_addr) {
+		kunmap_atomic(area->vm_addr, KM_USER1);
+	} else if (area->vm_mm != ZS_MM_RO) {
+		int first = PAGE_SIZE - pos;
+		char *addr;
+
+		addr = kmap_atomic(zspage->pages[off >> PAGE_SHIFT], KM_USER1);
+		memcpy(addr + pos, area->vm_buf, first);
+		kunmap_atomic(addr, KM_USER1);
+		addr = kmap_atomic(zspage->pages[(off >> PAGE_SHIFT) + 1],
+					KM_USER1);
+		memcpy(addr, area->vm_buf + first, class->size - first);
+		kunmap_atomic(addr, KM_USER1);
+	}
+	put_cpu_var(zs_map_area);
+
+	unpin_handle(handle);
+}
+EXPORT_SYMBOL_GPL(zs_unmap_object);
+
+/*
+ * Returns total memory used by allocator (userdata + metadata)
+ */
+u64 zs_get_total_size_bytes(struct zs_pool *pool)
+{
+	return (u64)atomic_long_read(&pool->pages_allocated) << PAGE_SHIFT;
+}
+EXPORT_SYMBOL_GPL(zs_get_total_size_bytes);
+
+/*
+ * Fill in stats for size class @index. Returns -ENOENT once @index is
+ * past the last class, so callers can simply count up from zero.
+ */
+int zs_get_class_stats(struct zs_pool *pool, int index,
+			struct zs_class_stats *stats)
+{
+	struct size_class *class;
+
+	if (index < 0 || index >= ZS_SIZE_CLASSES)
+		return -ENOENT;
+
+	class = pool->size_class[index];
+	spin_lock(&class->lock);
+	stats->size = class->size;
+	stats->pages_per_zspage = class->pages_per_zspage;
+	stats->zspages = class->zspages;
+	stats->objs_allocated = class->zspages * class->objs_per_zspage;
+	stats->objs_inuse = class->objs_inuse;
+	spin_unlock(&class->lock);
+
+	return 0;
+}
+EXPORT_SYMBOL_GPL(zs_get_class_stats);
+
+/*
+ * Move as many objects as fit out of @src into other zspages of the
+ * class. Pinned (mapped or being freed) objects are left in place.
+ * Called with class->lock held and @src off the fullness lists.
+ */
+static void migrate_zspage(struct size_class *class, struct zspage *src)
+{
+	u32 s_idx;
+
+	for (s_idx = 0; s_idx < class->objs_per_zspage && src->inuse;
+	     s_idx++) {
+		unsigned long handle = src->slot[s_idx];
+		struct zspage *dst;
+		u32 d_idx;
+
+		if (handle & ZS_SLOT_FREE)
+			continue;
+
+		dst = find_get_zspage(class);
+		if (!dst)
+			break;
+
+		if (!trypin_handle(handle))
+			continue;
+
+		d_idx = obj_alloc(class, dst, handle);
+		copy_object(class, dst, d_idx, src, s_idx);
+		/* keep the pin bit set until the unpin below */
+		*(unsigned long *)handle =
+			(location_to_obj(dst, d_idx) << 1) |
+			BIT(HANDLE_PIN_BIT);
+		obj_free(class, src, s_idx);
+		fix_fullness_group(class, dst);
+
+		unpin_handle(handle);
+	}
+}
+
+/* Would moving objects around free at least one zspage of this class? */
+static int zs_can_compact(struct size_class *class)
+{
+	u64 obj_wasted = class->zspages * class->objs_per_zspage -
+				class->objs_inuse;
+
+	return obj_wasted >= class->objs_per_zspage;
+}
+
+static unsigned long zs_compact_class(struct zs_pool *pool,
+					struct size_class *class)
+{
+	struct list_head *sparse = &class->fullness_list[ZS_ALMOST_EMPTY];
+	unsigned long pages_freed = 0;
+	struct zspage *src;
+
+	spin_lock(&class->lock);
+	while (zs_can_compact(class) && !list_empty(sparse)) {
+		/* drain the least recently filed sparse zspage */
+		src = list_entry(sparse->prev, struct zspage, list);
+		list_del_init(&src->list);
+
+		migrate_zspage(class, src);
+
+		if (src->inuse) {
+			/* pinned objects, or nowhere left to put them */
+			src->fullness = ZS_EMPTY;
+			fix_fullness_group(class, src);
+			break;
+		}
+
+		class->zspages--;
+		spin_unlock(&class->lock);
+
+		atomic_long_sub(class->pages_per_zspage,
+				&pool->pages_allocated);
+		pages_freed += class->pages_per_zspage;
+		free_zspage(src);
+
+		cond_resched();
+		spin_lock(&class->lock);
+	}
+	spin_unlock(&class->lock);
+
+	return pages_freed;
+}
+
+/**
+ * zs_compact - move objects to free sparsely used zspages
+ * @pool: pool to compact
+ *
+ * May sleep. Returns the number of pages given back to the system.
+ */
+unsigned long zs_compact(struct zs_pool *pool)
+{
+	int i;
+	unsigned long pages_freed = 0;
+
+	for (i = ZS_SIZE_CLASSES - 1; i >= 0; i--)
+		pages_freed += zs_compact_class(pool, pool->size_class[i]);
+
+	return pages_freed;
+}
+EXPORT_SYMBOL_GPL(zs_compact);
+
+static void zs_free_map_areas(void)
+{
+	int cpu;
+
+	for_each_possible_cpu(cpu) {
+		struct mapping_area *area = &per_cpu(zs_map_area, cpu);
+		kfree(area->vm_buf);
+		area->vm_buf = NULL;
+	}
+}
+
+static int __init zs_init(void)
+{
+	int cpu;
+
+	handle_cachep = kmem_cache_create("zs_handle", sizeof(unsigned long),
+					0, 0, NULL);
+	if (!handle_cachep)
+		return -ENOMEM;
+
+	for_each_possible_cpu(cpu) {
+		struct mapping_area *area = &per_cpu(zs_map_area, cpu);
+
+		area->vm_buf = kmalloc(ZS_MAX_ALLOC_SIZE, GFP_KERNEL);
+		if (!area->vm_buf) {
+			zs_free_map_areas();
+			kmem_cache_destroy(handle_cachep);
+			return -ENOMEM;
+		}
+	}
+
+	return 0;
+}
+
+static void __exit zs_exit(void)
+{
+	zs_free_map_areas();
+	kmem_cache_destroy(handle_cachep);
+}
+
+module_init(zs_init);
+module_exit(zs_exit);
@@ -0,0 +1,119 @@
+/*
+ * zsmalloc memory allocator
+ *
+ * Copyright (C) 2008, 2009, 2010  Nitin Gupta
+ *
+ * This code is released using a dual license strategy: BSD/GPL
+ * You can choose the licence that better fits your requirements.
+ *
+ * Released under the terms of 3-clause BSD License
+ * Released under the terms of GNU General Public License Version 2.0
+ */
+
+#ifndef _ZS_MALLOC_INT_H_
+#define _ZS_MALLOC_INT_H_
+
+#include <linux/kernel.h>
+#include <linux/list.h>
+#include <linux/spinlock.h>
+#include <linux/types.h>
+#include <asm/atomic.h>
+
+/* User configurable params */
+
+/*
+ * A zspage is a group of up to 2^ZS_MAX_ZSPAGE_ORDER order-0 pages
+ * which are carved into objects of one size class. The pages need
+ * not be contiguous; objects may span a page boundary.
+ */
+#define ZS_MAX_ZSPAGE_ORDER	2
+#define ZS_MAX_PAGES_PER_ZSPAGE	(1 << ZS_MAX_ZSPAGE_ORDER)
+
+#define ZS_MIN_ALLOC_SHIFT	5
+#define ZS_MIN_ALLOC_SIZE	(1 << ZS_MIN_ALLOC_SHIFT)
+#define ZS_MAX_ALLOC_SIZE	PAGE_SIZE
+
+/*
+ * Size classes are ZS_SIZE_CLASS_DELTA bytes apart: 16 bytes for 4k
+ * pages, so a stored object wastes at most 15 bytes to rounding.
+ */
+#define ZS_SIZE_CLASS_DELTA	(PAGE_SIZE >> 8)
+#define ZS_SIZE_CLASSES		((ZS_MAX_ALLOC_SIZE - ZS_MIN_ALLOC_SIZE) \
+					/ ZS_SIZE_CLASS_DELTA + 1)
+
+/* End of user params */
+
+/*
+ * An object is addressed by <PFN of the first zspage page, object index>.
+ * The index needs enough bits for the smallest class in the largest
+ * zspage.
+ */
+#define OBJ_INDEX_BITS	(PAGE_SHIFT + ZS_MAX_ZSPAGE_ORDER - ZS_MIN_ALLOC_SHIFT)
+#define OBJ_INDEX_MASK	((1UL << OBJ_INDEX_BITS) - 1)
+
+/*
+ * A handle is a pointer to one word holding the object location shifted
+ * left by one. Bit 0 is a lock that pins the object in place while it
+ * is mapped, freed or migrated.
+ */
+#define HANDLE_PIN_BIT	0
+
+/*
+ * zspage->slot[] holds the handle of an allocated object, or a free
+ * list link (next free index << 1 | ZS_SLOT_FREE) for a free one.
+ * Handles are word aligned, so bit 0 tells the two apart.
+ */
+#define ZS_SLOT_FREE	1UL
+
+/*
+ * Fullness groups. A zspage moves between the per-class lists as
+ * objects are allocated and freed; empty zspages are freed at once.
+ */
+enum fullness_group {
+	ZS_EMPTY,
+	ZS_ALMOST_EMPTY,	/* at most 3/4 of the objects in use */
+	ZS_ALMOST_FULL,
+	ZS_FULL,
+	_ZS_NR_FULLNESS_GROUPS,
+};
+
+struct size_class;
+
+struct zspage {
+	struct list_head list;
+	struct size_class *class;
+	u16 inuse;		/* no. of objects allocated */
+	u16 freeobj;		/* first free object index */
+	u8 fullness;
+	u8 nr_pages;
+	struct page *pages[ZS_MAX_PAGES_PER_ZSPAGE];
+	unsigned long slot[0];	/* one per object, see ZS_SLOT_FREE */
+};
+
+struct size_class {
+	/* protects the lists and every zspage of this class */
+	spinlock_t lock;
+	struct list_head fullness_list[_ZS_NR_FULLNESS_GROUPS];
+
+	u32 size;
+	u32 pages_per_zspage;
+	u32 objs_per_zspage;
+
+	/* stats, protected by lock */
+	u64 zspages;
+	u64 objs_inuse;
+};
+
+struct zs_pool {
+	struct size_class *size_class[ZS_SIZE_CLASSES];
+	atomic_long_t pages_allocated;
+};
+
+/* per-cpu buffer for objects that span two pages */
+struct mapping_area {
+	char *vm_buf;
+	char *vm_addr;		/* address of kmap_atomic()'ed page */
+	enum zs_mapmode vm_mm;
+};
+
+#endif
@@ -17,6 +17,7 @@
 #include <linux/cpufreq.h>
 #include <linux/mutex.h>
 #include <linux/msm_tsens.h>
+#include <linux/msm_thermal.h>
 #include <linux/workqueue.h>
 #include <linux/cpu.h>
 
@@ -30,6 +31,8 @@ static int allowed_max_high = DEF_ALLOWED_MAX_HIGH;
 static int allowed_max_low = (DEF_ALLOWED_MAX_HIGH - 10);
 static int allowed_max_freq = DEF_ALLOWED_MAX_FREQ;
 static int check_interval_ms = DEF_THERMAL_CHECK_MS;
+/* above allowed_max_high until back below allowed_max_low */
+static int limited;
 
 module_param(allowed_max_high, int, 0);
 module_param(allowed_max_freq, int, 0);
@@ -37,6 +40,17 @@ module_param(check_interval_ms, int, 0);
 
 static struct delayed_work check_temp_work;
 
+/*
+ * Whether the cores are held at allowed_max_freq for temperature.  Only
+ * this driver's own cap counts: a lower policy max may just as well come
+ * from userspace or a performance lock.
+ */
+int msm_thermal_limited(void)
+{
+	return ACCESS_ONCE(limited);
+}
+EXPORT_SYMBOL(msm_thermal_limited);
+
 static int update_cpu_max_freq(struct cpufreq_policy *cpu_policy,
 			       int cpu, int max_freq)
 {
@@ -77,6 +91,11 @@ static void check_temp(struct work_struct *work)
 		pr_info("msm_thermal: TSENS sensor %d (%ld C)\n",
 				tsens_dev.sensor_num, temp);
 
+	if (temp >= allowed_max_high)
+		limited = 1;
+	else if (temp < allowed_max_low)
+		limited = 0;
+
 	for_each_possible_cpu(cpu) {
 		update_policy = 0;
 		cpu_policy = cpufreq_cpu_get(cpu);
@@ -119,6 +138,7 @@ static void disable_msm_thermal(void)
 	int cpu = 0;
 	struct cpufreq_policy *cpu_policy = NULL;
 
+	limited = 0;
 	for_each_possible_cpu(cpu) {
 		cpu_policy = cpufreq_cpu_get(cpu);
 		if (cpu_policy) {
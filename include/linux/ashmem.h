@@ -14,6 +14,7 @@
 
 #include <linux/limits.h>
 #include <linux/ioctl.h>
+#include <linux/types.h>
 
 #define ASHMEM_NAME_LEN		256
 
@@ -32,6 +33,26 @@ struct ashmem_pin {
 	__u32 len;	/* length forward from offset, in bytes, page-aligned */
 };
 
+/* Operations for ASHMEM_PIN_BATCH */
+#define ASHMEM_BATCH_PIN		1
+#define ASHMEM_BATCH_UNPIN		2
+#define ASHMEM_BATCH_GET_PIN_STATUS	3
+
+struct ashmem_pin_op {
+	__u32 offset;	/* as in struct ashmem_pin */
+	__u32 len;
+	__u32 op;	/* ASHMEM_BATCH_* */
+	__s32 ret;	/* out: what the single-range ioctl would return */
+};
+
+#define ASHMEM_PIN_BATCH_MAX	256
+
+struct ashmem_pin_batch {
+	__u64 ops;	/* user pointer to an array of struct ashmem_pin_op */
+	__u32 count;	/* entries in that array, at most ASHMEM_PIN_BATCH_MAX */
+	__u32 reserved;
+};
+
 #define __ASHMEMIOC		0x77
 
 #define ASHMEM_SET_NAME		_IOW(__ASHMEMIOC, 1, char[ASHMEM_NAME_LEN])
@@ -47,9 +68,14 @@ struct ashmem_pin {
 #define ASHMEM_CACHE_FLUSH_RANGE	_IO(__ASHMEMIOC, 11)
 #define ASHMEM_CACHE_CLEAN_RANGE	_IO(__ASHMEMIOC, 12)
 #define ASHMEM_CACHE_INV_RANGE		_IO(__ASHMEMIOC, 13)
+#define ASHMEM_PIN_BATCH	_IOWR(__ASHMEMIOC, 14, struct ashmem_pin_batch)
+#define ASHMEM_POPULATE		_IOW(__ASHMEMIOC, 15, struct ashmem_pin)
 
+#ifdef __KERNEL__
 int get_ashmem_file(int fd, struct file **filp, struct file **vm_file,
 			unsigned long *len);
 void put_ashmem_file(struct file *file);
+unsigned long ashmem_unpinned_pages(void);
+#endif
 
 #endif	/* _LINUX_ASHMEM_H */
@@ -11,12 +11,26 @@
  *
  */
 
+#include <linux/percpu.h>
+#include <linux/seqlock.h>
+
+/*
+ * Run queue averages are fixed point with RQ_AVG_FSHIFT fractional bits and
+ * decay by 1/2^RQ_AVG_DECAY_SHIFT per jiffy, a time constant of 8 ticks.
+ */
+#define RQ_AVG_FSHIFT		10
+#define RQ_AVG_DECAY_SHIFT	3
+
+struct rq_cpu_avg {
+	seqcount_t seq;
+	unsigned int avg;		/* nr_running, decayed */
+	unsigned long last_jiffy;	/* jiffy of the last sample */
+};
+
 struct rq_data {
-	unsigned int rq_avg;
+	unsigned int rq_avg;		/* last notified aggregate, tenths */
 	unsigned long rq_poll_jiffies;
 	unsigned long def_timer_jiffies;
-	unsigned long rq_poll_last_jiffy;
-	unsigned long rq_poll_total_jiffies;
 	unsigned long def_timer_last_jiffy;
 	unsigned int def_interval;
 	int64_t def_start_time;
@@ -29,3 +43,8 @@ struct rq_data {
 extern spinlock_t rq_lock;
 extern struct rq_data rq_info;
 extern struct workqueue_struct *rq_wq;
+DECLARE_PER_CPU(struct rq_cpu_avg, rq_cpu_avg);
+
+/* Averaged runnable tasks in tenths, of one cpu or all online cpus */
+extern unsigned int rq_avg_cpu(int cpu);
+extern unsigned int rq_avg_total(void);
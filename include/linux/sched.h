@@ -137,6 +137,7 @@ extern int nr_threads;
 DECLARE_PER_CPU(unsigned long, process_counts);
 extern int nr_processes(void);
 extern unsigned long nr_running(void);
+extern unsigned long nr_running_cpu(int cpu);
 extern unsigned long nr_uninterruptible(void);
 extern unsigned long nr_iowait(void);
 extern unsigned long nr_iowait_cpu(int cpu);
@@ -1760,6 +1761,9 @@ extern int task_free_unregister(struct notifier_block *n);
 extern int task_fork_register(struct notifier_block *n);
 extern int task_fork_unregister(struct notifier_block *n);
 
+extern int task_migration_register(struct notifier_block *n);
+extern int task_migration_unregister(struct notifier_block *n);
+
 /*
  * Per process flags
  */
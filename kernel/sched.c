@@ -2027,6 +2027,32 @@ static void update_rq_clock_task(struct rq *rq, s64 delta)
 
 #endif /* CONFIG_IRQ_TIME_ACCOUNTING */
 
+/*
+ * Notifier list called after a task has been moved to another CPU by a
+ * wakeup or by load balancing, with the destination CPU as the action and
+ * the source CPU as the data.  No runqueue lock is held, but it may be
+ * called from atomic context.
+ */
+static ATOMIC_NOTIFIER_HEAD(task_migration_notifier);
+
+int task_migration_register(struct notifier_block *n)
+{
+	return atomic_notifier_chain_register(&task_migration_notifier, n);
+}
+EXPORT_SYMBOL(task_migration_register);
+
+int task_migration_unregister(struct notifier_block *n)
+{
+	return atomic_notifier_chain_unregister(&task_migration_notifier, n);
+}
+EXPORT_SYMBOL(task_migration_unregister);
+
+static inline void task_migration_notify(int src_cpu, int dest_cpu)
+{
+	atomic_notifier_call_chain(&task_migration_notifier, dest_cpu,
+				   (void *)(long)src_cpu);
+}
+
 #include "sched_idletask.c"
 #include "sched_fair.c"
 #include "sched_rt.c"
@@ -2675,15 +2701,15 @@ static int
 try_to_wake_up(struct task_struct *p, unsigned int state, int wake_flags)
 {
 	unsigned long flags;
-	int cpu, success = 0;
+	int cpu, src_cpu, success = 0;
 
 	smp_wmb();
 	raw_spin_lock_irqsave(&p->pi_lock, flags);
+	src_cpu = cpu = task_cpu(p);
 	if (!(p->state & state))
 		goto out;
 
 	success = 1; /* we're going to change ->state */
-	cpu = task_cpu(p);
 
 	if (p->on_rq && ttwu_remote(p, wake_flags))
 		goto stat;
@@ -2732,6 +2758,9 @@ stat:
 out:
 	raw_spin_unlock_irqrestore(&p->pi_lock, flags);
 
+	if (src_cpu != cpu)
+		task_migration_notify(src_cpu, cpu);
+
 	return success;
 }
 
@@ -3205,6 +3234,11 @@ unsigned long nr_running(void)
 	return sum;
 }
 
+unsigned long nr_running_cpu(int cpu)
+{
+	return cpu_rq(cpu)->nr_running;
+}
+
 unsigned long nr_uninterruptible(void)
 {
 	unsigned long i, sum = 0;
@@ -5167,11 +5201,12 @@ recheck:
 	}
 
 	/*
-	 * If not changing anything there's no need to proceed further:
+	 * If not changing anything there's no need to proceed further,
+	 * but store a possible modification of reset_on_fork:
 	 */
 	if (unlikely(policy == p->policy && (!rt_policy(policy) ||
 			param->sched_priority == p->rt_priority))) {
-
+		p->sched_reset_on_fork = reset_on_fork;
 		__task_rq_unlock(rq);
 		raw_spin_unlock_irqrestore(&p->pi_lock, flags);
 		return 0;
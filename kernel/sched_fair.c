@@ -3384,6 +3384,9 @@ redo:
 		double_rq_unlock(this_rq, busiest);
 		local_irq_restore(flags);
 
+		if (ld_moved)
+			task_migration_notify(cpu_of(busiest), this_cpu);
+
 		/*
 		 * some other cpu did the load balance for us.
 		 */
@@ -3552,6 +3555,7 @@ static int active_load_balance_cpu_stop(void *data)
 	int target_cpu = busiest_rq->push_cpu;
 	struct rq *target_rq = cpu_rq(target_cpu);
 	struct sched_domain *sd;
+	int moved = 0;
 
 	raw_spin_lock_irq(&busiest_rq->lock);
 
@@ -3585,8 +3589,9 @@ static int active_load_balance_cpu_stop(void *data)
 	if (likely(sd)) {
 		schedstat_inc(sd, alb_count);
 
-		if (move_one_task(target_rq, target_cpu, busiest_rq,
-				  sd, CPU_IDLE))
+		moved = move_one_task(target_rq, target_cpu, busiest_rq,
+				      sd, CPU_IDLE);
+		if (moved)
 			schedstat_inc(sd, alb_pushed);
 		else
 			schedstat_inc(sd, alb_failed);
@@ -3596,6 +3601,9 @@ static int active_load_balance_cpu_stop(void *data)
 out_unlock:
 	busiest_rq->active_balance = 0;
 	raw_spin_unlock_irq(&busiest_rq->lock);
+
+	if (moved)
+		task_migration_notify(busiest_cpu, target_cpu);
 	return 0;
 }
 
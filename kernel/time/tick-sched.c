@@ -30,6 +30,68 @@
 struct rq_data rq_info;
 struct workqueue_struct *rq_wq;
 spinlock_t rq_lock;
+DEFINE_PER_CPU(struct rq_cpu_avg, rq_cpu_avg);
+
+/*
+ * Move avg towards sample for n jiffies.  Past 64 steps the old value has
+ * decayed below the fixed point resolution.
+ */
+static unsigned int rq_avg_decay(unsigned int avg, unsigned int sample,
+				 unsigned long n)
+{
+	if (n >= 64)
+		return sample;
+
+	while (n--)
+		avg = avg - (avg >> RQ_AVG_DECAY_SHIFT) +
+			(sample >> RQ_AVG_DECAY_SHIFT);
+
+	return avg;
+}
+
+static unsigned int __rq_avg_cpu(int cpu)
+{
+	struct rq_cpu_avg *ra = &per_cpu(rq_cpu_avg, cpu);
+	unsigned long gap, poll = max(rq_info.rq_poll_jiffies, 1UL);
+	unsigned int seq, avg;
+
+	if (!cpu_online(cpu))
+		return 0;
+
+	do {
+		seq = read_seqcount_begin(&ra->seq);
+		avg = ra->avg;
+		gap = jiffies - ra->last_jiffy;
+	} while (read_seqcount_retry(&ra->seq, seq));
+
+	/*
+	 * A busy cpu samples every poll period, so a longer gap means its
+	 * tick has been stopped in idle with nothing runnable.  Account for
+	 * that here rather than reporting the value from before idle.  One
+	 * jiffy of slack covers ticks landing just after the jiffies update.
+	 */
+	if (gap > poll + 1)
+		avg = rq_avg_decay(avg, 0, gap - poll);
+
+	return avg;
+}
+
+unsigned int rq_avg_cpu(int cpu)
+{
+	return (__rq_avg_cpu(cpu) * 10) >> RQ_AVG_FSHIFT;
+}
+EXPORT_SYMBOL(rq_avg_cpu);
+
+unsigned int rq_avg_total(void)
+{
+	unsigned int cpu, sum = 0;
+
+	for_each_online_cpu(cpu)
+		sum += __rq_avg_cpu(cpu);
+
+	return (sum * 10) >> RQ_AVG_FSHIFT;
+}
+EXPORT_SYMBOL(rq_avg_total);
 
 /*
  * Per cpu nohz control structure
@@ -715,37 +777,27 @@ void tick_check_idle(int cpu)
  * High resolution timer specific code
  */
 #ifdef CONFIG_HIGH_RES_TIMERS
-static void update_rq_stats(void)
+static void update_rq_stats(int cpu)
 {
-	unsigned long jiffy_gap = 0;
-	unsigned int rq_avg = 0;
-	unsigned long flags = 0;
-
-	jiffy_gap = jiffies - rq_info.rq_poll_last_jiffy;
-
-	if (jiffy_gap >= rq_info.rq_poll_jiffies) {
-
-		spin_lock_irqsave(&rq_lock, flags);
-
-		if (!rq_info.rq_avg)
-			rq_info.rq_poll_total_jiffies = 0;
-
-		rq_avg = nr_running() * 10;
+	struct rq_cpu_avg *ra = &per_cpu(rq_cpu_avg, cpu);
+	unsigned long poll = max(rq_info.rq_poll_jiffies, 1UL);
+	unsigned long jiffy_gap;
+	unsigned int avg;
 
-		if (rq_info.rq_poll_total_jiffies) {
-			rq_avg = (rq_avg * jiffy_gap) +
-				(rq_info.rq_avg *
-				 rq_info.rq_poll_total_jiffies);
-			do_div(rq_avg,
-			       rq_info.rq_poll_total_jiffies + jiffy_gap);
-		}
+	jiffy_gap = jiffies - ra->last_jiffy;
+	if (jiffy_gap < poll)
+		return;
 
-		rq_info.rq_avg =  rq_avg;
-		rq_info.rq_poll_total_jiffies += jiffy_gap;
-		rq_info.rq_poll_last_jiffy = jiffies;
+	/* Jiffies beyond the poll period were spent idle with no tick */
+	avg = ra->avg;
+	if (jiffy_gap > poll + 1)
+		avg = rq_avg_decay(avg, 0, jiffy_gap - poll);
+	avg = rq_avg_decay(avg, nr_running_cpu(cpu) << RQ_AVG_FSHIFT, poll);
 
-		spin_unlock_irqrestore(&rq_lock, flags);
-	}
+	write_seqcount_begin(&ra->seq);
+	ra->avg = avg;
+	ra->last_jiffy = jiffies;
+	write_seqcount_end(&ra->seq);
 }
 
 static void wakeup_user(void)
@@ -807,17 +859,18 @@ static enum hrtimer_restart tick_sched_timer(struct hrtimer *timer)
 		update_process_times(user_mode(regs));
 		profile_tick(CPU_PROFILING);
 
-		if ((rq_info.init == 1) && (tick_do_timer_cpu == cpu)) {
+		if (rq_info.init == 1) {
 
 			/*
-			 * update run queue statistics
+			 * update run queue statistics of this cpu
 			 */
-			update_rq_stats();
+			update_rq_stats(cpu);
 
 			/*
 			 * wakeup user if needed
 			 */
-			wakeup_user();
+			if (tick_do_timer_cpu == cpu)
+				wakeup_user();
 		}
 	}
 
@@ -0,0 +1,118 @@
+/*
+ * LZ4 - Fast LZ compression algorithm
+ *
+ * Greedy, single-pass compressor producing the LZ4 block format described
+ * by Yann Collet, http://code.google.com/p/lz4/
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2 as
+ *  published by the Free Software Foundation.
+ */
+
+#include <linux/module.h>
+#include <linux/kernel.h>
+#include <linux/string.h>
+#include <linux/types.h>
+#include <linux/lz4.h>
+#include <asm/unaligned.h>
+#include "lz4defs.h"
+
+static inline unsigned char *lz4_put_length(unsigned char *op, size_t len)
+{
+	for (; len >= 255; len -= 255)
+		*op++ = 255;
+	*op++ = len;
+	return op;
+}
+
+static unsigned char *lz4_put_literals(unsigned char *op,
+				       const unsigned char *anchor,
+				       size_t len, unsigned char **token)
+{
+	*token = op++;
+	if (len >= RUN_MASK) {
+		**token = RUN_MASK << ML_BITS;
+		op = lz4_put_length(op, len - RUN_MASK);
+	} else {
+		**token = len << ML_BITS;
+	}
+	memcpy(op, anchor, len);
+	return op + len;
+}
+
+int lz4_compress(const unsigned char *src, size_t src_len,
+		unsigned char *dst, size_t *dst_len, void *wrkmem)
+{
+	u32 *hash_table = wrkmem;
+	const unsigned char *ip = src;
+	const unsigned char *anchor = src;
+	const unsigned char *const iend = src + src_len;
+	const unsigned char *const mflimit = iend - MFLIMIT;
+	const unsigned char *const matchlimit = iend - LASTLITERALS;
+	unsigned char *op = dst;
+	unsigned char *token;
+
+	memset(hash_table, 0, LZ4_MEM_COMPRESS);
+
+	if (src_len < MFLIMIT + 1)
+		goto last_literals;
+
+	hash_table[LZ4_HASH_VALUE(ip)] = 0;
+	ip++;
+
+	while (ip <= mflimit) {
+		const unsigned char *ref;
+		const unsigned char *match_start;
+		size_t len;
+		u32 h = LZ4_HASH_VALUE(ip);
+
+		ref = src + hash_table[h];
+		hash_table[h] = ip - src;
+		if (ref >= ip || ip - ref > MAX_DISTANCE ||
+		    get_unaligned((const u32 *)ref) !=
+		    get_unaligned((const u32 *)ip)) {
+			ip++;
+			continue;
+		}
+
+		/* stretch the match backwards over pending literals */
+		while (ip > anchor && ref > src && ip[-1] == ref[-1]) {
+			ip--;
+			ref--;
+		}
+
+		op = lz4_put_literals(op, anchor, ip - anchor, &token);
+		put_unaligned_le16(ip - ref, op);
+		op += 2;
+
+		match_start = ip;
+		ip += MINMATCH;
+		ref += MINMATCH;
+		while (ip < matchlimit && *ip == *ref) {
+			ip++;
+			ref++;
+		}
+
+		len = ip - match_start - MINMATCH;
+		if (len >= ML_MASK) {
+			*token += ML_MASK;
+			op = lz4_put_length(op, len - ML_MASK);
+		} else {
+			*token += len;
+		}
+		anchor = ip;
+
+		if (ip > mflimit)
+			break;
+		hash_table[LZ4_HASH_VALUE(ip - 2)] = ip - 2 - src;
+	}
+
+last_literals:
+	op = lz4_put_literals(op, anchor, iend - anchor, &token);
+	*dst_len = op - dst;
+	return 0;
+}
+EXPORT_SYMBOL(lz4_compress);
+
+MODULE_LICENSE("GPL");
+MODULE_DESCRIPTION("LZ4 compressor");
@@ -0,0 +1,25 @@
+/*
+ * lz4defs.h -- common and architecture specific defines for the kernel usage
+ *
+ *  Block format compatible with the LZ4 library by Yann Collet,
+ *  http://code.google.com/p/lz4/
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2 as
+ *  published by the Free Software Foundation.
+ */
+
+#define MINMATCH	4
+#define MFLIMIT		12	/* last match starts this far before the end */
+#define LASTLITERALS	5	/* the block always ends with literals */
+#define MAX_DISTANCE	65535
+
+#define ML_BITS		4
+#define ML_MASK		((1U << ML_BITS) - 1)
+#define RUN_BITS	(8 - ML_BITS)
+#define RUN_MASK	((1U << RUN_BITS) - 1)
+
+#define LZ4_HASH_LOG	12
+#define LZ4_HASH_VALUE(p)	\
+	((get_unaligned((const u32 *)(p)) * 2654435761U) >> \
+	 (32 - LZ4_HASH_LOG))
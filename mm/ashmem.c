@@ -29,6 +29,11 @@
 #include <linux/mutex.h>
 #include <linux/shmem_fs.h>
 #include <linux/ashmem.h>
+#include <linux/sched.h>
+#include <linux/wait.h>
+#include <linux/debugfs.h>
+#include <linux/seq_file.h>
+#include <linux/slab.h>
 #include <asm/cacheflush.h>
 
 #define ASHMEM_NAME_PREFIX "dev/ashmem/"
@@ -44,11 +49,17 @@
 struct ashmem_area {
 	char name[ASHMEM_FULL_NAME_LEN];/* optional name for /proc/pid/maps */
 	struct list_head unpinned_list;	/* list of all ashmem areas */
+	struct list_head area_list;	/* entry in ashmem_area_list */
 	struct file *file;		/* the shmem-based backing file */
 	size_t size;			/* size of the mapping, in bytes */
 	unsigned long vm_start;		/* Start address of vm_area
 					 * which maps this ashmem */
 	unsigned long prot_mask;	/* allowed prot bits, as vm_flags */
+	pid_t owner;			/* tgid of the opener */
+	char owner_comm[TASK_COMM_LEN];	/* and its name, for the stats */
+	unsigned long unpinned_pages;	/* pages of ours on the LRU */
+	unsigned long purged_pages;	/* pages the shrinker took, ever */
+	atomic_t purge_inflight;	/* ranges being truncated unlocked */
 };
 
 /*
@@ -71,6 +82,15 @@ static LIST_HEAD(ashmem_lru_list);
 /* Count of pages on our LRU list, protected by ashmem_mutex */
 static unsigned long lru_count;
 
+/* All open areas, for the debugfs stats, protected by ashmem_mutex */
+static LIST_HEAD(ashmem_area_list);
+
+/*
+ * The shrinker truncates ranges with ashmem_mutex dropped.  Pinning an
+ * area, or freeing it, waits here until its in-flight truncations are done.
+ */
+static DECLARE_WAIT_QUEUE_HEAD(ashmem_purge_wait);
+
 /*
  * ashmem_mutex - protects the list of and each individual ashmem_area
  *
@@ -78,6 +98,20 @@ static unsigned long lru_count;
  */
 static DEFINE_MUTEX(ashmem_mutex);
 
+/*
+ * ashmem_unpinned_pages - number of unpinned pages our shrinker could purge
+ *
+ * Read without ashmem_mutex on purpose: the low memory killer calls this
+ * from reclaim, which can be entered by an allocation made under
+ * ashmem_mutex.  The word-sized read may be stale but never torn, which is
+ * good enough for a memory pressure heuristic.
+ */
+unsigned long ashmem_unpinned_pages(void)
+{
+	return ACCESS_ONCE(lru_count);
+}
+EXPORT_SYMBOL(ashmem_unpinned_pages);
+
 static struct kmem_cache *ashmem_area_cachep __read_mostly;
 static struct kmem_cache *ashmem_range_cachep __read_mostly;
 
@@ -109,12 +143,14 @@ static inline void lru_add(struct ashmem_range *range)
 {
 	list_add_tail(&range->lru, &ashmem_lru_list);
 	lru_count += range_size(range);
+	range->asma->unpinned_pages += range_size(range);
 }
 
 static inline void lru_del(struct ashmem_range *range)
 {
 	list_del(&range->lru);
 	lru_count -= range_size(range);
+	range->asma->unpinned_pages -= range_size(range);
 }
 
 /*
@@ -128,13 +164,13 @@ static inline void lru_del(struct ashmem_range *range)
  *
  * Caller must hold ashmem_mutex.
  */
-static int range_alloc(struct ashmem_area *asma,
-		       struct ashmem_range *prev_range, unsigned int purged,
-		       size_t start, size_t end)
+static int __range_alloc(struct ashmem_area *asma,
+			 struct ashmem_range *prev_range, unsigned int purged,
+			 size_t start, size_t end, gfp_t gfp)
 {
 	struct ashmem_range *range;
 
-	range = kmem_cache_zalloc(ashmem_range_cachep, GFP_KERNEL);
+	range = kmem_cache_zalloc(ashmem_range_cachep, gfp);
 	if (unlikely(!range))
 		return -ENOMEM;
 
@@ -151,6 +187,13 @@ static int range_alloc(struct ashmem_area *asma,
 	return 0;
 }
 
+static inline int range_alloc(struct ashmem_area *asma,
+			      struct ashmem_range *prev_range,
+			      unsigned int purged, size_t start, size_t end)
+{
+	return __range_alloc(asma, prev_range, purged, start, end, GFP_KERNEL);
+}
+
 static void range_del(struct ashmem_range *range)
 {
 	list_del(&range->unpinned);
@@ -172,8 +215,41 @@ static inline void range_shrink(struct ashmem_range *range,
 	range->pgstart = start;
 	range->pgend = end;
 
-	if (range_on_lru(range))
+	if (range_on_lru(range)) {
 		lru_count -= pre - range_size(range);
+		range->asma->unpinned_pages -= pre - range_size(range);
+	}
+}
+
+/*
+ * range_purge_tail - mark pages [pgstart, range->pgend] of an LRU range as
+ * purged while its head stays unpinned on the LRU, so that a small shrink
+ * request does not throw away all of a large area.  The purged tail joins
+ * an adjacent purged range if there is one.
+ *
+ * Caller must hold ashmem_mutex.
+ */
+static int range_purge_tail(struct ashmem_range *range, size_t pgstart)
+{
+	struct ashmem_area *asma = range->asma;
+	struct ashmem_range *prev;
+
+	/* the unpinned list is sorted by descending page */
+	if (range->unpinned.prev != &asma->unpinned_list) {
+		prev = list_entry(range->unpinned.prev, struct ashmem_range,
+				  unpinned);
+		if (!range_on_lru(prev) && prev->pgstart == range->pgend + 1) {
+			prev->pgstart = pgstart;
+			goto shrink;
+		}
+	}
+	/* we are in reclaim: don't recurse, just purge the whole range */
+	if (__range_alloc(asma, range, ASHMEM_WAS_PURGED, pgstart,
+			  range->pgend, GFP_NOWAIT | __GFP_NOWARN))
+		return -ENOMEM;
+shrink:
+	range_shrink(range, range->pgstart, pgstart - 1);
+	return 0;
 }
 
 static int ashmem_open(struct inode *inode, struct file *file)
@@ -192,8 +268,15 @@ static int ashmem_open(struct inode *inode, struct file *file)
 	INIT_LIST_HEAD(&asma->unpinned_list);
 	memcpy(asma->name, ASHMEM_NAME_PREFIX, ASHMEM_NAME_PREFIX_LEN);
 	asma->prot_mask = PROT_MASK;
+	asma->owner = task_tgid_nr(current);
+	get_task_comm(asma->owner_comm, current->group_leader);
+	atomic_set(&asma->purge_inflight, 0);
 	file->private_data = asma;
 
+	mutex_lock(&ashmem_mutex);
+	list_add_tail(&asma->area_list, &ashmem_area_list);
+	mutex_unlock(&ashmem_mutex);
+
 	return 0;
 }
 
@@ -205,8 +288,12 @@ static int ashmem_release(struct inode *ignored, struct file *file)
 	mutex_lock(&ashmem_mutex);
 	list_for_each_entry_safe(range, next, &asma->unpinned_list, unpinned)
 		range_del(range);
+	list_del(&asma->area_list);
 	mutex_unlock(&ashmem_mutex);
 
+	/* the shrinker may still be truncating ranges it took from us */
+	wait_event(ashmem_purge_wait, !atomic_read(&asma->purge_inflight));
+
 	if (asma->file)
 		fput(asma->file);
 	kmem_cache_free(ashmem_area_cachep, asma);
@@ -336,6 +423,109 @@ out:
 	return ret;
 }
 
+/* ranges taken off the LRU per hold of ashmem_mutex in the shrinker */
+#define ASHMEM_SHRINK_BATCH	8
+
+struct ashmem_purge {
+	struct ashmem_area *asma;
+	struct file *file;
+	loff_t start;
+	loff_t end;
+};
+
+/*
+ * ashmem_isolate - take up to ASHMEM_SHRINK_BATCH of the least recently
+ * used unpinned ranges off the LRU and mark them purged.  A range larger
+ * than what is left of 'nr' only loses its tail.  Each returned
+ * entry holds a reference on the backing file and counts as in flight on
+ * its area until the caller has truncated it.
+ *
+ * Caller must hold ashmem_mutex.
+ */
+static int ashmem_isolate(struct ashmem_purge *batch, unsigned long *nr)
+{
+	struct ashmem_range *range, *next;
+	size_t pgstart, pgend, pages;
+	int n = 0;
+
+	list_for_each_entry_safe(range, next, &ashmem_lru_list, lru) {
+		struct ashmem_area *asma = range->asma;
+
+		if (n == ASHMEM_SHRINK_BATCH || !*nr)
+			break;
+
+		pgstart = range->pgstart;
+		pgend = range->pgend;
+		if (range_size(range) > *nr &&
+		    !range_purge_tail(range, pgend - *nr + 1)) {
+			pgstart = pgend - *nr + 1;
+		} else {
+			range->purged = ASHMEM_WAS_PURGED;
+			lru_del(range);
+		}
+		pages = pgend - pgstart + 1;
+
+		batch[n].asma = asma;
+		batch[n].file = asma->file;
+		batch[n].start = pgstart * PAGE_SIZE;
+		batch[n].end = (pgend + 1) * PAGE_SIZE - 1;
+		get_file(asma->file);
+		atomic_inc(&asma->purge_inflight);
+		n++;
+
+		asma->purged_pages += pages;
+		*nr -= min_t(unsigned long, *nr, pages);
+	}
+
+	return n;
+}
+
+/*
+ * ashmem_purge_lru - purge up to 'nr' pages LRU-wise
+ *
+ * We approximate LRU via least-recently-unpinned, with areas that get pinned
+ * again moved back to the young end, jettisoning unpinned (partial) chunks of
+ * ashmem regions LRU-wise until we hit 'nr' pages freed.  The actual
+ * truncation happens in batches with ashmem_mutex dropped, so pin and unpin
+ * of other areas do not wait behind it.
+ *
+ * With 'block' unset only trylock is used, as reclaim may be entered with
+ * ashmem_mutex held: we give up at the first failed attempt, returning -1 if
+ * that was the first one.  Returns the number of pages left on the LRU.
+ */
+static int ashmem_purge_lru(unsigned long nr, bool block)
+{
+	struct ashmem_purge batch[ASHMEM_SHRINK_BATCH];
+	int i, n;
+
+	if (block)
+		mutex_lock(&ashmem_mutex);
+	else if (!mutex_trylock(&ashmem_mutex))
+		return -1;
+
+	while (nr && !list_empty(&ashmem_lru_list)) {
+		n = ashmem_isolate(batch, &nr);
+		mutex_unlock(&ashmem_mutex);
+
+		for (i = 0; i < n; i++) {
+			vmtruncate_range(batch[i].file->f_dentry->d_inode,
+					 batch[i].start, batch[i].end);
+			fput(batch[i].file);
+			/* the area may be freed as soon as this drops to 0 */
+			if (atomic_dec_and_test(&batch[i].asma->purge_inflight))
+				wake_up_all(&ashmem_purge_wait);
+		}
+
+		if (block)
+			mutex_lock(&ashmem_mutex);
+		else if (!mutex_trylock(&ashmem_mutex))
+			return lru_count;
+	}
+	mutex_unlock(&ashmem_mutex);
+
+	return lru_count;
+}
+
 /*
  * ashmem_shrink - our cache shrinker, called from mm/vmscan.c :: shrink_slab
  *
@@ -346,15 +536,9 @@ out:
  *
  * Return value is the number of objects (pages) remaining, or -1 if we cannot
  * proceed without risk of deadlock (due to gfp_mask).
- *
- * We approximate LRU via least-recently-unpinned, jettisoning unpinned partial
- * chunks of ashmem regions LRU-wise one-at-a-time until we hit 'nr_to_scan'
- * pages freed.
  */
 static int ashmem_shrink(struct shrinker *s, struct shrink_control *sc)
 {
-	struct ashmem_range *range, *next;
-
 	/* We might recurse into filesystem code, so bail out if necessary */
 	if (sc->nr_to_scan && !(sc->gfp_mask & __GFP_FS))
 		return -1;
@@ -362,26 +546,7 @@ static int ashmem_shrink(struct shrinker *s, struct shrink_control *sc)
 		return lru_count;
 
 	/* If our mutex is held, we are recursing into ourselves, so bail out */
-	if (!mutex_trylock(&ashmem_mutex)) {
-                return -1;
-	}
-
-	list_for_each_entry_safe(range, next, &ashmem_lru_list, lru) {
-		struct inode *inode = range->asma->file->f_dentry->d_inode;
-		loff_t start = range->pgstart * PAGE_SIZE;
-		loff_t end = (range->pgend + 1) * PAGE_SIZE - 1;
-
-		vmtruncate_range(inode, start, end);
-		range->purged = ASHMEM_WAS_PURGED;
-		lru_del(range);
-
-		sc->nr_to_scan -= range_size(range);
-		if (sc->nr_to_scan <= 0)
-			break;
-	}
-	mutex_unlock(&ashmem_mutex);
-
-	return lru_count;
+	return ashmem_purge_lru(sc->nr_to_scan, false);
 }
 
 static struct shrinker ashmem_shrinker = {
@@ -562,6 +727,22 @@ restart:
 	return range_alloc(asma, range, purged, pgstart, pgend);
 }
 
+/*
+ * area_lru_touch - an area that is being pinned again is in active use, so
+ * move whatever it still has unpinned to the young end of the LRU; areas
+ * nobody has touched in a while get purged first.
+ *
+ * Caller must hold ashmem_mutex.
+ */
+static void area_lru_touch(struct ashmem_area *asma)
+{
+	struct ashmem_range *range;
+
+	list_for_each_entry(range, &asma->unpinned_list, unpinned)
+		if (range_on_lru(range))
+			list_move_tail(&range->lru, &ashmem_lru_list);
+}
+
 /*
  * ashmem_get_pin_status - Returns ASHMEM_IS_UNPINNED if _any_ pages in the
  * given interval are unpinned and ASHMEM_IS_PINNED otherwise.
@@ -586,6 +767,52 @@ static int ashmem_get_pin_status(struct ashmem_area *asma, size_t pgstart,
 	return ret;
 }
 
+/*
+ * ashmem_pin_to_pages - validate a user supplied (offset, len) pair and
+ * turn it into an inclusive page interval of 'asma'.
+ */
+static int ashmem_pin_to_pages(struct ashmem_area *asma,
+			       struct ashmem_pin *pin,
+			       size_t *pgstart, size_t *pgend)
+{
+	/* per custom, you can pass zero for len to mean "everything onward" */
+	if (!pin->len)
+		pin->len = PAGE_ALIGN(asma->size) - pin->offset;
+
+	if (unlikely((pin->offset | pin->len) & ~PAGE_MASK))
+		return -EINVAL;
+
+	if (unlikely(((__u32) -1) - pin->offset < pin->len))
+		return -EINVAL;
+
+	if (unlikely(PAGE_ALIGN(asma->size) < pin->offset + pin->len))
+		return -EINVAL;
+
+	*pgstart = pin->offset / PAGE_SIZE;
+	*pgend = *pgstart + (pin->len / PAGE_SIZE) - 1;
+
+	return 0;
+}
+
+/*
+ * Pages the shrinker is still truncating must not be handed back.  Wait for
+ * it with ashmem_mutex dropped so other areas are not held up, and check
+ * again once the mutex is back: the shrinker may have taken more of this
+ * area in between.  It cannot start on it again while we hold the mutex, so
+ * once this returns any number of pins are safe.
+ *
+ * Caller must hold ashmem_mutex; it is dropped and retaken.
+ */
+static void ashmem_pin_wait(struct ashmem_area *asma)
+{
+	while (atomic_read(&asma->purge_inflight)) {
+		mutex_unlock(&ashmem_mutex);
+		wait_event(ashmem_purge_wait,
+			   !atomic_read(&asma->purge_inflight));
+		mutex_lock(&ashmem_mutex);
+	}
+}
+
 static int ashmem_pin_unpin(struct ashmem_area *asma, unsigned long cmd,
 			    void __user *p)
 {
@@ -599,27 +826,17 @@ static int ashmem_pin_unpin(struct ashmem_area *asma, unsigned long cmd,
 	if (unlikely(copy_from_user(&pin, p, sizeof(pin))))
 		return -EFAULT;
 
-	/* per custom, you can pass zero for len to mean "everything onward" */
-	if (!pin.len)
-		pin.len = PAGE_ALIGN(asma->size) - pin.offset;
-
-	if (unlikely((pin.offset | pin.len) & ~PAGE_MASK))
-		return -EINVAL;
-
-	if (unlikely(((__u32) -1) - pin.offset < pin.len))
-		return -EINVAL;
-
-	if (unlikely(PAGE_ALIGN(asma->size) < pin.offset + pin.len))
-		return -EINVAL;
-
-	pgstart = pin.offset / PAGE_SIZE;
-	pgend = pgstart + (pin.len / PAGE_SIZE) - 1;
+	ret = ashmem_pin_to_pages(asma, &pin, &pgstart, &pgend);
+	if (unlikely(ret))
+		return ret;
 
 	mutex_lock(&ashmem_mutex);
 
 	switch (cmd) {
 	case ASHMEM_PIN:
+		ashmem_pin_wait(asma);
 		ret = ashmem_pin(asma, pgstart, pgend);
+		area_lru_touch(asma);
 		break;
 	case ASHMEM_UNPIN:
 		ret = ashmem_unpin(asma, pgstart, pgend);
@@ -634,6 +851,170 @@ static int ashmem_pin_unpin(struct ashmem_area *asma, unsigned long cmd,
 	return ret;
 }
 
+/*
+ * ashmem_pin_batch - apply an array of pin/unpin/status operations under a
+ * single hold of ashmem_mutex.  A batch that pins first waits, with the
+ * mutex dropped, for purges of the area in flight.  Each operation's 'ret'
+ * is set to what the equivalent single-range ioctl would have returned; an
+ * invalid entry gets -EINVAL and does not stop the others.
+ */
+static int ashmem_pin_batch(struct ashmem_area *asma, void __user *p)
+{
+	struct ashmem_pin_batch batch;
+	struct ashmem_pin_op *ops;
+	struct ashmem_pin pin;
+	size_t pgstart, pgend, size;
+	bool pinned = false;
+	unsigned int i;
+	int ret = 0;
+
+	if (unlikely(!asma->file))
+		return -EINVAL;
+
+	if (unlikely(copy_from_user(&batch, p, sizeof(batch))))
+		return -EFAULT;
+
+	if (unlikely(!batch.count || batch.count > ASHMEM_PIN_BATCH_MAX))
+		return -EINVAL;
+
+	size = batch.count * sizeof(*ops);
+	ops = kmalloc(size, GFP_KERNEL);
+	if (unlikely(!ops))
+		return -ENOMEM;
+
+	if (unlikely(copy_from_user(ops,
+			(void __user *)(unsigned long)batch.ops, size))) {
+		ret = -EFAULT;
+		goto out;
+	}
+
+	for (i = 0; i < batch.count; i++)
+		if (ops[i].op == ASHMEM_BATCH_PIN)
+			pinned = true;
+
+	mutex_lock(&ashmem_mutex);
+
+	if (pinned)
+		ashmem_pin_wait(asma);
+
+	for (i = 0; i < batch.count; i++) {
+		pin.offset = ops[i].offset;
+		pin.len = ops[i].len;
+		ops[i].ret = ashmem_pin_to_pages(asma, &pin, &pgstart, &pgend);
+		if (unlikely(ops[i].ret))
+			continue;
+
+		switch (ops[i].op) {
+		case ASHMEM_BATCH_PIN:
+			ops[i].ret = ashmem_pin(asma, pgstart, pgend);
+			break;
+		case ASHMEM_BATCH_UNPIN:
+			ops[i].ret = ashmem_unpin(asma, pgstart, pgend);
+			break;
+		case ASHMEM_BATCH_GET_PIN_STATUS:
+			ops[i].ret = ashmem_get_pin_status(asma, pgstart,
+							   pgend);
+			break;
+		default:
+			ops[i].ret = -EINVAL;
+			break;
+		}
+	}
+	if (pinned)
+		area_lru_touch(asma);
+
+	mutex_unlock(&ashmem_mutex);
+
+	if (unlikely(copy_to_user((void __user *)(unsigned long)batch.ops,
+				  ops, size)))
+		ret = -EFAULT;
+out:
+	kfree(ops);
+	return ret;
+}
+
+/*
+ * ashmem_populate - allocate the backing pages of a range in one pass and
+ * map them into each of the caller's mappings of the area, as MAP_POPULATE
+ * would have.  A large region then costs one syscall instead of a page
+ * fault per page.  Pages of the range that are unpinned are populated too,
+ * so callers should pin first.
+ */
+static int ashmem_populate(struct ashmem_area *asma, void __user *p)
+{
+	struct mm_struct *mm = current->mm;
+	struct vm_area_struct *vma;
+	struct address_space *mapping;
+	struct ashmem_pin pin;
+	struct file *file;
+	size_t pgstart, pgend, idx;
+	gfp_t gfp;
+	int ret;
+
+	if (unlikely(copy_from_user(&pin, p, sizeof(pin))))
+		return -EFAULT;
+
+	mutex_lock(&ashmem_mutex);
+	file = asma->file;
+	if (file)
+		get_file(file);
+	mutex_unlock(&ashmem_mutex);
+
+	if (unlikely(!file))
+		return -EINVAL;
+
+	ret = ashmem_pin_to_pages(asma, &pin, &pgstart, &pgend);
+	if (unlikely(ret))
+		goto out;
+
+	/* fill the page cache first, so the faults below only map */
+	mapping = file->f_mapping;
+	gfp = mapping_gfp_mask(mapping) | __GFP_NOWARN;
+	for (idx = pgstart; idx <= pgend; idx++) {
+		struct page *page;
+
+		if (fatal_signal_pending(current)) {
+			ret = -EINTR;
+			goto out;
+		}
+
+		page = shmem_read_mapping_page_gfp(mapping, idx, gfp);
+		if (IS_ERR(page)) {
+			ret = PTR_ERR(page);
+			goto out;
+		}
+		page_cache_release(page);
+		cond_resched();
+	}
+
+	if (!mm)
+		goto out;
+
+	down_read(&mm->mmap_sem);
+	for (vma = mm->mmap; vma; vma = vma->vm_next) {
+		unsigned long first, last;
+
+		if (vma->vm_file != file || !(vma->vm_flags & VM_READ))
+			continue;
+
+		first = max_t(unsigned long, pgstart, vma->vm_pgoff);
+		last = min_t(unsigned long, pgend + 1,
+			     vma->vm_pgoff + vma_pages(vma));
+		if (first >= last)
+			continue;
+
+		ret = make_pages_present(
+			vma->vm_start + ((first - vma->vm_pgoff) << PAGE_SHIFT),
+			vma->vm_start + ((last - vma->vm_pgoff) << PAGE_SHIFT));
+		if (ret)
+			break;
+	}
+	up_read(&mm->mmap_sem);
+out:
+	fput(file);
+	return ret;
+}
+
 #ifdef CONFIG_OUTER_CACHE
 static unsigned int virtaddr_to_physaddr(unsigned int virtaddr)
 {
@@ -730,16 +1111,18 @@ static long ashmem_ioctl(struct file *file, unsigned int cmd, unsigned long arg)
 	case ASHMEM_GET_PIN_STATUS:
 		ret = ashmem_pin_unpin(asma, cmd, (void __user *) arg);
 		break;
+	case ASHMEM_PIN_BATCH:
+		ret = ashmem_pin_batch(asma, (void __user *) arg);
+		break;
+	case ASHMEM_POPULATE:
+		ret = ashmem_populate(asma, (void __user *) arg);
+		break;
 	case ASHMEM_PURGE_ALL_CACHES:
 		ret = -EPERM;
 		if (capable(CAP_SYS_ADMIN)) {
-			struct shrink_control sc = {
-				.gfp_mask = GFP_KERNEL,
-				.nr_to_scan = 0,
-			};
-			ret = ashmem_shrink(&ashmem_shrinker, &sc);
-			sc.nr_to_scan = ret;
-			ashmem_shrink(&ashmem_shrinker, &sc);
+			/* not reclaim: wait for the mutex, do not give up */
+			ret = lru_count;
+			ashmem_purge_lru(ret, true);
 		}
 		break;
 	case ASHMEM_CACHE_FLUSH_RANGE:
@@ -826,6 +1209,43 @@ static struct miscdevice ashmem_misc = {
 	.fops = &ashmem_fops,
 };
 
+#ifdef CONFIG_DEBUG_FS
+/*
+ * One line per open area, tagged with the process that created it, so that
+ * unpinned and purged pages can be added up per process.
+ */
+static int ashmem_stats_show(struct seq_file *m, void *unused)
+{
+	struct ashmem_area *asma;
+
+	seq_printf(m, "%-7s %-16s %10s %10s %10s %s\n", "pid", "comm",
+		   "bytes", "unpinned", "purged", "name");
+	mutex_lock(&ashmem_mutex);
+	list_for_each_entry(asma, &ashmem_area_list, area_list)
+		seq_printf(m, "%-7d %-16s %10zu %10lu %10lu %s\n",
+			   asma->owner, asma->owner_comm, asma->size,
+			   asma->unpinned_pages, asma->purged_pages,
+			   asma->name + ASHMEM_NAME_PREFIX_LEN);
+	mutex_unlock(&ashmem_mutex);
+
+	return 0;
+}
+
+static int ashmem_stats_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, ashmem_stats_show, NULL);
+}
+
+static const struct file_operations ashmem_stats_fops = {
+	.open = ashmem_stats_open,
+	.read = seq_read,
+	.llseek = seq_lseek,
+	.release = single_release,
+};
+
+static struct dentry *ashmem_debugfs;
+#endif
+
 static int __init ashmem_init(void)
 {
 	int ret;
@@ -854,6 +1274,11 @@ static int __init ashmem_init(void)
 
 	register_shrinker(&ashmem_shrinker);
 
+#ifdef CONFIG_DEBUG_FS
+	ashmem_debugfs = debugfs_create_file("ashmem", 0444, NULL, NULL,
+					     &ashmem_stats_fops);
+#endif
+
 	printk(KERN_INFO "ashmem: initialized\n");
 
 	return 0;
@@ -865,6 +1290,10 @@ static void __exit ashmem_exit(void)
 
 	unregister_shrinker(&ashmem_shrinker);
 
+#ifdef CONFIG_DEBUG_FS
+	debugfs_remove(ashmem_debugfs);
+#endif
+
 	ret = misc_deregister(&ashmem_misc);
 	if (unlikely(ret))
 		printk(KERN_ERR "ashmem: failed to unregister misc device!\n");
@@ -0,0 +1,154 @@
+/*
+ * logger-write-bench.c -- logger write throughput against writer threads
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * For 1, 2, 4, ... up to 'threads' writer threads, each thread writes
+ * 'count' entries of 'len' payload bytes to the log device the way liblog
+ * does (one writev of priority, tag and message), all threads starting
+ * together.  The time until the last thread finishes gives the aggregate
+ * entry and byte rate, so the scaling with thread count shows how much
+ * writers still serialize on each other in the driver.
+ */
+
+/* $(CROSS_COMPILE)cc -Wall -Wextra -O2 -o logger-write-bench logger-write-bench.c -lpthread -lrt */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/uio.h>
+#include <time.h>
+#include <unistd.h>
+
+#define MAX_THREADS	64
+#define MAX_LEN		4000	/* stays below LOGGER_ENTRY_MAX_PAYLOAD */
+
+static const char *device = "/dev/log/main";
+static const char tag[] = "logger-bench";
+static unsigned threads = 8, count = 20000, len = 100;
+static char msg[MAX_LEN + 1];
+
+static pthread_barrier_t start;
+
+static void die(const char *what)
+{
+	fprintf(stderr, "logger-write-bench: %s: %s\n", what, strerror(errno));
+	exit(1);
+}
+
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void *writer(void *arg)
+{
+	unsigned char prio = 4;	/* ANDROID_LOG_INFO */
+	struct iovec vec[3];
+	int fd = (long)arg;
+	unsigned i;
+
+	vec[0].iov_base = &prio;
+	vec[0].iov_len = 1;
+	vec[1].iov_base = (void *)tag;
+	vec[1].iov_len = sizeof(tag);
+	vec[2].iov_base = msg;
+	vec[2].iov_len = len + 1;
+
+	pthread_barrier_wait(&start);
+
+	for (i = 0; i < count; i++)
+		if (writev(fd, vec, 3) < 0)
+			die("writev");
+
+	return NULL;
+}
+
+static void run(int fd, unsigned n)
+{
+	pthread_t tid[MAX_THREADS];
+	double t, entries, bytes;
+	unsigned i;
+
+	if (pthread_barrier_init(&start, NULL, n + 1))
+		die("pthread_barrier_init");
+	for (i = 0; i < n; i++)
+		if (pthread_create(&tid[i], NULL, writer, (void *)(long)fd)) {
+			errno = EAGAIN;
+			die("pthread_create");
+		}
+
+	/* the writers may be done before the barrier returns here */
+	t = now();
+	pthread_barrier_wait(&start);
+	for (i = 0; i < n; i++)
+		pthread_join(tid[i], NULL);
+	t = now() - t;
+	pthread_barrier_destroy(&start);
+
+	entries = (double)n * count;
+	bytes = entries * (1 + sizeof(tag) + len + 1);
+	printf("%7u %10.3f ms %12.0f entries/s %8.2f MB/s %8.0f ns/entry\n",
+	       n, t * 1e3, entries / t, bytes / t / 1e6, t * 1e9 / entries);
+}
+
+int main(int argc, char **argv)
+{
+	unsigned n;
+	int fd, c;
+
+	while ((c = getopt(argc, argv, "d:t:n:l:")) != -1) {
+		switch (c) {
+		case 'd':
+			device = optarg;
+			break;
+		case 't':
+			threads = strtoul(optarg, NULL, 0);
+			break;
+		case 'n':
+			count = strtoul(optarg, NULL, 0);
+			break;
+		case 'l':
+			len = strtoul(optarg, NULL, 0);
+			break;
+		default:
+			fprintf(stderr, "usage: %s [-d device] [-t max threads] "
+				"[-n entries per thread] [-l payload bytes]\n",
+				argv[0]);
+			return 2;
+		}
+	}
+	if (!threads || threads > MAX_THREADS || !count || len > MAX_LEN) {
+		fprintf(stderr, "threads must be 1..%d, entries at least 1, "
+			"payload at most %d bytes\n", MAX_THREADS, MAX_LEN);
+		return 2;
+	}
+
+	memset(msg, 'x', len);
+	msg[len] = '\0';
+
+	/* all threads share one fd, like the processes of a busy system */
+	fd = open(device, O_WRONLY);
+	if (fd < 0)
+		die(device);
+
+	printf("%s: %u entries of %u bytes per thread\n", device, count, len);
+	printf("%7s %13s %20s %13s %16s\n", "threads", "time", "rate",
+	       "bandwidth", "per entry");
+
+	for (n = 1; n <= threads; n *= 2)
+		run(fd, n);
+	if ((n / 2) != threads)
+		run(fd, threads);
+
+	close(fd);
+	return 0;
+}